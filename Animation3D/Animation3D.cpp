@@ -21,7 +21,8 @@
 #include <GL/freeglut.h>
 #include "geometry/geometry.h"
 #include "ShaderSupport/GLSLShader.h"   // Need to include before scene.h
-#include "Scene/scene.h"
+#include "Scene/Scene.h"
+#include "HeadlessSupport/OffscreenRenderer.h"
 
 #include "ColorNode.h"
 #include "UnitSquareSurface.h"
@@ -47,6 +48,10 @@ std::vector<Plane> BoundingPlanes;
 // Ball transforms. We have this global so we can more easily do intersection testing
 BallTransform* BallTransforms[NUMBER_OF_BALLS];
 
+// Broad phase for ball-ball intersection testing and the candidate pairs it finds
+CollisionWorld BallWorld;
+std::vector<CollisionPair> BallPairs;
+
 // Simple logging function
 void logmsg(const char *message, ...)
 {
@@ -64,31 +69,41 @@ void logmsg(const char *message, ...)
 }
 
 /**
- * Use a timer method to try to do a consistent update rate.
- * Without using a timer, the speed of movement will depend on how fast
- * the program runs (fast movement on a fast PC and slow movement on a
- * slower PC)
+ * Move the balls one frame, bouncing them off each other and the walls.
+ * Called by the timer and, in headless mode, once per frame.
  */
-void timerFunction(int value)
+void updateFrame()
 {
-   // Initialize all balls to have no intersection
+   // Initialize all balls to have no intersection. Add each ball's movement
+   // over this frame to the broad phase.
+   BallWorld.Clear();
    for (unsigned int i = 0; i < NUMBER_OF_BALLS; i++)
+   {
       BallTransforms[i]->SetIntersectTime(0.0f);
+      BallWorld.Insert(BallTransforms[i]->GetPosition(),
+                       BallTransforms[i]->GetDirection() * BallTransforms[i]->GetSpeed(),
+                       BallTransforms[i]->GetRadius());
+   }
 
-   // Go through all balls and test for intersection with subsequent ball
-   for (unsigned int i = 0; i < NUMBER_OF_BALLS; i++)
+   // Go through the candidate pairs from the broad phase. They are sorted so each
+   // ball is tested against subsequent balls in order.
+   BallWorld.FindPairs(BallPairs);
+   unsigned int current = NUMBER_OF_BALLS;
+   bool done = false;
+   std::vector<CollisionPair>::iterator pair = BallPairs.begin();
+   for ( ; pair != BallPairs.end(); pair++)
    {
       // If intersection with a prior ball is not found, test for intersection with successive balls
-      if (BallTransforms[i]->GetIntersectTime() == 0.0f)
+      if (pair->first != current)
       {
-         for (unsigned int j = i+1; j < NUMBER_OF_BALLS; j++)
-         {
-            // If an intersection occurs, break out of loop. We will only worry about a ball intersecting
-            // one other in a single frame and won't care much if it is the closest
-            if (BallTransforms[i]->IntersectBall(BallTransforms[j]))
-               break;
-         }
+         current = pair->first;
+         done = (BallTransforms[current]->GetIntersectTime() != 0.0f);
       }
+
+      // If an intersection occurs, skip the rest of this ball's pairs. We will only worry about a ball
+      // intersecting one other in a single frame and won't care much if it is the closest
+      if (!done && BallTransforms[current]->IntersectBall(BallTransforms[pair->second]))
+         done = true;
    }
 
    // Go through all ball and test for plane intersection on those that do not intersect with another ball
@@ -121,6 +136,17 @@ void timerFunction(int value)
 
    // Update the scene graph
    SceneRoot->Update(MySceneState);
+}
+
+/**
+ * Use a timer method to try to do a consistent update rate.
+ * Without using a timer, the speed of movement will depend on how fast
+ * the program runs (fast movement on a fast PC and slow movement on a
+ * slower PC)
+ */
+void timerFunction(int value)
+{
+   updateFrame();
 
    // Set update to specified frames per second
    glutTimerFunc((int)(1000.0f / FRAMES_PER_SEC), timerFunction, 0);
@@ -129,9 +155,10 @@ void timerFunction(int value)
 }
 
 /**
- * Display callback function
+ * Draw the scene into the current framebuffer (the window's back buffer or,
+ * in headless mode, the offscreen framebuffer).
  */
-void display(void)
+void drawFrame()
 {
    // Clear the framebuffer and the depth buffer
    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -139,6 +166,14 @@ void display(void)
    // Init scene state and draw the scene graph
    MySceneState.Init();
    SceneRoot->Draw(MySceneState);
+}
+
+/**
+ * Display callback function
+ */
+void display(void)
+{
+   drawFrame();
   
    // Swap buffers
    glutSwapBuffers();
@@ -211,6 +246,7 @@ void ConstructScene()
    BoundingPlanes.push_back(p4);
    Plane p5(Point3(0.0f, -50.0f, 50.0f), Vector3(0.0f, 1.0f, 0.0f));
    BoundingPlanes.push_back(p5);
+   BallWorld.SetBounds(BoundingPlanes);
 
    // Construct the geometry objects
    UnitSquareSurface1* unitSquare = new UnitSquareSurface1(shader->GetPositionLoc(), shader->GetNormalLoc());
@@ -302,9 +338,12 @@ void ConstructScene()
 }
 
 /**
- * Main 
+ * Create the window with an OpenGL 3.2 core profile context.
+ * @param  argc  Argument count (passed to glutInit)
+ * @param  argv  Arguments
+ * @return  Returns true if the window and context were created.
  */
-int main(int argc, char** argv)
+bool InitializeWindow(int& argc, char** argv)
 {
    printf("HERE\n");
 
@@ -328,13 +367,31 @@ int main(int argc, char** argv)
    // Initialize Open 3.2 core profile
    if (gl3wInit()) {
       fprintf(stderr, "gl3wInit: failed to initialize OpenGL\n");
-      return -1;
+      return false;
    }
    if (!gl3wIsSupported(3, 2)) {
       fprintf(stderr, "OpenGL 3.2 not supported\n");
-      return -1;
+      return false;
    }
    printf("OpenGL %s, GLSL %s\n", glGetString(GL_VERSION), glGetString(GL_SHADING_LANGUAGE_VERSION));
+   return true;
+}
+
+/**
+ * Main 
+ */
+int main(int argc, char** argv)
+{
+   // Offscreen rendering: Animation3D -headless <frames> [-size <width> <height>]
+   //                      [-dump <prefix>] [-every <n>] [-timings <file>]
+   OffscreenRenderer offscreen;
+   if (offscreen.ParseArguments(argc, argv))
+   {
+      if (!offscreen.CreateContext(argc, argv, "Animated Balls", 3, 2))
+         return -1;
+   }
+   else if (!InitializeWindow(argc, argv))
+      return -1;
 
    // Set the clear color to black. Any part of the window outside the
    // viewport should appear black
@@ -377,6 +434,11 @@ int main(int argc, char** argv)
 
    // Set the composite projection and viewing matrix
    MySceneState.m_pvMatrix = projection * view;
+   MySceneState.ViewChanged();
+
+   // Render frames offscreen instead of running interactively
+   if (offscreen.IsEnabled())
+      return offscreen.Run(reshape, updateFrame, drawFrame) ? 0 : -1;
 
    // Set update rate
    glutTimerFunc((int)(1000.0f / FRAMES_PER_SEC), timerFunction, 0);
@@ -247,6 +247,7 @@ protected:
       m_matrix.SetIdentity();
       m_matrix.Translate(m_position.x, m_position.y, m_position.z);
       m_matrix.Scale(m_radius, m_radius, m_radius);
+      MatrixChanged();
    }
 
    // Create a random value between a specified minv and maxv.
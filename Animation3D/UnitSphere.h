@@ -14,7 +14,7 @@
 #define __UNITSPHERE_H
 
 #include <vector>
-#include "scene/scene.h"
+#include "Scene/Scene.h"
 
 /**
  * Unit sphere geometry node.
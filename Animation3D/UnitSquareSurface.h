@@ -13,7 +13,7 @@
 #define __UNITSQUARESURFACE_H
 
 #include <vector>
-#include "scene/scene.h"
+#include "Scene/Scene.h"
 
 /**
  * Unit square geometry node.
@@ -23,6 +23,7 @@
 #include "PointNode.h"
 #include "LineShaderNode.h"
 #include "LineNode.h"
+#include "HeadlessSupport/OffscreenRenderer.h"
 
 char PointVShader[] = "\
    #version 150\n\
@@ -83,6 +84,10 @@ SceneState MySceneState;
 // follow mouse motion events and draw if the left button is down.
 bool DrawLine = false;
 
+// Window size
+int RenderWidth  = 640;
+int RenderHeight = 480;
+
 // Current line being drawn (while dragging the mouse)
 LineSegment2 CurrentLine;
 Color3 CurrentLineColor0(0.8f, 0.1f, 0.1f);     // Color at the start of the line
@@ -110,9 +115,68 @@ Color3 GetRandomColor()
 }
 
 /**
- * Display callback function
+ * Clear the lines and intersection points. Seeds the random colors again so
+ * colors appear in the same order.
  */
-void display(void)
+void ClearLines()
+{
+   CurrentLineNode->Clear();
+   PriorLinesNode->Clear();
+   PriorIntersections->Clear();
+   CurrentLine.A.Set(0.0f, 0.0f);
+   CurrentLine.B.Set(0.0f, 0.0f);
+   SeedRandomColors();
+}
+
+/**
+ * Add the current line to the prior lines (in a random color) and its
+ * intersections with them to the prior intersections, and stop dragging it.
+ */
+void AddCurrentLine()
+{
+   // Use the same color at each end of the line
+   Color3 c = GetRandomColor();
+   PriorLinesNode->AddLineSegment(CurrentLine, c, c);
+
+   // Get all the intersections of the current line with all other PreviousLines
+   // and add them to the Prior. This avoids having to calculate these 
+   // intersections again.
+   Point2 intersectPt;
+   std::vector<Point2> intersectionPts;
+   std::vector<LineSegment2>& segments = PriorLinesNode->GetLineSegments();
+   std::vector<LineSegment2>::iterator line;
+   for (line = segments.begin(); line != segments.end(); line++)
+      if (line->Intersect(CurrentLine, intersectPt))
+         intersectionPts.push_back(intersectPt);
+   PriorIntersections->Add(intersectionPts);
+
+   // Clear the current intersection points
+   CurrentIntersections->Clear();
+
+   // No longer dragging a line - clear it
+   DrawLine = false;
+   CurrentLineNode->Clear();
+}
+
+/**
+ * Add a line between two random points in the window, as if drawn with the
+ * mouse. Headless mode adds one line per frame, starting over when the
+ * lines reach the capacity of the vertex buffer.
+ */
+void updateFrame()
+{
+   if (PriorLinesNode->GetLineSegments().size() >= MAX_LINE_SEGMENTS - 1)
+      ClearLines();
+   CurrentLine.A.Set(rand01() * RenderWidth, rand01() * RenderHeight);
+   CurrentLine.B.Set(rand01() * RenderWidth, rand01() * RenderHeight);
+   AddCurrentLine();
+}
+
+/**
+ * Draw the scene into the current framebuffer (the window's back buffer or,
+ * in headless mode, the offscreen framebuffer).
+ */
+void drawFrame()
 {
    // Clear the framebuffer
    glClear(GL_COLOR_BUFFER_BIT);
@@ -134,6 +198,14 @@ void display(void)
    // Draw the scene
    SceneRoot->Draw(MySceneState);
    checkError("After Draw");
+}
+
+/**
+ * Display callback function
+ */
+void display(void)
+{
+   drawFrame();
 
    // Swap buffers
    glutSwapBuffers();
@@ -154,12 +226,7 @@ void keyboard(unsigned char key, int x, int y)
     // Clear the list of PreviousLines, intersection points, and the current line
     // See random colors again so hopefully colors appear in same order
     case 'c':
-      CurrentLineNode->Clear();
-      PriorLinesNode->Clear();
-      PriorIntersections->Clear();
-      CurrentLine.A.Set(0.0f, 0.0f);
-      CurrentLine.B.Set(0.0f, 0.0f);
-      SeedRandomColors();
+      ClearLines();
       glutPostRedisplay();
 	   break;
 
@@ -213,28 +280,7 @@ void mouse(int button, int state, int x, int y)
    // On a button up event add the CurrentLine to the list of PreviousLines
    if (button == GLUT_LEFT_BUTTON && state == GLUT_UP)
    {
-      // Use the same color at each end of the line
-      Color3 c = GetRandomColor();
-      PriorLinesNode->AddLineSegment(CurrentLine, c, c);
-   
-      // Get all the intersections of the current line with all other PreviousLines
-      // and add them to the Prior. This avoids having to calculate these 
-      // intersections again.
-      Point2 intersectPt;
-      std::vector<Point2> intersectionPts;
-      std::vector<LineSegment2>& segments = PriorLinesNode->GetLineSegments();
-      std::vector<LineSegment2>::iterator line;
-      for (line = segments.begin(); line != segments.end(); line++)
-         if (line->Intersect(CurrentLine, intersectPt))
-            intersectionPts.push_back(intersectPt);
-      PriorIntersections->Add(intersectionPts);
-
-	   // Clear the current intersection points
-	   CurrentIntersections->Clear();
-
-      // No longer dragging a line - clear it
-      DrawLine = false;
-      CurrentLineNode->Clear();
+      AddCurrentLine();
 
 	   // Force a redisplay
       glutPostRedisplay();
@@ -265,6 +311,9 @@ void mouseMotion(int x, int y)
  */
 void reshape(int width, int height)
 {
+   RenderWidth  = width;
+   RenderHeight = height;
+
    // Set a 2-D orthographic projection matrix
    MySceneState.m_projection.m00() = 2.0f / (float)width;
    MySceneState.m_projection.m03() = -1.0f;
@@ -316,9 +365,13 @@ void CreateScene()
 }
 
 /**
- * Main 
+ * Print the keyboard commands and create the window with an OpenGL 3.2 core
+ * profile context.
+ * @param  argc  Argument count (passed to glutInit)
+ * @param  argv  Arguments
+ * @return  Returns true if the window and context were created.
  */
-int main(int argc, char** argv)
+bool InitializeWindow(int& argc, char** argv)
 {
    std::cout << "Keyboard Controls:" << std::endl;
    std::cout << "  A - Enable line anti-aliasing  a - Disable line anti-aliasing" 
@@ -341,7 +394,7 @@ int main(int argc, char** argv)
    if (glutCreateWindow("DrawLines by David Nesbitt") < 0) 
    {
       printf("Could not create Window with glutCreateWindow\n");
-      return -1;
+      return false;
    }
 
    // Set the callback methods
@@ -354,13 +407,31 @@ int main(int argc, char** argv)
    // Initialize Open 3.2 core profile
    if (gl3wInit()) {
       fprintf(stderr, "gl3wInit: failed to initialize OpenGL\n");
-      return -1;
+      return false;
    }
    if (!gl3wIsSupported(3, 2)) {
       fprintf(stderr, "OpenGL 3.2 not supported\n");
-      return -1;
+      return false;
    }
    printf("OpenGL %s, GLSL %s\n", glGetString(GL_VERSION), glGetString(GL_SHADING_LANGUAGE_VERSION));
+   return true;
+}
+
+/**
+ * Main 
+ */
+int main(int argc, char** argv)
+{
+   // Offscreen rendering: DrawLines -headless <frames> [-size <width> <height>]
+   //                      [-dump <prefix>] [-every <n>] [-timings <file>]
+   OffscreenRenderer offscreen;
+   if (offscreen.ParseArguments(argc, argv))
+   {
+      if (!offscreen.CreateContext(argc, argv, "DrawLines by David Nesbitt", 3, 2))
+         return -1;
+   }
+   else if (!InitializeWindow(argc, argv))
+      return -1;
 
    // Create the scene
    SeedRandomColors();
@@ -378,6 +449,10 @@ int main(int argc, char** argv)
    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
    glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);            // Best quality line AA
 
+   // Render frames offscreen instead of running interactively
+   if (offscreen.IsEnabled())
+      return offscreen.Run(reshape, updateFrame, drawFrame) ? 0 : -1;
+
    glutMainLoop();
    return 0;
 }
\ No newline at end of file
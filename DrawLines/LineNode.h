@@ -13,7 +13,7 @@
 #define __LINENODE_H
 
 #include <vector>
-#include "scene/scene.h"
+#include "Scene/Scene.h"
 
 /**
  * Unit sphere geometry node.
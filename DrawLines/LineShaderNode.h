@@ -14,7 +14,7 @@
 #define __LINESHADERNODE_H
 
 #include <vector>
-#include "scene/scene.h"
+#include "Scene/Scene.h"
 
 /**
  * Offset line shader node.
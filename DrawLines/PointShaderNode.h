@@ -14,7 +14,7 @@
 #define __POINTSHADERNODE_H
 
 #include <vector>
-#include "scene/scene.h"
+#include "Scene/Scene.h"
 
 /**
  *Point shader node.
@@ -0,0 +1,798 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    BallSystem.h
+//	Purpose: Scene node that moves a set of balls within a confined space.
+//          Ball state is stored as arrays (one entry per ball) rather than
+//          as one transform node per ball.
+//
+//============================================================================
+
+#ifndef __BALLSYSTEM_H
+#define __BALLSYSTEM_H
+
+#include "Scene/Scene.h"
+#include "ThreadSupport/JobSystem.h"
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+/**
+ * Collision predicted during a step: a ball touches another ball or a
+ * bounding plane at a time of impact given as a fraction of the step. The
+ * event is stale (and skipped) if either ball has collided since the event
+ * was predicted.
+ */
+struct BallEvent
+{
+   float        time;           // Time of impact (fraction of the step)
+   unsigned int ball;           // Ball
+   unsigned int other;          // Other ball, or the plane index for a plane event
+   bool         plane;          // Collision is with a bounding plane
+   unsigned int version;        // Collision count of the ball when predicted
+   unsigned int otherVersion;   // Collision count of the other ball when predicted
+
+   /**
+    * Greater than operator. Orders events by time, then ball, then other
+    * ball or plane, so events at the same time are always resolved in the
+    * same order.
+    * @param  e  Event to compare to.
+    * @return  Returns true if this event happens after e.
+    */
+   bool operator > (const BallEvent& e) const
+   {
+      if (time != e.time)
+         return time > e.time;
+      if (ball != e.ball)
+         return ball > e.ball;
+      if (other != e.other)
+         return other > e.other;
+      return plane > e.plane;
+   }
+};
+
+/**
+ * Ball system node. Holds the position, direction, speed, radius and
+ * collision state of every ball in separate arrays so stepping, collision
+ * testing and transform generation are simple loops over contiguous memory.
+ * The ball geometry (e.g. a unit sphere) is drawn for all balls with one
+ * instanced draw call using the per-ball transforms.
+ * Step moves the balls by one fixed simulation step and keeps the positions
+ * before the step, so Interpolate can place the drawn balls anywhere between
+ * the last two steps when the render rate differs from the step rate.
+ *
+ * Collisions are continuous. DetectCollisions predicts the time of impact of
+ * every ball with the nearest plane and with each nearby ball, and Step
+ * resolves them in time order from a queue: each collision moves the balls
+ * involved to the time of impact, reflects them and predicts new impacts for
+ * those balls only. A ball can collide any number of times in a step, so
+ * fast balls do not pass through walls or through each other.
+ *
+ * If a job system is set, the per-ball loops (and the broad phase pair
+ * search and first predictions) are split into fixed size chunks and run
+ * across threads. Each chunk writes only its own balls, so results do not
+ * depend on the number of threads. The collisions are resolved in order on
+ * the calling thread.
+ */
+class BallSystem: public TransformNode
+{
+public:
+   /**
+    * Constructor given the number of simulation steps per second and the
+    * maximum number of balls. Once the maximum is reached, each new ball
+    * replaces the oldest.
+    * @param  stepRate  Simulation steps per second
+    * @param  maxBalls  Maximum number of live balls
+    */
+   BallSystem(const float stepRate, const unsigned int maxBalls)
+   {
+      m_stepRate = stepRate;
+      m_maxBalls = maxBalls;
+      m_oldest   = 0;
+      m_jobs     = NULL;
+      m_eventCount   = 0;
+      m_eventLimited = false;
+      m_px.reserve(maxBalls);
+      m_py.reserve(maxBalls);
+      m_pz.reserve(maxBalls);
+      m_prevX.reserve(maxBalls);
+      m_prevY.reserve(maxBalls);
+      m_prevZ.reserve(maxBalls);
+      m_dx.reserve(maxBalls);
+      m_dy.reserve(maxBalls);
+      m_dz.reserve(maxBalls);
+      m_speed.reserve(maxBalls);
+      m_radius.reserve(maxBalls);
+      m_time.reserve(maxBalls);
+      m_version.reserve(maxBalls);
+      m_ballEvents.reserve(maxBalls);
+      m_transforms.reserve(maxBalls);
+      m_world.Reserve(maxBalls);
+   }
+
+   /**
+    * Destructor
+    */
+   virtual ~BallSystem() { }
+
+   /**
+    * Set the planes that confine the balls (e.g. the walls of a room). The
+    * broad phase grid is sized to the planes. The planes should have unit
+    * normals.
+    * @param  planes  Inward facing bounding planes.
+    */
+   void SetBoundingPlanes(const std::vector<Plane>& planes)
+   {
+      m_planes = planes;
+      m_world.SetBounds(planes);
+   }
+
+   /**
+    * Set the job system used to run the per-ball loops in parallel.
+    * @param  jobs  Job system (NULL to run on the calling thread)
+    */
+   void SetJobSystem(JobSystem* jobs)
+   {
+      m_jobs = jobs;
+   }
+
+   /**
+    * Set the geometry drawn for each ball. It is scaled by the ball radius
+    * so it should be a unit sphere.
+    * @param  surface  Ball geometry
+    */
+   void SetGeometry(TriSurface* surface)
+   {
+      InstancedGeometryNode* balls = new InstancedGeometryNode(surface);
+      balls->SetInstances(&m_transforms);
+      AddChild(balls);
+   }
+
+   /**
+    * Set levels of detail drawn for the balls. Each ball is drawn at the
+    * level that suits its size on screen. The levels are scaled by the ball
+    * radius so they should be unit spheres.
+    * @param  levels  Ball geometry levels
+    */
+   void SetGeometry(LODGeometryNode* levels)
+   {
+      levels->SetInstances(&m_transforms);
+      AddChild(levels);
+   }
+
+   /**
+    * Add a ball. If the maximum number of balls is reached the oldest ball
+    * is replaced.
+    * @param  position   Initial position of the ball center
+    * @param  direction  Direction of travel (need not be unit length)
+    * @param  speed      Speed in units per second
+    * @param  radius     Radius of the ball
+    * @return  Returns the index of the ball.
+    */
+   unsigned int AddBall(const Point3& position, const Vector3& direction,
+                        const float speed, const float radius)
+   {
+      Vector3 dir = direction;
+      dir.Normalize();
+
+      unsigned int i;
+      if (GetCount() < m_maxBalls)
+      {
+         i = GetCount();
+         m_px.push_back(0.0f);
+         m_py.push_back(0.0f);
+         m_pz.push_back(0.0f);
+         m_prevX.push_back(0.0f);
+         m_prevY.push_back(0.0f);
+         m_prevZ.push_back(0.0f);
+         m_dx.push_back(0.0f);
+         m_dy.push_back(0.0f);
+         m_dz.push_back(0.0f);
+         m_speed.push_back(0.0f);
+         m_radius.push_back(0.0f);
+         m_time.push_back(0.0f);
+         m_version.push_back(0);
+         m_ballEvents.push_back(0);
+         m_transforms.push_back(Matrix4x4());
+      }
+      else
+      {
+         i = m_oldest;
+         m_oldest = (m_oldest + 1) % m_maxBalls;
+      }
+
+      m_px[i] = position.x;
+      m_py[i] = position.y;
+      m_pz[i] = position.z;
+      m_prevX[i] = position.x;
+      m_prevY[i] = position.y;
+      m_prevZ[i] = position.z;
+      m_dx[i] = dir.x;
+      m_dy[i] = dir.y;
+      m_dz[i] = dir.z;
+      m_speed[i]  = speed / m_stepRate;
+      m_radius[i] = radius;
+      m_time[i]   = 0.0f;
+      m_version[i]++;
+      setTransform(i, position.x, position.y, position.z);
+      transformsChanged();
+      return i;
+   }
+
+   /**
+    * Get the number of live balls.
+    * @return  Returns the number of balls.
+    */
+   unsigned int GetCount() const
+   {
+      return (unsigned int)m_px.size();
+   }
+
+   /**
+    * Remove all balls.
+    */
+   void Clear()
+   {
+      m_px.clear();
+      m_py.clear();
+      m_pz.clear();
+      m_prevX.clear();
+      m_prevY.clear();
+      m_prevZ.clear();
+      m_dx.clear();
+      m_dy.clear();
+      m_dz.clear();
+      m_speed.clear();
+      m_radius.clear();
+      m_time.clear();
+      m_version.clear();
+      m_ballEvents.clear();
+      m_transforms.clear();
+      m_events.clear();
+      m_oldest = 0;
+      transformsChanged();
+   }
+
+   /**
+    * Get the current position of a ball.
+    * @param  i  Ball index
+    * @return  Returns the center of the ball.
+    */
+   Point3 GetPosition(const unsigned int i) const
+   {
+      return Point3(m_px[i], m_py[i], m_pz[i]);
+   }
+
+   /**
+    * Get the direction of travel of a ball (a unit vector).
+    * @param  i  Ball index
+    * @return  Returns the direction of travel.
+    */
+   Vector3 GetDirection(const unsigned int i) const
+   {
+      return Vector3(m_dx[i], m_dy[i], m_dz[i]);
+   }
+
+   /**
+    * Get the radius of a ball.
+    * @param  i  Ball index
+    * @return  Returns the radius of the ball.
+    */
+   float GetRadius(const unsigned int i) const
+   {
+      return m_radius[i];
+   }
+
+   /**
+    * Get the number of collisions resolved during the last step.
+    * @return  Returns the collision count.
+    */
+   unsigned int GetEventCount() const
+   {
+      return m_eventCount;
+   }
+
+   /**
+    * Check whether any ball reached the limit of MAX_EVENTS_PER_BALL
+    * collisions with other balls in the last step (its later collisions
+    * with balls that step were not resolved).
+    * @return  Returns true if collisions were left unresolved.
+    */
+   bool IsEventLimitReached() const
+   {
+      return m_eventLimited;
+   }
+
+   /**
+    * Predict the collisions that occur during the next step. Nearby balls
+    * are found with a grid, using the distance each ball can move in a step
+    * in any direction (since it may bounce). Each ball's earliest plane
+    * impact and its impacts with each nearby ball are queued. Call once per
+    * step before Step.
+    */
+   void DetectCollisions()
+   {
+      unsigned int n = GetCount();
+
+      // All balls start the step at time 0 with no collisions. Add each
+      // ball's reach over this step to the broad phase.
+      m_world.Clear();
+      for (unsigned int i = 0; i < n; i++)
+      {
+         m_time[i]       = 0.0f;
+         m_version[i]    = 0;
+         m_ballEvents[i] = 0;
+         m_world.Insert(Point3(m_px[i], m_py[i], m_pz[i]), m_speed[i], m_radius[i]);
+      }
+
+      // Only balls whose reach overlaps can collide. Each chunk of the grid
+      // is searched into its own list, then the lists are merged and sorted
+      // by the first ball then the second, so the neighbor lists do not
+      // depend on the number of threads.
+      m_world.Build();
+      unsigned int chunks = JobSystem::GetChunkCount(n, CHUNK_SIZE);
+      if (m_chunkPairs.size() < chunks)
+         m_chunkPairs.resize(chunks);
+      parallelFor(n, [this](unsigned int begin, unsigned int end)
+      {
+         std::vector<CollisionPair>& pairs = m_chunkPairs[begin / CHUNK_SIZE];
+         pairs.clear();
+         m_world.FindPairs(begin, end, pairs);
+      });
+      m_pairs.clear();
+      for (unsigned int c = 0; c < chunks; c++)
+         m_pairs.insert(m_pairs.end(), m_chunkPairs[c].begin(), m_chunkPairs[c].end());
+      std::sort(m_pairs.begin(), m_pairs.end());
+      buildNeighbors();
+
+      // Predict the first impacts of each chunk of balls into its own list,
+      // then merge the lists in chunk order and build the event queue
+      if (m_chunkEvents.size() < chunks)
+         m_chunkEvents.resize(chunks);
+      parallelFor(n, [this](unsigned int begin, unsigned int end)
+      {
+         std::vector<BallEvent>& events = m_chunkEvents[begin / CHUNK_SIZE];
+         events.clear();
+         predictFirst(begin, end, events);
+      });
+      m_events.clear();
+      for (unsigned int c = 0; c < chunks; c++)
+         m_events.insert(m_events.end(), m_chunkEvents[c].begin(), m_chunkEvents[c].end());
+      std::make_heap(m_events.begin(), m_events.end(), std::greater<BallEvent>());
+   }
+
+   /**
+    * Move all balls by one step, resolving the predicted collisions in time
+    * order. The drawn transforms are not changed until Interpolate is
+    * called. Call after DetectCollisions.
+    */
+   void Step()
+   {
+      unsigned int n = GetCount();
+      parallelFor(n, [this](unsigned int begin, unsigned int end)
+      {
+         savePositions(begin, end);
+      });
+
+      resolveEvents();
+
+      // Move every ball the rest of the way to the end of the step
+      parallelFor(n, [this](unsigned int begin, unsigned int end)
+      {
+         for (unsigned int i = begin; i < end; i++)
+         {
+            advance(i, 1.0f);
+            m_time[i] = 0.0f;
+         }
+      });
+   }
+
+   /**
+    * Set the drawn transforms of all balls between their positions before and
+    * after the last step.
+    * @param  alpha  Fraction of the way from the previous position to the
+    *                current position (1 draws the current position)
+    */
+   void Interpolate(const float alpha)
+   {
+      parallelFor(GetCount(), [this, alpha](unsigned int begin, unsigned int end)
+      {
+         interpolate(begin, end, alpha);
+      });
+      transformsChanged();
+   }
+
+   /**
+    * Move all balls by one step, draw them at their new positions and update
+    * the children.
+    * @param  sceneState  Current scene state
+    */
+   virtual void Update(SceneState& sceneState)
+   {
+      Step();
+      Interpolate(1.0f);
+
+      // Update all children
+      SceneNode::Update(sceneState);
+   }
+
+   // Most collisions with other balls resolved per ball in one step. Balls
+   // wedged against each other can collide over and over at the same time.
+   // Once a ball reaches the limit it passes through other balls for the
+   // rest of the step (it still bounces off the planes), while the other
+   // balls keep colliding.
+   static const unsigned int MAX_EVENTS_PER_BALL = 16;
+
+protected:
+   // Number of balls in each chunk of work given to the job system
+   static const unsigned int CHUNK_SIZE = 1024;
+
+   JobSystem*   m_jobs;           // Job system for the per-ball loops (may be NULL)
+   float        m_stepRate;       // Simulation steps per second
+   unsigned int m_maxBalls;       // Maximum number of live balls
+   unsigned int m_oldest;         // Ball replaced next once at the maximum
+
+   // Ball state - one entry per ball
+   std::vector<float> m_px, m_py, m_pz;      // Current position
+   std::vector<float> m_prevX, m_prevY, m_prevZ;   // Position before the last step
+   std::vector<float> m_dx, m_dy, m_dz;      // Direction vector (unit length)
+   std::vector<float> m_speed;               // Speed - units per step
+   std::vector<float> m_radius;              // Radius
+
+   // Time within the step that the current position is at, the number of
+   // collisions of the ball this step (events predicted with an older count
+   // are stale) and how many of them were with other balls
+   std::vector<float>        m_time;
+   std::vector<unsigned int> m_version;
+   std::vector<unsigned int> m_ballEvents;
+
+   // Modeling transform of each ball
+   std::vector<Matrix4x4> m_transforms;
+
+   // Bounding planes, broad phase and the candidate pairs it finds
+   std::vector<Plane>         m_planes;
+   CollisionWorld             m_world;
+   std::vector<CollisionPair> m_pairs;
+   std::vector<std::vector<CollisionPair> > m_chunkPairs;
+
+   // Candidate pairs as a list of neighbors per ball: the neighbors of ball i
+   // are m_neighbors[m_neighborStart[i]] up to m_neighbors[m_neighborStart[i+1]]
+   std::vector<unsigned int> m_neighborStart;
+   std::vector<unsigned int> m_neighbors;
+   std::vector<unsigned int> m_neighborNext;
+
+   // Collision queue (a heap with the earliest event on top)
+   std::vector<BallEvent> m_events;
+   std::vector<std::vector<BallEvent> > m_chunkEvents;
+   unsigned int m_eventCount;     // Collisions resolved in the last step
+   bool         m_eventLimited;   // A ball reached the collision limit in the last step
+
+   /**
+    * Mark the bounds of the ball geometry (and of this node) as changed
+    * after the ball transforms change.
+    */
+   void transformsChanged()
+   {
+      std::vector<SceneNode*>::iterator i = m_children.begin();
+      for ( ; i != m_children.end(); i++)
+         (*i)->InvalidateBounds();
+   }
+
+   /**
+    * Run a function over all balls [0, count), split into chunks across the
+    * job system's threads if there is one.
+    * @param  count     Number of balls
+    * @param  function  Function called with each chunk of balls [begin, end)
+    */
+   void parallelFor(const unsigned int count, const JobSystem::RangeFunction& function)
+   {
+      if (m_jobs != NULL)
+         m_jobs->ParallelFor(count, CHUNK_SIZE, function);
+      else
+      {
+         for (unsigned int begin = 0; begin < count; begin += CHUNK_SIZE)
+            function(begin, MINV(begin + CHUNK_SIZE, count));
+      }
+   }
+
+   /**
+    * Build the neighbor list of each ball from the candidate pairs (a
+    * counting sort, so each list is in increasing order).
+    */
+   void buildNeighbors()
+   {
+      unsigned int n = GetCount();
+      m_neighborStart.assign(n + 1, 0);
+      std::vector<CollisionPair>::const_iterator pair = m_pairs.begin();
+      for ( ; pair != m_pairs.end(); pair++)
+      {
+         m_neighborStart[pair->first + 1]++;
+         m_neighborStart[pair->second + 1]++;
+      }
+      for (unsigned int i = 0; i < n; i++)
+         m_neighborStart[i + 1] += m_neighborStart[i];
+
+      m_neighborNext.assign(m_neighborStart.begin(), m_neighborStart.end() - 1);
+      m_neighbors.resize(m_neighborStart[n]);
+      for (pair = m_pairs.begin(); pair != m_pairs.end(); pair++)
+      {
+         m_neighbors[m_neighborNext[pair->first]++]  = pair->second;
+         m_neighbors[m_neighborNext[pair->second]++] = pair->first;
+      }
+   }
+
+   /**
+    * Predict the first impacts of balls [begin, end): the earliest plane
+    * impact of each ball and its impacts with each later neighbor (so each
+    * pair is predicted once).
+    * @param  begin   First ball
+    * @param  end     One past the last ball
+    * @param  events  (OUT) Predicted events are appended to this list
+    */
+   void predictFirst(const unsigned int begin, const unsigned int end,
+                     std::vector<BallEvent>& events) const
+   {
+      BallEvent e;
+      for (unsigned int i = begin; i < end; i++)
+      {
+         if (predictPlane(i, e))
+            events.push_back(e);
+         for (unsigned int k = m_neighborStart[i]; k < m_neighborStart[i + 1]; k++)
+         {
+            unsigned int j = m_neighbors[k];
+            if (j > i && predictBalls(i, j, e))
+               events.push_back(e);
+         }
+      }
+   }
+
+   /**
+    * Queue new impacts for a ball after it collides: its earliest plane
+    * impact and its impacts with each neighbor.
+    * @param  i     Ball index
+    * @param  skip  Neighbor not to test (the ball it just hit, which is
+    *               moving away from it)
+    */
+   void predict(const unsigned int i, const unsigned int skip)
+   {
+      BallEvent e;
+      if (predictPlane(i, e))
+         pushEvent(e);
+
+      // No more impacts with balls are predicted for a ball at its limit (or
+      // with one). Earlier predictions are already stale (its count changed).
+      if (m_ballEvents[i] >= MAX_EVENTS_PER_BALL)
+      {
+         m_eventLimited = true;
+         return;
+      }
+      for (unsigned int k = m_neighborStart[i]; k < m_neighborStart[i + 1]; k++)
+      {
+         unsigned int j = m_neighbors[k];
+         if (j != skip && m_ballEvents[j] < MAX_EVENTS_PER_BALL && predictBalls(i, j, e))
+            pushEvent(e);
+      }
+   }
+
+   // Add an event to the collision queue
+   void pushEvent(const BallEvent& e)
+   {
+      m_events.push_back(e);
+      std::push_heap(m_events.begin(), m_events.end(), std::greater<BallEvent>());
+   }
+
+   /**
+    * Resolve the queued collisions in time order. Each collision moves the
+    * balls involved to the time of impact, reflects their directions and
+    * predicts their next impacts. Events for balls that have collided since
+    * they were predicted are skipped. Once a ball has had MAX_EVENTS_PER_BALL
+    * collisions with other balls no more are predicted for it; the other
+    * balls' events are unaffected.
+    */
+   void resolveEvents()
+   {
+      m_eventCount   = 0;
+      m_eventLimited = false;
+      while (!m_events.empty())
+      {
+         BallEvent e = m_events.front();
+         std::pop_heap(m_events.begin(), m_events.end(), std::greater<BallEvent>());
+         m_events.pop_back();
+         if (m_version[e.ball] != e.version || (!e.plane && m_version[e.other] != e.otherVersion))
+            continue;
+         m_eventCount++;
+
+         advance(e.ball, e.time);
+         m_version[e.ball]++;
+         if (e.plane)
+         {
+            // Reflect the direction about the plane normal
+            reflect(e.ball, m_planes[e.other].GetNormal());
+            predict(e.ball, GetCount());
+         }
+         else
+         {
+            // Both balls reflect about the plane between them (normal along
+            // the line between the centers)
+            advance(e.other, e.time);
+            m_version[e.other]++;
+            m_ballEvents[e.ball]++;
+            m_ballEvents[e.other]++;
+            Vector3 normal = GetPosition(e.other) - GetPosition(e.ball);
+            if (normal.Norm() > EPSILON)
+            {
+               normal.Normalize();
+               reflect(e.ball, normal);
+               reflect(e.other, normal);
+            }
+            predict(e.ball, e.other);
+            predict(e.other, e.ball);
+         }
+      }
+   }
+
+   /**
+    * Find the earliest time in this step that a ball touches a bounding
+    * plane while moving towards it. A ball already touching (or past) a
+    * plane it is moving towards hits it immediately.
+    * @param  i  Ball index
+    * @param  e  (OUT) Plane event
+    * @return  Returns true if the ball hits a plane during this step.
+    */
+   bool predictPlane(const unsigned int i, BallEvent& e) const
+   {
+      float smallestT = 2.0f;
+      unsigned int hit = 0;
+      Point3 p = GetPosition(i);
+      for (unsigned int k = 0; k < m_planes.size(); k++)
+      {
+         // Rate the distance to the plane changes (units per step)
+         const Plane& plane = m_planes[k];
+         float rate = (plane.a * m_dx[i] + plane.b * m_dy[i] + plane.c * m_dz[i]) * m_speed[i];
+         if (rate >= 0.0f)
+            continue;
+
+         float gap = plane.Solve(p) - m_radius[i];
+         float t = (gap > 0.0f) ? m_time[i] + gap / -rate : m_time[i];
+         if (t < smallestT)
+         {
+            smallestT = t;
+            hit = k;
+         }
+      }
+      if (smallestT > 1.0f)
+         return false;
+
+      e.time         = smallestT;
+      e.ball         = i;
+      e.other        = hit;
+      e.plane        = true;
+      e.version      = m_version[i];
+      e.otherVersion = 0;
+      return true;
+   }
+
+   /**
+    * Find the time in this step that 2 balls first touch while moving
+    * towards each other. Balls that already overlap and are moving towards
+    * each other touch immediately.
+    * @param  i  Index of a ball
+    * @param  j  Index of the other ball
+    * @param  e  (OUT) Ball event
+    * @return  Returns true if the balls hit during this step.
+    */
+   bool predictBalls(const unsigned int i, const unsigned int j, BallEvent& e) const
+   {
+      // Find both balls at the later of their current times
+      float t0 = MAXV(m_time[i], m_time[j]);
+      float si = m_speed[i];
+      float sj = m_speed[j];
+      float ti = t0 - m_time[i];
+      float tj = t0 - m_time[j];
+
+      // Relative position and velocity (units per step) of ball j
+      float dx = (m_px[j] + m_dx[j] * (sj * tj)) - (m_px[i] + m_dx[i] * (si * ti));
+      float dy = (m_py[j] + m_dy[j] * (sj * tj)) - (m_py[i] + m_dy[i] * (si * ti));
+      float dz = (m_pz[j] + m_dz[j] * (sj * tj)) - (m_pz[i] + m_dz[i] * (si * ti));
+      float vx = m_dx[j] * sj - m_dx[i] * si;
+      float vy = m_dy[j] * sj - m_dy[i] * si;
+      float vz = m_dz[j] * sj - m_dz[i] * si;
+
+      // Solve |d + v s| = ri + rj for the first s >= 0. No impact if the
+      // balls are not moving towards each other.
+      float b = dx * vx + dy * vy + dz * vz;
+      if (b >= 0.0f)
+         return false;
+      float r = m_radius[i] + m_radius[j];
+      float c = dx * dx + dy * dy + dz * dz - r * r;
+      float s = 0.0f;
+      if (c > 0.0f)
+      {
+         float a = vx * vx + vy * vy + vz * vz;
+         float disc = b * b - a * c;
+         if (disc < 0.0f)
+            return false;
+
+         // Smaller root, in a form that does not lose precision when c is small
+         s = c / (-b + sqrtf(disc));
+      }
+      float t = t0 + s;
+      if (t > 1.0f)
+         return false;
+
+      e.time         = t;
+      e.ball         = i;
+      e.other        = j;
+      e.plane        = false;
+      e.version      = m_version[i];
+      e.otherVersion = m_version[j];
+      return true;
+   }
+
+   // Move a ball along its direction to a later time within the step
+   void advance(const unsigned int i, const float t)
+   {
+      float d = m_speed[i] * (t - m_time[i]);
+      m_px[i] += m_dx[i] * d;
+      m_py[i] += m_dy[i] * d;
+      m_pz[i] += m_dz[i] * d;
+      m_time[i] = t;
+   }
+
+   // Reflect the direction of a ball about a plane with the given unit normal
+   void reflect(const unsigned int i, const Vector3& normal)
+   {
+      float d2 = 2.0f * (m_dx[i] * normal.x + m_dy[i] * normal.y + m_dz[i] * normal.z);
+      m_dx[i] -= normal.x * d2;
+      m_dy[i] -= normal.y * d2;
+      m_dz[i] -= normal.z * d2;
+   }
+
+   /**
+    * Keep the positions of balls [begin, end) before the step.
+    * @param  begin  First ball
+    * @param  end    One past the last ball
+    */
+   void savePositions(const unsigned int begin, const unsigned int end)
+   {
+      for (unsigned int i = begin; i < end; i++)
+      {
+         m_prevX[i] = m_px[i];
+         m_prevY[i] = m_py[i];
+         m_prevZ[i] = m_pz[i];
+      }
+   }
+
+   /**
+    * Set the transforms of balls [begin, end) between their previous and
+    * current positions.
+    * @param  begin  First ball
+    * @param  end    One past the last ball
+    * @param  alpha  Fraction of the way from the previous position
+    */
+   void interpolate(const unsigned int begin, const unsigned int end, const float alpha)
+   {
+      for (unsigned int i = begin; i < end; i++)
+      {
+         setTransform(i, m_prevX[i] + (m_px[i] - m_prevX[i]) * alpha,
+                         m_prevY[i] + (m_py[i] - m_prevY[i]) * alpha,
+                         m_prevZ[i] + (m_pz[i] - m_prevZ[i]) * alpha);
+      }
+   }
+
+   // Set the transformation matrix of a ball (translate to the given center
+   // and scale a unit sphere by the radius)
+   void setTransform(const unsigned int i, const float x, const float y, const float z)
+   {
+      Matrix4x4& m = m_transforms[i];
+      float r = m_radius[i];
+      m.m00() = r;     m.m01() = 0.0f;  m.m02() = 0.0f;  m.m03() = x;
+      m.m10() = 0.0f;  m.m11() = r;     m.m12() = 0.0f;  m.m13() = y;
+      m.m20() = 0.0f;  m.m21() = 0.0f;  m.m22() = r;     m.m23() = z;
+      m.m30() = 0.0f;  m.m31() = 0.0f;  m.m32() = 0.0f;  m.m33() = 1.0f;
+   }
+};
+
+#endif
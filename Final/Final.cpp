@@ -6,11 +6,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <vector>
 #include <time.h>
+#include <chrono>
 #include <fcntl.h>
-#include <io.h>
+#include <atomic>
+#include <new>
 
 #include <GL/gl3w.h>
 #include <GL/freeglut.h>
@@ -21,10 +24,17 @@
 
 #include "geometry/geometry.h"
 #include "ShaderSupport/GLSLShader.h"
-#include "Scene/scene.h"
+#include "Scene/Scene.h"
+
+#include "Scene/RayTracer.h"
+#include "HeadlessSupport/OffscreenRenderer.h"
+#include "ProfileSupport/Profiler.h"
 
 #include "LightingShaderNode.h"
-#include "BallTransform.h"
+#include "BallSystem.h"
+#include "FixedTimestep.h"
+#include "Random.h"
+#include "InputRecorder.h"
 #include "Fitting.h"
 
 #pragma comment(lib, "DevIL.lib")
@@ -41,10 +51,12 @@ int   MouseY;
 // Bounding planes of the enclosure. Used for intersection testing.
 std::vector<Plane> BoundingPlanes;
 
-unsigned int currentNumBalls = 0;
 const unsigned int MAX_NUMBER_OF_BALLS = 900;
-// Ball transforms. We have this global so we can more easily do intersection testing
-BallTransform* BallTransforms[MAX_NUMBER_OF_BALLS];
+// All balls are held in a single node. We have this global so we can more easily do intersection testing
+BallSystem* Balls;
+
+// Threads used to update the balls
+JobSystem* Jobs;
 int numBallsToShoot = 1;
 PresentationNode* ballColor;
 float ballSpeed = 95.0f;
@@ -53,10 +65,42 @@ float ballSpeed = 95.0f;
 int RenderWidth = 640;
 int RenderHeight = 480;
 
-const float FrameRate = 72.0f;
-
-// Scene root
-SceneNode* SceneRoot;
+// Window size the mouse position is relative to. While a recording plays
+// this is the recorded window size, which may differ from the render size.
+int InputWidth = 640;
+int InputHeight = 480;
+
+// The balls and camera move in fixed steps at this rate whatever the render
+// rate. At most MaxStepsPerFrame steps are taken before drawing a frame, so a
+// slow frame slows the simulation rather than making it fall further behind.
+const float SimulationRate = 72.0f;
+const unsigned int MaxStepsPerFrame = 5;
+FixedTimestep Simulation(SimulationRate, MaxStepsPerFrame);
+
+// Frames per second of simulated time in headless mode
+float HeadlessFrameRate = SimulationRate;
+
+// Number of simulation steps taken. Recorded input is tied to the step it
+// arrived before, so a run can be played back exactly.
+unsigned int SimulationStep = 0;
+InputRecorder Input;
+
+// Random numbers for shooting balls (seeded so a run can be repeated)
+Random ShotRandom;
+
+// Timings of the last frame, and their totals while a recording plays
+unsigned int FrameSteps = 0;
+double PhysicsMs = 0.0;
+double RenderMs = 0.0;
+unsigned int ReplayFrames = 0;
+double ReplayPhysicsMs = 0.0;
+double ReplayRenderMs = 0.0;
+double MaxPhysicsMs = 0.0;
+double MaxRenderMs = 0.0;
+bool ReplayMatched = true;
+
+// Scene root. Draws the scene from a compiled render queue.
+RenderQueueNode* SceneRoot;
 
 // Global camera node. Use this as the root of the scene graph.
 CameraNode* MyCamera;
@@ -71,8 +115,37 @@ LightNode* Spotlight;
 // Global scene state
 SceneState MySceneState;
 
+// Frame profiler and its zones: ball collisions, ball and camera movement,
+// and drawing (also timed on the GPU). Traces go to ProfileFile.
+Profiler Profile;
+unsigned int CollisionZone;
+unsigned int PhysicsZone;
+unsigned int DrawZone;
+const char* ProfileFile = "Final.trace.json";
+
 SphereSection* sphere;
 
+#ifdef _DEBUG
+// Debug builds count heap allocations (operator new) so the 'm' key can
+// show that drawing a frame does not allocate
+std::atomic<unsigned long> HeapAllocations(0);
+unsigned long DisplayAllocations = 0;
+
+void* operator new(size_t size)
+{
+	HeapAllocations++;
+	void* p = malloc((size > 0) ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+#endif
+
 // Simple logging function
 void logmsg(const char *message, ...)
 {
@@ -158,14 +231,11 @@ SceneNode* ConstructUnitBox(UnitSquareSurface* unitSquare)
 }
 
 /**
-* Construct room as a child of the specified node
-* @param  parent      Parent node
-* @param  unitSquare  Geometry node to use
+* Form the bounding planes of the room (for intersection testing)
 */
-void ConstructRoom(SceneNode* parent, UnitSquareSurface* unitSquare)
+void ConstructBoundingPlanes()
 {
-
-	// Form bounding planes (for intersection testing)
+	BoundingPlanes.clear();
 	Plane p0(Point3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 0.0f, 1.0f));
 	BoundingPlanes.push_back(p0);
 	Plane p1(Point3(0.0f, 0.0f, 80.0f), Vector3(0.0f, 0.0f, -1.0f));
@@ -178,6 +248,16 @@ void ConstructRoom(SceneNode* parent, UnitSquareSurface* unitSquare)
 	BoundingPlanes.push_back(p4);
 	Plane p5(Point3(0.0f, -100.0f, 50.0f), Vector3(0.0f, 1.0f, 0.0f));
 	BoundingPlanes.push_back(p5);
+}
+
+/**
+* Construct room as a child of the specified node
+* @param  parent      Parent node
+* @param  unitSquare  Geometry node to use
+*/
+void ConstructRoom(SceneNode* parent, UnitSquareSurface* unitSquare)
+{
+	ConstructBoundingPlanes();
 
 	// Contruct transform nodes for the walls. Perform rotations so the 
 	// walls face inwards
@@ -295,14 +375,30 @@ SceneNode* ConstructTable(SceneNode* box, ConicSurface* leg)
 }
 
 /**
-* Construct the scene
+* Get the largest projected diameter (pixels) at which a circle drawn with
+* a number of segments stays within half a pixel of the true circle. A level
+* of detail is used down to the size where the next coarser level would be
+* good enough.
+* @param  segments  Number of segments around the silhouette
+* @return  Returns the diameter in pixels.
+*/
+float MaxSilhouetteSize(const unsigned int segments)
+{
+	return 1.0f / (1.0f - cosf((float)M_PI / (float)segments));
+}
+
+/**
+* Construct the scene. Surfaces create their vertex buffers and textures when
+* first drawn, so the scene can be built without an OpenGL context when the
+* shader is not compiled (the ray tracer does not need it).
+* @param  compileShader  Compile the lighting shader and get its locations
 */
-void ConstructScene()
+void ConstructScene(const bool compileShader)
 {
 	// Construct the lighting shader node
 	LightingShaderNode* lightingShader = new LightingShaderNode();
-	if (!lightingShader->Create("phong.vert", "phong.frag") ||
-		!lightingShader->GetLocations())
+	if (compileShader && (!lightingShader->Create("phong.vert", "phong.frag") ||
+		!lightingShader->GetLocations()))
 		exit(-1);
 
 	int positionLoc = lightingShader->GetPositionLoc();
@@ -321,18 +417,38 @@ void ConstructScene()
 	// Construct a unit cylinder surface
 	ConicSurface* cylinder = new ConicSurface(1.0f, 1.0f, 18, 4, positionLoc, normalLoc, textureLoc);
 
-	// Construct a torus
-	TorusSurface* torus = new TorusSurface(20.0f, 5.0f, 18, 18, positionLoc, normalLoc, textureLoc);
+	// Torus levels of detail
+	LODGeometryNode* torus = new LODGeometryNode;
+	torus->AddLevel(new TorusSurface(20.0f, 5.0f, 18, 18, positionLoc, normalLoc, textureLoc), MaxSilhouetteSize(12));
+	torus->AddLevel(new TorusSurface(20.0f, 5.0f, 12, 12, positionLoc, normalLoc, textureLoc), MaxSilhouetteSize(8));
+	torus->AddLevel(new TorusSurface(20.0f, 5.0f, 8, 8, positionLoc, normalLoc, textureLoc), 0.0f);
 
 	// Construct a cylinder surface with two different radii
 	ConicSurface* shooterCylinder = new ConicSurface(1.0f, 2.0f, 18, 4, positionLoc, normalLoc, textureLoc);
 
-	// Teapot
-	MeshTeapot* teapot = new MeshTeapot(3, positionLoc, normalLoc, textureLoc);
+	// Teapot levels of detail. About 4 patches span the silhouette, each with
+	// 2^level segments.
+	LODGeometryNode* teapot = new LODGeometryNode;
+	teapot->AddLevel(new MeshTeapot(3, positionLoc, normalLoc, textureLoc, Jobs), MaxSilhouetteSize(16));
+	teapot->AddLevel(new MeshTeapot(2, positionLoc, normalLoc, textureLoc, Jobs), MaxSilhouetteSize(8));
+	teapot->AddLevel(new MeshTeapot(1, positionLoc, normalLoc, textureLoc, Jobs), 0.0f);
 
-	// Sphere
+	// Sphere levels of detail, shared by the sphere and the balls (which
+	// select a level per ball)
 	sphere = new SphereSection(-90.0f, 90.0f, 18,
 		-180.0f, 180.0f, 36, 1.0f, positionLoc, normalLoc, textureLoc);
+	const unsigned int sphereLevels = 4;
+	const unsigned int sphereSegments[sphereLevels] = { 36, 24, 16, 12 };
+	LODGeometryNode* sphereLOD = new LODGeometryNode;
+	LODGeometryNode* ballLOD = new LODGeometryNode;
+	for (unsigned int i = 0; i < sphereLevels; i++)
+	{
+		SphereSection* level = (i == 0) ? sphere : new SphereSection(-90.0f, 90.0f, sphereSegments[i] / 2,
+			-180.0f, 180.0f, sphereSegments[i], 1.0f, positionLoc, normalLoc, textureLoc);
+		float minSize = (i + 1 < sphereLevels) ? MaxSilhouetteSize(sphereSegments[i + 1]) : 0.0f;
+		sphereLOD->AddLevel(level, minSize);
+		ballLOD->AddLevel(level, minSize);
+	}
 
 	// Construct a fitting
 	Fitting* fitting = new Fitting(positionLoc, normalLoc, textureLoc);
@@ -341,7 +457,7 @@ void ConstructScene()
 
 	// Wood
 	PresentationNode* wood = new PresentationNode;
-	wood->SetTexture("../images/woodgrain.jpg", GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_NEAREST, GL_LINEAR, GL_TEXTURE0 + 1);
+	wood->SetTexture("../images/Woodgrain.jpg", GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_NEAREST, GL_LINEAR, GL_TEXTURE0 + 1);
 	wood->SetMaterialAmbientAndDiffuse(Color4(0.55f, 0.45f, 0.15f));
 	wood->SetMaterialSpecular(Color4(0.3f, 0.3f, 0.3f));
 	wood->SetMaterialShininess(64.0f);
@@ -460,7 +576,7 @@ void ConstructScene()
 	// --------------------- Scene construction ----------------- //
 
 	// Construct the scene root node
-	SceneRoot = new SceneNode;
+	SceneRoot = new RenderQueueNode;
 	SceneRoot->AddChild(lightingShader);
 	lightingShader->AddChild(MyCamera);
 
@@ -487,6 +603,13 @@ void ConstructScene()
 	// Construct the room (walls, floor, ceiling)
 	ConstructRoom(myScene, unitSquare);
 
+	// Balls are drawn as unit spheres and bounce off the room
+	Balls = new BallSystem(SimulationRate, MAX_NUMBER_OF_BALLS);
+	Balls->SetBoundingPlanes(BoundingPlanes);
+	Balls->SetJobSystem(Jobs);
+	ballColor->AddChild(Balls);
+	Balls->SetGeometry(ballLOD);
+
 	// Construct the table
 	SceneNode* table = ConstructTable(box, cylinder);
 	myScene->AddChild(wood);
@@ -513,7 +636,7 @@ void ConstructScene()
 
 	myScene->AddChild(sphereTexture);
 	sphereTexture->AddChild(sphereTransform);
-	sphereTransform->AddChild(sphere);
+	sphereTransform->AddChild(sphereLOD);
 
 	// Fitting material
 	PresentationNode* fittingMaterial = new PresentationNode;
@@ -555,138 +678,281 @@ void UpdateSpotlight()
 	Spotlight->SetSpotlightDirection(dir);
 }
 
+// Input handlers (also called to play back recorded input)
+void handleKey(unsigned char key);
+void handleMouse(int button, int state, int x, int y);
+
 /**
-* Use a timer method to try to do a consistent update rate or 72Hz.
-* Without using a timer, the speed of movement will depend on how fast
-* the program runs (fast movement on a fast PC and slow movement on a
-* slower PC)
+* Find a checksum of the simulation state (ball positions and directions,
+* camera and shooting settings). A recording stores the checksum at its end
+* so playback can check that it reached exactly the same state.
 */
-void timerFunction(int value)
+uint64_t simulationChecksum()
 {
+	uint64_t hash = InputRecorder::CHECKSUM_START;
+	for (unsigned int i = 0; i < Balls->GetCount(); i++)
+	{
+		Point3  p = Balls->GetPosition(i);
+		Vector3 d = Balls->GetDirection(i);
+		float state[6] = { p.x, p.y, p.z, d.x, d.y, d.z };
+		hash = InputRecorder::Checksum(state, sizeof(state), hash);
+	}
+	Point3  eye = MyCamera->GetPosition();
+	Vector3 vpn = MyCamera->GetViewPlaneNormal();
+	float camera[7] = { eye.x, eye.y, eye.z, vpn.x, vpn.y, vpn.z, Velocity };
+	hash = InputRecorder::Checksum(camera, sizeof(camera), hash);
+	return InputRecorder::Checksum(&numBallsToShoot, sizeof(numBallsToShoot), hash);
+}
+
+/**
+* End the input recording (if recording) with the step count and the state
+* checksum. Called on exit.
+*/
+void stopRecording()
+{
+	if (!Input.IsRecording())
+		return;
+	Input.StopRecording(SimulationStep, simulationChecksum());
+	printf("Recorded %u steps\n", SimulationStep);
+}
+
+/**
+* Print the timings of the replayed frames and check the state against the
+* recording. Called when playback reaches the end of the recording.
+*/
+void finishPlayback()
+{
+	Input.StopPlaying();
+	unsigned int frames = MAXV(ReplayFrames, 1u);
+	printf("Replayed %u steps in %u frames: physics mean %.3f ms (max %.3f), render mean %.3f ms (max %.3f)\n",
+		SimulationStep, ReplayFrames, ReplayPhysicsMs / frames, MaxPhysicsMs,
+		ReplayRenderMs / frames, MaxRenderMs);
+	if (Input.IsComplete())
+	{
+		uint64_t checksum = simulationChecksum();
+		ReplayMatched = (checksum == Input.GetChecksum());
+		printf("State checksum %016llx %s the recording\n", (unsigned long long)checksum,
+			ReplayMatched ? "matches" : "DOES NOT MATCH");
+	}
+	else
+		printf("Recording has no end checksum - state not checked\n");
+}
+
+/**
+* Apply the recorded input due before the next simulation step, and finish
+* playback once the end of the recording is reached.
+*/
+void playInput()
+{
+	InputEvent e;
+	while (Input.Next(SimulationStep, e))
+	{
+		switch (e.type)
+		{
+		case INPUT_KEY:
+			handleKey(e.code);
+			break;
+
+		case INPUT_MOUSE:
+			handleMouse(e.code, e.state, e.x, e.y);
+			break;
+
+		case INPUT_MOTION:
+			MouseX = e.x;
+			MouseY = e.y;
+			break;
+
+		case INPUT_WINDOW:
+			InputWidth = e.x;
+			InputHeight = e.y;
+			break;
+
+		default:
+			break;
+		}
+	}
+	if (Input.IsPlaying() && SimulationStep >= Input.GetEndStep())
+		finishPlayback();
+}
+
+/**
+* Print the timings of the last frame while a recording plays.
+*/
+void reportFrame()
+{
+	if (!Input.IsPlaying())
+		return;
+	printf("frame %5u: %u steps, physics %7.3f ms, render %7.3f ms\n", ReplayFrames, FrameSteps, PhysicsMs, RenderMs);
+	ReplayFrames++;
+	ReplayPhysicsMs += PhysicsMs;
+	ReplayRenderMs += RenderMs;
+	MaxPhysicsMs = MAXV(MaxPhysicsMs, PhysicsMs);
+	MaxRenderMs = MAXV(MaxRenderMs, RenderMs);
+}
+
+/**
+* Advance the simulation by one fixed step (recorded input, camera movement,
+* ball collisions and ball positions).
+*/
+void stepSimulation()
+{
+	playInput();
+
 	// If mouse button is down, generate another view
 	if (Animate)
 	{
+		ProfileZone zone(Profile, PhysicsZone);
+
 		// Find relative dx and dy relative to center of the window
-		float dx = 4.0f * ((MouseX - ((float)RenderWidth * 0.5f)) / (float)RenderWidth);
-		float dy = 4.0f * ((((float)RenderHeight * 0.5f) - MouseY) / (float)RenderHeight);
+		float dx = 4.0f * ((MouseX - ((float)InputWidth * 0.5f)) / (float)InputWidth);
+		float dy = 4.0f * ((((float)InputHeight * 0.5f) - MouseY) / (float)InputHeight);
 		float dz = (Forward) ? Velocity : -Velocity;
 		MyCamera->MoveAndTurn(dx * Velocity, dy * Velocity, dz);
 
-		MyCamera->Update(MySceneState);
 		UpdateSpotlight();
 		updateShooter();
 	}
 
-	// Initialize all balls to have no intersection
-	for (unsigned int i = 0; i < currentNumBalls % MAX_NUMBER_OF_BALLS; i++)
-		BallTransforms[i]->SetIntersectTime(0.0f);
+	// Find ball-ball and ball-wall intersections for this step
+	Profile.BeginZone(CollisionZone);
+	Balls->DetectCollisions();
+	Profile.EndZone(CollisionZone);
 
-	// Go through all balls and test for intersection with subsequent ball
-	for (unsigned int i = 0; i < currentNumBalls % MAX_NUMBER_OF_BALLS; i++)
-	{
-		// If intersection with a prior ball is not found, test for intersection with successive balls
-		if (BallTransforms[i]->GetIntersectTime() == 0.0f)
-		{
-			for (unsigned int j = i + 1; j < currentNumBalls % MAX_NUMBER_OF_BALLS; j++)
-			{
-				// If an intersection occurs, break out of loop. We will only worry about a ball intersecting
-				// one other in a single frame and won't care much if it is the closest
-				if (BallTransforms[i]->IntersectBall(BallTransforms[j]))
-					break;
-			}
-		}
-	}
+	// Move the balls (they are drawn where Interpolate puts them)
+	ProfileZone zone(Profile, PhysicsZone);
+	Balls->Step();
+	SimulationStep++;
+}
+
+/**
+* Run a number of simulation steps, then place the balls between their
+* positions after the last two steps for drawing.
+* @param  steps  Number of steps to run
+*/
+void runSimulation(const unsigned int steps)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < steps; i++)
+		stepSimulation();
+
+	// Input recorded after the last step of a recording
+	playInput();
 
-	// Go through all ball and test for plane intersection on those that do not intersect with another ball
-	for (unsigned int i = 0; i < currentNumBalls % MAX_NUMBER_OF_BALLS; i++)
 	{
-		// Check for collision with any planes
-		if (BallTransforms[i]->GetIntersectTime() == 0.0f)
-		{
-			float t = 0.0f;
-			float smallestT = 1.0f;
-			std::vector<Plane>::iterator plane = BoundingPlanes.begin();
-			Plane intersectPlane;
-			for (; plane != BoundingPlanes.end(); plane++)
-			{
-				t = BallTransforms[i]->IntersectWithPlane(*plane);
-				if (t < smallestT)
-				{
-					// Copy the nearest intersection and the plane of intersection
-					smallestT = t;
-					intersectPlane = *plane;
-				}
-			}
-			if (smallestT != 1.0f)
-			{
-				BallTransforms[i]->SetIntersectTime(smallestT);
-				BallTransforms[i]->SetIntersectPlane(intersectPlane);
-			}
-		}
+		ProfileZone zone(Profile, PhysicsZone);
+		Balls->Interpolate(Simulation.GetAlpha());
 	}
+	FrameSteps = steps;
+	PhysicsMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
 
-	// update all balls in the scene if we haven't already updated the scene due to being in animate mode
-	if (!Animate)
-		ballColor->Update(MySceneState);
+/**
+* Advance the scene by the wall clock time since the last frame. The
+* simulation runs in fixed steps so the speed of movement does not depend
+* on how fast the program draws (fast movement on a fast PC and slow
+* movement on a slower PC).
+*/
+void updateFrame()
+{
+	runSimulation(Simulation.Advance());
+}
 
-	glutPostRedisplay();
+/**
+* Advance the scene by one headless frame of simulated time, so every run
+* takes the same steps whatever the time taken to draw.
+*/
+void updateHeadlessFrame()
+{
+	runSimulation(Simulation.Advance(1.0 / HeadlessFrameRate));
+}
 
-	glutTimerFunc((int)(1000.0f / FrameRate), timerFunction, 0);
+/**
+* Idle callback. Draw frames continuously (as fast as the program runs, or
+* at the display rate if buffer swaps wait for vertical sync).
+*/
+void idle()
+{
+	glutPostRedisplay();
 }
 
 /**
-* Display callback function
+* Draw the scene into the current framebuffer (the window's back buffer or,
+* in headless mode, the offscreen framebuffer).
 */
-void display(void)
+void drawFrame()
 {
+	ProfileZone zone(Profile, DrawZone);
+
 	// Clear the framebuffer and the depth buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+#ifdef _DEBUG
+	unsigned long allocations = HeapAllocations;
+#endif
+
 	// Initialize the scene state and draw the scene graph
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
 	MySceneState.Init();
 	SceneRoot->Draw(MySceneState);
+	RenderMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+#ifdef _DEBUG
+	DisplayAllocations = HeapAllocations - allocations;
+#endif
+}
+
+/**
+* Display callback function
+*/
+void display(void)
+{
+	updateFrame();
+	drawFrame();
 
 	// Swap buffers
 	glutSwapBuffers();
+
+	// A frame runs from one buffer swap to the next
+	Profile.NextFrame();
+	reportFrame();
+}
+
+/**
+* Draw a frame in headless mode and start the profiler's next frame.
+*/
+void drawHeadlessFrame()
+{
+	drawFrame();
+	Profile.NextFrame();
+	reportFrame();
 }
 
 // method invoked when a ball is shot
 void shootBalls(){
 
 	for (int i = 0; i < numBallsToShoot; i++){
-		BallTransform* newBall = new BallTransform(FrameRate);
-		newBall->SetPosition(shooterPosition);
-		newBall->SetSpeed(ballSpeed);
 		Point3 lap = MyCamera->GetLookAtPt();
 		// generate random numbers in the range [-20,20] to offset ball direction
-		lap.x += (rand() % 40 - 20) * i;
-		lap.y += (rand() % 40 - 20) * i;
-		lap.z += (rand() % 40 - 20) * i;
-		newBall->SetDirection(Vector3(shooterPosition, lap));
-		newBall->SetRadius(1.5f);
-		newBall->setTransform();
-
-		// delete oldest balls when we exceed 30 balls alive
-		if (currentNumBalls >= MAX_NUMBER_OF_BALLS) {
-			delete BallTransforms[currentNumBalls % MAX_NUMBER_OF_BALLS];
-		}
-		BallTransforms[currentNumBalls % MAX_NUMBER_OF_BALLS] = newBall;
-		currentNumBalls += 1;
+		lap.x += ShotRandom.Range(-20, 19) * i;
+		lap.y += ShotRandom.Range(-20, 19) * i;
+		lap.z += ShotRandom.Range(-20, 19) * i;
 
-		ballColor->AddChild(newBall);
-		newBall->AddChild(sphere);
+		// the oldest ball is replaced once the maximum number of balls are alive
+		Balls->AddBall(shooterPosition, Vector3(shooterPosition, lap), ballSpeed, 1.5f);
 	}
 }
 
 /**
-* Keyboard callback.
+* Act on a key press (from the keyboard or a recording).
+* @param  key  Key
 */
-void keyboard(unsigned char key, int x, int y)
+void handleKey(unsigned char key)
 {
 	switch (key)
 	{
 		// Escape key
 	case 27:
+		stopRecording();
 		delete MyCamera;
 		exit(0);
 		break;
@@ -738,19 +1004,16 @@ void keyboard(unsigned char key, int x, int y)
 		MyCamera->SetViewUp(Vector3(0.0, 0.0, 1.0));
 		UpdateSpotlight();
 		updateShooter();
-		glutPostRedisplay();
 		break;
 
 		// Roll the camera by 5 degrees
 	case 'r':
 		MyCamera->Roll(5);
-		glutPostRedisplay();
 		break;
 
 		// Roll the camera by 5 degrees (clockwise)
 	case 'R':
 		MyCamera->Roll(-5);
-		glutPostRedisplay();
 		break;
 
 		// Change the pitch of the camera by 5 degrees
@@ -758,7 +1021,6 @@ void keyboard(unsigned char key, int x, int y)
 		MyCamera->Pitch(5);
 		UpdateSpotlight();
 		updateShooter();
-		glutPostRedisplay();
 		break;
 
 		// Change the pitch of the camera by 5 degrees (clockwise)
@@ -766,7 +1028,6 @@ void keyboard(unsigned char key, int x, int y)
 		MyCamera->Pitch(-5);
 		UpdateSpotlight();
 		updateShooter();
-		glutPostRedisplay();
 		break;
 
 		// Change the heading of the camera by 5 degrees
@@ -774,14 +1035,12 @@ void keyboard(unsigned char key, int x, int y)
 		MyCamera->Heading(5);
 		UpdateSpotlight();
 		updateShooter();
-		glutPostRedisplay();
 		break;
 
 		// Change the heading of the camera by 5 degrees (clockwise)
 	case 'H':
 		MyCamera->Heading(-5);
 		UpdateSpotlight();
-		glutPostRedisplay();
 		break;
 
 		// slide camera right
@@ -789,7 +1048,6 @@ void keyboard(unsigned char key, int x, int y)
 		MyCamera->Slide(5.0f, 0.0f, 0.0f);
 		UpdateSpotlight();
 		updateShooter();
-		glutPostRedisplay();
 		break;
 
 		// slide camera left
@@ -798,7 +1056,6 @@ void keyboard(unsigned char key, int x, int y)
 		MyCamera->Slide(-5.0f, 0.0f, 0.0f);
 		UpdateSpotlight();
 		updateShooter();
-		glutPostRedisplay();
 		break;
 
 		// slide camera up
@@ -806,7 +1063,6 @@ void keyboard(unsigned char key, int x, int y)
 		MyCamera->Slide(0.0f, 5.0f, 0.0f);
 		UpdateSpotlight();
 		updateShooter();
-		glutPostRedisplay();
 		break;
 
 		// slide camera down
@@ -815,7 +1071,6 @@ void keyboard(unsigned char key, int x, int y)
 		MyCamera->Slide(0.0f, -5.0f, 0.0f);
 		UpdateSpotlight();
 		updateShooter();
-		glutPostRedisplay();
 		break;
 
 		// move camera forward
@@ -823,7 +1078,6 @@ void keyboard(unsigned char key, int x, int y)
 		MyCamera->Slide(0.0f, 0.0f, 5.0f);
 		UpdateSpotlight();
 		updateShooter();
-		glutPostRedisplay();
 		break;
 
 		// move camera backward
@@ -831,7 +1085,6 @@ void keyboard(unsigned char key, int x, int y)
 		MyCamera->Slide(0.0f, 0.0f, -5.0f);
 		UpdateSpotlight();
 		updateShooter();
-		glutPostRedisplay();
 		break;
 
 		// Go faster
@@ -848,7 +1101,53 @@ void keyboard(unsigned char key, int x, int y)
 
 	case 's':
 		shootBalls();
-		glutPostRedisplay();
+		break;
+
+		// Report the transform matrix cache and geometry statistics for the last frame
+	case 'm':
+		printf("Matrices computed: %u   reused: %u\n", MySceneState.m_matricesComputed,
+			MySceneState.m_matricesSkipped);
+		printf("Triangles drawn: %u   draw calls: %u\n", MySceneState.m_trianglesDrawn,
+			MySceneState.m_drawCalls);
+		printf("Culled nodes: %u   triangles: %u\n", MySceneState.m_nodesCulled,
+			MySceneState.m_trianglesCulled);
+		printf("State changes: %u   render queue records: %u\n", MySceneState.m_stateChanges,
+			SceneRoot->IsEnabled() ? SceneRoot->GetRecordCount() : 0);
+		printf("GL state cache calls: %u   redundant calls dropped: %u\n",
+			MySceneState.m_glState.GetCallCount(), MySceneState.m_glState.GetSkippedCount());
+#ifdef _DEBUG
+		printf("Heap allocations during display: %lu   matrix stack allocations: %u\n",
+			DisplayAllocations, MySceneState.m_modelMatrixStack.GetAllocationCount());
+#endif
+		break;
+
+		// Toggle view frustum culling
+	case 'c':
+		MySceneState.m_cullingEnabled = !MySceneState.m_cullingEnabled;
+		printf("Culling %s\n", MySceneState.m_cullingEnabled ? "on" : "off");
+		break;
+
+		// Print the frame profiler's zone and GPU timings
+	case 't':
+		Profile.PrintSummary();
+		break;
+
+		// Write the profiled frames as a Chrome trace
+	case 'T':
+		if (Profile.WriteChromeTrace(ProfileFile))
+			printf("Wrote profiler trace to %s\n", ProfileFile);
+		break;
+
+		// Toggle dropping redundant OpenGL state changes and uniform updates
+	case 'g':
+		MySceneState.m_glState.SetEnabled(!MySceneState.m_glState.IsEnabled());
+		printf("GL state cache %s\n", MySceneState.m_glState.IsEnabled() ? "on" : "off");
+		break;
+
+		// Toggle drawing from the render queue (otherwise traverse the scene graph)
+	case 'q':
+		SceneRoot->SetEnabled(!SceneRoot->IsEnabled());
+		printf("Render queue %s\n", SceneRoot->IsEnabled() ? "on" : "off");
 		break;
 
 	default:
@@ -857,9 +1156,24 @@ void keyboard(unsigned char key, int x, int y)
 }
 
 /**
-* Mouse callback (called when a mouse button state changes)
+* Keyboard callback. Keys are recorded, or ignored while a recording plays
+* (except escape).
 */
-void mouse(int button, int state, int x, int y)
+void keyboard(unsigned char key, int x, int y)
+{
+	if (key != 27)
+	{
+		if (Input.IsPlaying())
+			return;
+		Input.Record(SimulationStep, INPUT_KEY, key, 0, x, y);
+	}
+	handleKey(key);
+}
+
+/**
+* Act on a mouse button state change (from the mouse or a recording).
+*/
+void handleMouse(int button, int state, int x, int y)
 {
 	// On a left button up event MoveAndTurn the view with forward motion
 	if (button == GLUT_LEFT_BUTTON)
@@ -890,11 +1204,26 @@ void mouse(int button, int state, int x, int y)
 	}
 }
 
+/**
+* Mouse callback (called when a mouse button state changes)
+*/
+void mouse(int button, int state, int x, int y)
+{
+	if (Input.IsPlaying())
+		return;
+	Input.Record(SimulationStep, INPUT_MOUSE, button, state, x, y);
+	handleMouse(button, state, x, y);
+}
+
 /**
 * Mouse motion callback (called when mouse button is depressed)
 */
 void mouseMotion(int x, int y)
 {
+	if (Input.IsPlaying())
+		return;
+	Input.Record(SimulationStep, INPUT_MOTION, 0, 0, x, y);
+
 	// Update position used for changing the view and force a new view
 	MouseX = x;
 	MouseY = y;
@@ -909,18 +1238,547 @@ void reshape(int width, int height)
 	RenderWidth = width;
 	RenderHeight = height;
 
+	// The mouse position is relative to the window (the recorded window
+	// while a recording plays)
+	if (!Input.IsPlaying())
+	{
+		InputWidth = width;
+		InputHeight = height;
+		Input.Record(SimulationStep, INPUT_WINDOW, 0, 0, width, height);
+	}
+
 	// Reset the viewport
 	glViewport(0, 0, width, height);
 
 	// Reset the perspective projection to reflect the change of 
-	// the aspect ratio 
+	// the aspect ratio (the height sets the level of detail scale)
+	MyCamera->ChangeViewport(width, height);
+}
+
+/**
+* Run the ball simulation without a window and report the time per frame
+* for increasing numbers of threads. The balls start from the same random
+* state for each run so the final positions should match for all thread counts.
+* @param  frames    Number of frames to step
+* @param  numBalls  Number of balls
+*/
+void RunBenchmark(const unsigned int frames, const unsigned int numBalls)
+{
+	ConstructBoundingPlanes();
+
+	// Thread counts to try: powers of 2 up to the number of hardware threads
+	std::vector<unsigned int> threadCounts;
+	unsigned int maxThreads = MAXV(std::thread::hardware_concurrency(), 1u);
+	for (unsigned int t = 1; t < maxThreads; t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(maxThreads);
+
+	printf("Stepping %u balls for %u frames\n", numBalls, frames);
+	printf("threads   ms/frame   speedup   checksum\n");
+	double baseTime = 0.0;
+	for (unsigned int r = 0; r < threadCounts.size(); r++)
+	{
+		JobSystem jobs(threadCounts[r]);
+		BallSystem* balls = new BallSystem(SimulationRate, numBalls);
+		balls->SetBoundingPlanes(BoundingPlanes);
+		balls->SetJobSystem(&jobs);
+
+		// Fill the room with balls moving in random directions
+		srand(1);
+		for (unsigned int i = 0; i < numBalls; i++)
+		{
+			Point3 position(-95.0f + 190.0f * (float)rand() / (float)RAND_MAX,
+				-95.0f + 190.0f * (float)rand() / (float)RAND_MAX,
+				5.0f + 70.0f * (float)rand() / (float)RAND_MAX);
+			Vector3 direction((float)rand() / (float)RAND_MAX - 0.5f,
+				(float)rand() / (float)RAND_MAX - 0.5f,
+				(float)rand() / (float)RAND_MAX - 0.5f);
+			balls->AddBall(position, direction, ballSpeed, 0.5f);
+		}
+
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (unsigned int f = 0; f < frames; f++)
+		{
+			balls->DetectCollisions();
+			balls->Step();
+			balls->Interpolate(1.0f);
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// Sum the positions so runs can be compared
+		double checksum = 0.0;
+		for (unsigned int i = 0; i < balls->GetCount(); i++)
+		{
+			Point3 p = balls->GetPosition(i);
+			checksum += p.x + p.y + p.z;
+		}
+
+		if (r == 0)
+			baseTime = ms;
+		printf("%7u   %8.3f   %7.2f   %.6f\n", threadCounts[r], ms / frames, baseTime / ms, checksum);
+		delete balls;
+	}
+}
+
+/**
+* Tunnelling stress test. Steps a room of balls moving at 1 to 8 times the
+* normal speed (up to about 10 diameters per step) and checks after every
+* step that no ball has passed through a wall and no two balls overlap.
+* @param  steps     Number of steps
+* @param  numBalls  Number of balls
+* @return  Returns true if no ball escaped or overlapped another.
+*/
+bool RunStressTest(const unsigned int steps, const unsigned int numBalls)
+{
+	ConstructBoundingPlanes();
+
+	const float radius = 0.5f;
+	const float tolerance = 0.01f;
+	JobSystem jobs;
+	BallSystem* balls = new BallSystem(SimulationRate, numBalls);
+	balls->SetBoundingPlanes(BoundingPlanes);
+	balls->SetJobSystem(&jobs);
+
+	// Start the balls at random, distinct points of a lattice (so none
+	// overlap) moving in random directions at random speeds
+	const float spacing = 2.0f;
+	const unsigned int nx = 98, ny = 98, nz = 39;
+	std::vector<bool> used(nx * ny * nz, false);
+	srand(1);
+	for (unsigned int i = 0; i < numBalls && i < used.size(); )
+	{
+		unsigned int site = (unsigned int)(((double)rand() * (RAND_MAX + 1.0) + rand()) /
+			((RAND_MAX + 1.0) * (RAND_MAX + 1.0)) * used.size());
+		if (used[site])
+			continue;
+		used[site] = true;
+		Point3 position(-98.0f + spacing * (site % nx),
+			-98.0f + spacing * ((site / nx) % ny),
+			2.0f + spacing * (site / (nx * ny)));
+		Vector3 direction((float)rand() / (float)RAND_MAX - 0.5f,
+			(float)rand() / (float)RAND_MAX - 0.5f,
+			(float)rand() / (float)RAND_MAX - 0.5f);
+		float speed = ballSpeed * (1.0f + 7.0f * (float)rand() / (float)RAND_MAX);
+		balls->AddBall(position, direction, speed, radius);
+		i++;
+	}
+
+	printf("Stepping %u balls at up to %.1f units per step for %u steps\n",
+		balls->GetCount(), 8.0f * ballSpeed / SimulationRate, steps);
+	unsigned int escaped = 0;
+	unsigned int overlaps = 0;
+	unsigned int limited = 0;
+	unsigned int maxEvents = 0;
+	double events = 0.0;
+	double ms = 0.0;
+	float deepest = 0.0f;
+	CollisionWorld world;
+	world.SetBounds(BoundingPlanes);
+	std::vector<CollisionPair> pairs;
+	for (unsigned int s = 0; s < steps; s++)
+	{
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		balls->DetectCollisions();
+		balls->Step();
+		ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		events += balls->GetEventCount();
+		maxEvents = MAXV(maxEvents, balls->GetEventCount());
+		if (balls->IsEventLimitReached())
+			limited++;
+
+		// Balls through a wall
+		world.Clear();
+		for (unsigned int i = 0; i < balls->GetCount(); i++)
+		{
+			Point3 p = balls->GetPosition(i);
+			float depth = 0.0f;
+			std::vector<Plane>::const_iterator plane = BoundingPlanes.begin();
+			for ( ; plane != BoundingPlanes.end(); plane++)
+				depth = MAXV(depth, radius - plane->Solve(p));
+			if (depth > tolerance)
+				escaped++;
+			deepest = MAXV(deepest, depth);
+			world.Insert(p, 0.0f, radius);
+		}
+
+		// Balls inside each other
+		world.FindPairs(pairs);
+		std::vector<CollisionPair>::const_iterator pair = pairs.begin();
+		for ( ; pair != pairs.end(); pair++)
+		{
+			float depth = 2.0f * radius - (balls->GetPosition(pair->second) - balls->GetPosition(pair->first)).Norm();
+			if (depth > tolerance)
+				overlaps++;
+			deepest = MAXV(deepest, depth);
+		}
+	}
+
+	bool ok = (escaped == 0 && overlaps == 0);
+	printf("%.3f ms/step, %.1f collisions/step (max %u), collision limit reached on %u steps\n",
+		ms / steps, events / steps, maxEvents, limited);
+	printf("Balls through a wall: %u, overlapping pairs: %u, deepest penetration %.4f\n",
+		escaped, overlaps, deepest);
+	printf("%s\n", ok ? "PASSED" : "FAILED");
+	delete balls;
+	return ok;
+}
+
+/**
+* Add the triangles of a teapot-like mesh to a surface: 32 patches (in an
+* 8 x 4 layout so neighboring patches share edge vertices), each split into
+* 2^level x 2^level quads of 2 triangles, as MeshTeapot stores them.
+* @param  surface  Surface to add to (if NULL the vertices are shared with a
+*                  linear search instead, as TriSurface used to)
+* @param  level    Subdivision level
+* @return  Returns the number of distinct vertices.
+*/
+unsigned int AddPatchMesh(TriSurface* surface, const unsigned int level)
+{
+	unsigned int n = 1u << level;
+	std::vector<Point3> vertices;
+	for (unsigned int patch = 0; patch < 32; patch++)
+	{
+		unsigned int px = (patch % 8) * n;
+		unsigned int py = (patch / 8) * n;
+		for (unsigned int i = 0; i < n; i++)
+		{
+			for (unsigned int j = 0; j < n; j++)
+			{
+				float x0 = (float)(px + i) / (float)n;
+				float x1 = (float)(px + i + 1) / (float)n;
+				float y0 = (float)(py + j) / (float)n;
+				float y1 = (float)(py + j + 1) / (float)n;
+				Point3 quad[6] = { Point3(x0, y0, 0.0f), Point3(x1, y0, 0.0f), Point3(x1, y1, 0.0f),
+				                   Point3(x0, y0, 0.0f), Point3(x1, y1, 0.0f), Point3(x0, y1, 0.0f) };
+				if (surface != NULL)
+				{
+					surface->Add(quad[0], quad[1], quad[2]);
+					surface->Add(quad[3], quad[4], quad[5]);
+					continue;
+				}
+
+				// Reference linear search
+				for (unsigned int k = 0; k < 6; k++)
+				{
+					std::vector<Point3>::iterator v = vertices.begin();
+					for ( ; v != vertices.end(); v++)
+						if (*v == quad[k])
+							break;
+					if (v == vertices.end())
+						vertices.push_back(quad[k]);
+				}
+			}
+		}
+	}
+	return (surface != NULL) ? surface->GetVertexCount() : (unsigned int)vertices.size();
+}
+
+/**
+* Teapot that can be built without an OpenGL context, by either method.
+*/
+class BenchmarkTeapot : public MeshTeapot
+{
+public:
+	// Recursive subdivision with averaged vertex normals (as MeshTeapot used to)
+	void Subdivide(const unsigned int level)
+	{
+		subdivide((int)level);
+		VertexNormalBuilder normals;
+		normals.Build(m_vertexList, m_faceList);
+	}
+
+	// Evaluate the patches on a grid
+	void Tessellate(const unsigned int level, JobSystem* jobs)
+	{
+		tessellate(1u << level, jobs);
+	}
+
+	// Recalculate the averaged vertex normals and return the time taken (ms)
+	double TimeNormals(JobSystem* jobs, const NormalWeighting weighting)
+	{
+		std::vector<VertexAndNormal>::iterator v = m_vertexList.begin();
+		for ( ; v != m_vertexList.end(); v++)
+			v->m_normal.Set(0.0f, 0.0f, 0.0f);
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		VertexNormalBuilder normals;
+		normals.SetJobSystem(jobs);
+		normals.SetWeighting(weighting);
+		normals.Build(m_vertexList, m_faceList);
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+};
+
+/**
+* Time building teapot-like meshes with TriSurface::Add for increasing
+* subdivision levels. Does not need an OpenGL context. The linear search
+* that TriSurface used before the vertex hash is timed for comparison at
+* levels where it finishes in reasonable time. Then times building the
+* teapot by recursive subdivision and by evaluating its patches on a grid,
+* and calculating the vertex normals of the grid teapot serially and with
+* the job system.
+* @param  maxLevel  Highest subdivision level
+*/
+void RunMeshBenchmark(const unsigned int maxLevel)
+{
+	printf("level   triangles   vertices    hash ms   linear ms\n");
+	for (unsigned int level = 1; level <= maxLevel; level++)
+	{
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		TriSurface* surface = new TriSurface;
+		unsigned int vertices = AddPatchMesh(surface, level);
+		double hashMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		delete surface;
+
+		unsigned int triangles = 64u << (2 * level);
+		if (level > 5)
+		{
+			printf("%5u   %9u   %8u   %8.2f           -\n", level, triangles, vertices, hashMs);
+			continue;
+		}
+		start = std::chrono::high_resolution_clock::now();
+		AddPatchMesh(NULL, level);
+		double linearMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		printf("%5u   %9u   %8u   %8.2f   %9.2f\n", level, triangles, vertices, hashMs, linearMs);
+	}
+
+	// Teapot by recursive subdivision and by evaluating the patches on a grid
+	JobSystem jobs;
+	printf("\nteapot  vertices   recursive ms    grid ms   grid %u threads ms\n", jobs.GetThreadCount());
+	for (unsigned int level = 1; level <= maxLevel; level++)
+	{
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		BenchmarkTeapot* recursive = new BenchmarkTeapot;
+		recursive->Subdivide(level);
+		double recursiveMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		start = std::chrono::high_resolution_clock::now();
+		BenchmarkTeapot* grid = new BenchmarkTeapot;
+		grid->Tessellate(level, NULL);
+		double gridMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		start = std::chrono::high_resolution_clock::now();
+		BenchmarkTeapot* parallel = new BenchmarkTeapot;
+		parallel->Tessellate(level, &jobs);
+		double parallelMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		printf("%6u  %8u   %12.2f   %8.2f   %17.2f\n", level, grid->GetVertexCount(), recursiveMs, gridMs, parallelMs);
+		delete recursive;
+		delete grid;
+		delete parallel;
+	}
+
+	// Averaged vertex normals of the grid teapot (after one untimed pass, so
+	// every pass starts with the mesh in cache)
+	printf("\nnormals  triangles   serial ms   %u threads ms   speedup   angle-weighted ms\n", jobs.GetThreadCount());
+	for (unsigned int level = 1; level <= maxLevel; level++)
+	{
+		BenchmarkTeapot* teapot = new BenchmarkTeapot;
+		teapot->Tessellate(level, &jobs);
+		teapot->TimeNormals(NULL, NORMALS_EQUAL);
+		double serialMs   = teapot->TimeNormals(NULL, NORMALS_EQUAL);
+		double parallelMs = teapot->TimeNormals(&jobs, NORMALS_EQUAL);
+		double angleMs    = teapot->TimeNormals(&jobs, NORMALS_ANGLE);
+		printf("%7u  %9u   %9.2f   %13.2f   %6.2fx   %17.2f\n", level, teapot->GetTriangleCount(),
+		       serialMs, parallelMs, serialMs / parallelMs, angleMs);
+		delete teapot;
+	}
+}
+
+/**
+* Render the scene with the CPU ray tracer and write it to an image file
+* (.ppm, or any format DevIL can write such as .png).
+* @param  fname   Output file name
+* @param  width   Image width
+* @param  height  Image height
+* @return  Returns true if the image was written.
+*/
+bool RenderTrace(const char* fname, const unsigned int width, const unsigned int height)
+{
 	MyCamera->ChangeAspectRatio((float)width / (float)height);
+
+	RayTracer tracer(width, height);
+	tracer.SetJobSystem(Jobs);
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	if (!tracer.Render(SceneRoot))
+	{
+		printf("RenderTrace: Scene has no camera\n");
+		return false;
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("Traced %u triangles at %ux%u in %.1f ms\n", tracer.GetTraceState().GetTriangleCount(),
+		width, height, ms);
+	return tracer.Save(fname);
 }
 
 /**
-* Main	
+* Construct the scene for the ray tracer regression check: a checkered floor,
+* a sphere with a clamped gradient texture and a torus, lit by a point
+* light, a directional light and a spotlight. The textures are generated, so
+* the traced image depends only on the scene and tracer code.
+* @param  width   Image width
+* @param  height  Image height
+* @return  Returns the scene root.
 */
-int main(int argc, char** argv)
+SceneNode* ConstructTraceCheckScene(const unsigned int width, const unsigned int height)
+{
+	// Tracing needs no shader locations
+	LightingShaderNode* shader = new LightingShaderNode();
+	shader->SetGlobalAmbient(Color4(0.2f, 0.2f, 0.2f, 1.0f));
+
+	CameraNode* camera = new CameraNode;
+	camera->SetPosition(Point3(0.0f, -60.0f, 25.0f));
+	camera->SetLookAtPt(Point3(0.0f, 0.0f, 5.0f));
+	camera->SetViewUp(Vector3(0.0, 0.0, 1.0));
+	camera->SetPerspective(50.0, (float)width / (float)height, 1.0, 300.0);
+
+	LightNode* light0 = new LightNode(0);
+	light0->SetDiffuse(Color4(0.6f, 0.6f, 0.6f, 1.0f));
+	light0->SetSpecular(Color4(0.6f, 0.6f, 0.6f, 1.0f));
+	light0->SetPosition(HPoint3(-30.0f, -30.0f, 40.0f, 1.0f));
+	light0->SetAttenuation(1.0f, 0.005f, 0.0f);
+	light0->Enable();
+
+	LightNode* light1 = new LightNode(1);
+	light1->SetDiffuse(Color4(0.4f, 0.4f, 0.3f, 1.0f));
+	light1->SetSpecular(Color4(0.3f, 0.3f, 0.3f, 1.0f));
+	light1->SetPosition(HPoint3(1.0f, -0.5f, 1.0f, 0.0f));
+	light1->Enable();
+
+	LightNode* spot = new LightNode(2);
+	spot->SetDiffuse(Color4(0.5f, 0.2f, 0.2f, 1.0f));
+	spot->SetSpecular(Color4(0.5f, 0.2f, 0.2f, 1.0f));
+	spot->SetPosition(HPoint3(20.0f, -20.0f, 50.0f, 1.0f));
+	spot->SetSpotlight(Vector3(-0.3f, 0.3f, -1.0f), 8.0f, 25.0f);
+	spot->Enable();
+
+	// 64 x 64 texel checkerboard with 8 x 8 texel squares, and a gradient.
+	// The sphere's texture coordinates are latitude and longitude in radians,
+	// so it is turned to show the gradient in front with clamped texels around it.
+	const unsigned int size = 64;
+	std::vector<unsigned char> checker(size * size * 4);
+	std::vector<unsigned char> gradient(size * size * 4);
+	for (unsigned int j = 0; j < size; j++)
+	{
+		for (unsigned int i = 0; i < size; i++)
+		{
+			unsigned char* c = &checker[(j * size + i) * 4];
+			unsigned char v = (((i / 8) + (j / 8)) % 2 == 0) ? 230 : 60;
+			c[0] = v;
+			c[1] = v;
+			c[2] = v;
+			c[3] = 255;
+			unsigned char* g = &gradient[(j * size + i) * 4];
+			g[0] = (unsigned char)(255 * i / (size - 1));
+			g[1] = (unsigned char)(255 * j / (size - 1));
+			g[2] = 128;
+			g[3] = 255;
+		}
+	}
+
+	PresentationNode* floorMaterial = new PresentationNode;
+	floorMaterial->SetTexture(&checker[0], size, size, GL_REPEAT, GL_REPEAT, GL_LINEAR, GL_LINEAR, GL_TEXTURE0 + 1);
+	floorMaterial->SetMaterialAmbientAndDiffuse(Color4(0.8f, 0.8f, 0.8f));
+	floorMaterial->SetMaterialSpecular(Color4(0.2f, 0.2f, 0.2f));
+	floorMaterial->SetMaterialShininess(8.0f);
+	TransformNode* floorTransform = new TransformNode;
+	floorTransform->Scale(100.0f, 100.0f, 1.0f);
+
+	PresentationNode* sphereMaterial = new PresentationNode;
+	sphereMaterial->SetTexture(&gradient[0], size, size, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_LINEAR, GL_LINEAR,
+		GL_TEXTURE0 + 2);
+	sphereMaterial->SetMaterialAmbientAndDiffuse(Color4(0.9f, 0.9f, 0.9f));
+	sphereMaterial->SetMaterialSpecular(Color4(0.8f, 0.8f, 0.8f));
+	sphereMaterial->SetMaterialShininess(32.0f);
+	TransformNode* sphereTransform = new TransformNode;
+	sphereTransform->Translate(-12.0f, 5.0f, 10.0f);
+	sphereTransform->Rotate(-120.0f, 0.0f, 0.0f, 1.0f);
+	sphereTransform->Scale(10.0f, 10.0f, 10.0f);
+
+	PresentationNode* torusMaterial = new PresentationNode;
+	torusMaterial->SetMaterialAmbientAndDiffuse(Color4(0.2f, 0.5f, 0.8f));
+	torusMaterial->SetMaterialSpecular(Color4(0.9f, 0.9f, 0.9f));
+	torusMaterial->SetMaterialShininess(64.0f);
+	TransformNode* torusTransform = new TransformNode;
+	torusTransform->Translate(14.0f, 10.0f, 6.0f);
+	torusTransform->Rotate(60.0f, 1.0f, 0.0f, 0.0f);
+
+	shader->AddChild(camera);
+	camera->AddChild(light0);
+	light0->AddChild(light1);
+	light1->AddChild(spot);
+	AddSubTree(spot, floorMaterial, floorTransform, new UnitSquareSurface(8, -1, -1, -1));
+	AddSubTree(spot, sphereMaterial, sphereTransform,
+		new SphereSection(-90.0f, 90.0f, 18, -180.0f, 180.0f, 36, 1.0f, -1, -1, -1));
+	AddSubTree(spot, torusMaterial, torusTransform, new TorusSurface(10.0f, 3.0f, 24, 24, -1, -1, -1));
+	return shader;
+}
+
+/**
+* Ray tracer regression check. Traces the check scene (see
+* ConstructTraceCheckScene) and compares it with a golden image. A pixel
+* differs if any channel differs by more than a tolerance, which absorbs
+* rounding differences between compilers and SIMD paths. The check fails if
+* the sizes differ or more than 0.5% of the pixels differ (edge pixels may
+* flip between objects).
+* @param  golden  Golden image (binary PPM)
+* @param  write   Write the golden image instead of comparing with it
+* @return  Returns true if the image matches (or was written).
+*/
+bool RunTraceCheck(const char* golden, const bool write)
+{
+	const unsigned int width = 160;
+	const unsigned int height = 120;
+	const int tolerance = 8;
+	SceneNode* root = ConstructTraceCheckScene(width, height);
+	JobSystem jobs;
+	RayTracer tracer(width, height);
+	tracer.SetJobSystem(&jobs);
+	bool ok = tracer.Render(root);
+	delete root;
+	if (!ok)
+		return false;
+	if (write)
+	{
+		printf("Writing %s (%u triangles)\n", golden, tracer.GetTraceState().GetTriangleCount());
+		return tracer.SavePPM(golden);
+	}
+
+	unsigned int goldenWidth, goldenHeight;
+	std::vector<unsigned char> pixels;
+	if (!RayTracer::LoadPPM(golden, goldenWidth, goldenHeight, pixels))
+		return false;
+	if (goldenWidth != width || goldenHeight != height)
+	{
+		printf("%s is %ux%u, expected %ux%u\nFAILED\n", golden, goldenWidth, goldenHeight, width, height);
+		return false;
+	}
+	const std::vector<unsigned char>& traced = tracer.GetPixels();
+	unsigned int differing = 0;
+	int maxDifference = 0;
+	for (unsigned int i = 0; i < width * height; i++)
+	{
+		int difference = 0;
+		for (unsigned int c = 0; c < 3; c++)
+			difference = MAXV(difference, abs((int)traced[i * 3 + c] - (int)pixels[i * 3 + c]));
+		if (difference > tolerance)
+			differing++;
+		maxDifference = MAXV(maxDifference, difference);
+	}
+	ok = (differing * 200 <= width * height);
+	printf("Pixels differing from %s by more than %d: %u of %u (largest difference %d)\n%s\n", golden,
+		tolerance, differing, width * height, maxDifference, ok ? "PASSED" : "FAILED");
+	return ok;
+}
+
+/**
+* Print the keyboard commands and create the window with an OpenGL 3.3 core
+* profile context.
+* @param  argc  Argument count (passed to glutInit)
+* @param  argv  Arguments
+* @return  Returns true if the window and context were created.
+*/
+bool InitializeWindow(int& argc, char** argv)
 {
 	// Print the keyboard commands
 	printf("i - Reset to initial view\n");
@@ -931,11 +1789,16 @@ int main(int argc, char** argv)
 	printf("Y - Slide camera up               y - Slide camera down\n");
 	printf("F - Move camera forward           f - Move camera backwards\n");
 	printf("V - Faster mouse movement         v - Slower mouse movement\n");
+	printf("m - Print matrix cache, triangle, culling, state change and GL state cache statistics for the last frame\n");
+	printf("c - Toggle view frustum culling\n");
+	printf("q - Toggle drawing from the render queue\n");
+	printf("g - Toggle the GL state cache (drops redundant state changes and uniform updates)\n");
+	printf("t - Print frame time percentiles and CPU/GPU zone times   T - Write them as a Chrome trace\n");
 	printf("s - Shoot Balls --- Use Number keys [0-9] to set the number of balls to shoot at one time.\n\n\n");
 
 	// Initialize free GLUT
 	glutInit(&argc, argv);
-	glutInitContextVersion(3, 2);
+	glutInitContextVersion(3, 3);
 	//glutInitContextFlags(GLUT_FORWARD_COMPATIBLE);  // Using this causes LineWidth to error
 	glutInitContextProfile(GLUT_CORE_PROFILE);
 
@@ -952,19 +1815,137 @@ int main(int argc, char** argv)
 	glutMotionFunc(mouseMotion);
 	glutKeyboardFunc(keyboard);
 
-	/* initialize random seed: */
-	srand(time(NULL));
-
-	// Initialize Open 3.2 core profile
+	// Initialize OpenGL 3.3 core profile
 	if (gl3wInit()) {
 		fprintf(stderr, "gl3wInit: failed to initialize OpenGL\n");
-		return -1;
+		return false;
 	}
-	if (!gl3wIsSupported(3, 2)) {
-		fprintf(stderr, "OpenGL 3.2 not supported\n");
-		return -1;
+	if (!gl3wIsSupported(3, 3)) {
+		fprintf(stderr, "OpenGL 3.3 not supported\n");
+		return false;
 	}
 	printf("OpenGL %s, GLSL %s\n", glGetString(GL_VERSION), glGetString(GL_SHADING_LANGUAGE_VERSION));
+	return true;
+}
+
+/**
+* Main	
+*/
+int main(int argc, char** argv)
+{
+	// Headless benchmark: Final -bench <frames> [-balls <n>]
+	// Tunnelling stress test: Final -stress <steps> [-balls <n>]
+	// Ray traced image of the initial view: Final -trace <file> [-size <width> <height>]
+	// Ray tracer regression check: Final -tracecheck <golden.ppm>
+	//                              (Final -tracegolden <golden.ppm> writes it)
+	// Mesh construction benchmark: Final -meshbench <max level>
+	// Offscreen rendering: Final -headless <frames> [-size <width> <height>]
+	//                      [-dump <prefix>] [-every <n>] [-timings <file>]
+	//                      [-profile <trace file>] [-fps <frames per second>]
+	// Record input: Final -record <file> [-seed <n>] (window or headless)
+	// Play back input: Final -replay <file> (window, or headless with enough frames)
+	unsigned int benchFrames = 0;
+	unsigned int stressSteps = 0;
+	unsigned int benchBalls = 20000;
+	unsigned int meshBenchLevels = 0;
+	const char* traceFile = NULL;
+	const char* traceCheckFile = NULL;
+	bool writeGolden = false;
+	unsigned int traceWidth = 640;
+	unsigned int traceHeight = 480;
+	unsigned int seed = (unsigned int)time(NULL);
+	const char* recordFile = NULL;
+	const char* replayFile = NULL;
+	for (int i = 1; i < argc - 1; i++)
+	{
+		if (strcmp(argv[i], "-bench") == 0)
+			benchFrames = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "-stress") == 0)
+			stressSteps = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "-balls") == 0)
+			benchBalls = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "-meshbench") == 0)
+			meshBenchLevels = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "-trace") == 0)
+			traceFile = argv[++i];
+		else if (strcmp(argv[i], "-tracecheck") == 0 || strcmp(argv[i], "-tracegolden") == 0)
+		{
+			writeGolden = (strcmp(argv[i], "-tracegolden") == 0);
+			traceCheckFile = argv[++i];
+		}
+		else if (strcmp(argv[i], "-profile") == 0)
+			ProfileFile = argv[++i];
+		else if (strcmp(argv[i], "-fps") == 0)
+			HeadlessFrameRate = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "-seed") == 0)
+			seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-record") == 0)
+			recordFile = argv[++i];
+		else if (strcmp(argv[i], "-replay") == 0)
+			replayFile = argv[++i];
+		else if (strcmp(argv[i], "-size") == 0 && i < argc - 2)
+		{
+			traceWidth = (unsigned int)atoi(argv[++i]);
+			traceHeight = (unsigned int)atoi(argv[++i]);
+		}
+	}
+	if (benchFrames > 0)
+	{
+		RunBenchmark(benchFrames, benchBalls);
+		return 0;
+	}
+	if (stressSteps > 0)
+		return RunStressTest(stressSteps, benchBalls) ? 0 : 1;
+	if (traceCheckFile != NULL)
+		return RunTraceCheck(traceCheckFile, writeGolden) ? 0 : 1;
+	if (meshBenchLevels > 0)
+	{
+		RunMeshBenchmark(meshBenchLevels);
+		return 0;
+	}
+
+	// Trace the scene to an image instead of running interactively. The
+	// ray tracer needs no OpenGL context.
+	if (traceFile != NULL)
+	{
+		ilInit();
+		Jobs = new JobSystem;
+		ConstructScene(false);
+		return RenderTrace(traceFile, traceWidth, traceHeight) ? 0 : -1;
+	}
+
+	OffscreenRenderer offscreen;
+	if (offscreen.ParseArguments(argc, argv))
+	{
+		if (!offscreen.CreateContext(argc, argv, "Final", 3, 3))
+			return -1;
+	}
+	else
+	{
+		if (!InitializeWindow(argc, argv))
+			return -1;
+	}
+
+	// Play back a recording with the seed it was made with, or record
+	// this run. Random numbers that change the simulation come from the seed.
+	if (replayFile != NULL)
+	{
+		if (!Input.StartPlaying(replayFile))
+			return -1;
+		seed = Input.GetSeed();
+		printf("Playing %s: %u steps, seed %u\n", replayFile, Input.GetEndStep(), seed);
+		if (Input.GetStepRate() != SimulationRate)
+			printf("Recorded at %.1f steps per second (now %.1f) - playback will differ\n",
+				Input.GetStepRate(), SimulationRate);
+	}
+	else if (recordFile != NULL)
+	{
+		if (!Input.StartRecording(recordFile, seed, SimulationRate))
+			return -1;
+		atexit(stopRecording);
+		printf("Recording input to %s, seed %u\n", recordFile, seed);
+	}
+	ShotRandom.Seed(seed);
 
 	// Set the clear color to black
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -975,9 +1956,6 @@ int main(int argc, char** argv)
 	// Enable the depth buffer
 	glEnable(GL_DEPTH_TEST);
 
-	// set static update interval
-	glutTimerFunc((int)(1000.0f / FrameRate), timerFunction, 0);
-
 	// Enable back face polygon removal
 	glFrontFace(GL_CCW);
 	glCullFace(GL_BACK);
@@ -987,7 +1965,39 @@ int main(int argc, char** argv)
 	glEnable(GL_MULTISAMPLE);
 
 	// Construct scene
-	ConstructScene();
+	Jobs = new JobSystem;
+	ConstructScene(true);
+
+	// Drop program, vertex array and uniform calls that would not change anything
+	MySceneState.m_glState.SetEnabled(true);
+
+	// Time collisions, movement and drawing of each frame
+	CollisionZone = Profile.AddZone("Collision");
+	PhysicsZone   = Profile.AddZone("Physics");
+	DrawZone      = Profile.AddZone("Draw", true);
+	Profile.NextFrame();
+
+	// Render frames offscreen instead of running interactively. Print the
+	// profiler summary and write the trace at the end.
+	if (offscreen.IsEnabled())
+	{
+		bool ok = offscreen.Run(reshape, updateHeadlessFrame, drawHeadlessFrame);
+		printf("Simulation steps: %u (%u dropped)\n", Simulation.GetStepCount(), Simulation.GetDroppedStepCount());
+		stopRecording();
+		if (Input.IsPlaying())
+		{
+			printf("Replay stopped at step %u of %u - render more frames\n", SimulationStep, Input.GetEndStep());
+			ok = false;
+		}
+		Profile.PrintSummary();
+		ok = Profile.WriteChromeTrace(ProfileFile) && ok;
+		return (ok && ReplayMatched) ? 0 : -1;
+	}
+
+	// Draw continuously. The simulation catches up on the time since the
+	// last frame before each frame is drawn.
+	Simulation.Reset();
+	glutIdleFunc(idle);
 
 	glutMainLoop();
 	return 0;
@@ -0,0 +1,137 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    FixedTimestep.h
+//	Purpose: Accumulator that converts elapsed time into a whole number of
+//          fixed simulation steps.
+//
+//============================================================================
+
+#ifndef __FIXEDTIMESTEP_H
+#define __FIXEDTIMESTEP_H
+
+#include <chrono>
+#include <math.h>
+
+/**
+ * Fixed timestep. Each rendered frame adds the time elapsed since the last
+ * frame to an accumulator and takes out as many whole steps as it holds, so
+ * the simulation runs at the step rate whatever the render rate. The time
+ * left over (less than one step) gives the fraction of the way from the
+ * previous simulation state to the current one, used to draw between them.
+ *
+ * At most maxSteps steps are taken in one frame. If more time than that has
+ * built up (a slow frame, or the program was paused) the extra whole steps
+ * are dropped, so under load the simulation slows to maxSteps steps per
+ * frame instead of falling further behind each frame.
+ */
+class FixedTimestep
+{
+public:
+   /**
+    * Constructor given the number of steps per second and the most steps
+    * to take in one frame.
+    * @param  stepRate  Simulation steps per second
+    * @param  maxSteps  Maximum steps per frame
+    */
+   FixedTimestep(const float stepRate, const unsigned int maxSteps)
+   {
+      m_step     = 1.0 / stepRate;
+      m_maxSteps = maxSteps;
+      Reset();
+   }
+
+   /**
+    * Empty the accumulator, restart the clock and reset the statistics.
+    */
+   void Reset()
+   {
+      m_accumulator  = 0.0;
+      m_steps        = 0;
+      m_droppedSteps = 0;
+      m_lastTime     = std::chrono::high_resolution_clock::now();
+   }
+
+   /**
+    * Add the wall clock time since the last call (or Reset) and take out the
+    * steps to run this frame.
+    * @return  Returns the number of steps to run.
+    */
+   unsigned int Advance()
+   {
+      std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+      double elapsed = std::chrono::duration<double>(now - m_lastTime).count();
+      m_lastTime = now;
+      return Advance(elapsed);
+   }
+
+   /**
+    * Add a given time and take out the steps to run this frame. Used to run
+    * the simulation on simulated rather than wall clock time.
+    * @param  seconds  Time to add
+    * @return  Returns the number of steps to run.
+    */
+   unsigned int Advance(const double seconds)
+   {
+      m_accumulator += seconds;
+      double whole = floor(m_accumulator / m_step);
+      unsigned int steps = (whole < (double)m_maxSteps) ? (unsigned int)whole : m_maxSteps;
+      if ((double)steps < whole)
+         m_droppedSteps += (unsigned int)whole - steps;
+
+      // Keep only the fraction of a step (dropped steps are discarded)
+      m_accumulator -= whole * m_step;
+      m_steps += steps;
+      return steps;
+   }
+
+   /**
+    * Get the fraction of a step left in the accumulator. Draw the simulation
+    * this far from the previous state to the current state.
+    * @return  Returns the interpolation factor [0, 1).
+    */
+   float GetAlpha() const
+   {
+      return (float)(m_accumulator / m_step);
+   }
+
+   /**
+    * Get the length of a step.
+    * @return  Returns the step length in seconds.
+    */
+   double GetStep() const
+   {
+      return m_step;
+   }
+
+   /**
+    * Get the number of steps taken since Reset.
+    * @return  Returns the step count.
+    */
+   unsigned int GetStepCount() const
+   {
+      return m_steps;
+   }
+
+   /**
+    * Get the number of steps dropped (because a frame would have taken more
+    * than the maximum) since Reset.
+    * @return  Returns the dropped step count.
+    */
+   unsigned int GetDroppedStepCount() const
+   {
+      return m_droppedSteps;
+   }
+
+protected:
+   double       m_step;           // Step length (seconds)
+   unsigned int m_maxSteps;       // Maximum steps per frame
+   double       m_accumulator;    // Time not yet simulated (seconds)
+   unsigned int m_steps;          // Steps taken since Reset
+   unsigned int m_droppedSteps;   // Steps dropped since Reset
+   std::chrono::high_resolution_clock::time_point m_lastTime;   // Time of the last Advance
+};
+
+#endif
@@ -0,0 +1,378 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    InputRecorder.h
+//	Purpose: Records the input that drives a simulation to a compact binary
+//          file and plays it back at the same simulation steps.
+//
+//============================================================================
+
+#ifndef __INPUTRECORDER_H
+#define __INPUTRECORDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Kinds of recorded input.
+ */
+enum InputType
+{
+   INPUT_KEY    = 1,    // Key press: code = key
+   INPUT_MOUSE  = 2,    // Mouse button: code = button, state = up/down, x, y
+   INPUT_MOTION = 3,    // Mouse motion: x, y
+   INPUT_WINDOW = 4,    // Window size the mouse position is relative to: x = width, y = height
+   INPUT_END    = 5     // End of the recording (step count and state checksum)
+};
+
+/**
+ * One recorded input, applied before the given simulation step.
+ */
+struct InputEvent
+{
+   uint32_t step;       // Simulation steps taken before the input
+   uint8_t  type;       // InputType
+   uint8_t  code;       // Key or mouse button
+   uint8_t  state;      // Mouse button state
+   int16_t  x;          // Mouse position or window width
+   int16_t  y;          // Mouse position or window height
+};
+
+/**
+ * Input recorder. While recording, each input the application receives is
+ * written with the number of simulation steps taken so far. A simulation
+ * that only changes at steps and draws its random numbers from the seed
+ * stored in the file can then be run again exactly: playback hands back
+ * each input before the step it was recorded at. The recording ends with
+ * the step count and a checksum of the simulation state, so playback can
+ * check that it reached the same state.
+ *
+ * File layout (little endian): a 16 byte header ("BREC", version, seed,
+ * step rate) followed by 12 byte events (step, type, code, state, unused
+ * byte, x, y). The last event is INPUT_END, followed by the 8 byte checksum.
+ */
+class InputRecorder
+{
+public:
+   /**
+    * Constructor. Neither recording nor playing.
+    */
+   InputRecorder()
+   {
+      m_file     = NULL;
+      m_playing  = false;
+      m_next     = 0;
+      m_seed     = 0;
+      m_stepRate = 0.0f;
+      m_endStep  = 0;
+      m_checksum = 0;
+      m_complete = false;
+   }
+
+   /**
+    * Destructor. Closes a recording without an end event.
+    */
+   ~InputRecorder()
+   {
+      if (m_file != NULL)
+         fclose(m_file);
+   }
+
+   /**
+    * Start recording to a file.
+    * @param  filename  File to write
+    * @param  seed      Seed of the simulation's random numbers
+    * @param  stepRate  Simulation steps per second
+    * @return  Returns true if the file was opened.
+    */
+   bool StartRecording(const char* filename, const unsigned int seed, const float stepRate)
+   {
+      m_file = fopen(filename, "wb");
+      if (m_file == NULL)
+      {
+         fprintf(stderr, "InputRecorder: could not open %s\n", filename);
+         return false;
+      }
+      m_seed     = seed;
+      m_stepRate = stepRate;
+
+      uint8_t header[HEADER_SIZE] = { 'B', 'R', 'E', 'C' };
+      put32(header + 4, VERSION);
+      put32(header + 8, seed);
+      put32(header + 12, floatBits(stepRate));
+      fwrite(header, 1, HEADER_SIZE, m_file);
+      return true;
+   }
+
+   /**
+    * Check whether input is being recorded.
+    * @return  Returns true if recording.
+    */
+   bool IsRecording() const
+   {
+      return m_file != NULL;
+   }
+
+   /**
+    * Record an input.
+    * @param  step   Simulation steps taken so far
+    * @param  type   Kind of input
+    * @param  code   Key or mouse button
+    * @param  state  Mouse button state
+    * @param  x      Mouse position or window width
+    * @param  y      Mouse position or window height
+    */
+   void Record(const unsigned int step, const InputType type, const unsigned int code,
+               const unsigned int state, const int x, const int y)
+   {
+      if (m_file == NULL)
+         return;
+
+      uint8_t record[EVENT_SIZE];
+      put32(record, step);
+      record[4] = (uint8_t)type;
+      record[5] = (uint8_t)code;
+      record[6] = (uint8_t)state;
+      record[7] = 0;
+      put16(record + 8, (uint16_t)(int16_t)x);
+      put16(record + 10, (uint16_t)(int16_t)y);
+      fwrite(record, 1, EVENT_SIZE, m_file);
+   }
+
+   /**
+    * End the recording, writing the step count and a checksum of the
+    * simulation state, and close the file.
+    * @param  step      Simulation steps taken
+    * @param  checksum  Checksum of the simulation state
+    */
+   void StopRecording(const unsigned int step, const uint64_t checksum)
+   {
+      if (m_file == NULL)
+         return;
+
+      Record(step, INPUT_END, 0, 0, 0, 0);
+      uint8_t bits[8];
+      put32(bits, (uint32_t)checksum);
+      put32(bits + 4, (uint32_t)(checksum >> 32));
+      fwrite(bits, 1, 8, m_file);
+      fclose(m_file);
+      m_file     = NULL;
+      m_endStep  = step;
+      m_checksum = checksum;
+   }
+
+   /**
+    * Load a recording to play back.
+    * @param  filename  File to read
+    * @return  Returns true if the file is a recording. A recording that was
+    *          cut short (no end event) plays back but cannot be checked.
+    */
+   bool StartPlaying(const char* filename)
+   {
+      FILE* f = fopen(filename, "rb");
+      if (f == NULL)
+      {
+         fprintf(stderr, "InputRecorder: could not open %s\n", filename);
+         return false;
+      }
+
+      uint8_t header[HEADER_SIZE];
+      if (fread(header, 1, HEADER_SIZE, f) != HEADER_SIZE ||
+          header[0] != 'B' || header[1] != 'R' || header[2] != 'E' || header[3] != 'C' ||
+          get32(header + 4) != VERSION)
+      {
+         fprintf(stderr, "InputRecorder: %s is not a recording\n", filename);
+         fclose(f);
+         return false;
+      }
+      m_seed     = get32(header + 8);
+      m_stepRate = bitsFloat(get32(header + 12));
+
+      m_events.clear();
+      m_complete = false;
+      m_endStep  = 0;
+      uint8_t record[EVENT_SIZE];
+      while (fread(record, 1, EVENT_SIZE, f) == EVENT_SIZE)
+      {
+         InputEvent e;
+         e.step  = get32(record);
+         e.type  = record[4];
+         e.code  = record[5];
+         e.state = record[6];
+         e.x     = (int16_t)get16(record + 8);
+         e.y     = (int16_t)get16(record + 10);
+         m_endStep = e.step;
+         if (e.type == INPUT_END)
+         {
+            uint8_t bits[8];
+            if (fread(bits, 1, 8, f) == 8)
+            {
+               m_checksum = (uint64_t)get32(bits) | ((uint64_t)get32(bits + 4) << 32);
+               m_complete = true;
+            }
+            break;
+         }
+         m_events.push_back(e);
+      }
+      fclose(f);
+
+      m_next    = 0;
+      m_playing = true;
+      return true;
+   }
+
+   /**
+    * Check whether a recording is playing.
+    * @return  Returns true if playing.
+    */
+   bool IsPlaying() const
+   {
+      return m_playing;
+   }
+
+   /**
+    * Stop playing (e.g. once the end of the recording is reached).
+    */
+   void StopPlaying()
+   {
+      m_playing = false;
+   }
+
+   /**
+    * Get the next recorded input due at a step. Call repeatedly before each
+    * step until it returns false.
+    * @param  step  Simulation steps taken so far
+    * @param  e     (OUT) Input
+    * @return  Returns true if an input is due.
+    */
+   bool Next(const unsigned int step, InputEvent& e)
+   {
+      if (!m_playing || m_next >= m_events.size() || m_events[m_next].step > step)
+         return false;
+      e = m_events[m_next++];
+      return true;
+   }
+
+   /**
+    * Get the seed of the simulation's random numbers.
+    * @return  Returns the seed.
+    */
+   unsigned int GetSeed() const
+   {
+      return m_seed;
+   }
+
+   /**
+    * Get the simulation step rate the recording was made at.
+    * @return  Returns steps per second.
+    */
+   float GetStepRate() const
+   {
+      return m_stepRate;
+   }
+
+   /**
+    * Get the number of steps in the recording (the step of the last input
+    * if the recording has no end event).
+    * @return  Returns the step count.
+    */
+   unsigned int GetEndStep() const
+   {
+      return m_endStep;
+   }
+
+   /**
+    * Check whether the recording has an end event with a checksum.
+    * @return  Returns true if the recording is complete.
+    */
+   bool IsComplete() const
+   {
+      return m_complete;
+   }
+
+   /**
+    * Get the checksum of the simulation state at the end of the recording.
+    * @return  Returns the checksum.
+    */
+   uint64_t GetChecksum() const
+   {
+      return m_checksum;
+   }
+
+   /**
+    * Add data to a checksum (64 bit FNV-1a).
+    * @param  data  Data
+    * @param  size  Size of the data (bytes)
+    * @param  hash  Checksum so far (start with CHECKSUM_START)
+    * @return  Returns the new checksum.
+    */
+   static uint64_t Checksum(const void* data, const unsigned int size, uint64_t hash)
+   {
+      const uint8_t* bytes = (const uint8_t*)data;
+      for (unsigned int i = 0; i < size; i++)
+      {
+         hash ^= bytes[i];
+         hash *= 1099511628211ull;
+      }
+      return hash;
+   }
+
+   // Starting value for Checksum
+   static const uint64_t CHECKSUM_START = 14695981039346656037ull;
+
+protected:
+   static const unsigned int VERSION     = 1;
+   static const unsigned int HEADER_SIZE = 16;
+   static const unsigned int EVENT_SIZE  = 12;
+
+   FILE*                   m_file;       // Recording file (NULL if not recording)
+   bool                    m_playing;    // A recording is playing
+   std::vector<InputEvent> m_events;     // Inputs being played
+   unsigned int            m_next;       // Next input to play
+   unsigned int            m_seed;       // Seed of the random numbers
+   float                   m_stepRate;   // Simulation steps per second
+   unsigned int            m_endStep;    // Steps in the recording
+   uint64_t                m_checksum;   // State checksum at the end
+   bool                    m_complete;   // The recording has an end event
+
+   // Write and read little endian values
+   static void put16(uint8_t* p, const uint16_t v)
+   {
+      p[0] = (uint8_t)v;
+      p[1] = (uint8_t)(v >> 8);
+   }
+   static void put32(uint8_t* p, const uint32_t v)
+   {
+      p[0] = (uint8_t)v;
+      p[1] = (uint8_t)(v >> 8);
+      p[2] = (uint8_t)(v >> 16);
+      p[3] = (uint8_t)(v >> 24);
+   }
+   static uint16_t get16(const uint8_t* p)
+   {
+      return (uint16_t)(p[0] | (p[1] << 8));
+   }
+   static uint32_t get32(const uint8_t* p)
+   {
+      return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+   }
+
+   // Bits of a float (and back)
+   static uint32_t floatBits(const float f)
+   {
+      union { float f; uint32_t u; } v;
+      v.f = f;
+      return v.u;
+   }
+   static float bitsFloat(const uint32_t u)
+   {
+      union { float f; uint32_t u; } v;
+      v.u = u;
+      return v.f;
+   }
+};
+
+#endif
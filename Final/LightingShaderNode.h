@@ -14,7 +14,7 @@
 #define __LIGHTINGSHADERNODE_H
 
 #include <vector>
-#include "scene/scene.h"
+#include "Scene/Scene.h"
 
 /**
  * Offset line shader node.
@@ -22,6 +22,15 @@
 class LightingShaderNode: public ShaderNode
 {
 public:
+   /**
+    * Constructor. Locations are -1 until GetLocations is called.
+    */
+   LightingShaderNode()
+   {
+      m_positionLoc = m_vertexNormalLoc = m_modelMatrixLoc = m_normalMatrixLoc = -1;
+      m_textureLoc = m_vTexCoordLoc = m_instanceMatrixLoc = m_instancedLoc = -1;
+   }
+
    /**
     * Gets uniform and attribute locations.
     */
@@ -49,12 +58,9 @@ public:
 		  return false;
 	  }
 
-      m_globalAmbientLoc = glGetUniformLocation(m_shaderProgram.GetProgram(), "globalLightAmbient");
-      if (m_globalAmbientLoc < 0)
-      {
-         printf("LightingShaderNode: Error getting global ambient location\n");
-         return false;
-      }
+      // Instancing support is optional
+      m_instanceMatrixLoc = glGetAttribLocation(m_shaderProgram.GetProgram(), "instanceMatrix");
+      m_instancedLoc = glGetUniformLocation(m_shaderProgram.GetProgram(), "instanced");
 
 	  m_textureLoc = glGetUniformLocation(m_shaderProgram.GetProgram(), "texture");
 	  if (m_textureLoc < 0)
@@ -63,59 +69,18 @@ public:
 		  return false;
 	  }
 
-      // Set the number of lights to 3
-      numLights = 3;
-      m_numLightsLoc = glGetUniformLocation(m_shaderProgram.GetProgram(), "numLights");
-      if (m_numLightsLoc < 0)
+      // Camera, lights and material uniforms are in uniform blocks
+      if (!BindUniformBlock("Camera", CAMERA_BLOCK_BINDING) ||
+          !BindUniformBlock("Lights", LIGHTS_BLOCK_BINDING) ||
+          !BindUniformBlock("Material", MATERIAL_BLOCK_BINDING))
       {
-         printf("LightingShaderNode: Error getting numLightsLoc location\n");
+         printf("LightingShaderNode: Error getting uniform block index\n");
          return false;
       }
 
-      // Get light uniforms
-      char name[128];
-      for (int i = 0; i < numLights; i++)
-      {
-         sprintf(name, "lights[%d].enabled", i);
-         m_lights[i].enabled = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-         sprintf(name, "lights[%d].spotlight", i);
-         m_lights[i].spotlight = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-         sprintf(name, "lights[%d].position", i);
-         m_lights[i].position = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-         sprintf(name, "lights[%d].ambient", i);
-         m_lights[i].ambient = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-         sprintf(name, "lights[%d].diffuse", i);
-         m_lights[i].diffuse = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-         sprintf(name, "lights[%d].specular", i);
-         m_lights[i].specular = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-         sprintf(name, "lights[%d].constantAttenuation", i);
-         m_lights[i].constantAttenuation = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-         sprintf(name, "lights[%d].linearAttenuation", i);
-         m_lights[i].linearAttenuation = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-         sprintf(name, "lights[%d].quadraticAttenuation", i);
-         m_lights[i].quadraticAttenuation = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-         sprintf(name, "lights[%d].spotCosCutoff", i);
-         m_lights[i].spotCosCutoff = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-         sprintf(name, "lights[%d].spotExponent", i);
-         m_lights[i].spotExponent = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-         sprintf(name, "lights[%d].spotDirection", i);
-         m_lights[i].spotDirection = glGetUniformLocation(m_shaderProgram.GetProgram(), name);
-      }
-      
       // Populate matrix uniform locations in scene state
-      m_pvmLoc = glGetUniformLocation(m_shaderProgram.GetProgram(), "pvm");
       m_modelMatrixLoc = glGetUniformLocation(m_shaderProgram.GetProgram(), "modelMatrix");
       m_normalMatrixLoc = glGetUniformLocation(m_shaderProgram.GetProgram(), "normalMatrix");
-  
-      // Populate material uniform locations in scene state 
-      m_materialAmbientLoc   = glGetUniformLocation(m_shaderProgram.GetProgram(), "materialAmbient");
-      m_materialDiffuseLoc   = glGetUniformLocation(m_shaderProgram.GetProgram(), "materialDiffuse");
-      m_materialSpecularLoc  = glGetUniformLocation(m_shaderProgram.GetProgram(), "materialSpecular");
-      m_materialEmissionLoc  = glGetUniformLocation(m_shaderProgram.GetProgram(), "materialEmission");
-      m_materialShininessLoc = glGetUniformLocation(m_shaderProgram.GetProgram(), "materialShininess");
-
-      // Populate camera position uniform location in scene state
-      m_cameraPositionLoc = glGetUniformLocation(m_shaderProgram.GetProgram(), "cameraPosition");
       return true;
    }
 
@@ -126,57 +91,66 @@ public:
 	 */
 	virtual void Draw(SceneState& sceneState)
 	{
+      Apply(sceneState);
+
+      // Draw all children
+		SceneNode::Draw(sceneState);
+	}
+
+   /**
+    * Enable the program and set the scene state locations without drawing
+    * the children.
+    * @param  sceneState   Current scene state.
+    */
+   virtual void Apply(SceneState& sceneState)
+   {
       // Enable this program
-      m_shaderProgram.Use();
+      sceneState.m_glState.UseProgram(m_shaderProgram.GetProgram());
 
-      // Set scene state locations to ones needed for this program
-      sceneState.m_numLightsLoc = m_numLightsLoc;
+      // Set scene state locations to ones needed for this program. The
+      // camera, lights and materials are set through the uniform blocks.
+      sceneState.m_numLightsLoc = -1;
       sceneState.m_positionLoc = m_positionLoc;
       sceneState.m_normalLoc = m_vertexNormalLoc;
-      sceneState.m_cameraPositionLoc = m_cameraPositionLoc;
-      sceneState.m_pvmLoc = m_pvmLoc;
+      sceneState.m_cameraPositionLoc = -1;
+      sceneState.m_pvmLoc = -1;
       sceneState.m_modelMatrixLoc = m_modelMatrixLoc;
       sceneState.m_normalMatrixLoc = m_normalMatrixLoc;
-      sceneState.m_materialAmbientLoc = m_materialAmbientLoc;
-      sceneState.m_materialDiffuseLoc = m_materialDiffuseLoc;
-      sceneState.m_materialSpecularLoc = m_materialSpecularLoc;
-      sceneState.m_materialEmissionLoc = m_materialEmissionLoc;
-      sceneState.m_materialShininessLoc = m_materialShininessLoc;
+      sceneState.m_materialAmbientLoc = -1;
+      sceneState.m_materialDiffuseLoc = -1;
+      sceneState.m_materialSpecularLoc = -1;
+      sceneState.m_materialEmissionLoc = -1;
+      sceneState.m_materialShininessLoc = -1;
 	  sceneState.m_textureLoc = m_textureLoc;
 	  sceneState.m_vTexCoord = m_vTexCoordLoc;
+      sceneState.m_instanceMatrixLoc = m_instanceMatrixLoc;
+      sceneState.m_instancedLoc = m_instancedLoc;
 
-      // Set the light locations
-      for (unsigned int i = 0; i < numLights; i++)
-         sceneState.lights[i] = m_lights[i];
-
-      // Draw all children
-		SceneNode::Draw(sceneState);
-	}
+      sceneState.UseUniformBlocks(true);
+      sceneState.m_lightsBlock.Write(0, (unsigned int)offsetof(LightsBlock, globalLightAmbient),
+                                     &m_globalAmbient.r, sizeof(float) * 4);
+      sceneState.m_stateChanges++;
+   }
 
    /**
-    * Set the lighting
+    * Set the lighting (written to the lights block when the shader is applied)
     */
    void SetGlobalAmbient(const Color4& globalAmbient) 
    {
-      m_shaderProgram.Use();
-      glUniform4fv(m_globalAmbientLoc, 1, &globalAmbient.r);
+      m_globalAmbient = globalAmbient;
    }
 
-
    /**
-    * Set light (used for Lighting and Viewing HW)
+    * Set the global ambient in the trace state and trace the children.
+    * @param  traceState  Current trace state
     */
-   void SetLight(const unsigned int n, const HPoint3& position, const Color4& ambient,
-                 const Color4& diffuse, const Color4& specular)
+   virtual void Trace(TraceState& traceState)
    {
-      m_shaderProgram.Use();
-      glUniform1i(m_lights[n].enabled, 1);
-      glUniform4fv(m_lights[n].position, 1, &position.x);
-      glUniform4fv(m_lights[n].ambient, 1, &ambient.r);
-      glUniform4fv(m_lights[n].diffuse, 1, &diffuse.r);
-      glUniform4fv(m_lights[n].specular, 1, &specular.r);
+      traceState.m_globalAmbient = m_globalAmbient;
+      SceneNode::Trace(traceState);
    }
 
+
    /**
     * Get the location of the vertex texture coordinate location attribute
 	*/
@@ -206,22 +180,13 @@ protected:
    // Uniform and attribute locations
    GLint m_positionLoc;
    GLint m_vertexNormalLoc;
-   GLint m_pvmLoc;
    GLint m_modelMatrixLoc;
    GLint m_normalMatrixLoc;
-   GLint m_materialAmbientLoc;
-   GLint m_materialDiffuseLoc;
-   GLint m_materialSpecularLoc;
-   GLint m_materialEmissionLoc;
-   GLint m_materialShininessLoc;
-   GLint m_cameraPositionLoc;
-   GLint m_globalAmbientLoc;
    GLint m_textureLoc;
    GLint m_vTexCoordLoc;
-
-   int numLights;
-   GLint m_numLightsLoc;
-   LightUniforms m_lights[3];
+   GLint m_instanceMatrixLoc;
+   GLint m_instancedLoc;
+   Color4 m_globalAmbient;
 };
 
 #endif
\ No newline at end of file
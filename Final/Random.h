@@ -0,0 +1,88 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    Random.h
+//	Purpose: Seeded pseudo-random number generator that gives the same
+//          sequence on every platform.
+//
+//============================================================================
+
+#ifndef __RANDOM_H
+#define __RANDOM_H
+
+/**
+ * Pseudo-random number generator (32 bit xorshift). Unlike rand(), the
+ * sequence depends only on the seed, not on the C library or on other code
+ * drawing numbers, so a run can be repeated exactly from its seed.
+ */
+class Random
+{
+public:
+   /**
+    * Constructor given the seed.
+    * @param  seed  Seed
+    */
+   Random(const unsigned int seed = 1)
+   {
+      Seed(seed);
+   }
+
+   /**
+    * Restart the sequence from a seed.
+    * @param  seed  Seed (any value, including 0)
+    */
+   void Seed(const unsigned int seed)
+   {
+      m_seed  = seed;
+      m_state = (seed != 0) ? seed : 0x9E3779B9u;
+   }
+
+   /**
+    * Get the seed the sequence was started from.
+    * @return  Returns the seed.
+    */
+   unsigned int GetSeed() const
+   {
+      return m_seed;
+   }
+
+   /**
+    * Get the next number in the sequence.
+    * @return  Returns a number in [1, 2^32 - 1].
+    */
+   unsigned int Next()
+   {
+      m_state ^= m_state << 13;
+      m_state ^= m_state >> 17;
+      m_state ^= m_state << 5;
+      return m_state;
+   }
+
+   /**
+    * Get the next number in a range.
+    * @param  low   Smallest value
+    * @param  high  Largest value (>= low)
+    * @return  Returns an integer in [low, high].
+    */
+   int Range(const int low, const int high)
+   {
+      return low + (int)(Next() % (unsigned int)(high - low + 1));
+   }
+
+   /**
+    * Get the next number as a float.
+    * @return  Returns a value in [0, 1).
+    */
+   float Uniform()
+   {
+      return (float)(Next() >> 8) * (1.0f / 16777216.0f);
+   }
+
+protected:
+   unsigned int m_seed;     // Seed of the sequence
+   unsigned int m_state;    // Generator state (never 0)
+};
+
+#endif
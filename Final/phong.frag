@@ -12,21 +12,25 @@ smooth in vec2 textureCoord;
 // texture object
 uniform sampler2D texture;
 
-// Uniforms for material properties
-uniform vec4   materialAmbient;
-uniform	vec4   materialDiffuse;
-uniform	vec4   materialSpecular;
-uniform	vec4   materialEmission;
-uniform	float  materialShininess;
+// The uniform blocks use the std140 layout and match the structures in
+// UniformBuffer.h
 
-// Global lighting environment ambient intensity
-uniform vec4  globalLightAmbient;
-
-// Camera position in world coordinates
-uniform vec3  cameraPosition;
+// Material properties (one block per material, bound by offset)
+layout(std140) uniform Material
+{
+	vec4   materialAmbient;
+	vec4   materialDiffuse;
+	vec4   materialSpecular;
+	vec4   materialEmission;
+	float  materialShininess;
+};
 
-// Number of active lights
-uniform int numLights;
+// Camera (shared with the vertex shader). Camera position in world coordinates.
+layout(std140) uniform Camera
+{
+	mat4 pvMatrix;
+	vec4 cameraPosition;
+};
 
 // Structure for a light source. Allow up to 8 lights.
 const int MAX_LIGHTS = 8; 
@@ -45,7 +49,15 @@ struct LightSource
 	float spotExponent;
 	vec3  spotDirection;
 };
-uniform LightSource lights[MAX_LIGHTS]; 
+
+// Lights: global lighting environment ambient intensity, number of active
+// lights and the light sources
+layout(std140) uniform Lights
+{
+	vec4 globalLightAmbient;
+	int  numLights;
+	LightSource lights[MAX_LIGHTS];
+};
 
 // Convenience method to compute attenuation for the ith light source
 // given a distance
@@ -172,7 +184,7 @@ void main()
 	vec3 n = normalize(normal);
 
 	// Construct a unit length vector from the vertex to the camera  
-	vec3 V = normalize(cameraPosition - vertex);
+	vec3 V = normalize(cameraPosition.xyz - vertex);
 
 	// set texture
 	vec4 textureColor;
@@ -11,11 +11,20 @@ in vec2 vTexCoord;
 // Incoming vertex and normal attributes
 in vec3 vertexPosition;		// Vertex position attribute
 in vec3 vertexNormal;		// Vertex normal attribute
+in mat4 instanceMatrix;		// Per-instance modeling matrix (instanced drawing only)
+
+// Camera uniform block (shared with the fragment shader, std140 layout
+// matching CameraBlock in UniformBuffer.h)
+layout(std140) uniform Camera
+{
+	mat4 pvMatrix;					// Composite projection and view matrix
+	vec4 cameraPosition;			// Camera position in world coordinates (w unused)
+};
 
 // Uniforms for matrices
-uniform mat4 pvm;					// Composite projection, view, model matrix
 uniform mat4 modelMatrix;			// Modeling  matrix
 uniform mat4 normalMatrix;			// Normal transformation matrix
+uniform bool instanced;				// Apply instanceMatrix after the modeling matrix
 
 // Simple shader for Phong (per-pixel) shading. The fragment shader will
 // do all the work. We need to pass per-vertex normals to the fragment
@@ -23,12 +32,23 @@ uniform mat4 normalMatrix;			// Normal transformation matrix
 // the fragment shader can interpolate world coordinates.
 void main()
 {
+	// For instanced drawing the instance matrix is applied first. Its normal
+	// matrix is the transpose of the inverse of its upper 3x3.
+	vec4 position = vec4(vertexPosition, 1.0);
+	vec3 n = vertexNormal;
+	if (instanced)
+	{
+		position = instanceMatrix * position;
+		n = transpose(inverse(mat3(instanceMatrix))) * n;
+	}
+
 	// Transform normal and position to world coords. 
-	normal = normalize(vec3(normalMatrix * vec4(vertexNormal, 0.0)));
-	vertex = vec3((modelMatrix * vec4(vertexPosition, 1.0)));
+	normal = normalize(vec3(normalMatrix * vec4(n, 0.0)));
+	vec4 world = modelMatrix * position;
+	vertex = vec3(world);
 	textureCoord = vTexCoord;
 
 	// Convert position to clip coordinates and pass along
-	gl_Position = pvm * vec4(vertexPosition, 1.0);
+	gl_Position = pvMatrix * world;
 
 }
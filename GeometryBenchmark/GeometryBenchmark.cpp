@@ -0,0 +1,493 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    GeometryBenchmark.cpp
+//	Purpose: Micro-benchmarks for the geometry library. Reports the time
+//          per operation and throughput of each benchmark, and optionally
+//          writes the results as JSON for regression tracking.
+//
+//============================================================================
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "geometry/geometry.h"
+
+// Usage: GeometryBenchmark [-filter <text>] [-min_time <seconds>]
+//                          [-repetitions <n>] [-json <file>]
+//
+// Each benchmark runs an operation over a small set of inputs (so they stay
+// in cache) as Google Benchmark does: the iteration count is grown until a
+// run takes at least the minimum time, then the run is repeated and the
+// median time per operation is reported.
+
+// Number of inputs each benchmark cycles through (a power of 2)
+const unsigned int INPUT_COUNT = 64;
+const unsigned int INPUT_MASK  = INPUT_COUNT - 1;
+
+// Most iterations in one run
+const unsigned int MAX_ITERATIONS = 1000000000;
+
+// Benchmark inputs
+Matrix4x4      Matrices[INPUT_COUNT];
+Vector3        Vectors[INPUT_COUNT];
+float          Angles[INPUT_COUNT];
+float          Values[INPUT_COUNT];
+Ray3           Rays[INPUT_COUNT];
+std::vector<BoundingSphere> Spheres;   // Constructed in place rather than assigned
+LineSegment2   Segments[INPUT_COUNT];
+std::vector<Point2> Polygon;
+CRectangle     Rectangle;
+
+// Results are stored here (and summed into Sink after each run) so the
+// compiler cannot drop the work being timed
+Matrix4x4      MatrixOut[INPUT_COUNT];
+Vector3        VectorOut[INPUT_COUNT];
+float          FloatOut[INPUT_COUNT];
+Point2         PointOut[INPUT_COUNT];
+LineSegment2   SegmentOut[INPUT_COUNT];
+volatile float Sink;
+
+/**
+ * Function that performs an operation a given number of times.
+ */
+typedef void (*BenchmarkFunction)(const unsigned int iterations);
+
+/**
+ * Benchmark: name and the function to time.
+ */
+struct Benchmark
+{
+   const char*       name;
+   BenchmarkFunction function;
+};
+
+/**
+ * Result of a benchmark (times are per operation).
+ */
+struct BenchmarkResult
+{
+   const char*  name;
+   unsigned int iterations;     // Iterations per run
+   unsigned int repetitions;    // Number of timed runs
+   double       realTime;       // Median wall clock time (ns)
+   double       cpuTime;        // Median CPU time (ns)
+   double       minTime;        // Fastest run (ns)
+   double       maxTime;        // Slowest run (ns)
+};
+
+// Simple logging function (the geometry library reports problems here)
+void logmsg(const char *message, ...)
+{
+   va_list arg;
+   va_start(arg, message);
+   vfprintf(stderr, message, arg);
+   putc('\n', stderr);
+   va_end(arg);
+}
+
+//----------------------------------------------------------------------------
+// Benchmarks
+//----------------------------------------------------------------------------
+
+void MatrixMultiply(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      MatrixOut[k] = Matrices[k] * Matrices[(k + 1) & INPUT_MASK];
+   }
+}
+
+void MatrixInverse(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      MatrixOut[k] = Matrices[k].GetInverse();
+   }
+}
+
+void MatrixAffineInverse(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      MatrixOut[k] = Matrices[k].GetAffineInverse();
+   }
+}
+
+void MatrixRotate(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      Matrix4x4 m = Matrices[k];
+      m.Rotate(Angles[k], Vectors[k].x, Vectors[k].y, Vectors[k].z);
+      MatrixOut[k] = m;
+   }
+}
+
+void VectorNormalize(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      Vector3 v = Vectors[k];
+      VectorOut[k] = v.Normalize();
+   }
+}
+
+void VectorCross(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      VectorOut[k] = Vectors[k].Cross(Vectors[(k + 1) & INPUT_MASK]);
+   }
+}
+
+void VectorDot(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      FloatOut[k] = Vectors[k].Dot(Vectors[(k + 1) & INPUT_MASK]);
+   }
+}
+
+void InvSqrtFast(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      FloatOut[k] = FastInvSqrt(Values[k]);
+   }
+}
+
+void InvSqrtStandard(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      FloatOut[k] = 1.0f / sqrtf(Values[k]);
+   }
+}
+
+void RaySphereIntersect(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      FloatOut[k] = Rays[k].Intersect(Spheres[(k + i / INPUT_COUNT) & INPUT_MASK]);
+   }
+}
+
+void SegmentIntersect(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      Segments[k].Intersect(Segments[(k + 1 + i / INPUT_COUNT) & INPUT_MASK], PointOut[k]);
+   }
+}
+
+void SegmentClipToPolygon(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      Segments[k].ClipToPolygon(Polygon, SegmentOut[k]);
+   }
+}
+
+void SegmentClipToRectangle(const unsigned int iterations)
+{
+   for (unsigned int i = 0; i < iterations; i++)
+   {
+      unsigned int k = i & INPUT_MASK;
+      Segments[k].ClipToRectangle(Rectangle, SegmentOut[k]);
+   }
+}
+
+// All benchmarks, in the order they run
+const Benchmark Benchmarks[] = {
+   { "Matrix4x4/Multiply",              MatrixMultiply },
+   { "Matrix4x4/Inverse",               MatrixInverse },
+   { "Matrix4x4/AffineInverse",         MatrixAffineInverse },
+   { "Matrix4x4/Rotate",                MatrixRotate },
+   { "Vector3/Normalize",               VectorNormalize },
+   { "Vector3/Cross",                   VectorCross },
+   { "Vector3/Dot",                     VectorDot },
+   { "InvSqrt/FastInvSqrt",             InvSqrtFast },
+   { "InvSqrt/StandardSqrt",            InvSqrtStandard },
+   { "Ray3/IntersectSphere",            RaySphereIntersect },
+   { "LineSegment2/Intersect",          SegmentIntersect },
+   { "LineSegment2/ClipToPolygon",      SegmentClipToPolygon },
+   { "LineSegment2/ClipToRectangle",    SegmentClipToRectangle }
+};
+const unsigned int BENCHMARK_COUNT = sizeof(Benchmarks) / sizeof(Benchmarks[0]);
+
+//----------------------------------------------------------------------------
+// Harness
+//----------------------------------------------------------------------------
+
+/**
+ * Get a random value in a range.
+ * @param  low   Smallest value
+ * @param  high  Largest value
+ * @return  Returns a value in [low, high].
+ */
+float randomRange(const float low, const float high)
+{
+   return low + (high - low) * rand01();
+}
+
+/**
+ * Fill the inputs with repeatable random values: matrices built from
+ * random translations, rotations and scales, unit and non-unit vectors,
+ * rays aimed near spheres (so about half hit), and segments that cross
+ * each other and the clip regions in various ways.
+ */
+void setupInputs()
+{
+   srand(1);
+   Spheres.clear();
+   Spheres.reserve(INPUT_COUNT);
+   for (unsigned int k = 0; k < INPUT_COUNT; k++)
+   {
+      Matrix4x4& m = Matrices[k];
+      m.SetIdentity();
+      m.Translate(randomRange(-10.0f, 10.0f), randomRange(-10.0f, 10.0f), randomRange(-10.0f, 10.0f));
+      m.Rotate(randomRange(0.0f, 360.0f), randomRange(-1.0f, 1.0f), randomRange(-1.0f, 1.0f), randomRange(-1.0f, 1.0f));
+      m.Scale(randomRange(0.5f, 2.0f), randomRange(0.5f, 2.0f), randomRange(0.5f, 2.0f));
+
+      Vectors[k].Set(randomRange(-10.0f, 10.0f), randomRange(-10.0f, 10.0f), randomRange(-10.0f, 10.0f));
+      Angles[k] = randomRange(0.0f, 360.0f);
+      Values[k] = randomRange(0.01f, 100.0f);
+
+      Point3 center(randomRange(-5.0f, 5.0f), randomRange(-5.0f, 5.0f), randomRange(-5.0f, 5.0f));
+      Spheres.emplace_back(center, randomRange(0.5f, 2.0f));
+      Point3 origin(randomRange(-20.0f, 20.0f), randomRange(-20.0f, 20.0f), -20.0f);
+      Vector3 dir(Point3(randomRange(-6.0f, 6.0f), randomRange(-6.0f, 6.0f), randomRange(-6.0f, 6.0f)) - origin);
+      Rays[k] = Ray3(origin, dir.Normalize());
+
+      Segments[k] = LineSegment2(Point2(randomRange(-15.0f, 15.0f), randomRange(-15.0f, 15.0f)),
+                                 Point2(randomRange(-15.0f, 15.0f), randomRange(-15.0f, 15.0f)));
+   }
+
+   // Regular octagon of radius 10 (counter-clockwise) and a 16 x 12 rectangle
+   Polygon.clear();
+   for (unsigned int i = 0; i < 8; i++)
+   {
+      float a = (float)i * (2.0f * (float)M_PI / 8.0f);
+      Polygon.push_back(Point2(10.0f * cosf(a), 10.0f * sinf(a)));
+   }
+   Rectangle.left   = -8.0f;
+   Rectangle.right  =  8.0f;
+   Rectangle.bottom = -6.0f;
+   Rectangle.top    =  6.0f;
+}
+
+/**
+ * Sum the results into Sink so the work that produced them is kept.
+ */
+void consumeResults()
+{
+   float s = 0.0f;
+   for (unsigned int k = 0; k < INPUT_COUNT; k++)
+   {
+      s += MatrixOut[k].m00() + MatrixOut[k].m23();
+      s += VectorOut[k].x + FloatOut[k] + PointOut[k].x;
+      s += SegmentOut[k].A.x + SegmentOut[k].B.y;
+   }
+   Sink = s;
+}
+
+/**
+ * Time one run of a benchmark.
+ * @param  function    Benchmark function
+ * @param  iterations  Number of iterations
+ * @param  cpuSeconds  (OUT) CPU time of the run (seconds)
+ * @return  Returns the wall clock time of the run (seconds).
+ */
+double timeRun(const BenchmarkFunction function, const unsigned int iterations, double& cpuSeconds)
+{
+   clock_t cpuStart = clock();
+   std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+   function(iterations);
+   double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+   cpuSeconds = (double)(clock() - cpuStart) / (double)CLOCKS_PER_SEC;
+   consumeResults();
+   return seconds;
+}
+
+/**
+ * Run a benchmark. The iteration count starts at 1 and grows (by up to 10
+ * times, aiming 40% past the minimum time) until a run takes at least the
+ * minimum time. The run is then repeated and the median taken.
+ * @param  benchmark    Benchmark to run
+ * @param  minTime      Minimum time per run (seconds)
+ * @param  repetitions  Number of timed runs
+ * @return  Returns the result.
+ */
+BenchmarkResult runBenchmark(const Benchmark& benchmark, const double minTime,
+                             const unsigned int repetitions)
+{
+   double cpuSeconds;
+   unsigned int iterations = 1;
+   for (;;)
+   {
+      double seconds = timeRun(benchmark.function, iterations, cpuSeconds);
+      if (seconds >= minTime || iterations >= MAX_ITERATIONS)
+         break;
+
+      double multiplier = (seconds > 0.0) ? 1.4 * minTime / seconds : 10.0;
+      multiplier = MINV(MAXV(multiplier, 2.0), 10.0);
+      double next = (double)iterations * multiplier;
+      iterations = (next < (double)MAX_ITERATIONS) ? (unsigned int)next : MAX_ITERATIONS;
+   }
+
+   std::vector<double> realTimes;
+   std::vector<double> cpuTimes;
+   for (unsigned int r = 0; r < repetitions; r++)
+   {
+      double seconds = timeRun(benchmark.function, iterations, cpuSeconds);
+      realTimes.push_back(seconds * 1.0e9 / iterations);
+      cpuTimes.push_back(cpuSeconds * 1.0e9 / iterations);
+   }
+   std::sort(realTimes.begin(), realTimes.end());
+   std::sort(cpuTimes.begin(), cpuTimes.end());
+
+   BenchmarkResult result;
+   result.name        = benchmark.name;
+   result.iterations  = iterations;
+   result.repetitions = repetitions;
+   result.realTime    = realTimes[repetitions / 2];
+   result.cpuTime     = cpuTimes[repetitions / 2];
+   result.minTime     = realTimes.front();
+   result.maxTime     = realTimes.back();
+   return result;
+}
+
+/**
+ * Write the results as JSON in the layout of Google Benchmark's
+ * --benchmark_out_format=json (so its compare tools can read it).
+ * @param  fname        File to write
+ * @param  executable   Program name
+ * @param  minTime      Minimum time per run (seconds)
+ * @param  results      Benchmark results
+ * @return  Returns true if the file was written.
+ */
+bool writeJSON(const char* fname, const char* executable, const double minTime,
+               const std::vector<BenchmarkResult>& results)
+{
+   FILE* f = fopen(fname, "w");
+   if (f == NULL)
+   {
+      fprintf(stderr, "Could not open %s\n", fname);
+      return false;
+   }
+
+   char date[64];
+   time_t now = time(NULL);
+   strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+   fprintf(f, "{\n  \"context\": {\n");
+   fprintf(f, "    \"date\": \"%s\",\n", date);
+   fprintf(f, "    \"executable\": \"");
+   for (const char* c = executable; *c != '\0'; c++)
+      fprintf(f, (*c == '\\' || *c == '"') ? "\\%c" : "%c", *c);
+   fprintf(f, "\",\n");
+   fprintf(f, "    \"matrix_kernels\": \"%s\",\n", MatrixKernelName());
+   fprintf(f, "    \"min_time\": %g,\n", minTime);
+   fprintf(f, "    \"library_build_type\": \"%s\"\n",
+#ifdef NDEBUG
+      "release"
+#else
+      "debug"
+#endif
+      );
+   fprintf(f, "  },\n  \"benchmarks\": [\n");
+   for (unsigned int i = 0; i < results.size(); i++)
+   {
+      const BenchmarkResult& r = results[i];
+      fprintf(f, "    {\n");
+      fprintf(f, "      \"name\": \"%s\",\n", r.name);
+      fprintf(f, "      \"run_name\": \"%s\",\n", r.name);
+      fprintf(f, "      \"run_type\": \"iteration\",\n");
+      fprintf(f, "      \"repetitions\": %u,\n", r.repetitions);
+      fprintf(f, "      \"iterations\": %u,\n", r.iterations);
+      fprintf(f, "      \"real_time\": %.4f,\n", r.realTime);
+      fprintf(f, "      \"cpu_time\": %.4f,\n", r.cpuTime);
+      fprintf(f, "      \"real_time_min\": %.4f,\n", r.minTime);
+      fprintf(f, "      \"real_time_max\": %.4f,\n", r.maxTime);
+      fprintf(f, "      \"time_unit\": \"ns\",\n");
+      fprintf(f, "      \"items_per_second\": %.6e\n", 1.0e9 / r.realTime);
+      fprintf(f, "    }%s\n", (i + 1 < results.size()) ? "," : "");
+   }
+   fprintf(f, "  ]\n}\n");
+   fclose(f);
+   return true;
+}
+
+int main(int argc, char* argv[])
+{
+   const char* filter   = NULL;
+   const char* jsonFile = NULL;
+   double minTime = 0.5;
+   unsigned int repetitions = 3;
+   for (int i = 1; i < argc - 1; i++)
+   {
+      if (strcmp(argv[i], "-filter") == 0)
+         filter = argv[++i];
+      else if (strcmp(argv[i], "-min_time") == 0)
+         minTime = atof(argv[++i]);
+      else if (strcmp(argv[i], "-repetitions") == 0)
+      {
+         int n = atoi(argv[++i]);
+         repetitions = (n > 1) ? (unsigned int)n : 1;
+      }
+      else if (strcmp(argv[i], "-json") == 0)
+         jsonFile = argv[++i];
+   }
+
+   setupInputs();
+
+#ifndef NDEBUG
+   printf("***WARNING*** Debug build: timings are not representative\n");
+#endif
+   printf("Matrix kernels: %s   min time %.2f s   repetitions %u\n", MatrixKernelName(), minTime, repetitions);
+   printf("----------------------------------------------------------------------------------\n");
+   printf("Benchmark                          Time (ns)    CPU (ns)   Iterations     Throughput\n");
+   printf("----------------------------------------------------------------------------------\n");
+
+   std::vector<BenchmarkResult> results;
+   for (unsigned int b = 0; b < BENCHMARK_COUNT; b++)
+   {
+      if (filter != NULL && strstr(Benchmarks[b].name, filter) == NULL)
+         continue;
+
+      BenchmarkResult r = runBenchmark(Benchmarks[b], minTime, repetitions);
+      results.push_back(r);
+      printf("%-32s %11.3f %11.3f %12u %10.2f M/s\n", r.name, r.realTime, r.cpuTime,
+             r.iterations, 1.0e3 / r.realTime);
+      fflush(stdout);
+   }
+
+   if (jsonFile != NULL)
+   {
+      if (!writeJSON(jsonFile, argv[0], minTime, results))
+         return -1;
+      printf("Wrote %s\n", jsonFile);
+   }
+   return 0;
+}
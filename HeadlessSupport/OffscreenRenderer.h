@@ -0,0 +1,494 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    OffscreenRenderer.h
+//	Purpose: Headless mode for the demo applications: renders a fixed number
+//          of frames into a framebuffer object without a visible window and
+//          writes the frames and per-frame timings.
+//
+//============================================================================
+
+#ifndef __OFFSCREENRENDERER_H
+#define __OFFSCREENRENDERER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+// Build with HEADLESS_EGL defined (and link with -lEGL) to create the
+// context with EGL, which needs no window system (e.g. Mesa's software
+// rasterizer on a Linux build or CI node). Otherwise a hidden freeglut
+// window provides the context.
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+/**
+ * Offscreen renderer. Runs an application's real update and draw code for
+ * a fixed number of frames with the frames drawn into a framebuffer object
+ * (RGBA8 color and 24 bit depth renderbuffers), so the rendering path can
+ * be run and timed where there is no display.
+ *
+ * Command line options (see ParseArguments):
+ *   -headless <frames>     Render this many frames offscreen and exit
+ *   -size <width> <height> Framebuffer size (default 640 x 480)
+ *   -dump <prefix>         Write frames to <prefix>0000.ppm, <prefix>0001.ppm ...
+ *   -every <n>             Write only every nth frame (default 1)
+ *   -timings <file>        Write per-frame timings (CSV)
+ *
+ * Usage: parse the arguments, call CreateContext in place of the freeglut
+ * window setup (it also initializes gl3w), set up OpenGL state and the
+ * scene as usual, then call Run with the application's reshape, update and
+ * draw functions. Draw functions must not swap buffers or bind framebuffer
+ * 0. Each frame is timed in three parts: the update, the draw calls (CPU
+ * time to submit) and the wait in glFinish for the GPU to finish the frame.
+ */
+class OffscreenRenderer
+{
+public:
+   /**
+    * Function called with the framebuffer size (as glutReshapeFunc).
+    */
+   typedef void (*ReshapeFunction)(int width, int height);
+
+   /**
+    * Function called once per frame to update or draw.
+    */
+   typedef void (*FrameFunction)();
+
+   /**
+    * Constructor. Headless mode is off until requested on the command line.
+    */
+   OffscreenRenderer()
+   {
+      m_frames      = 0;
+      m_width       = 640;
+      m_height      = 480;
+      m_dumpEvery   = 1;
+      m_dumpPrefix  = NULL;
+      m_timingsFile = NULL;
+      m_framebuffer = 0;
+      m_colorBuffer = 0;
+      m_depthBuffer = 0;
+#ifdef HEADLESS_EGL
+      m_display     = EGL_NO_DISPLAY;
+      m_context     = EGL_NO_CONTEXT;
+      m_surface     = EGL_NO_SURFACE;
+#endif
+   }
+
+   /**
+    * Destructor. Deletes the framebuffer and the context.
+    */
+   ~OffscreenRenderer()
+   {
+      if (m_framebuffer != 0)
+      {
+         glDeleteFramebuffers(1, &m_framebuffer);
+         glDeleteRenderbuffers(1, &m_colorBuffer);
+         glDeleteRenderbuffers(1, &m_depthBuffer);
+      }
+#ifdef HEADLESS_EGL
+      if (m_display != EGL_NO_DISPLAY)
+      {
+         eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+         if (m_context != EGL_NO_CONTEXT)
+            eglDestroyContext(m_display, m_context);
+         if (m_surface != EGL_NO_SURFACE)
+            eglDestroySurface(m_display, m_surface);
+         eglTerminate(m_display);
+      }
+#endif
+   }
+
+   /**
+    * Read the headless options from the command line. Other arguments are
+    * ignored, so applications may parse their own options as well.
+    * @param  argc  Argument count
+    * @param  argv  Arguments
+    * @return  Returns true if headless mode was requested.
+    */
+   bool ParseArguments(const int argc, char** argv)
+   {
+      for (int i = 1; i < argc - 1; i++)
+      {
+         if (strcmp(argv[i], "-headless") == 0)
+            m_frames = (unsigned int)atoi(argv[++i]);
+         else if (strcmp(argv[i], "-size") == 0 && i < argc - 2)
+         {
+            m_width  = (unsigned int)atoi(argv[++i]);
+            m_height = (unsigned int)atoi(argv[++i]);
+         }
+         else if (strcmp(argv[i], "-dump") == 0)
+            m_dumpPrefix = argv[++i];
+         else if (strcmp(argv[i], "-every") == 0)
+            m_dumpEvery = (unsigned int)atoi(argv[++i]);
+         else if (strcmp(argv[i], "-timings") == 0)
+            m_timingsFile = argv[++i];
+      }
+      if (m_width == 0 || m_height == 0)
+      {
+         m_width  = 640;
+         m_height = 480;
+      }
+      if (m_dumpEvery == 0)
+         m_dumpEvery = 1;
+      return IsEnabled();
+   }
+
+   /**
+    * Check whether headless mode was requested.
+    * @return  Returns true if frames are to be rendered offscreen.
+    */
+   bool IsEnabled() const
+   {
+      return m_frames > 0;
+   }
+
+   /**
+    * Get the framebuffer width.
+    * @return  Returns the width in pixels.
+    */
+   unsigned int GetWidth() const
+   {
+      return m_width;
+   }
+
+   /**
+    * Get the framebuffer height.
+    * @return  Returns the height in pixels.
+    */
+   unsigned int GetHeight() const
+   {
+      return m_height;
+   }
+
+   /**
+    * Create an OpenGL core profile context without a visible window, make
+    * it current and initialize gl3w.
+    * @param  argc   Argument count (passed to glutInit)
+    * @param  argv   Arguments
+    * @param  title  Window title (for the hidden freeglut window)
+    * @param  major  OpenGL major version
+    * @param  minor  OpenGL minor version
+    * @return  Returns true if the context is ready.
+    */
+   bool CreateContext(int& argc, char** argv, const char* title, const int major, const int minor)
+   {
+#ifdef HEADLESS_EGL
+      if (!createEGLContext(major, minor))
+         return false;
+#else
+      glutInit(&argc, argv);
+      glutInitContextVersion(major, minor);
+      glutInitContextProfile(GLUT_CORE_PROFILE);
+      glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH);
+      glutInitWindowSize(1, 1);
+      if (glutCreateWindow(title) < 1)
+      {
+         fprintf(stderr, "OffscreenRenderer: could not create a window\n");
+         return false;
+      }
+      glutHideWindow();
+#endif
+
+      if (gl3wInit())
+      {
+         fprintf(stderr, "gl3wInit: failed to initialize OpenGL\n");
+         return false;
+      }
+      if (!gl3wIsSupported(major, minor))
+      {
+         fprintf(stderr, "OpenGL %d.%d not supported\n", major, minor);
+         return false;
+      }
+      printf("OpenGL %s, GLSL %s (%s, headless)\n", glGetString(GL_VERSION),
+             glGetString(GL_SHADING_LANGUAGE_VERSION), glGetString(GL_RENDERER));
+      return true;
+   }
+
+   /**
+    * Render the frames. The framebuffer object is created and bound, then
+    * reshape is called with its size. Frame 0 shows the initial state (as
+    * the first display of a window does); each later frame calls update
+    * before drawing. Prints a summary of the timings.
+    * @param  reshape  Reshape function (may be NULL)
+    * @param  update   Update function (NULL for a static scene)
+    * @param  draw     Draw function
+    * @return  Returns true if every frame was rendered and written.
+    */
+   bool Run(ReshapeFunction reshape, FrameFunction update, FrameFunction draw)
+   {
+      if (!createFramebuffer())
+         return false;
+      if (reshape != NULL)
+         reshape((int)m_width, (int)m_height);
+
+      std::vector<FrameTiming> timings(m_frames);
+      std::vector<unsigned char> pixels;
+      bool ok = true;
+      for (unsigned int frame = 0; frame < m_frames; frame++)
+      {
+         FrameTiming& timing = timings[frame];
+         Clock::time_point start = Clock::now();
+         if (update != NULL && frame > 0)
+            update();
+         Clock::time_point updated = Clock::now();
+         draw();
+         Clock::time_point drawn = Clock::now();
+         glFinish();
+         Clock::time_point finished = Clock::now();
+         timing.update = milliseconds(start, updated);
+         timing.draw   = milliseconds(updated, drawn);
+         timing.finish = milliseconds(drawn, finished);
+
+         if (m_dumpPrefix != NULL && frame % m_dumpEvery == 0)
+            ok = writeFrame(frame, pixels) && ok;
+      }
+
+      GLenum error = glGetError();
+      if (error != GL_NO_ERROR)
+      {
+         fprintf(stderr, "OffscreenRenderer: OpenGL error 0x%x\n", error);
+         ok = false;
+      }
+      report(timings);
+      if (m_timingsFile != NULL)
+         ok = writeTimings(timings) && ok;
+      return ok;
+   }
+
+protected:
+   typedef std::chrono::high_resolution_clock Clock;
+
+   // Time spent in each part of a frame (milliseconds)
+   struct FrameTiming
+   {
+      double update;       // Update function
+      double draw;         // Draw function (CPU time to submit)
+      double finish;       // Waiting in glFinish for the GPU
+   };
+
+   unsigned int m_frames;          // Frames to render (0 = not headless)
+   unsigned int m_width;           // Framebuffer size
+   unsigned int m_height;
+   unsigned int m_dumpEvery;       // Write every nth frame
+   const char*  m_dumpPrefix;      // Frame file name prefix (NULL = no frames written)
+   const char*  m_timingsFile;     // Timings file name (NULL = not written)
+   GLuint       m_framebuffer;     // Framebuffer object and its renderbuffers
+   GLuint       m_colorBuffer;
+   GLuint       m_depthBuffer;
+#ifdef HEADLESS_EGL
+   EGLDisplay   m_display;
+   EGLContext   m_context;
+   EGLSurface   m_surface;         // Small pbuffer (EGL_NO_SURFACE if surfaceless)
+#endif
+
+   // Milliseconds between two times
+   static double milliseconds(const Clock::time_point& begin, const Clock::time_point& end)
+   {
+      return std::chrono::duration<double, std::milli>(end - begin).count();
+   }
+
+#ifdef HEADLESS_EGL
+   /**
+    * Create an EGL context. Uses Mesa's surfaceless platform when it is
+    * available, otherwise the default display. The context is made current
+    * without a surface if the implementation allows it, otherwise with a
+    * 1 x 1 pbuffer (all drawing goes to the framebuffer object either way).
+    * @param  major  OpenGL major version
+    * @param  minor  OpenGL minor version
+    * @return  Returns true if the context is current.
+    */
+   bool createEGLContext(const int major, const int minor)
+   {
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+      PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+         (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+      if (getPlatformDisplay != NULL)
+      {
+         m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+         if (m_display != EGL_NO_DISPLAY && !eglInitialize(m_display, NULL, NULL))
+            m_display = EGL_NO_DISPLAY;
+      }
+#endif
+      if (m_display == EGL_NO_DISPLAY)
+      {
+         m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+         if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, NULL, NULL))
+         {
+            fprintf(stderr, "OffscreenRenderer: no EGL display\n");
+            m_display = EGL_NO_DISPLAY;
+            return false;
+         }
+      }
+      if (!eglBindAPI(EGL_OPENGL_API))
+      {
+         fprintf(stderr, "OffscreenRenderer: EGL does not support OpenGL\n");
+         return false;
+      }
+
+      // Prefer a config with pbuffer support, but accept any OpenGL config
+      const EGLint pbufferConfig[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                       EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+      const EGLint anyConfig[]     = { EGL_SURFACE_TYPE, 0,
+                                       EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+      EGLConfig config;
+      EGLint count = 0;
+      bool pbuffer = eglChooseConfig(m_display, pbufferConfig, &config, 1, &count) && count > 0;
+      if (!pbuffer && (!eglChooseConfig(m_display, anyConfig, &config, 1, &count) || count == 0))
+      {
+         fprintf(stderr, "OffscreenRenderer: no EGL config for OpenGL\n");
+         return false;
+      }
+
+      const EGLint contextAttributes[] = {
+         EGL_CONTEXT_MAJOR_VERSION, major,
+         EGL_CONTEXT_MINOR_VERSION, minor,
+         EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+         EGL_NONE };
+      m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttributes);
+      if (m_context == EGL_NO_CONTEXT)
+      {
+         fprintf(stderr, "OffscreenRenderer: could not create an OpenGL %d.%d core context (0x%x)\n",
+                 major, minor, eglGetError());
+         return false;
+      }
+
+      if (eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context))
+         return true;
+      if (pbuffer)
+      {
+         const EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+         m_surface = eglCreatePbufferSurface(m_display, config, surfaceAttributes);
+         if (m_surface != EGL_NO_SURFACE && eglMakeCurrent(m_display, m_surface, m_surface, m_context))
+            return true;
+      }
+      fprintf(stderr, "OffscreenRenderer: could not make the EGL context current (0x%x)\n", eglGetError());
+      return false;
+   }
+#endif
+
+   /**
+    * Create the framebuffer object and bind it for drawing and reading.
+    * @return  Returns true if the framebuffer is complete.
+    */
+   bool createFramebuffer()
+   {
+      glGenRenderbuffers(1, &m_colorBuffer);
+      glBindRenderbuffer(GL_RENDERBUFFER, m_colorBuffer);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, (GLsizei)m_width, (GLsizei)m_height);
+      glGenRenderbuffers(1, &m_depthBuffer);
+      glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, (GLsizei)m_width, (GLsizei)m_height);
+      glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+      glGenFramebuffers(1, &m_framebuffer);
+      glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorBuffer);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+      GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+      if (status != GL_FRAMEBUFFER_COMPLETE)
+      {
+         fprintf(stderr, "OffscreenRenderer: framebuffer incomplete (0x%x)\n", status);
+         return false;
+      }
+      glViewport(0, 0, (GLsizei)m_width, (GLsizei)m_height);
+      return true;
+   }
+
+   /**
+    * Read the framebuffer and write it as a binary PPM file (top row first).
+    * @param  frame   Frame number
+    * @param  pixels  Buffer for the pixels (reused between frames)
+    * @return  Returns true if the file was written.
+    */
+   bool writeFrame(const unsigned int frame, std::vector<unsigned char>& pixels) const
+   {
+      unsigned int row = m_width * 3;
+      pixels.resize(row * m_height * 2);
+      unsigned char* image   = &pixels[0];
+      unsigned char* flipped = image + row * m_height;
+      glPixelStorei(GL_PACK_ALIGNMENT, 1);
+      glReadPixels(0, 0, (GLsizei)m_width, (GLsizei)m_height, GL_RGB, GL_UNSIGNED_BYTE, image);
+
+      // OpenGL rows start at the bottom
+      for (unsigned int y = 0; y < m_height; y++)
+         memcpy(flipped + y * row, image + (m_height - 1 - y) * row, row);
+
+      char fname[1024];
+      sprintf(fname, "%.1000s%04u.ppm", m_dumpPrefix, frame);
+      FILE* file = fopen(fname, "wb");
+      if (file == NULL)
+      {
+         fprintf(stderr, "OffscreenRenderer: Error opening %s\n", fname);
+         return false;
+      }
+      fprintf(file, "P6\n%u %u\n255\n", m_width, m_height);
+      bool ok = (fwrite(flipped, 1, row * m_height, file) == row * m_height);
+      fclose(file);
+      return ok;
+   }
+
+   /**
+    * Write the timings of each frame as CSV.
+    * @param  timings  Frame timings
+    * @return  Returns true if the file was written.
+    */
+   bool writeTimings(const std::vector<FrameTiming>& timings) const
+   {
+      FILE* file = fopen(m_timingsFile, "w");
+      if (file == NULL)
+      {
+         fprintf(stderr, "OffscreenRenderer: Error opening %s\n", m_timingsFile);
+         return false;
+      }
+      fprintf(file, "frame,update_ms,draw_ms,finish_ms,total_ms\n");
+      for (unsigned int i = 0; i < timings.size(); i++)
+      {
+         const FrameTiming& t = timings[i];
+         fprintf(file, "%u,%.4f,%.4f,%.4f,%.4f\n", i, t.update, t.draw, t.finish,
+                 t.update + t.draw + t.finish);
+      }
+      fclose(file);
+      return true;
+   }
+
+   /**
+    * Print the mean of each part of the frame time and the minimum, median
+    * and maximum frame time. Frame 0 (which includes first use costs such
+    * as shader and buffer setup in the driver) is left out unless it is the
+    * only frame.
+    * @param  timings  Frame timings
+    */
+   void report(const std::vector<FrameTiming>& timings) const
+   {
+      unsigned int first = (timings.size() > 1) ? 1 : 0;
+      unsigned int count = (unsigned int)timings.size() - first;
+      double update = 0.0, draw = 0.0, finish = 0.0;
+      std::vector<double> totals;
+      for (unsigned int i = first; i < timings.size(); i++)
+      {
+         update += timings[i].update;
+         draw   += timings[i].draw;
+         finish += timings[i].finish;
+         totals.push_back(timings[i].update + timings[i].draw + timings[i].finish);
+      }
+      std::sort(totals.begin(), totals.end());
+      double mean = (update + draw + finish) / count;
+      printf("Rendered %u frames at %ux%u\n", (unsigned int)timings.size(), m_width, m_height);
+      printf("  mean ms/frame: %.3f (update %.3f, draw %.3f, finish %.3f), %.1f frames/sec\n",
+             mean, update / count, draw / count, finish / count, (mean > 0.0) ? 1000.0 / mean : 0.0);
+      printf("  ms/frame min %.3f, median %.3f, max %.3f (frame 0: %.3f)\n", totals.front(),
+             totals[totals.size() / 2], totals.back(),
+             timings[0].update + timings[0].draw + timings[0].finish);
+   }
+};
+
+#endif
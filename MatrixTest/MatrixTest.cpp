@@ -31,6 +31,163 @@ void logmsg(const char *message, ...)
    va_end(arg);
 }
 
+// Random number in [lo, hi] (fixed sequence after srand)
+float random(const float lo, const float hi)
+{
+   return lo + (hi - lo) * (float)rand() / (float)RAND_MAX;
+}
+
+// Random point in the cube [-size, size]^3
+Point3 randomPoint(const float size)
+{
+   return Point3(random(-size, size), random(-size, size), random(-size, size));
+}
+
+// Random ray from the cube [-3, 3]^3 toward a point in [-1, 1]^3 (unit
+// direction), so most rays pass near the random boxes and triangles
+Ray3 randomRay()
+{
+   Point3 o = randomPoint(3.0f);
+   return Ray3(o, Vector3(o, randomPoint(1.0f)).Normalize());
+}
+
+// Random box inside the cube [-1, 1]^3
+AABB randomBox()
+{
+   AABB box;
+   box.Add(randomPoint(1.0f));
+   box.Add(randomPoint(1.0f));
+   return box;
+}
+
+// Determinant of the 3x3 matrix with columns a, b and c
+double det3(const double* a, const double* b, const double* c)
+{
+   return a[0] * (b[1] * c[2] - b[2] * c[1]) - a[1] * (b[0] * c[2] - b[2] * c[0]) +
+          a[2] * (b[0] * c[1] - b[1] * c[0]);
+}
+
+// Relative difference of 2 ray parameters
+double tError(const double t, const double ref)
+{
+   return fabs(t - ref) / ((fabs(ref) > 1.0) ? fabs(ref) : 1.0);
+}
+
+/**
+ * Compare RayPacket<N> with Ray3 on random rays against random boxes and
+ * triangles. Each active lane must give the same hit, t, u and v as the
+ * scalar test, and lanes without a ray must report no hit and t = 0.
+ * @param  tests  Number of packets to test
+ */
+template <unsigned int N>
+void testRayPacket(const unsigned int tests)
+{
+   unsigned int maskErrors = 0, tErrors = 0, uvErrors = 0, inactiveErrors = 0, hits = 0;
+   Ray3  rays[N];
+   float t[N], u[N], v[N];
+   for (unsigned int test = 0; test < tests; test++)
+   {
+      // Partly filled packets check the unused lanes
+      unsigned int count = 1 + (unsigned int)rand() % N;
+      for (unsigned int i = 0; i < count; i++)
+         rays[i] = randomRay();
+      RayPacket<N> packet(rays, count);
+
+      AABB box = randomBox();
+      int mask = packet.Intersect(box, t);
+      for (unsigned int i = 0; i < N; i++)
+      {
+         float ref = (i < count) ? rays[i].Intersect(box) : 0.0f;
+         if (((mask >> i) & 1) != (ref != 0.0f))
+            maskErrors++;
+         if (i >= count && t[i] != 0.0f)
+            inactiveErrors++;
+         else if (t[i] != ref)
+            tErrors++;
+         hits += (ref != 0.0f);
+      }
+
+      Point3 v0 = randomPoint(1.0f), v1 = randomPoint(1.0f), v2 = randomPoint(1.0f);
+      mask = packet.Intersect(v0, v1, v2, t, u, v);
+      for (unsigned int i = 0; i < N; i++)
+      {
+         float refU = 0.0f, refV = 0.0f;
+         float ref = (i < count) ? rays[i].Intersect(v0, v1, v2, refU, refV) : 0.0f;
+         if (((mask >> i) & 1) != (ref != 0.0f))
+            maskErrors++;
+         if (i >= count && (t[i] != 0.0f || u[i] != 0.0f || v[i] != 0.0f))
+            inactiveErrors++;
+         else if (t[i] != ref)
+            tErrors++;
+         else if (ref != 0.0f && (u[i] != refU || v[i] != refV))
+            uvErrors++;
+         hits += (ref != 0.0f);
+      }
+   }
+   logmsg("RayPacket<%u>: %u packets, %u hits, %u mask errors, %u t errors, %u u,v errors, "
+          "%u unused lane errors", N, tests, hits, maskErrors, tErrors, uvErrors, inactiveErrors);
+}
+
+/**
+ * Compare BVH closest-hit and any-hit queries with testing every triangle
+ * on random rays. The closest hit must have the same t as the nearest
+ * triangle hit (and the same triangle unless 2 triangles tie), and any-hit
+ * must agree on whether there is a hit before a random tMax.
+ * @param  label     Name for the log
+ * @param  bvh       Hierarchy built over (or refit to) the mesh
+ * @param  vertices  Vertex positions
+ * @param  faces     Face list
+ * @param  tests     Number of rays
+ */
+void testBVH(const char* label, const BVH& bvh, const std::vector<Point3>& vertices,
+             const std::vector<unsigned int>& faces, const unsigned int tests)
+{
+   unsigned int closestErrors = 0, triangleErrors = 0, anyErrors = 0, hits = 0;
+   unsigned int triangles = (unsigned int)(faces.size() / 3);
+   for (unsigned int test = 0; test < tests; test++)
+   {
+      Ray3 ray = randomRay();
+
+      // Nearest hit (first triangle wins ties, as in the traversal)
+      float nearest = FLT_MAX;
+      unsigned int nearestTriangle = 0;
+      for (unsigned int i = 0; i < triangles; i++)
+      {
+         float u, v;
+         float t = ray.Intersect(vertices[faces[i * 3]], vertices[faces[i * 3 + 1]],
+                                 vertices[faces[i * 3 + 2]], u, v);
+         if (t > 0.0f && t < nearest)
+         {
+            nearest = t;
+            nearestTriangle = i;
+         }
+      }
+
+      BVH::Hit hit;
+      bool found = bvh.Intersect(ray, hit);
+      if (found != (nearest != FLT_MAX) || (found && hit.t != nearest))
+         closestErrors++;
+      else if (found && hit.triangle != nearestTriangle)
+      {
+         // Another triangle at exactly the same t is also correct
+         float u, v;
+         unsigned int i = hit.triangle;
+         if (ray.Intersect(vertices[faces[i * 3]], vertices[faces[i * 3 + 1]],
+                           vertices[faces[i * 3 + 2]], u, v) != nearest)
+            triangleErrors++;
+      }
+      hits += found;
+
+      // Any hit before a limit around the nearest hit
+      float tMax = random(0.0f, 6.0f);
+      if (tMax != nearest && bvh.IntersectAny(ray, tMax) != (nearest < tMax))
+         anyErrors++;
+   }
+   logmsg("BVH %s: %u triangles, %u nodes, %u rays, %u hits, %u closest hit errors, "
+          "%u triangle errors, %u any hit errors", label, triangles, bvh.GetNodeCount(), tests,
+          hits, closestErrors, triangleErrors, anyErrors);
+}
+
 
 int main(int argc, char* argv[])
 {
@@ -52,6 +209,237 @@ int main(int argc, char* argv[])
    float d = abs(w.Dot(n)) / abs(n.Norm());
    logmsg("distance: %f", d);
 
+   /************ Matrix kernels *************/
+
+   // Compare the matrix kernels against straightforward versions
+   logmsg("\nMatrix kernels: %s", MatrixKernelName());
+   Matrix4x4 A, B;
+   A.Translate(-5.0f, 10.0f, 15.0f);
+   A.Rotate(30.0f, 1.0f, 2.0f, 3.0f);
+   A.Scale(2.0f, 3.0f, 4.0f);
+   B.Rotate(-60.0f, 0.0f, 1.0f, 1.0f);
+   B.Translate(1.0f, -2.0f, 3.0f);
+
+   // Product
+   Matrix4x4 AB = A * B;
+   float err = 0.0f;
+   for (unsigned int row = 0; row < 4; row++)
+   {
+      for (unsigned int col = 0; col < 4; col++)
+      {
+         float s = 0.0f;
+         for (unsigned int k = 0; k < 4; k++)
+            s += A.m(row, k) * B.m(k, col);
+         float e = fabs(s - AB.m(row, col));
+         err = (e > err) ? e : err;
+      }
+   }
+   logmsg("Multiply max error: %g", err);
+
+   // Affine inverse vs. general inverse
+   Matrix4x4 AI = A.GetAffineInverse();
+   Matrix4x4 GI = A.GetInverse();
+   err = 0.0f;
+   for (unsigned int i = 0; i < 16; i++)
+   {
+      float e = fabs(AI.Get()[i] - GI.Get()[i]);
+      err = (e > err) ? e : err;
+   }
+   logmsg("Affine inverse max error: %g", err);
+
+   // Batch transform vs. single transforms
+   Point3 pts[7], out[7];
+   for (unsigned int i = 0; i < 7; i++)
+      pts[i].Set((float)i, 1.0f - (float)i, 0.5f * (float)i);
+   A.Transform(pts, out, 7);
+   err = 0.0f;
+   for (unsigned int i = 0; i < 7; i++)
+   {
+      HPoint3 q = A * pts[i];
+      float e = fabs(q.x - out[i].x) + fabs(q.y - out[i].y) + fabs(q.z - out[i].z);
+      err = (e > err) ? e : err;
+   }
+   logmsg("Batch transform max error: %g", err);
+
+   /************ Ray intersections *************/
+
+   // Compare the ray intersections with the same tests done in double
+   // precision. Rays that pass within a small distance of an edge, or are
+   // nearly parallel to a plane, may round either way so they are skipped.
+   logmsg("\nRay intersections");
+   srand(1);
+   const unsigned int rayTests = 100000;
+   unsigned int misses = 0, skipped = 0, hits = 0;
+   double tErr = 0.0;
+   for (unsigned int i = 0; i < rayTests; i++)
+   {
+      Ray3 ray = randomRay();
+      Plane plane(randomPoint(1.0f), randomPoint(1.0f), randomPoint(1.0f));
+      double denom = (double)plane.a * ray.d.x + (double)plane.b * ray.d.y + (double)plane.c * ray.d.z;
+      double ref   = -((double)plane.a * ray.o.x + (double)plane.b * ray.o.y + (double)plane.c * ray.o.z -
+                       (double)plane.d) / denom;
+      if (fabs(denom) < 1e-3 * plane.GetNormal().Norm() || fabs(ref) < 1e-4)
+      {
+         skipped++;
+         continue;
+      }
+      float t = ray.Intersect(plane);
+      if ((t != 0.0f) != (ref > 0.0))
+         misses++;
+      else if (t != 0.0f)
+      {
+         hits++;
+         double e = tError(t, ref);
+         tErr = (e > tErr) ? e : tErr;
+      }
+   }
+   logmsg("Plane: %u rays, %u hits, %u skipped, %u hit errors, max t error %g",
+          rayTests, hits, skipped, misses, tErr);
+
+   misses = skipped = hits = 0;
+   tErr = 0.0;
+   for (unsigned int i = 0; i < rayTests; i++)
+   {
+      Ray3 ray = randomRay();
+      AABB box = randomBox();
+
+      // Slab test with exact division (axis parallel rays are rare and skipped)
+      double o[3] = { ray.o.x, ray.o.y, ray.o.z }, d[3] = { ray.d.x, ray.d.y, ray.d.z };
+      double lo[3] = { box.m_min.x, box.m_min.y, box.m_min.z };
+      double hi[3] = { box.m_max.x, box.m_max.y, box.m_max.z };
+      double tnear = -1e30, tfar = 1e30;
+      bool parallel = false;
+      for (unsigned int a = 0; a < 3; a++)
+      {
+         if (fabs(d[a]) < 1e-4)
+            parallel = true;
+         double t1 = (lo[a] - o[a]) / d[a], t2 = (hi[a] - o[a]) / d[a];
+         tnear = (t1 < t2 ? t1 : t2) > tnear ? (t1 < t2 ? t1 : t2) : tnear;
+         tfar  = (t1 > t2 ? t1 : t2) < tfar  ? (t1 > t2 ? t1 : t2) : tfar;
+      }
+      if (parallel || fabs(tfar - tnear) < 1e-4 || fabs(tfar) < 1e-4 || fabs(tnear) < 1e-4)
+      {
+         skipped++;
+         continue;
+      }
+      double ref = (tfar < tnear || tfar <= 0.0) ? 0.0 : ((tnear > 0.0) ? tnear : tfar);
+      float t = ray.Intersect(box);
+      if ((t != 0.0f) != (ref != 0.0))
+         misses++;
+      else if (t != 0.0f)
+      {
+         hits++;
+         double e = tError(t, ref);
+         tErr = (e > tErr) ? e : tErr;
+      }
+   }
+   logmsg("Box: %u rays, %u hits, %u skipped, %u hit errors, max t error %g",
+          rayTests, hits, skipped, misses, tErr);
+
+   misses = skipped = hits = 0;
+   tErr = 0.0;
+   double uvErr = 0.0;
+   for (unsigned int i = 0; i < rayTests; i++)
+   {
+      Ray3 ray = randomRay();
+      Point3 v0 = randomPoint(1.0f), v1 = randomPoint(1.0f), v2 = randomPoint(1.0f);
+
+      // Solve o + t d = v0 + u e1 + v e2 by Cramer's rule:
+      // [-d e1 e2] (t u v) = o - v0
+      double e1[3] = { v1.x - v0.x, v1.y - v0.y, v1.z - v0.z };
+      double e2[3] = { v2.x - v0.x, v2.y - v0.y, v2.z - v0.z };
+      double nd[3] = { -ray.d.x, -ray.d.y, -ray.d.z };
+      double s[3]  = { ray.o.x - v0.x, ray.o.y - v0.y, ray.o.z - v0.z };
+      double det = det3(nd, e1, e2);
+      double area = sqrt(SQR(e1[1] * e2[2] - e1[2] * e2[1]) + SQR(e1[2] * e2[0] - e1[0] * e2[2]) +
+                         SQR(e1[0] * e2[1] - e1[1] * e2[0]));
+      if (fabs(det) < 1e-3 * area || area < 1e-3)
+      {
+         skipped++;
+         continue;
+      }
+      double refT = det3(s, e1, e2) / det;
+      double refU = det3(nd, s, e2) / det;
+      double refV = det3(nd, e1, s) / det;
+      double edge = (refU < refV) ? refU : refV;
+      edge = (1.0 - refU - refV < edge) ? 1.0 - refU - refV : edge;
+      if (fabs(edge) < 1e-4 || fabs(refT - EPSILON) < 1e-4)
+      {
+         skipped++;
+         continue;
+      }
+      bool refHit = (edge > 0.0 && refT > EPSILON);
+      float u, v;
+      float t = ray.Intersect(v0, v1, v2, u, v);
+      if ((t != 0.0f) != refHit)
+         misses++;
+      else if (t != 0.0f)
+      {
+         hits++;
+         double e = tError(t, refT);
+         tErr = (e > tErr) ? e : tErr;
+         e = fabs(u - refU) + fabs(v - refV);
+         uvErr = (e > uvErr) ? e : uvErr;
+      }
+   }
+   logmsg("Triangle: %u rays, %u hits, %u skipped, %u hit errors, max t error %g, max u,v error %g",
+          rayTests, hits, skipped, misses, tErr, uvErr);
+
+   /************ Ray packets *************/
+
+   // Packets must match the scalar intersections exactly
+   logmsg("\nRay packets");
+   testRayPacket<4>(20000);
+   testRayPacket<8>(20000);
+
+   /************ Bounding volume hierarchy *************/
+
+   // A bumpy sphere with some random triangles inside and around it
+   logmsg("\nBounding volume hierarchy");
+   std::vector<Point3> vertices;
+   std::vector<unsigned int> faces;
+   const unsigned int rings = 24, segments = 48;
+   for (unsigned int i = 0; i <= rings; i++)
+   {
+      for (unsigned int j = 0; j <= segments; j++)
+      {
+         float theta = (float)M_PI * (float)i / (float)rings;
+         float phi   = 2.0f * (float)M_PI * (float)j / (float)segments;
+         float r     = random(0.9f, 1.1f);
+         vertices.push_back(Point3(r * sinf(theta) * cosf(phi), r * sinf(theta) * sinf(phi),
+                                   r * cosf(theta)));
+      }
+   }
+   for (unsigned int i = 0; i < rings; i++)
+   {
+      for (unsigned int j = 0; j < segments; j++)
+      {
+         unsigned int a = i * (segments + 1) + j;
+         unsigned int b = a + segments + 1;
+         unsigned int tri[6] = { a, b, b + 1, a, b + 1, a + 1 };
+         faces.insert(faces.end(), tri, tri + 6);
+      }
+   }
+   for (unsigned int i = 0; i < 300; i++)
+   {
+      Point3 c = randomPoint(1.5f);
+      for (unsigned int k = 0; k < 3; k++)
+      {
+         faces.push_back((unsigned int)vertices.size());
+         vertices.push_back(c + Vector3(random(-0.2f, 0.2f), random(-0.2f, 0.2f), random(-0.2f, 0.2f)));
+      }
+   }
+
+   BVH bvh;
+   bvh.Build(vertices, faces);
+   testBVH("build", bvh, vertices, faces, 20000);
+
+   // Move the vertices and refit without rebuilding
+   for (unsigned int i = 0; i < vertices.size(); i++)
+      vertices[i] = vertices[i] + Vector3(random(-0.3f, 0.3f), random(-0.3f, 0.3f), random(-0.3f, 0.3f));
+   bvh.Refit(vertices);
+   testBVH("refit", bvh, vertices, faces, 20000);
+
    
    
    
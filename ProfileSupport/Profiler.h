@@ -0,0 +1,534 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    Profiler.h
+//	Purpose: Per-frame CPU and GPU timing of named zones, kept in a ring
+//          buffer of recent frames with percentile summaries and Chrome
+//          trace export.
+//
+//============================================================================
+
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+/**
+ * Frame profiler. The application registers named zones (AddZone), marks
+ * each frame with NextFrame and brackets the work to time with BeginZone /
+ * EndZone (or a ProfileZone on the stack). For each of the most recent
+ * frames the profiler keeps:
+ *   - the frame interval (from this frame's start to the next frame's) and
+ *     the CPU time spent in the frame's zones,
+ *   - per zone: the CPU time and the number of times it was entered, and
+ *     for zones registered with GPU timing, the GPU time measured with a
+ *     GL_TIME_ELAPSED query.
+ *
+ * The history is a ring buffer allocated up front, so recording does not
+ * allocate. GPU query results are read QUERY_FRAMES frames after they are
+ * issued, so reading them does not wait for the GPU. Only one
+ * GL_TIME_ELAPSED query can be active at a time, so a GPU zone that starts
+ * inside another is timed on the CPU only, as is a GPU zone entered more
+ * than once in a frame after the first time. GPU timing needs OpenGL 3.3
+ * (timer queries) and a current context; without them GPU zones are timed
+ * on the CPU only.
+ *
+ * Frame times are summarized as mean and 50th, 95th and 99th percentiles
+ * (PrintSummary) and can be written in the Chrome trace event format
+ * (WriteChromeTrace) for viewing in chrome://tracing or Perfetto.
+ */
+class Profiler
+{
+public:
+   // Maximum number of zones
+   static const unsigned int MAX_ZONES = 16;
+
+   // Frames between issuing a GPU query and reading its result
+   static const unsigned int QUERY_FRAMES = 4;
+
+   /**
+    * Constructor. The profiler is enabled.
+    * @param  historyFrames  Number of recent frames to keep (at least QUERY_FRAMES + 1)
+    */
+   Profiler(const unsigned int historyFrames = 1024)
+   {
+      unsigned int frames = (historyFrames > QUERY_FRAMES) ? historyFrames : QUERY_FRAMES + 1;
+      m_frames.resize(frames);
+      m_enabled    = true;
+      m_zoneCount  = 0;
+      m_gpuState   = GPU_UNKNOWN;
+      m_gpuActive  = false;
+      memset(m_queries, 0, sizeof(m_queries));
+      memset(m_queryFrame, 0, sizeof(m_queryFrame));
+      memset(m_queryUsed, 0, sizeof(m_queryUsed));
+      m_epoch      = Clock::now();
+      Reset();
+   }
+
+   /**
+    * Destructor. Deletes the query objects (the context they were created
+    * in must still be current).
+    */
+   ~Profiler()
+   {
+      if (m_gpuState == GPU_ENABLED)
+         glDeleteQueries(QUERY_FRAMES * MAX_ZONES, &m_queries[0][0]);
+   }
+
+   /**
+    * Register a zone.
+    * @param  name  Zone name (copied)
+    * @param  gpu   True to also time the zone on the GPU
+    * @return  Returns the zone id passed to BeginZone and EndZone
+    *          (MAX_ZONES if there are too many zones).
+    */
+   unsigned int AddZone(const char* name, const bool gpu = false)
+   {
+      if (m_zoneCount >= MAX_ZONES)
+         return MAX_ZONES;
+      m_zoneNames.push_back(name);
+      m_zoneGPU[m_zoneCount] = gpu;
+      return m_zoneCount++;
+   }
+
+   /**
+    * Enable or disable recording. Recorded frames are kept.
+    * @param  enabled  True to record frames
+    */
+   void SetEnabled(const bool enabled)
+   {
+      m_enabled = enabled;
+      m_inFrame = false;
+   }
+
+   /**
+    * Check whether frames are recorded.
+    * @return  Returns true if the profiler is enabled.
+    */
+   bool IsEnabled() const
+   {
+      return m_enabled;
+   }
+
+   /**
+    * Forget all recorded frames.
+    */
+   void Reset()
+   {
+      m_frameCount = 0;
+      m_inFrame    = false;
+      m_gpuActive  = false;
+      memset(m_queryUsed, 0, sizeof(m_queryUsed));
+   }
+
+   /**
+    * Get the number of frames recorded since the last reset.
+    * @return  Returns the frame count (including frames no longer in the history).
+    */
+   unsigned long GetFrameCount() const
+   {
+      return m_frameCount;
+   }
+
+   /**
+    * End the current frame (if any) and start the next one. Reads the GPU
+    * times of the frame issued QUERY_FRAMES frames ago.
+    */
+   void NextFrame()
+   {
+      if (!m_enabled)
+         return;
+
+      // Zones should end before the frame does; stop a GPU query left active
+      // and clear its zone's flag so the zone's EndZone does not end it again
+      if (m_gpuActive)
+      {
+         glEndQuery(GL_TIME_ELAPSED);
+         m_gpuActive = false;
+         for (unsigned int z = 0; z < m_zoneCount; z++)
+            current().zones[z].timingGPU = false;
+      }
+
+      double now = elapsed();
+      if (m_inFrame)
+         current().interval = now - current().start;
+
+      // Frame numbers of frames in the history start at 1
+      m_frameCount++;
+      m_inFrame = true;
+      FrameSample& frame = current();
+      frame.frame    = m_frameCount;
+      frame.start    = now;
+      frame.interval = -1.0;
+      for (unsigned int z = 0; z < m_zoneCount; z++)
+      {
+         frame.zones[z].start     = -1.0;
+         frame.zones[z].cpu       = 0.0;
+         frame.zones[z].gpu       = -1.0;
+         frame.zones[z].calls     = 0;
+         frame.zones[z].timingGPU = false;
+      }
+      readQueries(m_frameCount % QUERY_FRAMES);
+   }
+
+   /**
+    * Start timing a zone. Zones must end before the frame does.
+    * @param  zone  Zone id
+    */
+   void BeginZone(const unsigned int zone)
+   {
+      if (!m_enabled || !m_inFrame || zone >= m_zoneCount)
+         return;
+
+      ZoneSample& sample = current().zones[zone];
+      sample.begin = elapsed();
+      if (sample.start < 0.0)
+         sample.start = sample.begin;
+      sample.calls++;
+
+      // One query per GPU zone per frame, and not inside another GPU zone
+      sample.timingGPU = false;
+      if (m_zoneGPU[zone] && !m_gpuActive && sample.calls == 1 && gpuTimingAvailable())
+      {
+         unsigned int slot = m_frameCount % QUERY_FRAMES;
+         glBeginQuery(GL_TIME_ELAPSED, m_queries[slot][zone]);
+         m_queryFrame[slot]       = m_frameCount;
+         m_queryUsed[slot][zone]  = true;
+         m_gpuActive              = true;
+         sample.timingGPU         = true;
+      }
+   }
+
+   /**
+    * Stop timing a zone.
+    * @param  zone  Zone id
+    */
+   void EndZone(const unsigned int zone)
+   {
+      if (!m_enabled || !m_inFrame || zone >= m_zoneCount)
+         return;
+
+      ZoneSample& sample = current().zones[zone];
+      if (sample.timingGPU)
+      {
+         glEndQuery(GL_TIME_ELAPSED);
+         m_gpuActive      = false;
+         sample.timingGPU = false;
+      }
+      sample.cpu += elapsed() - sample.begin;
+   }
+
+   /**
+    * Read the GPU times of every frame still waiting for them (waits for the
+    * GPU). Call before printing a summary or writing a trace.
+    */
+   void Flush()
+   {
+      for (unsigned int slot = 0; slot < QUERY_FRAMES; slot++)
+         readQueries(slot);
+   }
+
+   /**
+    * Print the mean and 50th / 95th / 99th percentile frame interval and the
+    * mean and 95th percentile of each zone over the frames in the history
+    * (frames that have ended). GPU times come from the frames whose queries
+    * have been read.
+    * @param  file  Output file
+    */
+   void PrintSummary(FILE* file = stdout)
+   {
+      Flush();
+      std::vector<double> values;
+      for (unsigned int i = 0; i < historyCount(); i++)
+      {
+         const FrameSample& frame = history(i);
+         if (frame.interval >= 0.0)
+            values.push_back(frame.interval);
+      }
+      if (values.empty())
+      {
+         fprintf(file, "Profiler: no complete frames\n");
+         return;
+      }
+      Stats stats = summarize(values);
+      fprintf(file, "Frame time over %u frames: mean %.3f ms (%.1f frames/sec), p50 %.3f, p95 %.3f, p99 %.3f, max %.3f ms\n",
+              stats.count, stats.mean, (stats.mean > 0.0) ? 1000.0 / stats.mean : 0.0,
+              stats.p50, stats.p95, stats.p99, stats.max);
+
+      for (unsigned int z = 0; z < m_zoneCount; z++)
+      {
+         std::vector<double> cpu, gpu;
+         for (unsigned int i = 0; i < historyCount(); i++)
+         {
+            const FrameSample& frame = history(i);
+            if (frame.interval < 0.0)
+               continue;
+            cpu.push_back(frame.zones[z].cpu);
+            if (frame.zones[z].gpu >= 0.0)
+               gpu.push_back(frame.zones[z].gpu);
+         }
+         Stats c = summarize(cpu);
+         fprintf(file, "  %-12s CPU mean %.3f ms, p95 %.3f, max %.3f", m_zoneNames[z].c_str(),
+                 c.mean, c.p95, c.max);
+         if (!gpu.empty())
+         {
+            Stats g = summarize(gpu);
+            fprintf(file, "   GPU mean %.3f ms, p95 %.3f, max %.3f", g.mean, g.p95, g.max);
+         }
+         fprintf(file, "\n");
+      }
+   }
+
+   /**
+    * Write the frames in the history in the Chrome trace event format. The
+    * frames and CPU zones are on one thread; GPU times are on a second
+    * thread, starting at the CPU start of their zone (the GPU clock is not
+    * aligned with the CPU clock).
+    * @param  fname  Output file name (.json)
+    * @return  Returns true if the file was written.
+    */
+   bool WriteChromeTrace(const char* fname)
+   {
+      Flush();
+      FILE* file = fopen(fname, "w");
+      if (file == NULL)
+      {
+         printf("Profiler: Error opening %s\n", fname);
+         return false;
+      }
+
+      fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+      fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+      fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+      for (unsigned int i = 0; i < historyCount(); i++)
+      {
+         const FrameSample& frame = history(i);
+         if (frame.interval >= 0.0)
+            writeEvent(file, "Frame", "frame", 1, frame.start, frame.interval, frame.frame);
+         for (unsigned int z = 0; z < m_zoneCount; z++)
+         {
+            const ZoneSample& zone = frame.zones[z];
+            if (zone.calls == 0)
+               continue;
+            writeEvent(file, m_zoneNames[z].c_str(), "cpu", 1, zone.start, zone.cpu, frame.frame);
+            if (zone.gpu >= 0.0)
+               writeEvent(file, m_zoneNames[z].c_str(), "gpu", 2, zone.start, zone.gpu, frame.frame);
+         }
+      }
+      fprintf(file, "\n]}\n");
+      bool ok = (ferror(file) == 0);
+      fclose(file);
+      return ok;
+   }
+
+protected:
+   typedef std::chrono::high_resolution_clock Clock;
+
+   // Whether GPU timer queries can be used (checked on first use)
+   enum GPUState { GPU_UNKNOWN, GPU_ENABLED, GPU_UNAVAILABLE };
+
+   // Times of a zone in one frame (milliseconds since the profiler was created)
+   struct ZoneSample
+   {
+      double       start;       // Start of the first call (-1 = not entered)
+      double       begin;       // Start of the current call
+      double       cpu;         // Total CPU time
+      double       gpu;         // GPU time (-1 = not measured or not read yet)
+      unsigned int calls;       // Number of calls
+      bool         timingGPU;   // The current call has a query active
+   };
+
+   // One frame
+   struct FrameSample
+   {
+      unsigned long frame;            // Frame number (from 1)
+      double        start;            // Start time
+      double        interval;         // Time to the start of the next frame (-1 = not ended)
+      ZoneSample    zones[MAX_ZONES];
+   };
+
+   // Summary of a set of times
+   struct Stats
+   {
+      unsigned int count;
+      double       mean;
+      double       p50;
+      double       p95;
+      double       p99;
+      double       max;
+   };
+
+   std::vector<FrameSample> m_frames;                              // Ring buffer of recent frames
+   unsigned long            m_frameCount;                          // Frames recorded (current frame number)
+   bool                     m_enabled;
+   bool                     m_inFrame;                             // A frame has been started
+   std::vector<std::string> m_zoneNames;
+   bool                     m_zoneGPU[MAX_ZONES];                  // Zone is timed on the GPU
+   unsigned int             m_zoneCount;
+   GPUState                 m_gpuState;
+   bool                     m_gpuActive;                           // A GL_TIME_ELAPSED query is active
+   GLuint                   m_queries[QUERY_FRAMES][MAX_ZONES];    // Queries for each frame in flight
+   unsigned long            m_queryFrame[QUERY_FRAMES];            // Frame that issued each slot's queries
+   bool                     m_queryUsed[QUERY_FRAMES][MAX_ZONES];  // Query issued and not read
+   Clock::time_point        m_epoch;                               // Time 0
+
+   // Milliseconds since the profiler was created
+   double elapsed() const
+   {
+      return std::chrono::duration<double, std::milli>(Clock::now() - m_epoch).count();
+   }
+
+   // Sample of the current frame
+   FrameSample& current()
+   {
+      return m_frames[m_frameCount % m_frames.size()];
+   }
+
+   // Number of frames in the history
+   unsigned int historyCount() const
+   {
+      return (m_frameCount < m_frames.size()) ? (unsigned int)m_frameCount : (unsigned int)m_frames.size();
+   }
+
+   // Frame i of the history (0 = oldest)
+   const FrameSample& history(const unsigned int i) const
+   {
+      unsigned long frame = m_frameCount - historyCount() + 1 + i;
+      return m_frames[frame % m_frames.size()];
+   }
+
+   /**
+    * Check whether GPU timer queries can be used, creating the query
+    * objects the first time.
+    * @return  Returns true if GPU zones can be timed.
+    */
+   bool gpuTimingAvailable()
+   {
+      if (m_gpuState == GPU_UNKNOWN)
+      {
+         if (gl3wIsSupported(3, 3))
+         {
+            glGenQueries(QUERY_FRAMES * MAX_ZONES, &m_queries[0][0]);
+            m_gpuState = GPU_ENABLED;
+         }
+         else
+            m_gpuState = GPU_UNAVAILABLE;
+      }
+      return m_gpuState == GPU_ENABLED;
+   }
+
+   /**
+    * Read the results of the queries in a slot into their frame's samples
+    * (if the frame is still in the history).
+    * @param  slot  Query slot
+    */
+   void readQueries(const unsigned int slot)
+   {
+      unsigned long frame = m_queryFrame[slot];
+      bool inHistory = (frame > 0 && frame <= m_frameCount && m_frameCount - frame < m_frames.size());
+      for (unsigned int z = 0; z < m_zoneCount; z++)
+      {
+         if (!m_queryUsed[slot][z])
+            continue;
+
+         // A query still active (the current frame's) is read later
+         if (frame == m_frameCount && current().zones[z].timingGPU)
+            continue;
+
+         GLuint64 ns = 0;
+         glGetQueryObjectui64v(m_queries[slot][z], GL_QUERY_RESULT, &ns);
+         m_queryUsed[slot][z] = false;
+         if (inHistory)
+            m_frames[frame % m_frames.size()].zones[z].gpu = (double)ns * 1.0e-6;
+      }
+   }
+
+   /**
+    * Find the mean, percentiles and maximum of a set of times (nearest rank).
+    * @param  values  Times (sorted by this call)
+    * @return  Returns the summary (all zero if there are no values).
+    */
+   static Stats summarize(std::vector<double>& values)
+   {
+      Stats stats;
+      memset(&stats, 0, sizeof(stats));
+      if (values.empty())
+         return stats;
+
+      std::sort(values.begin(), values.end());
+      double sum = 0.0;
+      for (unsigned int i = 0; i < values.size(); i++)
+         sum += values[i];
+      stats.count = (unsigned int)values.size();
+      stats.mean  = sum / values.size();
+      stats.p50   = percentile(values, 50.0);
+      stats.p95   = percentile(values, 95.0);
+      stats.p99   = percentile(values, 99.0);
+      stats.max   = values.back();
+      return stats;
+   }
+
+   // Nearest rank percentile of sorted values
+   static double percentile(const std::vector<double>& sorted, const double p)
+   {
+      unsigned int rank = (unsigned int)ceil(p / 100.0 * sorted.size());
+      if (rank < 1)
+         rank = 1;
+      if (rank > sorted.size())
+         rank = (unsigned int)sorted.size();
+      return sorted[rank - 1];
+   }
+
+   // Write a complete ("X") event. Times are in milliseconds, written in microseconds.
+   static void writeEvent(FILE* file, const char* name, const char* category, const int tid,
+                          const double start, const double duration, const unsigned long frame)
+   {
+      fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                    "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%lu}}",
+              name, category, tid, start * 1000.0, duration * 1000.0, frame);
+   }
+};
+
+/**
+ * Times a profiler zone from construction to the end of the enclosing scope.
+ */
+class ProfileZone
+{
+public:
+   /**
+    * Constructor. Starts the zone.
+    * @param  profiler  Profiler
+    * @param  zone      Zone id
+    */
+   ProfileZone(Profiler& profiler, const unsigned int zone)
+      : m_profiler(profiler), m_zone(zone)
+   {
+      m_profiler.BeginZone(m_zone);
+   }
+
+   /**
+    * Destructor. Ends the zone.
+    */
+   ~ProfileZone()
+   {
+      m_profiler.EndZone(m_zone);
+   }
+
+protected:
+   Profiler&    m_profiler;
+   unsigned int m_zone;
+
+private:
+   ProfileZone(const ProfileZone&);
+   ProfileZone& operator=(const ProfileZone&);
+};
+
+#endif
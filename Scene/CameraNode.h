@@ -32,11 +32,14 @@ public:
 		m_aspect = 1.0f;
 		m_near   = 1.0f;
 		m_far    = 1000.0f;
+		m_viewportHeight = 480;
 
 		// Initial view settings
 		m_lpt    = Point3(0.0f, 0.0f, 0.0f);
 		m_vrp    = Point3(0.0f, 0.0f, 1.0f);
 		m_v      = Vector3(0.0f, 1.0f, 0.0f);
+		m_serial = SceneState::NewSerial();
+		m_frustumSerial = 0;
 	}
 
 	/**
@@ -51,18 +54,95 @@ public:
 	 */
 	void Draw(SceneState& sceneState)
 	{
-		// Copy the current composite projection and viewing matrix to the scene state
-		sceneState.m_pvMatrix = m_projection * m_view;
-
-      // Set the shader PVM matrix - this will allow drawing children without a TransformNode
-      glUniformMatrix4fv(sceneState.m_pvmLoc, 1, GL_FALSE, sceneState.m_pvMatrix.Get());
-
-      // Set the camera position
-      glUniform3fv(sceneState.m_cameraPositionLoc, 1, &m_vrp.x);
+      Apply(sceneState);
 
 		// Draw children
 		SceneNode::Draw(sceneState);
 	}
+
+   /**
+    * Set the view matrices, camera uniforms and frustum without drawing the
+    * children.
+    * @param  sceneState  Current scene state
+    */
+   void Apply(SceneState& sceneState)
+   {
+		// Copy the current composite projection and viewing matrix to the scene state.
+		// Transform nodes keep their cached matrices while the serial is unchanged.
+		if (sceneState.m_viewSerial != m_serial)
+		{
+			sceneState.m_pvMatrix   = m_projection * m_view;
+			sceneState.m_viewSerial = m_serial;
+		}
+
+      if (sceneState.m_uniformBlocks)
+      {
+         // The composite matrix and camera position go in the camera block.
+         // Load identity modeling matrices so children without a TransformNode
+         // can be drawn.
+         CameraBlock block;
+         memcpy(block.pvMatrix, sceneState.m_pvMatrix.Get(), sizeof(block.pvMatrix));
+         block.cameraPosition[0] = m_vrp.x;
+         block.cameraPosition[1] = m_vrp.y;
+         block.cameraPosition[2] = m_vrp.z;
+         block.cameraPosition[3] = 1.0f;
+         sceneState.m_cameraBlock.Write(0, 0, &block, sizeof(block));
+         if (sceneState.m_modelMatrixLoc != -1)
+         {
+            Matrix4x4 identity;
+            sceneState.m_glState.UniformMatrix4fv(sceneState.m_modelMatrixLoc, identity.Get());
+            sceneState.m_glState.UniformMatrix4fv(sceneState.m_normalMatrixLoc, identity.Get());
+         }
+      }
+      else
+      {
+         // Set the shader PVM matrix - this will allow drawing children without a TransformNode
+         sceneState.m_glState.UniformMatrix4fv(sceneState.m_pvmLoc, sceneState.m_pvMatrix.Get());
+
+         // Set the camera position
+         sceneState.m_glState.Uniform3fv(sceneState.m_cameraPositionLoc, &m_vrp.x);
+      }
+
+      // Level of detail nodes use these to find the projected size of objects
+      sceneState.m_cameraPosition  = m_vrp;
+      sceneState.m_projectionScale = GetProjectionScale();
+
+      // Set the view frustum so children outside it are culled
+      if (sceneState.m_cullingEnabled)
+      {
+         sceneState.m_frustum      = GetFrustum();
+         sceneState.m_frustumValid = true;
+      }
+      sceneState.m_stateChanges++;
+   }
+
+   /**
+    * Set the camera in the trace state and trace the children.
+    * @param  traceState  Current trace state
+    */
+   void Trace(TraceState& traceState)
+   {
+      traceState.m_hasCamera      = true;
+      traceState.m_cameraPosition = m_vrp;
+      traceState.m_cameraU        = m_u;
+      traceState.m_cameraV        = m_v;
+      traceState.m_cameraN        = m_n;
+      traceState.m_fov            = m_fov;
+      traceState.m_aspect         = m_aspect;
+      traceState.m_near           = m_near;
+      traceState.m_far            = m_far;
+      SceneNode::Trace(traceState);
+   }
+
+   /**
+    * Set the current camera in the render queue and compile the children.
+    * @param  queue  Render queue being compiled
+    */
+   void Compile(RenderQueue& queue)
+   {
+      queue.SetCamera(this);
+      SceneNode::Compile(queue);
+   }
 	
 	/**
 	 * Sets the view reference point (camera position)
@@ -315,6 +395,45 @@ public:
       setPerspective();
    }
 
+   /**
+    * Change the viewport size. Sets the aspect ratio and the height used to
+    * find the projected size of objects in pixels.
+    * @param  width   Viewport width in pixels
+    * @param  height  Viewport height in pixels
+    */
+   void ChangeViewport(const int width, const int height)
+   {
+      m_viewportHeight = (height > 0) ? height : 1;
+      m_aspect = (float)width / (float)m_viewportHeight;
+      setPerspective();
+   }
+
+   /**
+    * Get the projected size scale: the height in pixels of an object of unit
+    * size at unit distance from the eye. An object of size s at distance d
+    * covers about s * scale / d pixels.
+    * @return  Returns the projection scale.
+    */
+   float GetProjectionScale() const
+   {
+      return 0.5f * (float)m_viewportHeight / tanf(degreesToRadians(m_fov * 0.5f));
+   }
+
+   /**
+    * Get the view frustum in world coordinates. It is rebuilt from the view
+    * axes and perspective parameters when either changes.
+    * @return  Returns the frustum.
+    */
+   const Frustum& GetFrustum()
+   {
+      if (m_frustumSerial != m_serial)
+      {
+         m_frustum.Set(m_vrp, m_u, m_v, m_n, m_fov, m_aspect, m_near, m_far);
+         m_frustumSerial = m_serial;
+      }
+      return m_frustum;
+   }
+
    /**
     * Change the near and far clipping planes.
     * @param  n  Near plane distance (must be positive)
@@ -333,6 +452,7 @@ private:
 	float   m_aspect;       // Aspect ratio (width / height)
 	float   m_near;         // Near clipping plane distance
 	float   m_far;          // Far clipping plane distance
+	int     m_viewportHeight; // Viewport height in pixels
 
 	Point3  m_vrp;		      // View point (eye)
 	Point3  m_lpt;		      // Lookat point
@@ -345,6 +465,11 @@ private:
 	// Matrices
 	Matrix4x4 m_view;	      // Viewing matrix
 	Matrix4x4 m_projection; // Projection matrix
+	unsigned int m_serial;  // Changes whenever the view or projection changes
+
+	// View frustum and the serial it was built for
+	Frustum      m_frustum;
+	unsigned int m_frustumSerial;
 
    // Sets the view axes
    void lookAt()
@@ -389,6 +514,7 @@ private:
       m_projection.m31() =  0.0f;
       m_projection.m32() = -1.0f;
       m_projection.m22() =  0.0f;
+      m_serial = SceneState::NewSerial();
    }
 
 	// Create viewing transformation matrix by composing the translation 
@@ -415,6 +541,7 @@ private:
 		m_view.m31() = 0.0f;
 		m_view.m32() = 0.0f;
 		m_view.m33() = 1.0f;
+		m_serial = SceneState::NewSerial();
 	}
 };
 
@@ -123,8 +123,8 @@ public:
 			m_faceList.push_back(getIndex(row+1, 0));
       }
 
-      // Create vertex buffers
-      CreateVertexBuffers(positionLoc, normalLoc, textureLoc);
+      // Vertex buffers are created when first drawn
+      SetVertexAttributes(positionLoc, normalLoc, textureLoc);
 	}
 	
 private:
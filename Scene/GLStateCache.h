@@ -0,0 +1,289 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    GLStateCache.h
+//	Purpose: Filter for redundant OpenGL state changes and uniform updates
+//          made by the scene graph nodes.
+//
+//============================================================================
+
+#ifndef __GLSTATECACHE_H
+#define __GLSTATECACHE_H
+
+#include <map>
+#include <string.h>
+#include <vector>
+
+/**
+ * OpenGL state cache. Scene nodes select programs, bind vertex arrays and
+ * set uniforms through this instead of calling OpenGL directly. When
+ * enabled, it remembers the current program, the bound vertex array and the
+ * value of every uniform of each program set through it, and drops calls
+ * that would not change anything. When disabled, every call goes to OpenGL
+ * as before.
+ *
+ * Uniform values belong to the program, so they stay valid while other
+ * programs are in use and are only filtered for a program selected with
+ * UseProgram (uniforms set while a program was selected some other way go
+ * to OpenGL). The program and vertex array bindings are forgotten at the
+ * start of each frame (see SceneState::Init), since code outside the scene
+ * graph may change them. Code that changes a program's uniforms directly
+ * must call Reset.
+ */
+class GLStateCache
+{
+public:
+   /**
+    * Constructor. The cache is disabled.
+    */
+   GLStateCache()
+   {
+      m_enabled = false;
+      m_calls   = 0;
+      m_skipped = 0;
+      InvalidateBindings();
+   }
+
+   /**
+    * Enable or disable filtering. The cache forgets all state either way.
+    * @param  enabled  True to drop redundant calls
+    */
+   void SetEnabled(const bool enabled)
+   {
+      m_enabled = enabled;
+      Reset();
+   }
+
+   /**
+    * Check whether redundant calls are dropped.
+    * @return  Returns true if the cache is enabled.
+    */
+   bool IsEnabled() const
+   {
+      return m_enabled;
+   }
+
+   /**
+    * Forget the current program and vertex array binding (uniform values are
+    * kept). Call after binding either outside the cache.
+    */
+   void InvalidateBindings()
+   {
+      m_program  = 0;
+      m_vao      = 0;
+      m_vaoKnown = false;
+      m_values   = NULL;
+   }
+
+   /**
+    * Forget all state, including uniform values.
+    */
+   void Reset()
+   {
+      InvalidateBindings();
+      m_uniforms.clear();
+   }
+
+   /**
+    * Reset the statistics (done by SceneState::Init at the start of a frame).
+    */
+   void ResetStatistics()
+   {
+      m_calls   = 0;
+      m_skipped = 0;
+   }
+
+   /**
+    * Get the number of calls made through the cache since the statistics
+    * were reset.
+    * @return  Returns the call count.
+    */
+   unsigned int GetCallCount() const
+   {
+      return m_calls;
+   }
+
+   /**
+    * Get the number of calls dropped because they would not change the
+    * OpenGL state.
+    * @return  Returns the count of redundant calls.
+    */
+   unsigned int GetSkippedCount() const
+   {
+      return m_skipped;
+   }
+
+   /**
+    * Select a program (glUseProgram).
+    * @param  program  Program object
+    */
+   void UseProgram(const GLuint program)
+   {
+      m_calls++;
+      if (m_enabled && program == m_program && program != 0)
+      {
+         m_skipped++;
+         return;
+      }
+      glUseProgram(program);
+      if (m_enabled)
+      {
+         m_program = program;
+         m_values  = (program != 0) ? &m_uniforms[program] : NULL;
+      }
+   }
+
+   /**
+    * Bind a vertex array object (glBindVertexArray).
+    * @param  vao  Vertex array object (0 to unbind)
+    */
+   void BindVertexArray(const GLuint vao)
+   {
+      m_calls++;
+      if (m_enabled && m_vaoKnown && vao == m_vao)
+      {
+         m_skipped++;
+         return;
+      }
+      glBindVertexArray(vao);
+      m_vao      = vao;
+      m_vaoKnown = m_enabled;
+   }
+
+   /**
+    * Finish with a vertex array. Unbinds it unless the cache is enabled, in
+    * which case it stays bound so the next draw of the same vertex array
+    * does not bind it again.
+    */
+   void ReleaseVertexArray()
+   {
+      if (!m_enabled)
+         glBindVertexArray(0);
+   }
+
+   /**
+    * Set an int (or bool / sampler) uniform (glUniform1i).
+    * @param  location  Uniform location (-1 is ignored, as in OpenGL)
+    * @param  v         Value
+    */
+   void Uniform1i(const GLint location, const GLint v)
+   {
+      if (location == -1)
+         return;
+      if (!changed(location, &v, sizeof(v)))
+         return;
+      glUniform1i(location, v);
+   }
+
+   /**
+    * Set a float uniform (glUniform1f).
+    * @param  location  Uniform location (-1 is ignored, as in OpenGL)
+    * @param  v         Value
+    */
+   void Uniform1f(const GLint location, const GLfloat v)
+   {
+      if (location == -1)
+         return;
+      if (!changed(location, &v, sizeof(v)))
+         return;
+      glUniform1f(location, v);
+   }
+
+   /**
+    * Set a vec3 uniform (glUniform3fv with a count of 1).
+    * @param  location  Uniform location (-1 is ignored, as in OpenGL)
+    * @param  v         3 values
+    */
+   void Uniform3fv(const GLint location, const GLfloat* v)
+   {
+      if (location == -1)
+         return;
+      if (!changed(location, v, 3 * sizeof(GLfloat)))
+         return;
+      glUniform3fv(location, 1, v);
+   }
+
+   /**
+    * Set a vec4 uniform (glUniform4fv with a count of 1).
+    * @param  location  Uniform location (-1 is ignored, as in OpenGL)
+    * @param  v         4 values
+    */
+   void Uniform4fv(const GLint location, const GLfloat* v)
+   {
+      if (location == -1)
+         return;
+      if (!changed(location, v, 4 * sizeof(GLfloat)))
+         return;
+      glUniform4fv(location, 1, v);
+   }
+
+   /**
+    * Set a mat4 uniform (glUniformMatrix4fv with a count of 1, not
+    * transposed).
+    * @param  location  Uniform location (-1 is ignored, as in OpenGL)
+    * @param  m         16 values in column order
+    */
+   void UniformMatrix4fv(const GLint location, const GLfloat* m)
+   {
+      if (location == -1)
+         return;
+      if (!changed(location, m, 16 * sizeof(GLfloat)))
+         return;
+      glUniformMatrix4fv(location, 1, GL_FALSE, m);
+   }
+
+protected:
+   // Largest uniform location whose value is remembered
+   static const GLint MAX_CACHED_LOCATION = 1023;
+
+   // Last value set for a uniform (size 0 = unknown)
+   struct UniformValue
+   {
+      unsigned int size;
+      GLfloat      value[16];
+   };
+
+   bool                                         m_enabled;
+   GLuint                                       m_program;    // Current program (0 = unknown)
+   GLuint                                       m_vao;        // Bound vertex array
+   bool                                         m_vaoKnown;   // m_vao is valid
+   std::vector<UniformValue>*                   m_values;     // Uniform values of m_program
+   std::map<GLuint, std::vector<UniformValue> > m_uniforms;   // Uniform values of each program
+   unsigned int                                 m_calls;      // Calls made through the cache
+   unsigned int                                 m_skipped;    // Calls dropped
+
+   /**
+    * Count a uniform call and check whether it changes the uniform's value,
+    * remembering the new value.
+    * @param  location  Uniform location
+    * @param  data      New value
+    * @param  size      Size of the value (bytes)
+    * @return  Returns true if the call must be made.
+    */
+   bool changed(const GLint location, const void* data, const unsigned int size)
+   {
+      m_calls++;
+      if (m_values == NULL || location < 0 || location > MAX_CACHED_LOCATION)
+         return true;
+
+      if ((GLint)m_values->size() <= location)
+      {
+         UniformValue unknown;
+         unknown.size = 0;
+         m_values->resize(location + 1, unknown);
+      }
+      UniformValue& current = (*m_values)[location];
+      if (current.size == size && memcmp(current.value, data, size) == 0)
+      {
+         m_skipped++;
+         return false;
+      }
+      current.size = size;
+      memcpy(current.value, data, size);
+      return true;
+   }
+};
+
+#endif
@@ -37,6 +37,27 @@ public:
    virtual void Draw(SceneState& sceneState)
    {
    }
+
+   /**
+    * Add a record that calls Draw to the render queue. Geometry nodes are
+    * leaf nodes, so children (kept only as references) are not compiled.
+    * @param  queue  Render queue being compiled
+    */
+   virtual void Compile(RenderQueue& queue)
+   {
+      queue.AddGeometry(this, false);
+   }
+
+protected:
+   /**
+    * Geometry nodes that do not report their extent have no bounds, so
+    * they are never culled.
+    * @return  Returns false.
+    */
+   virtual bool computeBounds(AABB&)
+   {
+      return false;
+   }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,185 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    InstancedGeometryNode.h
+//	Purpose: Scene graph geometry node that draws many copies of a triangle
+//          surface with a single instanced draw call.
+//
+//============================================================================
+
+#ifndef __INSTANCEDGEOMETRYNODE_H
+#define __INSTANCEDGEOMETRYNODE_H
+
+#include <vector>
+
+/**
+ * Instanced geometry node. Draws a TriSurface once per modeling matrix in a
+ * per-instance transform list. The matrices are copied to a vertex buffer
+ * and fed to the vertex shader as a per-instance mat4 attribute, so the
+ * number of draw calls does not depend on the number of instances. The
+ * shader must declare the instance matrix attribute and an "instanced" flag
+ * (see SceneState::m_instanceMatrixLoc and m_instancedLoc).
+ */
+class InstancedGeometryNode: public GeometryNode
+{
+public:
+   /**
+    * Constructor given the surface to draw.
+    * @param  surface  Triangle surface drawn for each instance
+    */
+   InstancedGeometryNode(TriSurface* surface)
+   {
+      m_nodeType       = SCENE_GEOMETRY;
+      m_surface        = surface;
+      m_transforms     = NULL;
+      m_vao            = 0;
+      m_instanceBuffer = 0;
+      m_bufferSize     = 0;
+
+      // Keep a reference to the surface. It is never drawn as a child.
+      AddChild(surface);
+   }
+
+   /**
+    * Destructor.
+    */
+   virtual ~InstancedGeometryNode()
+   {
+      glDeleteBuffers(1, &m_instanceBuffer);
+      glDeleteVertexArrays(1, &m_vao);
+   }
+
+   /**
+    * Set the per-instance modeling matrices. The list is read (not copied)
+    * each time the node is drawn, so it must remain valid while this node
+    * is in use. Call InvalidateBounds when the matrices change.
+    * @param  transforms  Modeling matrix for each instance
+    */
+   void SetInstances(const std::vector<Matrix4x4>* transforms)
+   {
+      m_transforms = transforms;
+      InvalidateBounds();
+   }
+
+   /**
+    * Draw all instances with one draw call. The current modeling matrix is
+    * applied to every instance (premultiplies the instance matrix).
+    * @param  sceneState  Current scene state
+    */
+   virtual void Draw(SceneState& sceneState)
+   {
+      if (m_transforms == NULL || m_transforms->empty() || sceneState.m_instanceMatrixLoc < 0)
+         return;
+
+      // Create the vertex array on first use (the attribute locations come
+      // from the current shader). This leaves no vertex array bound.
+      if (m_vao == 0)
+         createVertexArray(sceneState);
+
+      // Copy the instance matrices to the instance buffer. Reallocate the
+      // buffer only when it must grow.
+      GLsizeiptr size = (GLsizeiptr)(m_transforms->size() * sizeof(Matrix4x4));
+      glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+      if (size > m_bufferSize)
+      {
+         glBufferData(GL_ARRAY_BUFFER, size, (void*)&(*m_transforms)[0], GL_STREAM_DRAW);
+         m_bufferSize = size;
+      }
+      else
+         glBufferSubData(GL_ARRAY_BUFFER, 0, size, (void*)&(*m_transforms)[0]);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+      // Draw all instances
+      sceneState.FlushUniformBlocks();
+      sceneState.m_glState.Uniform1i(sceneState.m_instancedLoc, 1);
+      m_surface->DrawInstanced(sceneState, m_vao, (GLsizei)m_transforms->size());
+      sceneState.m_glState.Uniform1i(sceneState.m_instancedLoc, 0);
+      sceneState.m_trianglesDrawn += m_surface->GetTriangleCount() * (unsigned int)m_transforms->size();
+      sceneState.m_drawCalls++;
+   }
+
+   /**
+    * Count the triangles drawn for all instances.
+    * @return  Returns the triangle count.
+    */
+   virtual unsigned int CountTriangles()
+   {
+      return (m_transforms == NULL) ? 0 : m_surface->GetTriangleCount() * (unsigned int)m_transforms->size();
+   }
+
+   /**
+    * Add the surface to the trace state once per instance.
+    * @param  traceState  Current trace state
+    */
+   virtual void Trace(TraceState& traceState)
+   {
+      if (m_transforms == NULL)
+         return;
+
+      std::vector<Matrix4x4>::const_iterator transform = m_transforms->begin();
+      for ( ; transform != m_transforms->end(); transform++)
+      {
+         traceState.PushTransforms();
+         traceState.m_modelMatrix *= *transform;
+         m_surface->Trace(traceState);
+         traceState.PopTransforms();
+      }
+   }
+
+protected:
+   TriSurface*                   m_surface;           // Surface drawn for each instance
+   const std::vector<Matrix4x4>* m_transforms;        // Modeling matrix for each instance
+   GLuint                        m_vao;               // Surface attributes plus instance matrix
+   GLuint                        m_instanceBuffer;    // Instance matrices
+   GLsizeiptr                    m_bufferSize;        // Allocated size of the instance buffer
+
+   // Default constructor is private to force use of the one with arguments
+   InstancedGeometryNode() { }
+
+   /**
+    * Compute the bounding box of the surface at every instance.
+    * @param  box  Empty box to grow to bound the instances
+    * @return  Returns false if the surface has no bounds.
+    */
+   virtual bool computeBounds(AABB& box)
+   {
+      AABB surface;
+      if (!m_surface->GetBounds(surface))
+         return false;
+      if (m_transforms == NULL)
+         return true;
+      std::vector<Matrix4x4>::const_iterator transform = m_transforms->begin();
+      for ( ; transform != m_transforms->end(); transform++)
+         box.Add(transform->Transform(surface));
+      return true;
+   }
+
+   /**
+    * Create a vertex array that reads the surface's vertex attributes per
+    * vertex and the instance matrix (one column per attribute location)
+    * per instance.
+    * @param  sceneState  Current scene state (attribute locations)
+    */
+   void createVertexArray(SceneState& sceneState)
+   {
+      glGenBuffers(1, &m_instanceBuffer);
+      m_vao = m_surface->CreateVertexArray(sceneState.m_positionLoc, sceneState.m_normalLoc,
+                                           sceneState.m_vTexCoord, &sceneState.m_glState);
+      sceneState.m_glState.BindVertexArray(m_vao);
+      glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+      for (int i = 0; i < 4; i++)
+      {
+         GLuint loc = (GLuint)(sceneState.m_instanceMatrixLoc + i);
+         glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(Matrix4x4),
+                               (void*)(i * 4 * sizeof(float)));
+         glEnableVertexAttribArray(loc);
+         glVertexAttribDivisor(loc, 1);
+      }
+      sceneState.m_glState.BindVertexArray(0);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+   }
+};
+
+#endif
@@ -0,0 +1,378 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    LODGeometryNode.h
+//	Purpose: Scene graph geometry node that draws one of several
+//          tessellations of a surface, chosen by its size on screen.
+//
+//============================================================================
+
+#ifndef __LODGEOMETRYNODE_H
+#define __LODGEOMETRYNODE_H
+
+#include <float.h>
+#include <vector>
+
+/**
+ * Level of detail geometry node. Holds several tessellations (levels) of the
+ * same surface, each with the minimum projected size (in pixels) at which it
+ * is used. Each draw projects the bounding sphere of the surface using the
+ * camera position and projection scale in the scene state (see CameraNode)
+ * and draws the finest level whose minimum size is met.
+ *
+ * To avoid popping back and forth when the size is near a threshold, a
+ * threshold is only crossed once the size is past it by the hysteresis
+ * fraction: a level is dropped for a coarser one below minSize * (1 - h)
+ * and a finer level is picked up above minSize * (1 + h).
+ *
+ * With a list of per-instance modeling matrices (see SetInstances) each
+ * instance selects its own level and keeps its own hysteresis state. The
+ * instances are sorted by level and each level is drawn with one instanced
+ * draw call. Instances whose bounding sphere is outside the view frustum
+ * are skipped (their level is still updated). Otherwise the node keeps one
+ * state, so a node that appears under several transforms should be split
+ * into one node per transform.
+ *
+ * Ray tracing always uses the finest level.
+ */
+class LODGeometryNode: public GeometryNode
+{
+public:
+   /**
+    * Constructor.
+    */
+   LODGeometryNode()
+   {
+      m_nodeType   = SCENE_GEOMETRY;
+      m_hysteresis = 0.15f;
+      m_current    = 0;
+      m_radius     = 0.0f;
+      m_boundsSet  = false;
+      m_transforms = NULL;
+   }
+
+   /**
+    * Destructor.
+    */
+   virtual ~LODGeometryNode() { }
+
+   /**
+    * Add a level. Levels are kept in order of decreasing minimum size, so
+    * they may be added in any order. Unless SetBounds is called, the bounds
+    * are taken from the first level added.
+    * @param  surface  Tessellation of the surface
+    * @param  minSize  Smallest projected size (pixels) at which the level
+    *                  is used. The coarsest level is used below all of them.
+    */
+   void AddLevel(TriSurface* surface, const float minSize)
+   {
+      LODLevel level;
+      level.surface   = surface;
+      level.minSize   = minSize;
+      level.instances = new InstancedGeometryNode(surface);
+      std::vector<LODLevel>::iterator pos = m_levels.begin();
+      while (pos != m_levels.end() && pos->minSize >= minSize)
+         pos++;
+      m_levels.insert(pos, level);
+
+      // Each level's instanced node draws that level's list of matrices.
+      // Inserting a level moves the lists, so point every node again.
+      m_levelTransforms.resize(m_levels.size());
+      for (unsigned int l = 0; l < m_levels.size(); l++)
+         m_levels[l].instances->SetInstances(&m_levelTransforms[l]);
+
+      // Keep references to the surface and its instanced node. They are
+      // never drawn as children. Adding them here, not when first drawn,
+      // keeps Draw from changing the scene graph.
+      AddChild(surface);
+      AddChild(level.instances);
+
+      if (!m_boundsSet)
+      {
+         surface->GetBoundingSphere(m_center, m_radius);
+         m_boundsSet = true;
+      }
+   }
+
+   /**
+    * Set the bounding sphere (in modeling coordinates) used to find the
+    * projected size.
+    * @param  center  Center of the sphere
+    * @param  radius  Radius of the sphere
+    */
+   void SetBounds(const Point3& center, const float radius)
+   {
+      m_center    = center;
+      m_radius    = radius;
+      m_boundsSet = true;
+      InvalidateBounds();
+   }
+
+   /**
+    * Set the hysteresis: the fraction of a threshold by which the projected
+    * size must pass it before the level changes.
+    * @param  fraction  Hysteresis fraction (0 to switch exactly at the thresholds)
+    */
+   void SetHysteresis(const float fraction)
+   {
+      m_hysteresis = fraction;
+   }
+
+   /**
+    * Set the per-instance modeling matrices. The list is read (not copied)
+    * each time the node is drawn, so it must remain valid while this node
+    * is in use. Call InvalidateBounds when the matrices change. The shader
+    * must support instancing (see InstancedGeometryNode).
+    * @param  transforms  Modeling matrix for each instance (NULL to draw once)
+    */
+   void SetInstances(const std::vector<Matrix4x4>* transforms)
+   {
+      m_transforms = transforms;
+      InvalidateBounds();
+   }
+
+   /**
+    * Get the number of levels.
+    * @return  Returns the level count.
+    */
+   unsigned int GetLevelCount() const
+   {
+      return (unsigned int)m_levels.size();
+   }
+
+   /**
+    * Get a level's surface (level 0 is the finest).
+    * @param  level  Level index
+    * @return  Returns the surface.
+    */
+   TriSurface* GetLevel(const unsigned int level) const
+   {
+      return m_levels[level].surface;
+   }
+
+   /**
+    * Get the level drawn last (without instances).
+    * @return  Returns the level index.
+    */
+   unsigned int GetCurrentLevel() const
+   {
+      return m_current;
+   }
+
+   /**
+    * Get the projected size of the bounding sphere: its diameter in pixels
+    * at its distance from the eye.
+    * @param  modelMatrix  Modeling matrix
+    * @param  sceneState   Scene state with the camera position and projection scale
+    * @return  Returns the projected size (very large if the eye is inside
+    *          the sphere or the camera is unknown).
+    */
+   float GetProjectedSize(const Matrix4x4& modelMatrix, const SceneState& sceneState) const
+   {
+      Point3 center;
+      float radius = worldSphere(modelMatrix, center);
+      return projectedSize(center, radius, sceneState);
+   }
+
+   /**
+    * Select the level for a projected size, with hysteresis.
+    * @param  size     Projected size in pixels
+    * @param  current  Level currently in use
+    * @return  Returns the level to use.
+    */
+   unsigned int SelectLevel(const float size, const unsigned int current) const
+   {
+      // Level i is used down to threshold i. Thresholds the current level
+      // is already past need the size to move back by the hysteresis.
+      unsigned int level = 0;
+      while (level + 1 < m_levels.size())
+      {
+         float scale = (level < current) ? 1.0f + m_hysteresis : 1.0f - m_hysteresis;
+         if (size >= m_levels[level].minSize * scale)
+            break;
+         level++;
+      }
+      return level;
+   }
+
+   /**
+    * Draw the level selected for the current modeling matrix, or each
+    * instance at its own level.
+    * @param  sceneState  Current scene state
+    */
+   virtual void Draw(SceneState& sceneState)
+   {
+      if (m_levels.empty())
+         return;
+
+      if (m_transforms == NULL)
+      {
+         m_current = SelectLevel(GetProjectedSize(sceneState.m_modelMatrix, sceneState), m_current);
+         m_levels[m_current].surface->Draw(sceneState);
+         return;
+      }
+
+      // Select the level of each instance and sort the instances by level.
+      // Each level's list has room for every instance, so it never grows
+      // while instances move between levels.
+      unsigned int count = (unsigned int)m_transforms->size();
+      if (m_instanceLevels.size() < count)
+         m_instanceLevels.resize(count, 0);
+      for (unsigned int l = 0; l < m_levels.size(); l++)
+      {
+         m_levelTransforms[l].clear();
+         m_levelTransforms[l].reserve(count);
+      }
+      Matrix4x4 modelMatrix;
+      Point3 center;
+      for (unsigned int i = 0; i < count; i++)
+      {
+         const Matrix4x4& transform = (*m_transforms)[i];
+         modelMatrix = sceneState.m_modelMatrix * transform;
+         float radius = worldSphere(modelMatrix, center);
+         unsigned int level = SelectLevel(projectedSize(center, radius, sceneState), m_instanceLevels[i]);
+         m_instanceLevels[i] = (unsigned char)level;
+         if (sceneState.m_frustumValid && sceneState.m_frustum.Outside(center, radius))
+         {
+            sceneState.m_nodesCulled++;
+            sceneState.m_trianglesCulled += m_levels[level].surface->GetTriangleCount();
+            continue;
+         }
+         m_levelTransforms[level].push_back(transform);
+      }
+
+      // One instanced draw per level in use
+      for (unsigned int l = 0; l < m_levels.size(); l++)
+      {
+         if (!m_levelTransforms[l].empty())
+            m_levels[l].instances->Draw(sceneState);
+      }
+   }
+
+   /**
+    * Count the triangles drawn at the current level (of each instance).
+    * @return  Returns the triangle count.
+    */
+   virtual unsigned int CountTriangles()
+   {
+      if (m_levels.empty())
+         return 0;
+      if (m_transforms == NULL)
+         return m_levels[m_current].surface->GetTriangleCount();
+
+      unsigned int count = 0;
+      for (unsigned int i = 0; i < m_transforms->size(); i++)
+      {
+         unsigned int level = (i < m_instanceLevels.size()) ? m_instanceLevels[i] : 0;
+         count += m_levels[level].surface->GetTriangleCount();
+      }
+      return count;
+   }
+
+   /**
+    * Add the finest level to the trace state (once per instance if there
+    * are instances).
+    * @param  traceState  Current trace state
+    */
+   virtual void Trace(TraceState& traceState)
+   {
+      if (m_levels.empty())
+         return;
+
+      if (m_transforms == NULL)
+      {
+         m_levels[0].surface->Trace(traceState);
+         return;
+      }
+      std::vector<Matrix4x4>::const_iterator transform = m_transforms->begin();
+      for ( ; transform != m_transforms->end(); transform++)
+      {
+         traceState.PushTransforms();
+         traceState.m_modelMatrix *= *transform;
+         m_levels[0].surface->Trace(traceState);
+         traceState.PopTransforms();
+      }
+   }
+
+protected:
+   // A tessellation and the smallest projected size it is used at
+   struct LODLevel
+   {
+      TriSurface*            surface;
+      float                  minSize;
+      InstancedGeometryNode* instances;   // Draws the level's instances
+   };
+
+   std::vector<LODLevel> m_levels;              // Levels, finest first
+   float                 m_hysteresis;          // Fraction past a threshold before switching
+   unsigned int          m_current;             // Level drawn last (without instances)
+   Point3                m_center;              // Bounding sphere (modeling coordinates)
+   float                 m_radius;
+   bool                  m_boundsSet;           // Bounds set (or taken from a level)
+
+   // Instances: modeling matrices, the level of each, and the matrices
+   // drawn at each level this frame
+   const std::vector<Matrix4x4>*        m_transforms;
+   std::vector<unsigned char>           m_instanceLevels;
+   std::vector<std::vector<Matrix4x4> > m_levelTransforms;
+
+   /**
+    * Compute the bounding box of the bounding sphere (at every instance).
+    * @param  box  Empty box to grow to bound the node
+    * @return  Returns true.
+    */
+   virtual bool computeBounds(AABB& box)
+   {
+      if (m_levels.empty())
+         return true;
+
+      Vector3 r(m_radius, m_radius, m_radius);
+      AABB sphere(m_center - r, m_center + r);
+      if (m_transforms == NULL)
+      {
+         box = sphere;
+         return true;
+      }
+      std::vector<Matrix4x4>::const_iterator transform = m_transforms->begin();
+      for ( ; transform != m_transforms->end(); transform++)
+         box.Add(transform->Transform(sphere));
+      return true;
+   }
+
+   /**
+    * Transform the bounding sphere. The radius is scaled by the largest
+    * axis scaling of the modeling matrix.
+    * @param  modelMatrix  Modeling matrix
+    * @param  center       Returns the center of the sphere
+    * @return  Returns the radius of the sphere.
+    */
+   float worldSphere(const Matrix4x4& modelMatrix, Point3& center) const
+   {
+      HPoint3 c = modelMatrix * m_center;
+      center.Set(c.x, c.y, c.z);
+      float s2 = 0.0f;
+      for (unsigned int col = 0; col < 3; col++)
+      {
+         float x = modelMatrix.m(0, col);
+         float y = modelMatrix.m(1, col);
+         float z = modelMatrix.m(2, col);
+         s2 = MAXV(s2, x * x + y * y + z * z);
+      }
+      return m_radius * sqrtf(s2);
+   }
+
+   // Projected diameter (pixels) of a sphere in world coordinates
+   static float projectedSize(const Point3& center, const float radius, const SceneState& sceneState)
+   {
+      if (sceneState.m_projectionScale <= 0.0f)
+         return FLT_MAX;
+      float d = (center - sceneState.m_cameraPosition).Norm();
+      if (d <= radius)
+         return FLT_MAX;
+      return 2.0f * radius * sceneState.m_projectionScale / d;
+   }
+};
+
+#endif
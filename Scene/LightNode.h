@@ -143,40 +143,102 @@ public:
 	 */
 	void Draw(SceneState& sceneState)
 	{
-      glUniform1i(sceneState.lights[m_index].enabled, (int)m_enabled);
+      Apply(sceneState);
+
+		// Draw children of this node
+		SceneNode::Draw(sceneState);
+
+      // To be proper we should disable this light so it does not impact any nodes that 
+      // are not descended from this node
+      sceneState.DisableLight(m_index);
+	}
+
+   /**
+    * Set the light uniforms for this light's slot (without drawing the
+    * children).
+    * @param  sceneState  Current scene state
+    */
+   void Apply(SceneState& sceneState)
+   {
+      if (sceneState.m_uniformBlocks)
+      {
+         applyBlock(sceneState);
+         sceneState.m_stateChanges++;
+         return;
+      }
+
+      sceneState.m_glState.Uniform1i(sceneState.lights[m_index].enabled, (int)m_enabled);
 		if (m_enabled)
 		{
-         glUniform1i(sceneState.lights[m_index].spotlight, (int)m_isSpotlight);
-         glUniform4fv(sceneState.lights[m_index].position, 1, &m_position.x);
-         glUniform4fv(sceneState.lights[m_index].ambient, 1, &m_ambient.r);
-         glUniform4fv(sceneState.lights[m_index].diffuse, 1, &m_diffuse.r);
-         glUniform4fv(sceneState.lights[m_index].specular, 1, &m_specular.r);
-         glUniform1f(sceneState.lights[m_index].constantAttenuation, m_atten0);
-         glUniform1f(sceneState.lights[m_index].linearAttenuation, m_atten1);
-         glUniform1f(sceneState.lights[m_index].quadraticAttenuation, m_atten2);
+         sceneState.m_glState.Uniform1i(sceneState.lights[m_index].spotlight, (int)m_isSpotlight);
+         sceneState.m_glState.Uniform4fv(sceneState.lights[m_index].position, &m_position.x);
+         sceneState.m_glState.Uniform4fv(sceneState.lights[m_index].ambient, &m_ambient.r);
+         sceneState.m_glState.Uniform4fv(sceneState.lights[m_index].diffuse, &m_diffuse.r);
+         sceneState.m_glState.Uniform4fv(sceneState.lights[m_index].specular, &m_specular.r);
+         sceneState.m_glState.Uniform1f(sceneState.lights[m_index].constantAttenuation, m_atten0);
+         sceneState.m_glState.Uniform1f(sceneState.lights[m_index].linearAttenuation, m_atten1);
+         sceneState.m_glState.Uniform1f(sceneState.lights[m_index].quadraticAttenuation, m_atten2);
          if (m_isSpotlight)
          {
             // Note we use cos of the spotlight cutoff angle so we don't have to compute cos 
             // in the shader
-            glUniform1f(sceneState.lights[m_index].spotCosCutoff, m_cosSpotCutoff);
-            glUniform3fv(sceneState.lights[m_index].spotDirection, 1, &m_spotDirection.x);
-            glUniform1f(sceneState.lights[m_index].spotExponent, m_spotExponent);
+            sceneState.m_glState.Uniform1f(sceneState.lights[m_index].spotCosCutoff, m_cosSpotCutoff);
+            sceneState.m_glState.Uniform3fv(sceneState.lights[m_index].spotDirection, &m_spotDirection.x);
+            sceneState.m_glState.Uniform1f(sceneState.lights[m_index].spotExponent, m_spotExponent);
          }
 
          if (m_index > (unsigned int)sceneState.m_maxEnabledLight)
          {
-            glUniform1i(sceneState.m_numLightsLoc, m_index+1);
+            sceneState.m_glState.Uniform1i(sceneState.m_numLightsLoc, m_index+1);
             sceneState.m_maxEnabledLight = m_index;
          }
       }
+      sceneState.m_stateChanges++;
+   }
 
-		// Draw children of this node
-		SceneNode::Draw(sceneState);
+   /**
+    * Enable this light in the trace state for the children (if enabled),
+    * matching the light uniforms set in Draw.
+    * @param  traceState  Current trace state
+    */
+   void Trace(TraceState& traceState)
+   {
+      if (m_enabled)
+      {
+         TraceLight light;
+         light.spotlight            = m_isSpotlight;
+         light.position             = m_position;
+         light.ambient              = m_ambient;
+         light.diffuse              = m_diffuse;
+         light.specular             = m_specular;
+         light.constantAttenuation  = m_atten0;
+         light.linearAttenuation    = m_atten1;
+         light.quadraticAttenuation = m_atten2;
+         light.spotCosCutoff        = m_cosSpotCutoff;
+         light.spotExponent         = m_spotExponent;
+         light.spotDirection        = m_spotDirection;
+         traceState.EnableLight(m_index, light);
+      }
+      else
+         traceState.SetLightSlot(m_index, -1);
 
-      // To be proper we should disable this light so it does not impact any nodes that 
-      // are not descended from this node
-      glUniform1i(sceneState.lights[m_index].enabled, 0);
-	}
+      // Draw disables the light after the children
+      SceneNode::Trace(traceState);
+      traceState.SetLightSlot(m_index, -1);
+   }
+
+   /**
+    * Put this light in its slot in the render queue for the children. The
+    * light is applied when drawn, so enabling or disabling it does not
+    * require compiling again.
+    * @param  queue  Render queue being compiled
+    */
+   void Compile(RenderQueue& queue)
+   {
+      queue.SetLight(m_index, this);
+      SceneNode::Compile(queue);
+      queue.SetLight(m_index, NULL);
+   }
 	
 protected:
 	bool         m_enabled;
@@ -194,6 +256,45 @@ protected:
 	
 	// Light position as a homogeneous coordinate. If w = 0 the light is directional
 	HPoint3      m_position;
+
+   /**
+    * Write this light to its slot in the lights uniform block. Unchanged
+    * values are not uploaded again.
+    * @param  sceneState  Current scene state
+    */
+   void applyBlock(SceneState& sceneState)
+   {
+      if (m_index >= BLOCK_MAX_LIGHTS)
+         return;
+
+      LightBlock block;
+      memset(&block, 0, sizeof(block));
+      block.enabled = (int)m_enabled;
+      if (m_enabled)
+      {
+         block.spotlight = (int)m_isSpotlight;
+         memcpy(block.position, &m_position.x, sizeof(block.position));
+         memcpy(block.ambient,  &m_ambient.r,  sizeof(block.ambient));
+         memcpy(block.diffuse,  &m_diffuse.r,  sizeof(block.diffuse));
+         memcpy(block.specular, &m_specular.r, sizeof(block.specular));
+         block.constantAttenuation  = m_atten0;
+         block.linearAttenuation    = m_atten1;
+         block.quadraticAttenuation = m_atten2;
+         block.spotCosCutoff        = m_cosSpotCutoff;
+         block.spotExponent         = m_spotExponent;
+         memcpy(block.spotDirection, &m_spotDirection.x, sizeof(block.spotDirection));
+      }
+      sceneState.m_lightsBlock.Write(0, (unsigned int)(offsetof(LightsBlock, lights) + m_index * sizeof(LightBlock)),
+                                     &block, sizeof(block));
+
+      if (m_enabled && m_index > (unsigned int)sceneState.m_maxEnabledLight)
+      {
+         int numLights = (int)m_index + 1;
+         sceneState.m_lightsBlock.Write(0, (unsigned int)offsetof(LightsBlock, numLights),
+                                        &numLights, sizeof(numLights));
+         sceneState.m_maxEnabledLight = m_index;
+      }
+   }
 };
 
 #endif
\ No newline at end of file
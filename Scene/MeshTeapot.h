@@ -5,13 +5,16 @@
 //
 //	Author:  David W. Nesbitt
 //	File:		MeshTeapot.h
-//	Purpose:	Construction of the Utah teapot using recursive subdivision.
+//	Purpose:	Construction of the Utah teapot by evaluating its Bezier
+//          patches on a grid (or using recursive subdivision).
 //============================================================================
 
 
 #ifndef __MESHTEAPOT_H__
 #define __MESHTEAPOT_H__
 
+#include <map>
+
 typedef float point[3];
 point TeapotVertexList[] = {
          {1.4f , 0.0f , 2.4f},
@@ -358,33 +361,81 @@ int PatchIndices[32][4][4]=  {
    {{270, 270, 270, 270}, {300, 305, 306, 279}, {297, 303, 304, 275}, {294, 301, 302, 271}}
 };
 
+// Key of a patch edge: the indices of its 4 control points (in the order
+// that sorts lower, so a shared edge has the same key in both patches)
+struct TeapotEdgeKey
+{
+   int c[4];
+
+   bool operator < (const TeapotEdgeKey& key) const
+   {
+      for (int i = 0; i < 4; i++)
+      {
+         if (c[i] != key.c[i])
+            return c[i] < key.c[i];
+      }
+      return false;
+   }
+};
+
 /**
+ * Utah teapot. By default each of the 32 bicubic patches is evaluated
+ * directly on a (2^level + 1) x (2^level + 1) grid of parameter values,
+ * which gives the same vertices (to within rounding) as level recursive
+ * subdivisions. Normals come from the patch derivatives, so they are exact
+ * rather than averaged from the faces.
  *
+ * Vertices on patch borders are shared by index: border vertices are
+ * identified by the control point indices of the patch edge (or corner)
+ * they lie on, so neighboring patches use the same vertices without any
+ * searching. Patches are evaluated in parallel if a job system is given.
  */
 class MeshTeapot : public TriSurface
 {
 public:
    /**
-    * Constructs the Utah teapot using uniform patch subdivision.  Reads in the 
-    * patch vertices and indices into a Point3 array.  Recursively subdivides and store
-    *	patches into a mesh surface.
-    * @param      level    Number of levels to subdivide the patches
+    * Constructs the Utah teapot by evaluating each patch on a grid with
+    * 2^level divisions in each direction.
+    * @param  level        Number of levels of subdivision the grid matches
+    * @param  positionLoc  Vertex position attribute location
+    * @param  normalLoc    Vertex normal attribute location
+    * @param  textureLoc   Texture coordinate attribute location
+    * @param  jobs         Job system to evaluate the patches with (may be NULL)
     */
-   MeshTeapot(int level, const int positionLoc, const int normalLoc, const int textureLoc)
+   MeshTeapot(int level, const int positionLoc, const int normalLoc, const int textureLoc,
+              JobSystem* jobs = NULL)
    {
       m_subdivisions = level;
+      tessellate(1u << level, jobs);
 
-      // Data is 32 patches, each with a 4x4 array of point[3].
-      //	Convert array data into Point3 array.
-      int m, patch;
-      Point3 data[32][4][4];
-      for (patch = 0; patch < 32; patch++)
+      // Normals are already set - the vertex buffers are created when first drawn
+      SetVertexAttributes(positionLoc, normalLoc, textureLoc);
+   }
+
+protected:
+   unsigned int m_subdivisions;
+
+   /**
+    * Constructor for derived classes that tessellate the teapot themselves.
+    */
+   MeshTeapot()
+   {
+      m_subdivisions = 0;
+   }
+
+   /**
+    * Get the control points of the 32 patches.
+    * @param  data  Patches (4x4 control points each)
+    */
+   static void getPatches(Point3 data[32][4][4])
+   {
+      int m;
+      for (int patch = 0; patch < 32; patch++)
       {
          for (int j = 0; j < 4; j++)
          {
             for (int k = 0; k < 4; k++)
             {
-               // Put teapot data into single array for subdivision
                m = PatchIndices[patch][j][k];
                data[patch][j][k].x = TeapotVertexList[m-1][0];
                data[patch][j][k].y = TeapotVertexList[m-1][1];
@@ -392,18 +443,333 @@ public:
             }
          }
       }
+   }
 
-      // Subdivide all 32 patches
-      for (patch = 0; patch < 32; patch++)
+   /**
+    * Construct the mesh using recursive subdivision of the patches (the
+    * original method). Adds the triangles - call End to set the normals.
+    * @param  level  Number of levels to subdivide the patches
+    */
+   void subdivide(const int level)
+   {
+      m_subdivisions = level;
+      Point3 data[32][4][4];
+      getPatches(data);
+      for (int patch = 0; patch < 32; patch++)
          dividePatch(data[patch], level);
+   }
+
+   /**
+    * Construct the mesh by evaluating each patch on an (n + 1) x (n + 1)
+    * grid of parameter values, with normals from the patch derivatives.
+    * Patch edges join the s direction of one patch to the t direction of
+    * another, so the grid has n divisions in both directions.
+    * @param  n     Number of divisions in each direction
+    * @param  jobs  Job system to evaluate the patches with (may be NULL)
+    */
+   void tessellate(const unsigned int n, JobSystem* jobs)
+   {
+      Point3 data[32][4][4];
+      getPatches(data);
+
+      // Some control points are listed twice (the bottom joins the body
+      // with copies of the body's points). Use the first of equal points so
+      // shared edges have the same control point indices.
+      int indices[32][4][4];
+      for (int patch = 0; patch < 32; patch++)
+      {
+         for (int j = 0; j < 4; j++)
+         {
+            for (int k = 0; k < 4; k++)
+            {
+               int m = PatchIndices[patch][j][k];
+               const float* p = TeapotVertexList[m-1];
+               for (int first = 1; first < m; first++)
+               {
+                  const float* q = TeapotVertexList[first-1];
+                  if (p[0] == q[0] && p[1] == q[1] && p[2] == q[2])
+                  {
+                     m = first;
+                     break;
+                  }
+               }
+               indices[patch][j][k] = m;
+            }
+         }
+      }
+
+      // Assign vertex indexes to the grid points of each patch. Border
+      // points are keyed by the control points of their corner or edge.
+      unsigned int gridSize = (n + 1) * (n + 1);
+      std::vector<unsigned int> grid(32 * gridSize);
+      std::vector<unsigned int> corners(TEAPOT_CONTROL_POINTS + 1, (unsigned int)PointHash::NOT_FOUND);
+      std::map<TeapotEdgeKey, unsigned int> edges;
+      unsigned int vertexCount = 0;
+      for (unsigned int patch = 0; patch < 32; patch++)
+      {
+         const int (*c)[4] = indices[patch];
+         for (unsigned int i = 0; i <= n; i++)
+         {
+            for (unsigned int j = 0; j <= n; j++)
+            {
+               unsigned int* index = &grid[patch * gridSize + i * (n + 1) + j];
+               bool sBorder = (i == 0 || i == n);
+               bool tBorder = (j == 0 || j == n);
+               if (sBorder && tBorder)
+                  *index = sharedVertex(corners[c[(i == 0) ? 0 : 3][(j == 0) ? 0 : 3]], vertexCount);
+               else if (sBorder)
+               {
+                  const int* row = c[(i == 0) ? 0 : 3];
+                  int edge[4] = { row[0], row[1], row[2], row[3] };
+                  *index = edgeVertex(edges, edge, j, n, corners, vertexCount);
+               }
+               else if (tBorder)
+               {
+                  int k = (j == 0) ? 0 : 3;
+                  int edge[4] = { c[0][k], c[1][k], c[2][k], c[3][k] };
+                  *index = edgeVertex(edges, edge, i, n, corners, vertexCount);
+               }
+               else
+                  *index = vertexCount++;
+            }
+         }
+      }
+
+      // The first grid point to use a vertex evaluates it
+      std::vector<char> owner(32 * gridSize, 0);
+      std::vector<char> assigned(vertexCount, 0);
+      for (unsigned int i = 0; i < 32 * gridSize; i++)
+      {
+         if (!assigned[grid[i]])
+            owner[i] = assigned[grid[i]] = 1;
+      }
+
+      // Bernstein polynomials (and derivatives) at each grid parameter value
+      std::vector<float> basis((n + 1) * 8);
+      for (unsigned int i = 0; i <= n; i++)
+         bernstein((float)i / (float)n, &basis[i * 8], &basis[i * 8 + 4]);
+
+      // Evaluate the patches
+      m_vertexList.assign(vertexCount, VertexAndNormal());
+      m_textureList.assign(vertexCount, Vector2());
+      m_faceList.resize(32 * n * n * 6);
+      std::vector<char> degenerate(vertexCount, 0);
+      JobSystem::RangeFunction evaluate = [&](unsigned int begin, unsigned int end)
+      {
+         for (unsigned int patch = begin; patch < end; patch++)
+         {
+            evaluatePatch(data[patch], n, &basis[0], &grid[patch * gridSize],
+                          &owner[patch * gridSize], degenerate);
+            addPatchFaces(&grid[patch * gridSize], n, &m_faceList[patch * n * n * 6]);
+         }
+      };
+      if (jobs != NULL)
+         jobs->ParallelFor(32, 1, evaluate);
+      else
+         evaluate(0, 32);
 
-      // End the mesh - construct vertex normals by averaging
-      End(positionLoc, normalLoc, textureLoc);
+      // Normals are undefined where a patch edge collapses to a point (e.g.
+      // the top of the lid) - average the adjoining face normals there
+      averageDegenerateNormals(degenerate);
+      m_bvhBuilt = false;
+      m_vertexHash.Clear();
    }
 
-protected:
-   unsigned int m_subdivisions;
+   // Number of distinct control points in the patch data
+   enum { TEAPOT_CONTROL_POINTS = 306 };
+
+   // Get the vertex for a corner control point, creating it if needed
+   static unsigned int sharedVertex(unsigned int& vertex, unsigned int& vertexCount)
+   {
+      if (vertex == (unsigned int)PointHash::NOT_FOUND)
+         vertex = vertexCount++;
+      return vertex;
+   }
+
+   /**
+    * Get the vertex at position k (1 to n-1) along a patch edge, creating the
+    * vertices of the edge if it has not been seen before.
+    * @param  edges        First vertex of the interior of each edge seen
+    * @param  edge         Control point indices of the edge
+    * @param  k            Position along the edge
+    * @param  n            Number of divisions of the edge
+    * @param  corners      Vertex of each corner control point
+    * @param  vertexCount  Number of vertices (updated)
+    * @return  Returns the vertex index.
+    */
+   static unsigned int edgeVertex(std::map<TeapotEdgeKey, unsigned int>& edges, const int edge[4],
+                                  const unsigned int k, const unsigned int n,
+                                  std::vector<unsigned int>& corners, unsigned int& vertexCount)
+   {
+      // An edge with all control points equal is a single point
+      if (edge[0] == edge[1] && edge[1] == edge[2] && edge[2] == edge[3])
+         return sharedVertex(corners[edge[0]], vertexCount);
+
+      // Key the edge in the direction that sorts lower
+      TeapotEdgeKey key;
+      bool reversed = false;
+      for (int i = 0; i < 4; i++)
+      {
+         if (edge[i] != edge[3 - i])
+         {
+            reversed = edge[3 - i] < edge[i];
+            break;
+         }
+      }
+      for (int i = 0; i < 4; i++)
+         key.c[i] = reversed ? edge[3 - i] : edge[i];
+
+      std::map<TeapotEdgeKey, unsigned int>::iterator found = edges.find(key);
+      if (found == edges.end())
+      {
+         found = edges.insert(std::make_pair(key, vertexCount)).first;
+         vertexCount += n - 1;
+      }
+      return found->second + (reversed ? n - k : k) - 1;
+   }
 
+   /**
+    * Evaluate the position, normal and texture coordinates of the grid
+    * points of a patch that it owns.
+    * @param  patch       Control points
+    * @param  n           Number of divisions in each direction
+    * @param  basis       Bernstein polynomials and derivatives at each of the
+    *                     n + 1 parameter values (8 floats each)
+    * @param  grid        Vertex index of each grid point
+    * @param  owner       Whether the patch evaluates each grid point
+    * @param  degenerate  Set for vertices whose normal is undefined
+    */
+   void evaluatePatch(const Point3 patch[4][4], const unsigned int n, const float* basis,
+                      const unsigned int* grid, const char* owner, std::vector<char>& degenerate)
+   {
+      Point3  q[4];                // Curve in t at the current s
+      Vector3 dq[4];               // Its derivative with respect to s
+      for (unsigned int i = 0; i <= n; i++)
+      {
+         // Collapse the patch to a curve in t (and its s derivative)
+         const float* bs  = &basis[i * 8];
+         const float* dbs = bs + 4;
+         for (int k = 0; k < 4; k++)
+         {
+            q[k].Set(0.0f, 0.0f, 0.0f);
+            dq[k].Set(0.0f, 0.0f, 0.0f);
+            for (int j = 0; j < 4; j++)
+            {
+               q[k].x  += bs[j] * patch[j][k].x;
+               q[k].y  += bs[j] * patch[j][k].y;
+               q[k].z  += bs[j] * patch[j][k].z;
+               dq[k].x += dbs[j] * patch[j][k].x;
+               dq[k].y += dbs[j] * patch[j][k].y;
+               dq[k].z += dbs[j] * patch[j][k].z;
+            }
+         }
+
+         for (unsigned int j = 0; j <= n; j++)
+         {
+            unsigned int g = i * (n + 1) + j;
+            if (!owner[g])
+               continue;
+
+            // Position and partial derivatives
+            const float* bt  = &basis[j * 8];
+            const float* dbt = bt + 4;
+            Point3  p(0.0f, 0.0f, 0.0f);
+            Vector3 ds(0.0f, 0.0f, 0.0f), dt(0.0f, 0.0f, 0.0f);
+            for (int k = 0; k < 4; k++)
+            {
+               p.x  += bt[k] * q[k].x;
+               p.y  += bt[k] * q[k].y;
+               p.z  += bt[k] * q[k].z;
+               ds   += dq[k] * bt[k];
+               dt.x += dbt[k] * q[k].x;
+               dt.y += dbt[k] * q[k].y;
+               dt.z += dbt[k] * q[k].z;
+            }
+
+            // The faces are ccw about dt x ds
+            VertexAndNormal& vertex = m_vertexList[grid[g]];
+            vertex.m_vertex = p;
+            vertex.m_normal = dt.Cross(ds);
+            if (vertex.m_normal.Norm() > EPSILON)
+               vertex.m_normal.Normalize();
+            else
+            {
+               vertex.m_normal.Set(0.0f, 0.0f, 0.0f);
+               degenerate[grid[g]] = 1;
+            }
+            m_textureList[grid[g]] = Vector2(p.x, p.y);
+         }
+      }
+   }
+
+   // Cubic Bernstein polynomials and their derivatives at u
+   static void bernstein(const float u, float b[4], float db[4])
+   {
+      float v = 1.0f - u;
+      b[0]  = v * v * v;
+      b[1]  = 3.0f * u * v * v;
+      b[2]  = 3.0f * u * u * v;
+      b[3]  = u * u * u;
+      db[0] = -3.0f * v * v;
+      db[1] = 3.0f * v * (v - 2.0f * u);
+      db[2] = 3.0f * u * (2.0f * v - u);
+      db[3] = 3.0f * u * u;
+   }
+
+   /**
+    * Add the 2 triangles of each grid cell of a patch to a face list.
+    * @param  grid   Vertex index of each grid point
+    * @param  n      Number of divisions in each direction
+    * @param  faces  Face list entries for the patch (6 per cell)
+    */
+   static void addPatchFaces(const unsigned int* grid, const unsigned int n, unsigned int* faces)
+   {
+      for (unsigned int i = 0; i < n; i++)
+      {
+         for (unsigned int j = 0; j < n; j++)
+         {
+            // Same triangles (and vertex order) as dividePatch stores for
+            // an even number of subdivisions
+            unsigned int a = grid[i * (n + 1) + j];
+            unsigned int b = grid[(i + 1) * (n + 1) + j];
+            unsigned int c = grid[(i + 1) * (n + 1) + j + 1];
+            unsigned int d = grid[i * (n + 1) + j + 1];
+            *faces++ = c;
+            *faces++ = b;
+            *faces++ = a;
+            *faces++ = d;
+            *faces++ = c;
+            *faces++ = a;
+         }
+      }
+   }
+
+   // Set the normals of degenerate vertices to the average of the
+   // adjoining face normals
+   void averageDegenerateNormals(const std::vector<char>& degenerate)
+   {
+      Vector3 e1, e2, faceNormal;
+      for (unsigned int f = 0; f + 2 < m_faceList.size(); f += 3)
+      {
+         unsigned int v0 = m_faceList[f], v1 = m_faceList[f + 1], v2 = m_faceList[f + 2];
+         if (!degenerate[v0] && !degenerate[v1] && !degenerate[v2])
+            continue;
+         e1.Set(m_vertexList[v0].m_vertex, m_vertexList[v1].m_vertex);
+         e2.Set(m_vertexList[v0].m_vertex, m_vertexList[v2].m_vertex);
+         faceNormal = e1.Cross(e2).Normalize();
+         if (degenerate[v0])
+            m_vertexList[v0].m_normal += faceNormal;
+         if (degenerate[v1])
+            m_vertexList[v1].m_normal += faceNormal;
+         if (degenerate[v2])
+            m_vertexList[v2].m_normal += faceNormal;
+      }
+      for (unsigned int v = 0; v < m_vertexList.size(); v++)
+      {
+         if (degenerate[v])
+            m_vertexList[v].m_normal.Normalize();
+      }
+   }
    /**
     * Convenience function to transpose the u,v elements of the patch.  This
     * will allow the same subdivide curve code to be used when subdividing along
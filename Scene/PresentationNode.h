@@ -12,8 +12,6 @@
 #ifndef __PRESENTATIONNODE_H
 #define __PRESENTATIONNODE_H
 
-#include <IL/il.h>
-
 /**
  * Presentation node. Applies material and texture
  */
@@ -28,7 +26,13 @@ public:
 		m_nodeType          = SCENE_PRESENTATION;
 		m_materialShininess = 1.0f;
 		m_texture = 0;
-		m_textureUnit = 0;
+		m_textureUnit = GL_TEXTURE0;
+		m_wrapS = GL_REPEAT;
+		m_wrapT = GL_REPEAT;
+		m_minFilter = GL_LINEAR;
+		m_magFilter = GL_LINEAR;
+		m_materialBlock = -1;
+		m_materialChanged = true;
 		// Note: color constructors default rgb to 0 and alpha to 1
 	}
 	
@@ -43,101 +47,82 @@ public:
 	void SetMaterialAmbient(const Color4& c)
 	{
 		m_materialAmbient = c;
+		m_materialChanged = true;
 	}
 	
 	void SetMaterialDiffuse(const Color4& c)
 	{
 		m_materialDiffuse = c;
+		m_materialChanged = true;
 	}
 	
 	void SetMaterialAmbientAndDiffuse(const Color4& c)
 	{
 		m_materialAmbient = c;
 		m_materialDiffuse = c;
+		m_materialChanged = true;
 	}
 	
 	void SetMaterialSpecular(const Color4& c)
 	{
 		m_materialSpecular = c;
+		m_materialChanged = true;
 	}
 	
 	void SetMaterialEmission(const Color4& c)
 	{
 		m_materialEmission = c;
+		m_materialChanged = true;
 	}
 	
 	void SetMaterialShininess(const float s)
 	{
 		m_materialShininess = s;
+		m_materialChanged = true;
 	}
 
+   /**
+    * Set the texture from an image file. The image is kept in memory and
+    * loaded into OpenGL when the material is first applied, so the texture
+    * can be set without an OpenGL context.
+    * @param  fname        Image file (loaded with DevIL)
+    * @param  wrapS        Wrap mode along s (e.g. GL_REPEAT)
+    * @param  wrapT        Wrap mode along t
+    * @param  minFilter    Minification filter
+    * @param  magFilter    Magnification filter
+    * @param  textureUnit  Texture unit the texture is bound to (GL_TEXTURE0 + n)
+    */
 	void SetTexture(const char* fname, GLuint wrapS, GLuint wrapT, GLuint minFilter, GLuint magFilter, GLenum textureUnit)
 	{
-		m_textureUnit = textureUnit;
-		// Bind a DevIL image
-		ILuint id;
-		ilGenImages(1, &id);
-		ilBindImage(id);
-		ILuint err = ilGetError();
-		if (err)
-			printf("Error binding image. %s %d\n", fname, err);
-
-		// Load image using lower left origin. Convert to RGBA
-		ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
-		ilEnable(IL_ORIGIN_SET);
-		ilLoadImage(fname);
-		ilConvertImage(IL_RGBA, IL_UNSIGNED_BYTE);
-		err = ilGetError();
-		if (err)
-			printf("Error loading texture. %s %d\n", fname, err);
-
-		// Get image dimensions and data
-		int w = ilGetInteger(IL_IMAGE_WIDTH);
-		int h = ilGetInteger(IL_IMAGE_HEIGHT);
-		unsigned char* data = ilGetData();
-		if (ilGetError() != IL_NO_ERROR)
-			printf("Error getting image data\n");
-
-		// allocate texture
-		glGenTextures(1, &m_texture);
-		glActiveTexture(m_textureUnit);
-		glBindTexture(GL_TEXTURE_2D, m_texture);
-
-		// when texture area is small, bilinear filter the closest mipmap
-		//glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-		//	GL_LINEAR_MIPMAP_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
-
-		// when texture area is large, bilinear filter the first mipmap
-		//glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
-		
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
-		//glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		//glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
-
-		// build our texture mipmaps
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glActiveTexture(GL_TEXTURE0);
+		m_image.Load(fname);
+		setTextureParameters(wrapS, wrapT, minFilter, magFilter, textureUnit);
 	}
 
+   /**
+    * Set the texture from pixels in memory (e.g. a generated pattern). As
+    * with an image file, it is loaded into OpenGL when first applied.
+    * @param  rgba         RGBA pixels, bottom row first
+    * @param  width        Image width
+    * @param  height       Image height
+    * @param  wrapS        Wrap mode along s (e.g. GL_REPEAT)
+    * @param  wrapT        Wrap mode along t
+    * @param  minFilter    Minification filter
+    * @param  magFilter    Magnification filter
+    * @param  textureUnit  Texture unit the texture is bound to (GL_TEXTURE0 + n)
+    */
+	void SetTexture(const unsigned char* rgba, const unsigned int width, const unsigned int height,
+		GLuint wrapS, GLuint wrapT, GLuint minFilter, GLuint magFilter, GLenum textureUnit)
+	{
+		m_image.Set(rgba, width, height);
+		setTextureParameters(wrapS, wrapT, minFilter, magFilter, textureUnit);
+	}
 
 	/**
 	 * Draw. Simply sets the material properties.
 	 */
 	void Draw(SceneState& sceneState)
 	{
-      // Set the material uniform values
-      glUniform4fv(sceneState.m_materialAmbientLoc, 1,  &m_materialAmbient.r);
-      glUniform4fv(sceneState.m_materialDiffuseLoc, 1,  &m_materialDiffuse.r);
-      glUniform4fv(sceneState.m_materialSpecularLoc, 1, &m_materialSpecular.r);
-      glUniform4fv(sceneState.m_materialEmissionLoc, 1, &m_materialEmission.r);
-      glUniform1f(sceneState.m_materialShininessLoc, m_materialShininess);
-	  glUniform1i(sceneState.m_textureLoc, m_texture);
+      Apply(sceneState);
 	  //glActiveTexture(m_textureUnit);
 	  //glBindTexture(GL_TEXTURE_2D, m_texture);
   
@@ -147,6 +132,81 @@ public:
 		// unbind texture
 		//glActiveTexture(GL_TEXTURE0);
 	}
+
+   /**
+    * Set the material uniform values (without drawing the children).
+    * @param  sceneState  Current scene state
+    */
+   void Apply(SceneState& sceneState)
+   {
+      if (sceneState.m_uniformBlocks)
+      {
+         // Each material has its own copy of the material block, written
+         // when the material changes and bound by offset
+         if (m_materialBlock < 0)
+            m_materialBlock = (int)sceneState.m_materialBlocks.Add();
+         if (m_materialChanged)
+         {
+            MaterialBlock block;
+            memcpy(block.materialAmbient,  &m_materialAmbient.r,  sizeof(block.materialAmbient));
+            memcpy(block.materialDiffuse,  &m_materialDiffuse.r,  sizeof(block.materialDiffuse));
+            memcpy(block.materialSpecular, &m_materialSpecular.r, sizeof(block.materialSpecular));
+            memcpy(block.materialEmission, &m_materialEmission.r, sizeof(block.materialEmission));
+            block.materialShininess = m_materialShininess;
+            block.pad[0] = block.pad[1] = block.pad[2] = 0.0f;
+            sceneState.m_materialBlocks.Write(m_materialBlock, 0, &block, sizeof(block));
+            m_materialChanged = false;
+         }
+         sceneState.m_materialBlocks.Bind(m_materialBlock);
+      }
+      else
+      {
+         sceneState.m_glState.Uniform4fv(sceneState.m_materialAmbientLoc, &m_materialAmbient.r);
+         sceneState.m_glState.Uniform4fv(sceneState.m_materialDiffuseLoc, &m_materialDiffuse.r);
+         sceneState.m_glState.Uniform4fv(sceneState.m_materialSpecularLoc, &m_materialSpecular.r);
+         sceneState.m_glState.Uniform4fv(sceneState.m_materialEmissionLoc, &m_materialEmission.r);
+         sceneState.m_glState.Uniform1f(sceneState.m_materialShininessLoc, m_materialShininess);
+      }
+
+      // The sampler reads the unit the texture is bound to. Materials without
+      // a texture use unit 0, which has none.
+      if (m_texture == 0 && !m_image.IsEmpty())
+         createTexture();
+      GLint unit = (m_texture != 0) ? (GLint)(m_textureUnit - GL_TEXTURE0) : 0;
+      sceneState.m_glState.Uniform1i(sceneState.m_textureLoc, unit);
+      sceneState.m_stateChanges++;
+   }
+
+   /**
+    * Set the current material in the trace state and trace the children.
+    * Like the material uniforms set in Draw, the material remains current
+    * after the children are traced. The ray tracer samples the texture
+    * image directly (base level only, no mipmaps).
+    * @param  traceState  Current trace state
+    */
+   void Trace(TraceState& traceState)
+   {
+      traceState.m_material.ambient   = m_materialAmbient;
+      traceState.m_material.diffuse   = m_materialDiffuse;
+      traceState.m_material.specular  = m_materialSpecular;
+      traceState.m_material.emission  = m_materialEmission;
+      traceState.m_material.shininess = m_materialShininess;
+      traceState.m_material.texture   = m_image.IsEmpty() ? NULL : &m_image;
+      traceState.m_material.repeatS   = (m_wrapS == GL_REPEAT);
+      traceState.m_material.repeatT   = (m_wrapT == GL_REPEAT);
+      SceneNode::Trace(traceState);
+   }
+
+   /**
+    * Set the current material in the render queue and compile the children.
+    * As in Draw, the material remains current after the children.
+    * @param  queue  Render queue being compiled
+    */
+   void Compile(RenderQueue& queue)
+   {
+      queue.SetMaterial(this);
+      SceneNode::Compile(queue);
+   }
 	
 protected:
 	Color4       m_materialAmbient;
@@ -156,6 +216,59 @@ protected:
 	GLfloat      m_materialShininess;
 	GLuint		 m_texture;
 	GLenum		 m_textureUnit;
+	GLuint       m_wrapS;
+	GLuint       m_wrapT;
+	GLuint       m_minFilter;
+	GLuint       m_magFilter;
+	TextureImage m_image;              // Texture image (kept after it is loaded into OpenGL)
+	int          m_materialBlock;      // Element of the material uniform blocks (-1 until applied)
+	bool         m_materialChanged;    // Material changed since written to its block
+
+	/**
+	 * Set the sampling parameters of a new texture image. A texture already
+	 * loaded into OpenGL is deleted so the new image is loaded when next applied.
+	 */
+	void setTextureParameters(GLuint wrapS, GLuint wrapT, GLuint minFilter, GLuint magFilter, GLenum textureUnit)
+	{
+		if (m_texture != 0)
+		{
+			glDeleteTextures(1, &m_texture);
+			m_texture = 0;
+		}
+		m_textureUnit = textureUnit;
+		m_wrapS       = wrapS;
+		m_wrapT       = wrapT;
+		m_minFilter   = minFilter;
+		m_magFilter   = magFilter;
+	}
+
+	/**
+	 * Load the texture image into OpenGL and bind it to its texture unit.
+	 */
+	void createTexture()
+	{
+		// allocate texture
+		glGenTextures(1, &m_texture);
+		glActiveTexture(m_textureUnit);
+		glBindTexture(GL_TEXTURE_2D, m_texture);
+
+		// when texture area is small, bilinear filter the closest mipmap
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, m_minFilter);
+
+		// when texture area is large, bilinear filter the first mipmap
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, m_magFilter);
+		
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, m_wrapS);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, m_wrapT);
+
+		// build our texture mipmaps
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_image.GetWidth(), m_image.GetHeight(), 0, GL_RGBA,
+			GL_UNSIGNED_BYTE, m_image.GetPixels());
+
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		glActiveTexture(GL_TEXTURE0);
+	}
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,444 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    RayTracer.h
+//	Purpose: CPU ray tracer that renders a scene graph to an image using
+//          the same Phong lighting as the phong.frag shader.
+//
+//============================================================================
+
+#ifndef __RAYTRACER_H
+#define __RAYTRACER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <IL/il.h>
+#include "Scene/Scene.h"
+#include "ThreadSupport/JobSystem.h"
+
+/**
+ * Ray tracer. Traces a scene graph into a TraceState (world coordinate
+ * triangles in a BVH, plus the materials and lights that were current for
+ * each triangle), then casts one ray per pixel center from the camera. Hits
+ * are shaded with the Phong model of phong.frag (directional, point and
+ * spot lights with attenuation, global ambient and emission), so a traced
+ * image can be compared with a drawn one. Textures are sampled bilinearly
+ * from the base level (the shader's mipmaps are not used).
+ *
+ * The image is split into square tiles which are rendered in parallel if a
+ * job system is set. Each tile writes only its own pixels so the image does
+ * not depend on the number of threads. Rendering does not use OpenGL.
+ */
+class RayTracer
+{
+public:
+   /**
+    * Constructor given the image size.
+    * @param  width   Image width in pixels
+    * @param  height  Image height in pixels
+    */
+   RayTracer(const unsigned int width, const unsigned int height)
+   {
+      m_jobs    = NULL;
+      m_shadows = false;
+      m_background = Color4(0.0f, 0.0f, 0.0f, 0.0f);
+      SetSize(width, height);
+   }
+
+   /**
+    * Set the image size.
+    * @param  width   Image width in pixels
+    * @param  height  Image height in pixels
+    */
+   void SetSize(const unsigned int width, const unsigned int height)
+   {
+      m_width  = width;
+      m_height = height;
+      m_pixels.assign(width * height * 3, 0);
+   }
+
+   /**
+    * Set the job system used to render tiles in parallel.
+    * @param  jobs  Job system (NULL to render on the calling thread)
+    */
+   void SetJobSystem(JobSystem* jobs)
+   {
+      m_jobs = jobs;
+   }
+
+   /**
+    * Enable or disable shadow rays. The shader does not cast shadows, so
+    * they are off by default to match drawn images.
+    * @param  shadows  True to test each light for occlusion
+    */
+   void SetShadows(const bool shadows)
+   {
+      m_shadows = shadows;
+   }
+
+   /**
+    * Set the background (clear) color.
+    * @param  color  Color of pixels whose ray hits nothing
+    */
+   void SetBackground(const Color4& color)
+   {
+      m_background = color;
+   }
+
+   /**
+    * Render a scene graph. The graph must contain a camera node.
+    * @param  root  Scene graph root
+    * @return  Returns false if the scene has no camera.
+    */
+   bool Render(SceneNode* root)
+   {
+      m_state.Init();
+      root->Trace(m_state);
+      if (!m_state.m_hasCamera)
+         return false;
+      m_state.Build();
+
+      // Render tiles in row order
+      unsigned int tilesX = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+      unsigned int tilesY = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+      unsigned int tiles  = tilesX * tilesY;
+      JobSystem::RangeFunction renderTiles = [this, tilesX](unsigned int begin, unsigned int end)
+      {
+         for (unsigned int t = begin; t < end; t++)
+            renderTile((t % tilesX) * TILE_SIZE, (t / tilesX) * TILE_SIZE);
+      };
+      if (m_jobs != NULL)
+         m_jobs->ParallelFor(tiles, 1, renderTiles);
+      else
+         renderTiles(0, tiles);
+      return true;
+   }
+
+   /**
+    * Get the trace state of the last render (geometry, lights, materials).
+    * @return  Returns the trace state.
+    */
+   const TraceState& GetTraceState() const
+   {
+      return m_state;
+   }
+
+   /**
+    * Get the rendered image: 8 bit RGB, top row first.
+    * @return  Returns the pixels.
+    */
+   const std::vector<unsigned char>& GetPixels() const
+   {
+      return m_pixels;
+   }
+
+   /**
+    * Write the image as a binary PPM file.
+    * @param  fname  File name
+    * @return  Returns true if the file was written.
+    */
+   bool SavePPM(const char* fname) const
+   {
+      FILE* file = fopen(fname, "wb");
+      if (file == NULL)
+      {
+         printf("RayTracer: Error opening %s\n", fname);
+         return false;
+      }
+      fprintf(file, "P6\n%u %u\n255\n", m_width, m_height);
+      size_t size = m_pixels.size();
+      bool ok = (size == 0 || fwrite(&m_pixels[0], 1, size, file) == size);
+      fclose(file);
+      return ok;
+   }
+
+   /**
+    * Read a binary PPM file as written by SavePPM (comments in the header
+    * are not supported).
+    * @param  fname   File name
+    * @param  width   Returns the image width
+    * @param  height  Returns the image height
+    * @param  pixels  Returns the pixels: 8 bit RGB, top row first
+    * @return  Returns false if the file cannot be read.
+    */
+   static bool LoadPPM(const char* fname, unsigned int& width, unsigned int& height,
+                       std::vector<unsigned char>& pixels)
+   {
+      FILE* file = fopen(fname, "rb");
+      if (file == NULL)
+      {
+         printf("RayTracer: Error opening %s\n", fname);
+         return false;
+      }
+      unsigned int levels = 0;
+      bool ok = (fscanf(file, "P6 %u %u %u", &width, &height, &levels) == 3 && levels == 255 &&
+                 fgetc(file) != EOF);
+      if (ok)
+      {
+         pixels.resize(width * height * 3);
+         size_t size = pixels.size();
+         ok = (size == 0 || fread(&pixels[0], 1, size, file) == size);
+      }
+      fclose(file);
+      if (!ok)
+         printf("RayTracer: %s is not a binary PPM image\n", fname);
+      return ok;
+   }
+
+   /**
+    * Write the image. Files ending in .ppm are written directly, other
+    * formats (e.g. .png) are written with DevIL (ilInit must have been called).
+    * @param  fname  File name
+    * @return  Returns true if the file was written.
+    */
+   bool Save(const char* fname) const
+   {
+      size_t len = strlen(fname);
+      if (len >= 4 && (strcmp(fname + len - 4, ".ppm") == 0 || strcmp(fname + len - 4, ".PPM") == 0))
+         return SavePPM(fname);
+
+      ILuint id;
+      ilGenImages(1, &id);
+      ilBindImage(id);
+      ilTexImage(m_width, m_height, 1, 3, IL_RGB, IL_UNSIGNED_BYTE, (void*)&m_pixels[0]);
+      ilRegisterOrigin(IL_ORIGIN_UPPER_LEFT);
+      ilEnable(IL_FILE_OVERWRITE);
+      bool ok = (ilSaveImage(fname) == IL_TRUE);
+      ilDeleteImages(1, &id);
+      if (!ok)
+         printf("RayTracer: Error saving %s %d\n", fname, ilGetError());
+      return ok;
+   }
+
+protected:
+   // Tile width and height in pixels
+   static const unsigned int TILE_SIZE = 16;
+
+   JobSystem*   m_jobs;           // Job system for the tiles (may be NULL)
+   bool         m_shadows;        // Cast shadow rays
+   Color4       m_background;     // Color where rays miss
+   unsigned int m_width;          // Image width
+   unsigned int m_height;         // Image height
+   TraceState   m_state;          // Traced scene
+   std::vector<unsigned char> m_pixels;   // RGB, top row first
+
+   /**
+    * Render the pixels of one tile.
+    * @param  x0  Left pixel of the tile
+    * @param  y0  Top pixel of the tile
+    */
+   void renderTile(const unsigned int x0, const unsigned int y0)
+   {
+      // Half the view window size at distance 1
+      float h = tanf(degreesToRadians(m_state.m_fov * 0.5f));
+      float w = m_state.m_aspect * h;
+      unsigned int x1 = MINV(x0 + TILE_SIZE, m_width);
+      unsigned int y1 = MINV(y0 + TILE_SIZE, m_height);
+      for (unsigned int y = y0; y < y1; y++)
+      {
+         for (unsigned int x = x0; x < x1; x++)
+         {
+            // Ray through the pixel center with unit depth along the view
+            // direction. Start it at the near plane and stop at the far plane
+            // so t + near is the view depth and clipping matches the drawn image.
+            float sx = (2.0f * ((float)x + 0.5f) / (float)m_width - 1.0f) * w;
+            float sy = (1.0f - 2.0f * ((float)y + 0.5f) / (float)m_height) * h;
+            Vector3 d = m_state.m_cameraU * sx + m_state.m_cameraV * sy - m_state.m_cameraN;
+            Ray3 ray(m_state.m_cameraPosition + d * m_state.m_near, d);
+
+            Color4 color = m_background;
+            BVH::Hit hit;
+            if (m_state.m_bvh.Intersect(ray, hit, m_state.m_far - m_state.m_near))
+               color = shade(ray, hit);
+
+            unsigned char* pixel = &m_pixels[(y * m_width + x) * 3];
+            pixel[0] = toByte(color.r);
+            pixel[1] = toByte(color.g);
+            pixel[2] = toByte(color.b);
+         }
+      }
+   }
+
+   /**
+    * Shade a ray hit (as the main function of phong.frag).
+    * @param  ray  Ray
+    * @param  hit  Closest hit
+    * @return  Returns the color.
+    */
+   Color4 shade(const Ray3& ray, const BVH::Hit& hit) const
+   {
+      // Interpolate the vertex normals
+      const unsigned int* face = &m_state.m_faces[hit.triangle * 3];
+      float w0 = 1.0f - hit.u - hit.v;
+      Vector3 n = m_state.m_normals[face[0]] * w0 + m_state.m_normals[face[1]] * hit.u +
+                  m_state.m_normals[face[2]] * hit.v;
+      n.Normalize();
+
+      // Unit length vector from the point to the camera
+      Point3  vertex = ray.o + ray.d * hit.t;
+      Vector3 V = m_state.m_cameraPosition - vertex;
+      V.Normalize();
+
+      const TraceShading& shading = m_state.m_shadings[m_state.m_faceShading[hit.triangle]];
+      const TraceMaterial& material = shading.material;
+      Color4 ambient(0.0f, 0.0f, 0.0f, 0.0f);
+      Color4 diffuse(0.0f, 0.0f, 0.0f, 0.0f);
+      Color4 specular(0.0f, 0.0f, 0.0f, 0.0f);
+      std::vector<unsigned int>::const_iterator i = shading.lights.begin();
+      for ( ; i != shading.lights.end(); i++)
+      {
+         const TraceLight& light = m_state.m_lights[*i];
+         if (light.position.w == 0.0f)
+            directionalLight(light, material, n, vertex, V, ambient, diffuse, specular);
+         else if (light.spotlight)
+            spotLight(light, material, n, vertex, V, ambient, diffuse, specular);
+         else
+            pointLight(light, material, n, vertex, V, ambient, diffuse, specular);
+      }
+
+      // Texture color. As in the shader, a texel of 0 (or no texture) leaves
+      // the lit color unchanged.
+      Color4 texColor(1.0f, 1.0f, 1.0f, 1.0f);
+      if (material.texture != NULL)
+      {
+         Vector2 tc = m_state.m_texCoords[face[0]] * w0 + m_state.m_texCoords[face[1]] * hit.u +
+                      m_state.m_texCoords[face[2]] * hit.v;
+         Color4 texel = material.texture->Sample(tc.x, tc.y, material.repeatS, material.repeatT);
+         if (texel.r != 0.0f || texel.g != 0.0f || texel.b != 0.0f || texel.a != 0.0f)
+            texColor = texel;
+      }
+
+      // Texture * all of emission + global ambient contribution + light sources
+      // ambient, diffuse and specular contributions
+      Color4 color;
+      color.r = texColor.r * (material.emission.r + m_state.m_globalAmbient.r * material.ambient.r +
+                ambient.r * material.ambient.r + diffuse.r * material.diffuse.r +
+                specular.r * material.specular.r);
+      color.g = texColor.g * (material.emission.g + m_state.m_globalAmbient.g * material.ambient.g +
+                ambient.g * material.ambient.g + diffuse.g * material.diffuse.g +
+                specular.g * material.specular.g);
+      color.b = texColor.b * (material.emission.b + m_state.m_globalAmbient.b * material.ambient.b +
+                ambient.b * material.ambient.b + diffuse.b * material.diffuse.b +
+                specular.b * material.specular.b);
+      color.a = 1.0f;
+      return color;
+   }
+
+   // Add c * s to a color
+   static void addScaled(Color4& sum, const Color4& c, const float s)
+   {
+      sum.r += c.r * s;
+      sum.g += c.g * s;
+      sum.b += c.b * s;
+      sum.a += c.a * s;
+   }
+
+   // Attenuation of a light at a distance
+   static float calculateAttenuation(const TraceLight& light, const float distance)
+   {
+      return 1.0f / (light.constantAttenuation + (light.linearAttenuation * distance) +
+                     (light.quadraticAttenuation * distance * distance));
+   }
+
+   // Check if a point is shadowed from a light along unit direction L up to distance
+   // dist. The ray starts slightly off the surface along the normal.
+   bool shadowed(const Point3& vertex, const Vector3& n, const Vector3& L, const float dist) const
+   {
+      if (!m_shadows)
+         return false;
+      Ray3 ray(vertex + n * 1.0e-3f, L);
+      return m_state.m_bvh.IntersectAny(ray, dist);
+   }
+
+   // Ambient, diffuse and specular contribution of a directional light
+   void directionalLight(const TraceLight& light, const TraceMaterial& material,
+                         const Vector3& N, const Point3& vtx, const Vector3& V,
+                         Color4& ambient, Color4& diffuse, Color4& specular) const
+   {
+      addScaled(ambient, light.ambient, 1.0f);
+
+      // Directional lights have constant L (normalized by the light node)
+      Vector3 L(light.position.x, light.position.y, light.position.z);
+      float nDotL = N.Dot(L);
+      if (nDotL > 0.0f && !shadowed(vtx, N, L, FLT_MAX))
+      {
+         addScaled(diffuse, light.diffuse, nDotL);
+
+         // Halfway vector (local viewpoint)
+         Vector3 H = L + V;
+         H.Normalize();
+         float nDotH = N.Dot(H);
+         if (nDotH > 0.0f)
+            addScaled(specular, light.specular, powf(nDotH, material.shininess));
+      }
+   }
+
+   // Ambient, diffuse and specular contribution of a point light
+   void pointLight(const TraceLight& light, const TraceMaterial& material,
+                   const Vector3& N, const Point3& vtx, const Vector3& V,
+                   Color4& ambient, Color4& diffuse, Color4& specular) const
+   {
+      Vector3 tmp(light.position.x - vtx.x, light.position.y - vtx.y, light.position.z - vtx.z);
+      float dist = tmp.Norm();
+      Vector3 L = tmp * (1.0f / dist);
+      float attenuation = calculateAttenuation(light, dist);
+      addScaled(ambient, light.ambient, attenuation);
+
+      float nDotL = N.Dot(L);
+      if (nDotL > 0.0f && !shadowed(vtx, N, L, dist))
+      {
+         addScaled(diffuse, light.diffuse, attenuation * nDotL);
+         Vector3 H = L + V;
+         H.Normalize();
+         float nDotH = N.Dot(H);
+         if (nDotH > 0.0f)
+            addScaled(specular, light.specular, attenuation * powf(nDotH, material.shininess));
+      }
+   }
+
+   // Ambient, diffuse and specular contribution of a spotlight. As in the
+   // shader the ambient is modulated by the spotlight effect.
+   void spotLight(const TraceLight& light, const TraceMaterial& material,
+                  const Vector3& N, const Point3& vtx, const Vector3& V,
+                  Color4& ambient, Color4& diffuse, Color4& specular) const
+   {
+      Vector3 tmp(light.position.x - vtx.x, light.position.y - vtx.y, light.position.z - vtx.z);
+      float dist = tmp.Norm();
+      Vector3 L = tmp * (1.0f / dist);
+      float attenuation = calculateAttenuation(light, dist);
+
+      float nDotL = N.Dot(L);
+      if (nDotL > 0.0f)
+      {
+         float spotEffect = -light.spotDirection.Dot(L);
+         if (spotEffect > light.spotCosCutoff)
+         {
+            attenuation *= powf(spotEffect, light.spotExponent);
+            if (!shadowed(vtx, N, L, dist))
+            {
+               addScaled(diffuse, light.diffuse, attenuation * nDotL);
+               Vector3 H = L + V;
+               H.Normalize();
+               float nDotH = N.Dot(H);
+               if (nDotH > 0.0f)
+                  addScaled(specular, light.specular, attenuation * powf(nDotH, material.shininess));
+            }
+         }
+         else
+            attenuation = 0.0f;
+      }
+      addScaled(ambient, light.ambient, attenuation);
+   }
+
+   // Convert a color component to a byte, clamping to [0, 1]
+   static unsigned char toByte(const float c)
+   {
+      float v = (c < 0.0f) ? 0.0f : ((c > 1.0f) ? 1.0f : c);
+      return (unsigned char)(v * 255.0f + 0.5f);
+   }
+};
+
+#endif
@@ -0,0 +1,290 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    RenderQueue.h
+//	Purpose: Flat list of draw records compiled from the scene graph, sorted
+//          to minimize state changes.
+//
+//============================================================================
+
+#ifndef __RENDERQUEUE_H
+#define __RENDERQUEUE_H
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+class TransformNode;
+class ShaderNode;
+class CameraNode;
+class LightNode;
+class PresentationNode;
+class GeometryNode;
+
+// Number of light slots a compiled light set holds
+const unsigned int RENDER_MAX_LIGHTS = 8;
+
+// Lights enabled in each slot (NULL if the slot is disabled)
+struct RenderLightSet
+{
+   LightNode* lights[RENDER_MAX_LIGHTS];
+};
+
+// A transform node in the compiled graph. Entries are in traversal order,
+// so an entry's parent always comes before it.
+struct RenderTransform
+{
+   TransformNode* node;                // NULL for entry 0 (no transform)
+   unsigned int   parent;              // Entry of the enclosing transform
+   Matrix4x4      world;               // World matrix (updated each frame)
+   unsigned int   serial;              // Serial of the world matrix
+};
+
+// One geometry node with the state it is drawn with. States are indexes
+// into the queue's tables, numbered in the order they were first seen.
+struct RenderRecord
+{
+   unsigned int  shader;               // Index into m_shaders
+   unsigned int  camera;               // Index into m_cameras
+   unsigned int  lightSet;             // Index into m_lightSets
+   unsigned int  material;             // Index into m_materials
+   unsigned int  mesh;                 // Distinct geometry node number
+   unsigned int  transform;            // Index into m_transforms
+   GeometryNode* geometry;             // Node to draw
+   bool          surface;              // Node is a TriSurface (drawn directly)
+};
+
+/**
+ * Render queue. Nodes add themselves to this during SceneNode::Compile the
+ * same way they set OpenGL state during Draw: shader, camera, light and
+ * presentation nodes set the current state, transform nodes push a
+ * transform entry for their children, and geometry nodes add a record with
+ * the current state. Records refer to the nodes rather than copying their
+ * properties, so only structural changes (adding or removing children)
+ * require compiling again. Sort() then orders the records by shader, camera,
+ * lights, material, mesh and transform (see RenderQueueNode for drawing).
+ */
+class RenderQueue
+{
+public:
+   // State tables. Entry 0 of the shader, camera and material tables is
+   // NULL (not set).
+   std::vector<ShaderNode*>       m_shaders;
+   std::vector<CameraNode*>       m_cameras;
+   std::vector<PresentationNode*> m_materials;
+   std::vector<RenderLightSet>    m_lightSets;
+   std::vector<RenderTransform>   m_transforms;
+   unsigned int                   m_lightSlots;    // Highest light slot used + 1
+
+   // Draw records (in traversal order until sorted)
+   std::vector<RenderRecord> m_records;
+
+   /**
+    * Constructor.
+    */
+   RenderQueue()
+   {
+      Clear();
+   }
+
+   /**
+    * Remove all records and state prior to compiling.
+    */
+   void Clear()
+   {
+      m_shaders.assign(1, (ShaderNode*)NULL);
+      m_cameras.assign(1, (CameraNode*)NULL);
+      m_materials.assign(1, (PresentationNode*)NULL);
+      m_lightSets.clear();
+      m_transforms.resize(1);
+      m_transforms[0].node   = NULL;
+      m_transforms[0].parent = 0;
+      m_transforms[0].world.SetIdentity();
+      m_transforms[0].serial = 0;
+      m_lightSlots = 0;
+      m_records.clear();
+      m_meshes.clear();
+      m_transformStack.clear();
+
+      m_shader    = 0;
+      m_camera    = 0;
+      m_material  = 0;
+      m_transform = 0;
+      for (unsigned int i = 0; i < RENDER_MAX_LIGHTS; i++)
+         m_lights.lights[i] = NULL;
+   }
+
+   /**
+    * Set the current shader (remains current after its children, as the
+    * program does in Draw).
+    * @param  shader  Shader node
+    */
+   void SetShader(ShaderNode* shader)
+   {
+      m_shader = indexOf(m_shaders, shader);
+   }
+
+   /**
+    * Set the current camera.
+    * @param  camera  Camera node
+    */
+   void SetCamera(CameraNode* camera)
+   {
+      m_camera = indexOf(m_cameras, camera);
+   }
+
+   /**
+    * Set the current material (remains current after its children, as the
+    * material uniforms do in Draw).
+    * @param  material  Presentation node
+    */
+   void SetMaterial(PresentationNode* material)
+   {
+      m_material = indexOf(m_materials, material);
+   }
+
+   /**
+    * Set the light in a slot.
+    * @param  slot   Light slot (the light node index)
+    * @param  light  Light node (NULL to disable the slot)
+    */
+   void SetLight(const unsigned int slot, LightNode* light)
+   {
+      if (slot >= RENDER_MAX_LIGHTS)
+         return;
+      m_lights.lights[slot] = light;
+      if (light != NULL && slot >= m_lightSlots)
+         m_lightSlots = slot + 1;
+   }
+
+   /**
+    * Add a transform entry for a transform node's children.
+    * @param  node  Transform node
+    */
+   void PushTransform(TransformNode* node)
+   {
+      RenderTransform transform;
+      transform.node   = node;
+      transform.parent = m_transform;
+      transform.serial = 0;
+      m_transforms.push_back(transform);
+      m_transformStack.push_back(m_transform);
+      m_transform = (unsigned int)m_transforms.size() - 1;
+   }
+
+   /**
+    * Revert to the transform in effect before the last PushTransform.
+    */
+   void PopTransform()
+   {
+      if (m_transformStack.size() > 0)
+      {
+         m_transform = m_transformStack.back();
+         m_transformStack.pop_back();
+      }
+      else
+         m_transform = 0;
+   }
+
+   /**
+    * Add a record drawing a geometry node with the current state.
+    * @param  geometry  Geometry node
+    * @param  surface   True if the node is a TriSurface that can be drawn
+    *                   directly (without calling its Draw method)
+    */
+   void AddGeometry(GeometryNode* geometry, const bool surface)
+   {
+      RenderRecord record;
+      record.shader    = m_shader;
+      record.camera    = m_camera;
+      record.lightSet  = getLightSet();
+      record.material  = m_material;
+      record.transform = m_transform;
+      record.geometry  = geometry;
+      record.surface   = surface;
+      std::map<GeometryNode*, unsigned int>::iterator mesh = m_meshes.find(geometry);
+      if (mesh == m_meshes.end())
+         mesh = m_meshes.insert(std::make_pair(geometry, (unsigned int)m_meshes.size())).first;
+      record.mesh = mesh->second;
+      m_records.push_back(record);
+   }
+
+   /**
+    * Sort the records by shader, camera, lights, material, mesh and
+    * transform. The sort is stable, so records with the same state stay in
+    * traversal order.
+    */
+   void Sort()
+   {
+      std::stable_sort(m_records.begin(), m_records.end(), lessState);
+   }
+
+protected:
+   // State while compiling
+   unsigned int              m_shader;
+   unsigned int              m_camera;
+   unsigned int              m_material;
+   unsigned int              m_transform;
+   RenderLightSet            m_lights;
+   std::vector<unsigned int> m_transformStack;
+
+   // Number of each geometry node
+   std::map<GeometryNode*, unsigned int> m_meshes;
+
+   // Find (or add) a state in a table
+   template <class T>
+   static unsigned int indexOf(std::vector<T*>& table, T* state)
+   {
+      for (unsigned int i = 0; i < table.size(); i++)
+      {
+         if (table[i] == state)
+            return i;
+      }
+      table.push_back(state);
+      return (unsigned int)table.size() - 1;
+   }
+
+   // Find (or add) the current light set. Searches from the most recent
+   // set, which is usually the match.
+   unsigned int getLightSet()
+   {
+      for (int i = (int)m_lightSets.size() - 1; i >= 0; i--)
+      {
+         if (sameLights(m_lightSets[i], m_lights))
+            return (unsigned int)i;
+      }
+      m_lightSets.push_back(m_lights);
+      return (unsigned int)m_lightSets.size() - 1;
+   }
+
+   // Compare light sets
+   static bool sameLights(const RenderLightSet& s1, const RenderLightSet& s2)
+   {
+      for (unsigned int i = 0; i < RENDER_MAX_LIGHTS; i++)
+      {
+         if (s1.lights[i] != s2.lights[i])
+            return false;
+      }
+      return true;
+   }
+
+   // Order records by state, most expensive change first
+   static bool lessState(const RenderRecord& r1, const RenderRecord& r2)
+   {
+      if (r1.shader != r2.shader)
+         return r1.shader < r2.shader;
+      if (r1.camera != r2.camera)
+         return r1.camera < r2.camera;
+      if (r1.lightSet != r2.lightSet)
+         return r1.lightSet < r2.lightSet;
+      if (r1.material != r2.material)
+         return r1.material < r2.material;
+      if (r1.mesh != r2.mesh)
+         return r1.mesh < r2.mesh;
+      return r1.transform < r2.transform;
+   }
+};
+
+#endif
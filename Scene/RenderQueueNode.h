@@ -0,0 +1,315 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    RenderQueueNode.h
+//	Purpose: Scene graph node that draws its children from a compiled,
+//          sorted render queue instead of traversing them.
+//
+//============================================================================
+
+#ifndef __RENDERQUEUENODE_H
+#define __RENDERQUEUENODE_H
+
+/**
+ * Render queue node. The first draw after a structural change below this
+ * node walks the children once (SceneNode::Compile) to build a flat list of
+ * draw records - geometry node, shader, camera, light set, material and
+ * transform - and sorts it by state (see RenderQueue). Each draw then:
+ *   - updates the world matrix of each transform entry in traversal order
+ *     (using the transform nodes' matrix caches), and
+ *   - submits the records in one loop, applying a shader, camera, light,
+ *     material or modeling matrix only when it differs from the previous
+ *     record's, and binding a surface's vertex array only when the surface
+ *     changes.
+ * Records are culled one at a time against the view frustum. Node
+ * properties (matrices, materials, light positions, instance lists) are
+ * read when drawn, so changing them does not require compiling again.
+ *
+ * Drawing is equivalent to Draw traversal for scenes that do not depend on
+ * draw order (no blending). Geometry below the queue node that is not under
+ * a transform node gets only the camera's matrix, as in Draw, so the queue
+ * node should be placed above all transform nodes (e.g. as the scene root).
+ */
+class RenderQueueNode: public SceneNode
+{
+public:
+   /**
+    * Constructor.
+    */
+   RenderQueueNode()
+   {
+      m_enabled        = true;
+      m_compiledSerial = 0;
+   }
+
+   /**
+    * Destructor.
+    */
+   virtual ~RenderQueueNode() { }
+
+   /**
+    * Enable or disable the render queue. When disabled, the children are
+    * drawn by traversal.
+    * @param  enabled  True to draw from the render queue
+    */
+   void SetEnabled(const bool enabled)
+   {
+      m_enabled = enabled;
+   }
+
+   /**
+    * Check whether the render queue is used.
+    * @return  Returns true if the children are drawn from the render queue.
+    */
+   bool IsEnabled() const
+   {
+      return m_enabled;
+   }
+
+   /**
+    * Get the number of draw records (compiled on the last draw).
+    * @return  Returns the record count.
+    */
+   unsigned int GetRecordCount() const
+   {
+      return (unsigned int)m_queue.m_records.size();
+   }
+
+   /**
+    * Draw the children from the render queue, compiling it first if the
+    * structure below this node has changed.
+    * @param  sceneState  Current scene state
+    */
+   virtual void Draw(SceneState& sceneState)
+   {
+      if (!m_enabled)
+      {
+         SceneNode::Draw(sceneState);
+         return;
+      }
+
+      if (m_compiledSerial != m_structureSerial)
+      {
+         m_queue.Clear();
+         SceneNode::Compile(m_queue);
+         m_queue.Sort();
+         m_compiledSerial = m_structureSerial;
+      }
+      updateTransforms(sceneState);
+      submit(sceneState);
+   }
+
+protected:
+   RenderQueue  m_queue;                 // Compiled draw records
+   unsigned int m_compiledSerial;        // Structure serial the queue was compiled at
+   bool         m_enabled;               // Draw from the queue (otherwise traverse)
+
+   /**
+    * Find the world matrix of every transform entry. Entry 0 takes the
+    * modeling matrix in effect at this node.
+    * @param  sceneState  Current scene state
+    */
+   void updateTransforms(SceneState& sceneState)
+   {
+      std::vector<RenderTransform>& transforms = m_queue.m_transforms;
+      transforms[0].world  = sceneState.m_modelMatrix;
+      transforms[0].serial = sceneState.m_modelSerial;
+      for (unsigned int i = 1; i < transforms.size(); i++)
+      {
+         RenderTransform& transform = transforms[i];
+         setModelMatrix(transforms[transform.parent], sceneState);
+         transform.node->UpdateWorldMatrix(sceneState);
+         transform.world  = sceneState.m_modelMatrix;
+         transform.serial = sceneState.m_modelSerial;
+      }
+      setModelMatrix(transforms[0], sceneState);
+   }
+
+   /**
+    * Draw the records in order, changing only the state that differs from
+    * the previous record.
+    * @param  sceneState  Current scene state
+    */
+   void submit(SceneState& sceneState)
+   {
+      // State of the last record drawn (-1 = not set since the shader changed)
+      int shader    = -1;
+      int camera    = -1;
+      int lightSet  = -1;
+      int material  = -1;
+      int transform = -1;
+      GLuint vao    = 0;
+
+      std::vector<RenderRecord>::const_iterator record = m_queue.m_records.begin();
+      for ( ; record != m_queue.m_records.end(); record++)
+      {
+         // Uniforms belong to the program, so a new shader needs all the
+         // other state set again
+         if ((int)record->shader != shader)
+         {
+            if (m_queue.m_shaders[record->shader] != NULL)
+               m_queue.m_shaders[record->shader]->Apply(sceneState);
+            shader   = (int)record->shader;
+            camera   = -1;
+            lightSet = -1;
+            material = -1;
+         }
+
+         // The camera sets the composite matrix, so the modeling matrices
+         // must be loaded again
+         if ((int)record->camera != camera)
+         {
+            if (m_queue.m_cameras[record->camera] != NULL)
+               m_queue.m_cameras[record->camera]->Apply(sceneState);
+            camera    = (int)record->camera;
+            transform = -1;
+         }
+
+         const RenderTransform& world = m_queue.m_transforms[record->transform];
+         if (cull(*record, world, sceneState))
+            continue;
+
+         if ((int)record->lightSet != lightSet)
+         {
+            applyLights(lightSet, record->lightSet, sceneState);
+            lightSet = (int)record->lightSet;
+         }
+         if ((int)record->material != material)
+         {
+            if (m_queue.m_materials[record->material] != NULL)
+               m_queue.m_materials[record->material]->Apply(sceneState);
+            material = (int)record->material;
+         }
+         if ((int)record->transform != transform)
+         {
+            loadTransform(record->transform, sceneState);
+            transform = (int)record->transform;
+         }
+
+         // Surfaces are drawn directly. Other geometry nodes draw themselves
+         // with the modeling matrix set (and may bind their own vertex arrays).
+         if (record->surface)
+         {
+            TriSurface* surface = static_cast<TriSurface*>(record->geometry);
+
+            // Creating the buffers on the first draw unbinds the vertex array
+            if (surface->CreateVertexBuffers(&sceneState.m_glState))
+               vao = 0;
+            if (surface->GetVertexArray() != vao)
+            {
+               vao = surface->GetVertexArray();
+               sceneState.m_glState.BindVertexArray(vao);
+            }
+            surface->DrawElements(sceneState);
+         }
+         else
+         {
+            if (vao != 0)
+            {
+               sceneState.m_glState.ReleaseVertexArray();
+               vao = 0;
+            }
+            setModelMatrix(world, sceneState);
+            record->geometry->Draw(sceneState);
+         }
+      }
+      if (vao != 0)
+         sceneState.m_glState.ReleaseVertexArray();
+
+      // Disable the lights as light nodes do after their children
+      if (lightSet >= 0)
+         applyLights(lightSet, (unsigned int)m_queue.m_lightSets.size(), sceneState);
+      setModelMatrix(m_queue.m_transforms[0], sceneState);
+   }
+
+   /**
+    * Check whether a record can be skipped because its geometry is outside
+    * the view frustum. Counts culled nodes and triangles in the scene state.
+    * @param  record      Draw record
+    * @param  world       Transform entry of the record
+    * @param  sceneState  Current scene state
+    * @return  Returns true if the record is culled.
+    */
+   static bool cull(const RenderRecord& record, const RenderTransform& world, SceneState& sceneState)
+   {
+      if (!sceneState.m_frustumValid)
+         return false;
+      AABB box;
+      if (!record.geometry->GetBounds(box))
+         return false;
+      if (!sceneState.m_frustum.Outside(world.world.Transform(box)))
+         return false;
+
+      sceneState.m_nodesCulled++;
+      sceneState.m_trianglesCulled += record.geometry->CountTriangles();
+      return true;
+   }
+
+   /**
+    * Change the enabled lights, applying only the slots that differ.
+    * @param  previous    Light set in effect (-1 if unknown)
+    * @param  next        Light set to apply (past the end to disable all lights)
+    * @param  sceneState  Current scene state
+    */
+   void applyLights(const int previous, const unsigned int next, SceneState& sceneState)
+   {
+      for (unsigned int slot = 0; slot < m_queue.m_lightSlots; slot++)
+      {
+         LightNode* light = (next < m_queue.m_lightSets.size()) ? m_queue.m_lightSets[next].lights[slot] : NULL;
+         if (previous >= 0 && m_queue.m_lightSets[previous].lights[slot] == light)
+            continue;
+         if (light != NULL)
+            light->Apply(sceneState);
+         else
+         {
+            sceneState.DisableLight(slot);
+            sceneState.m_stateChanges++;
+         }
+      }
+   }
+
+   /**
+    * Load the matrix uniforms of a transform entry. Entry 0 (no transform
+    * node) loads only the composite matrix, as the camera does (or, for
+    * shaders that use the camera uniform block, the modeling matrices).
+    * @param  index       Transform entry
+    * @param  sceneState  Current scene state
+    */
+   void loadTransform(const unsigned int index, SceneState& sceneState)
+   {
+      const RenderTransform& transform = m_queue.m_transforms[index];
+      if (transform.node == NULL)
+      {
+         if (sceneState.m_pvmLoc != -1)
+         {
+            Matrix4x4 pvm = sceneState.m_pvMatrix * transform.world;
+            sceneState.m_glState.UniformMatrix4fv(sceneState.m_pvmLoc, pvm.Get());
+         }
+         else if (sceneState.m_modelMatrixLoc != -1)
+         {
+            Matrix4x4 normalMatrix = transform.world.GetAffineInverse().Transpose();
+            sceneState.m_glState.UniformMatrix4fv(sceneState.m_modelMatrixLoc, transform.world.Get());
+            sceneState.m_glState.UniformMatrix4fv(sceneState.m_normalMatrixLoc, normalMatrix.Get());
+         }
+         sceneState.m_stateChanges++;
+         return;
+      }
+
+      // The node's cache may hold another entry's matrix if the node
+      // appears more than once, so update it from the parent entry first
+      setModelMatrix(m_queue.m_transforms[transform.parent], sceneState);
+      transform.node->UpdateWorldMatrix(sceneState);
+      transform.node->LoadMatrices(sceneState);
+   }
+
+   // Set the current modeling matrix to a transform entry's world matrix
+   static void setModelMatrix(const RenderTransform& transform, SceneState& sceneState)
+   {
+      sceneState.m_modelMatrix = transform.world;
+      sceneState.m_modelSerial = transform.serial;
+   }
+};
+
+#endif
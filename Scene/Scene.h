@@ -21,20 +21,29 @@ enum SceneNodeType { SCENE_BASE, SCENE_PRESENTATION,
 // Include other scene files
 #include "Scene/Color3.h"
 #include "Scene/Color4.h"
+#include "Scene/UniformBuffer.h"
+#include "Scene/GLStateCache.h"
 #include "Scene/SceneState.h"
+#include "Scene/TextureImage.h"
+#include "Scene/TraceState.h"
+#include "Scene/RenderQueue.h"
 #include "Scene/SceneNode.h"
 #include "Scene/TransformNode.h"
 #include "Scene/PresentationNode.h"
 #include "Scene/GeometryNode.h"
 #include "Scene/ShaderNode.h"
 #include "Scene/CameraNode.h"
+#include "Scene/VertexNormals.h"
 #include "Scene/TriSurface.h"
+#include "Scene/InstancedGeometryNode.h"
+#include "Scene/LODGeometryNode.h"
 #include "Scene/MeshTeapot.h"
 #include "Scene/UnitSquare.h"
 #include "Scene/ConicSurface.h"
 #include "Scene/LightNode.h"
 #include "Scene/SphereSection.h"
 #include "Scene/Torus.h"
+#include "Scene/RenderQueueNode.h"
 
 inline void checkError(const char* str) 
 {
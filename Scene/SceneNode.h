@@ -13,10 +13,23 @@
 #ifndef __SCENENODE_H
 #define __SCENENODE_H
 
+#include <string>
 #include <vector>
 
 /**
  * Scene graph node: base class
+ *
+ * Each node caches the bounding box of what it and its children draw, in
+ * the coordinates the node is drawn in (its parent's modeling
+ * coordinates). Nodes may be shared by several parents, so the box is kept
+ * in these local coordinates and transformed by the current modeling matrix
+ * when it is tested against the view frustum. Changing a node's geometry or
+ * transform must call InvalidateBounds, which also invalidates the
+ * parents' boxes.
+ *
+ * Adding or removing children is a structural change: it gives the node and
+ * all nodes above it a new structure serial, so a compiled render queue
+ * (see RenderQueueNode) can tell when it must be compiled again.
  */
 class SceneNode
 {
@@ -24,7 +37,8 @@ public:
 	/**
 	 * Constructor. Set the reference count to 0.
 	 */
-   SceneNode() : m_referenceCount(0), m_nodeType(SCENE_BASE) { } 
+   SceneNode() : m_referenceCount(0), m_nodeType(SCENE_BASE), m_bounded(true), m_boundsValid(false),
+                 m_structureSerial(0) { } 
 
 	/**
 	* Destructor
@@ -49,7 +63,8 @@ public:
 	/**
 	 * Draw the scene node and its children. The base class just draws the
     * children. Derived classes can use this (SceneNode::Draw()) to draw
-    * all children without having to duplicate this code.
+    * all children without having to duplicate this code. Children outside
+    * the view frustum are skipped (see cull).
     * @param  sceneState  Current scene state
 	 */
 	virtual void Draw(SceneState& sceneState)
@@ -57,7 +72,10 @@ public:
 		// Loop through the list and draw the children
 		std::vector<SceneNode*>::iterator i = m_children.begin();
 		for ( ; i != m_children.end(); i++)
-			(*i)->Draw(sceneState);
+      {
+         if (!cull(*i, sceneState))
+			   (*i)->Draw(sceneState);
+      }
 	}
 	
 	/**
@@ -71,6 +89,34 @@ public:
 		for ( ; i != m_children.end(); i++)
 			(*i)->Update(sceneState);
 	}	
+
+	/**
+	 * Add the scene node and its children to a trace state for ray tracing.
+    * Nodes that set drawing state or draw geometry in Draw override this to
+    * do the same to the trace state. The base class just traces the children.
+    * @param  traceState  Current trace state
+	 */
+	virtual void Trace(TraceState& traceState)
+	{
+		// Loop through the list and trace the children
+		std::vector<SceneNode*>::iterator i = m_children.begin();
+		for ( ; i != m_children.end(); i++)
+			(*i)->Trace(traceState);
+	}
+
+	/**
+	 * Add the scene node and its children to a render queue. Nodes that set
+    * drawing state or draw geometry in Draw override this to do the same to
+    * the render queue. The base class just compiles the children.
+    * @param  queue  Render queue being compiled
+	 */
+	virtual void Compile(RenderQueue& queue)
+	{
+		// Loop through the list and compile the children
+		std::vector<SceneNode*>::iterator i = m_children.begin();
+		for ( ; i != m_children.end(); i++)
+			(*i)->Compile(queue);
+	}
 	
 	/**
 	 * Destroy all the children
@@ -79,9 +125,14 @@ public:
 	{
 		for (std::vector<SceneNode*>::iterator i = m_children.begin();
 					i != m_children.end(); i++)
+      {
+         (*i)->removeParent(this);
 			(*i)->Release();
+      }
 
       m_children.clear();
+      InvalidateBounds();
+      structureChanged(SceneState::NewSerial());
 	}
 
 	/**
@@ -92,8 +143,60 @@ public:
 	{
 		m_children.push_back(node);
 		node->m_referenceCount++;
+      node->m_parents.push_back(this);
+      InvalidateBounds();
+      structureChanged(SceneState::NewSerial());
 	}
 
+   /**
+    * Get the bounding box of this node and its children in the coordinates
+    * the node is drawn in. The box is computed on first use after
+    * InvalidateBounds.
+    * @param  box  Returns the bounding box (empty if nothing is drawn)
+    * @return  Returns false if the node has no bounds (it may draw anywhere,
+    *          so it is never culled).
+    */
+   bool GetBounds(AABB& box)
+   {
+      if (!m_boundsValid)
+      {
+         m_bounds.Clear();
+         m_bounded     = computeBounds(m_bounds);
+         m_boundsValid = true;
+      }
+      box = m_bounds;
+      return m_bounded;
+   }
+
+   /**
+    * Mark the bounds of this node and all nodes above it as changed. Call
+    * when the geometry or transform of the node changes.
+    */
+   void InvalidateBounds()
+   {
+      // If this node is already invalid then so are its parents
+      if (!m_boundsValid)
+         return;
+      m_boundsValid = false;
+      std::vector<SceneNode*>::iterator i = m_parents.begin();
+      for ( ; i != m_parents.end(); i++)
+         (*i)->InvalidateBounds();
+   }
+
+   /**
+    * Count the triangles this node and its children draw (used for culling
+    * statistics).
+    * @return  Returns the triangle count.
+    */
+   virtual unsigned int CountTriangles()
+   {
+      unsigned int count = 0;
+		std::vector<SceneNode*>::iterator i = m_children.begin();
+		for ( ; i != m_children.end(); i++)
+         count += (*i)->CountTriangles();
+      return count;
+   }
+
    /**
 	 * Get the type of scene node
     * @return  Returns the type of hte scene node.
@@ -126,6 +229,93 @@ protected:
 	SceneNodeType           m_nodeType;
 	int                     m_referenceCount;
 	std::vector<SceneNode*> m_children;
+   std::vector<SceneNode*> m_parents;        // Nodes this node is a child of
+
+   // Cached bounds (see GetBounds)
+   AABB m_bounds;
+   bool m_bounded;
+   bool m_boundsValid;
+
+   // Serial of the last change to the children of this node or any node
+   // below it
+   unsigned int m_structureSerial;
+
+   /**
+    * Compute the bounding box of this node in the coordinates it is drawn
+    * in. The base class returns the union of the children's boxes. A node
+    * with a light below it has no bounds, so culling it never skips the
+    * light.
+    * @param  box  Empty box to grow to bound the node
+    * @return  Returns false if the node has no bounds.
+    */
+   virtual bool computeBounds(AABB& box)
+   {
+      AABB child;
+		std::vector<SceneNode*>::iterator i = m_children.begin();
+		for ( ; i != m_children.end(); i++)
+      {
+         if ((*i)->m_nodeType == SCENE_LIGHT || !(*i)->GetBounds(child))
+            return false;
+         box.Add(child);
+      }
+      return true;
+   }
+
+   /**
+    * Check whether a child can be skipped because it is outside the view
+    * frustum. Counts culled nodes and triangles in the scene state. Nodes
+    * that set drawing state (shaders, cameras, lights and presentation
+    * nodes) are never culled, so the state seen by later nodes does not
+    * depend on what is visible. Nor are nodes with a light below them
+    * (they have no bounds, see computeBounds).
+    * @param  child       Child node
+    * @param  sceneState  Current scene state (modeling matrix and frustum)
+    * @return  Returns true if the child is culled.
+    */
+   static bool cull(SceneNode* child, SceneState& sceneState)
+   {
+      if (!sceneState.m_frustumValid)
+         return false;
+      SceneNodeType type = child->m_nodeType;
+      if (type != SCENE_BASE && type != SCENE_TRANSFORM && type != SCENE_GEOMETRY)
+         return false;
+
+      AABB box;
+      if (!child->GetBounds(box))
+         return false;
+      if (!sceneState.m_frustum.Outside(sceneState.m_modelMatrix.Transform(box)))
+         return false;
+
+      sceneState.m_nodesCulled++;
+      sceneState.m_trianglesCulled += child->CountTriangles();
+      return true;
+   }
+
+   // Record a structural change at this node and all nodes above it. Nodes
+   // reached twice (through shared children) already have the serial.
+   void structureChanged(const unsigned int serial)
+   {
+      if (m_structureSerial == serial)
+         return;
+      m_structureSerial = serial;
+      std::vector<SceneNode*>::iterator i = m_parents.begin();
+      for ( ; i != m_parents.end(); i++)
+         (*i)->structureChanged(serial);
+   }
+
+   // Remove one reference to a parent
+   void removeParent(SceneNode* parent)
+   {
+      std::vector<SceneNode*>::iterator i = m_parents.begin();
+      for ( ; i != m_parents.end(); i++)
+      {
+         if (*i == parent)
+         {
+            m_parents.erase(i);
+            return;
+         }
+      }
+   }
 };
 
 #endif
\ No newline at end of file
@@ -12,8 +12,6 @@
 #ifndef __SCENESTATE_H
 #define __SCENESTATE_H
 
-#include <list>
-
 // Simple structure to hold light uniform locations
 struct LightUniforms
 {
@@ -39,6 +37,7 @@ public:
    GLint m_offsetLoc;                  // Vertex offset location
    GLint m_normalLoc;                  // Vertex normal
    GLint m_vertexColorLoc;             // Vertex color attribute location
+   GLint m_instanceMatrixLoc;          // Per-instance modeling matrix attribute location (uses 4 locations)
 
    // Uniform locations
    GLint m_orthoMatrixLoc;             // Orthographic projection location (2-D)
@@ -52,6 +51,7 @@ public:
    GLint m_cameraPositionLoc;          // Camera position loc
    GLint m_textureLoc;				   // texture location
    GLint m_vTexCoord;				   // vertex texture coordinate location
+   GLint m_instancedLoc;               // Flag indicating instanced drawing
 
    // Material uniforms
    GLint m_materialAmbientLoc;
@@ -63,7 +63,21 @@ public:
    // Lights
    int    m_maxEnabledLight;
    GLint  m_numLightsLoc;
-   LightUniforms lights[2];
+   LightUniforms lights[BLOCK_MAX_LIGHTS];
+
+   // Uniform blocks. A shader that declares the camera, lights and material
+   // blocks sets m_uniformBlocks when applied (see UseUniformBlocks). Camera,
+   // light and presentation nodes then write the blocks instead of setting
+   // the individual uniforms above, and the blocks are flushed before each
+   // draw call.
+   bool          m_uniformBlocks;
+   UniformBuffer m_cameraBlock;        // One CameraBlock
+   UniformBuffer m_lightsBlock;        // One LightsBlock
+   UniformBuffer m_materialBlocks;     // One MaterialBlock per presentation node
+
+   // Filter for redundant program, vertex array and uniform calls made by
+   // the scene nodes (disabled unless the application enables it)
+   GLStateCache  m_glState;
 
    // Current matrices
    float m_ortho[16];                  // Orthographic projection matrix (2-D)  (for use in GetStarted)
@@ -72,26 +86,152 @@ public:
    Matrix4x4 m_pvMatrix;               // Current composite projection and view matrix
    Matrix4x4 m_modelMatrix;            // Current model matrix
 
-   // Retained state to push/pop modeling matrix
-   std::list<Matrix4x4> m_modelMatrixStack;
+   // Camera used to select levels of detail (set by the camera node)
+   Point3 m_cameraPosition;            // View point (eye) in world coordinates
+   float  m_projectionScale;           // Pixels per unit size at unit distance (0 = unknown)
+
+   // View frustum in world coordinates (set by the camera node). Nodes
+   // outside it are not drawn.
+   Frustum m_frustum;
+   bool    m_frustumValid;             // Frustum is set and culling is enabled
+   bool    m_cullingEnabled;           // Allow the camera to enable culling
+
+   // Serial numbers identifying the current matrices. Transform nodes use
+   // these to tell whether their cached matrices are still valid.
+   unsigned int m_modelSerial;         // Current model matrix (0 = identity)
+   unsigned int m_viewSerial;          // Current view and projection matrices
+
+   // Matrix cache statistics for the current frame
+   unsigned int m_matricesComputed;    // Number of matrices recomputed
+   unsigned int m_matricesSkipped;     // Number of cached matrices reused
+
+   // Geometry statistics for the current frame
+   unsigned int m_trianglesDrawn;      // Number of triangles drawn (all instances)
+   unsigned int m_drawCalls;           // Number of draw calls
+   unsigned int m_nodesCulled;         // Number of nodes (or instances) skipped by culling
+   unsigned int m_trianglesCulled;     // Number of triangles they would have drawn
+   unsigned int m_stateChanges;        // Number of shaders, cameras, lights, materials
+                                       // and modeling matrices applied
+
+   // Retained state to push/pop modeling matrix. Pushing does not allocate
+   // once the stack has grown to the deepest nesting in the scene.
+   MatrixStack m_modelMatrixStack;
 
    /**
     * Scene state constructor. Sets default values.
     */
    SceneState()
+      : m_cameraBlock(CAMERA_BLOCK_BINDING, sizeof(CameraBlock)),
+        m_lightsBlock(LIGHTS_BLOCK_BINDING, sizeof(LightsBlock)),
+        m_materialBlocks(MATERIAL_BLOCK_BINDING, sizeof(MaterialBlock))
    {
       m_modelMatrixLoc = -1;
       m_modelViewMatrixLoc = -1;
+      m_instanceMatrixLoc = -1;
+      m_instancedLoc = -1;
+      m_projectionScale = 0.0f;
+      m_cullingEnabled = true;
+      m_uniformBlocks = false;
+      m_viewSerial = NewSerial();
       Init();
    }
 
    /**
-    * Initialize scene state prior to drawing.
+    * Get a new serial number. Serial numbers are unique across all scene
+    * states and nodes, so a cached matrix tagged with a serial can never
+    * be mistaken for one derived from a different matrix.
+    * @return  Returns a new serial number (never 0).
+    */
+   static unsigned int NewSerial()
+   {
+      static unsigned int serial = 0;
+      serial++;
+      if (serial == 0)
+         serial++;
+      return serial;
+   }
+
+   /**
+    * Mark the view or projection matrix as changed. Call this after setting
+    * m_view or m_pvMatrix directly (CameraNode does this itself).
+    */
+   void ViewChanged()
+   {
+      m_viewSerial = NewSerial();
+   }
+
+   /**
+    * Initialize scene state prior to drawing. Resets the matrix cache,
+    * geometry statistics and the OpenGL state cache's program and vertex
+    * array bindings. Culling is off until a camera sets the frustum.
     */
    void Init() 
    {
       m_modelMatrix.SetIdentity();
-      m_modelMatrixStack.clear();
+      m_modelMatrixStack.Clear();
+      m_modelSerial      = 0;
+      m_matricesComputed = 0;
+      m_matricesSkipped  = 0;
+      m_trianglesDrawn   = 0;
+      m_drawCalls        = 0;
+      m_nodesCulled      = 0;
+      m_trianglesCulled  = 0;
+      m_stateChanges     = 0;
+      m_frustumValid     = false;
+      m_glState.InvalidateBindings();
+      m_glState.ResetStatistics();
+   }
+
+   /**
+    * Select uniform blocks or individual uniforms for the camera, lights and
+    * materials. Shaders that declare the blocks call this when applied. The
+    * camera and lights blocks are created and bound the first time.
+    * @param  use  True if the current shader uses the uniform blocks
+    */
+   void UseUniformBlocks(const bool use)
+   {
+      m_uniformBlocks = use;
+      if (use && m_cameraBlock.GetCount() == 0)
+      {
+         m_cameraBlock.Add();
+         m_cameraBlock.Flush();
+         m_cameraBlock.Bind(0);
+         m_lightsBlock.Add();
+         m_lightsBlock.Flush();
+         m_lightsBlock.Bind(0);
+      }
+   }
+
+   /**
+    * Send the changes to the uniform blocks to OpenGL. Call before each
+    * draw call.
+    */
+   void FlushUniformBlocks()
+   {
+      if (m_uniformBlocks)
+      {
+         m_cameraBlock.Flush();
+         m_lightsBlock.Flush();
+         m_materialBlocks.Flush();
+      }
+   }
+
+   /**
+    * Disable a light slot.
+    * @param  index  Light slot
+    */
+   void DisableLight(const unsigned int index)
+   {
+      if (index >= BLOCK_MAX_LIGHTS)
+         return;
+      if (m_uniformBlocks)
+      {
+         int enabled = 0;
+         m_lightsBlock.Write(0, (unsigned int)(offsetof(LightsBlock, lights) + index * sizeof(LightBlock)),
+                             &enabled, sizeof(enabled));
+      }
+      else
+         m_glState.Uniform1i(lights[index].enabled, 0);
    }
 
    /**
@@ -99,7 +239,7 @@ public:
     */
    void PushTransforms()
    {
-      m_modelMatrixStack.push_back(m_modelMatrix);
+      m_modelMatrixStack.Push(m_modelMatrix);
    }
 
    /**
@@ -109,12 +249,7 @@ public:
    void PopTransforms()
    {  
       // If there are any matrices on the stack, retrieve the last one and remove it from the stack
-      if (m_modelMatrixStack.size() > 0)
-      {
-         m_modelMatrix = m_modelMatrixStack.back();
-         m_modelMatrixStack.pop_back();
-      }
-      else
+      if (!m_modelMatrixStack.Pop(m_modelMatrix))
          m_modelMatrix.SetIdentity();  
    }
 };
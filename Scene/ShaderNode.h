@@ -103,6 +103,43 @@ public:
    // Derived classes must add this to set all internal uniforms and attribute locations
    virtual bool GetLocations() = 0;
 
+   /**
+    * Bind a uniform block declared by the program to a binding point.
+    * @param  name     Uniform block name
+    * @param  binding  Binding point (see UniformBuffer.h)
+    * @return  Returns true if the program declares the block.
+    */
+   bool BindUniformBlock(const char* name, const GLuint binding)
+   {
+      GLuint index = glGetUniformBlockIndex(m_shaderProgram.GetProgram(), name);
+      if (index == GL_INVALID_INDEX)
+         return false;
+      glUniformBlockBinding(m_shaderProgram.GetProgram(), index, binding);
+      return true;
+   }
+
+   /**
+    * Enable the program without drawing the children. Derived classes that
+    * set uniform and attribute locations in the scene state in Draw should
+    * do so here as well (a render queue uses this to switch shaders).
+    * @param  sceneState  Current scene state
+    */
+   virtual void Apply(SceneState& sceneState)
+   {
+      sceneState.m_glState.UseProgram(m_shaderProgram.GetProgram());
+      sceneState.m_stateChanges++;
+   }
+
+   /**
+    * Set the current shader in the render queue and compile the children.
+    * @param  queue  Render queue being compiled
+    */
+   virtual void Compile(RenderQueue& queue)
+   {
+      queue.SetShader(this);
+      SceneNode::Compile(queue);
+   }
+
 protected:
    GLSLVertexShader   m_vertexShader;
    GLSLFragmentShader m_fragmentShader;
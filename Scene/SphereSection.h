@@ -66,13 +66,18 @@ public:
          }
       }
 
-      // Copy the first column of vertices (eliminates chances of roundoff)
+      // Copy the first column of vertices (eliminates chances of roundoff).
+      // Its texture coordinates are at the maximum longitude.
       for (unsigned int i = 0; i <= nLat + 1; i++)
+      {
          m_vertexList.push_back(m_vertexList[i]);
+         m_textureList.push_back(Vector2(m_textureList[i].x, maxLngRadians));
+      }
 
-      // Construct face list.  There are nLat+1 rows and nLng+1 columns. Create VBOs
+      // Construct face list.  There are nLat+1 rows and nLng+1 columns. VBOs are
+      // created when first drawn
       ConstructRowColFaceList(nLat + 1, nLng+1);
-      CreateVertexBuffers(positionLoc, normalLoc, textureLoc);
+      SetVertexAttributes(positionLoc, normalLoc, textureLoc);
 	}
 	
 private:
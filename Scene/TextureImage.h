@@ -0,0 +1,191 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    TextureImage.h
+//	Purpose: Texture image kept in memory, so a texture can be set up
+//          without an OpenGL context and sampled by the ray tracer.
+//
+//============================================================================
+
+#ifndef __TEXTUREIMAGE_H
+#define __TEXTUREIMAGE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <IL/il.h>
+
+/**
+ * Texture image: 8 bit RGBA pixels with the bottom row first (the order
+ * glTexImage2D expects). Presentation nodes keep their image after it is
+ * loaded into OpenGL.
+ */
+class TextureImage
+{
+public:
+   /**
+    * Constructor. Creates an empty image.
+    */
+   TextureImage()
+   {
+      m_width  = 0;
+      m_height = 0;
+   }
+
+   /**
+    * Load an image file with DevIL (ilInit must have been called). Leaves
+    * the image empty if the file cannot be loaded.
+    * @param  fname  File name
+    * @return  Returns true if the image was loaded.
+    */
+   bool Load(const char* fname)
+   {
+      Clear();
+      ILuint id;
+      ilGenImages(1, &id);
+      ilBindImage(id);
+      ILuint err = ilGetError();
+      if (err)
+         printf("Error binding image. %s %d\n", fname, err);
+
+      // Load image using lower left origin. Convert to RGBA
+      ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
+      ilEnable(IL_ORIGIN_SET);
+      ilLoadImage(fname);
+      ilConvertImage(IL_RGBA, IL_UNSIGNED_BYTE);
+      err = ilGetError();
+      if (err)
+         printf("Error loading texture. %s %d\n", fname, err);
+
+      // Get image dimensions and data
+      int w = ilGetInteger(IL_IMAGE_WIDTH);
+      int h = ilGetInteger(IL_IMAGE_HEIGHT);
+      unsigned char* data = ilGetData();
+      if (ilGetError() != IL_NO_ERROR)
+         printf("Error getting image data\n");
+      if (data != NULL && w > 0 && h > 0)
+         Set(data, (unsigned int)w, (unsigned int)h);
+      ilDeleteImages(1, &id);
+      return !IsEmpty();
+   }
+
+   /**
+    * Copy the pixels of an image.
+    * @param  rgba    RGBA pixels, bottom row first
+    * @param  width   Image width
+    * @param  height  Image height
+    */
+   void Set(const unsigned char* rgba, const unsigned int width, const unsigned int height)
+   {
+      m_width  = width;
+      m_height = height;
+      m_pixels.assign(rgba, rgba + width * height * 4);
+   }
+
+   /**
+    * Remove the image.
+    */
+   void Clear()
+   {
+      m_width  = 0;
+      m_height = 0;
+      m_pixels.clear();
+   }
+
+   /**
+    * Check whether there is an image.
+    * @return  Returns true if the image has no pixels.
+    */
+   bool IsEmpty() const
+   {
+      return m_pixels.empty();
+   }
+
+   /**
+    * Get the image width.
+    * @return  Returns the width in pixels.
+    */
+   unsigned int GetWidth() const
+   {
+      return m_width;
+   }
+
+   /**
+    * Get the image height.
+    * @return  Returns the height in pixels.
+    */
+   unsigned int GetHeight() const
+   {
+      return m_height;
+   }
+
+   /**
+    * Get the pixels.
+    * @return  Returns the RGBA pixels, bottom row first (NULL if empty).
+    */
+   const unsigned char* GetPixels() const
+   {
+      return m_pixels.empty() ? NULL : &m_pixels[0];
+   }
+
+   /**
+    * Sample the image with bilinear filtering, as GL_LINEAR does for the
+    * base level. Texel centers are at (i + 0.5) / size.
+    * @param  s        Texture coordinate along the width
+    * @param  t        Texture coordinate along the height (0 is the bottom row)
+    * @param  repeatS  Repeat along s (GL_REPEAT), else clamp to the edge
+    * @param  repeatT  Repeat along t
+    * @return  Returns the color (0 if the image is empty).
+    */
+   Color4 Sample(const float s, const float t, const bool repeatS, const bool repeatT) const
+   {
+      if (m_pixels.empty())
+         return Color4(0.0f, 0.0f, 0.0f, 0.0f);
+
+      float x = s * (float)m_width - 0.5f;
+      float y = t * (float)m_height - 0.5f;
+      float fx = floorf(x);
+      float fy = floorf(y);
+      float a = x - fx;
+      float b = y - fy;
+      int x0 = (int)fx;
+      int y0 = (int)fy;
+      int i0 = texel(x0, m_width, repeatS);
+      int i1 = texel(x0 + 1, m_width, repeatS);
+      int j0 = texel(y0, m_height, repeatT);
+      int j1 = texel(y0 + 1, m_height, repeatT);
+      float c[4];
+      for (unsigned int k = 0; k < 4; k++)
+      {
+         float bottom = (1.0f - a) * pixel(i0, j0)[k] + a * pixel(i1, j0)[k];
+         float top    = (1.0f - a) * pixel(i0, j1)[k] + a * pixel(i1, j1)[k];
+         c[k] = ((1.0f - b) * bottom + b * top) * (1.0f / 255.0f);
+      }
+      return Color4(c[0], c[1], c[2], c[3]);
+   }
+
+protected:
+   unsigned int m_width;
+   unsigned int m_height;
+   std::vector<unsigned char> m_pixels;   // RGBA, bottom row first
+
+   // Wrap or clamp a texel index to [0, size)
+   static int texel(const int i, const unsigned int size, const bool repeat)
+   {
+      int n = (int)size;
+      if (repeat)
+         return ((i % n) + n) % n;
+      return (i < 0) ? 0 : ((i >= n) ? n - 1 : i);
+   }
+
+   // Get the RGBA components of a texel
+   const unsigned char* pixel(const int i, const int j) const
+   {
+      return &m_pixels[((unsigned int)j * m_width + (unsigned int)i) * 4];
+   }
+};
+
+#endif
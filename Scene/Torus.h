@@ -61,9 +61,10 @@ public:
 		   }
 	   }
 
-      // Construct face list.  There are ntube+1 rows and nring+1 columns. Create VBOs
+      // Construct face list.  There are ntube+1 rows and nring+1 columns. VBOs are
+      // created when first drawn
       ConstructRowColFaceList(ntube+1, nring+1);
-      CreateVertexBuffers(positionLoc, normalLoc, textureLoc);
+      SetVertexAttributes(positionLoc, normalLoc, textureLoc);
 	}
 	
 private:
@@ -0,0 +1,295 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    TraceState.h
+//	Purpose: Class used to collect geometry, materials and lights during
+//          traversal of the scene graph for ray tracing.
+//
+//============================================================================
+
+#ifndef __TRACESTATE_H
+#define __TRACESTATE_H
+
+#include <vector>
+
+// Number of light slots (matches MAX_LIGHTS in the Phong shader)
+const unsigned int TRACE_MAX_LIGHTS = 8;
+
+// Material properties (as set by a presentation node)
+struct TraceMaterial
+{
+   Color4 ambient;
+   Color4 diffuse;
+   Color4 specular;
+   Color4 emission;
+   float  shininess;
+   const TextureImage* texture;     // Texture image (NULL if not textured)
+   bool   repeatS;                  // Texture wrap mode is GL_REPEAT along s
+   bool   repeatT;                  // Texture wrap mode is GL_REPEAT along t
+};
+
+// Light source properties (as set by a light node). Position is in world
+// coordinates, w = 0 for a directional light.
+struct TraceLight
+{
+   bool    spotlight;
+   HPoint3 position;
+   Color4  ambient;
+   Color4  diffuse;
+   Color4  specular;
+   float   constantAttenuation;
+   float   linearAttenuation;
+   float   quadraticAttenuation;
+   float   spotCosCutoff;
+   float   spotExponent;
+   Vector3 spotDirection;
+};
+
+// Material and enabled lights in effect when a triangle was added
+struct TraceShading
+{
+   TraceMaterial             material;
+   std::vector<unsigned int> lights;      // Indexes into TraceState::m_lights
+};
+
+/**
+ * Trace state. Nodes add themselves to this during SceneNode::Trace the same
+ * way they set OpenGL state during Draw: transform nodes change the current
+ * modeling matrix, presentation nodes set the current material, light nodes
+ * enable a light slot for their children, and geometry nodes add their
+ * triangles. Triangles are transformed to world coordinates and tagged with
+ * the material and lights current at the time, so the traced image matches
+ * what Draw produces. Build() then creates a BVH over all the triangles.
+ */
+class TraceState
+{
+public:
+   // Camera (set by the camera node)
+   bool    m_hasCamera;
+   Point3  m_cameraPosition;           // View point (eye)
+   Vector3 m_cameraU;                  // View right axis
+   Vector3 m_cameraV;                  // View up axis
+   Vector3 m_cameraN;                  // View plane normal (points away from the scene)
+   float   m_fov;                      // Field of view y (degrees)
+   float   m_aspect;                   // Aspect ratio (width / height)
+   float   m_near;                     // Near clipping plane distance
+   float   m_far;                      // Far clipping plane distance
+
+   // Global light ambient (set by the lighting shader node)
+   Color4 m_globalAmbient;
+
+   // Current modeling matrix and retained matrices to push/pop
+   Matrix4x4              m_modelMatrix;
+   std::vector<Matrix4x4> m_modelMatrixStack;
+
+   // Current material and the light in each slot (-1 if the slot is disabled)
+   TraceMaterial m_material;
+   int           m_lightSlots[TRACE_MAX_LIGHTS];
+
+   // Lights and shading records referenced by the triangles
+   std::vector<TraceLight>   m_lights;
+   std::vector<TraceShading> m_shadings;
+
+   // Triangles in world coordinates: 3 entries in m_faces and one in
+   // m_faceShading per triangle. Vertexes without texture coordinates
+   // have (0, 0).
+   std::vector<Point3>       m_positions;
+   std::vector<Vector3>      m_normals;
+   std::vector<Vector2>      m_texCoords;
+   std::vector<unsigned int> m_faces;
+   std::vector<unsigned int> m_faceShading;
+
+   // Hierarchy over the triangles (see Build)
+   BVH m_bvh;
+
+   /**
+    * Constructor.
+    */
+   TraceState()
+   {
+      m_globalAmbient = Color4(0.0f, 0.0f, 0.0f, 0.0f);
+      Init();
+   }
+
+   /**
+    * Initialize the trace state prior to traversing the scene graph. Removes
+    * all geometry and lights. Materials default to 0 (as the shader uniforms
+    * do) and the global ambient is kept.
+    */
+   void Init()
+   {
+      m_hasCamera = false;
+      m_fov       = 50.0f;
+      m_aspect    = 1.0f;
+      m_near      = 1.0f;
+      m_far       = 1000.0f;
+      m_modelMatrix.SetIdentity();
+      m_modelMatrixStack.clear();
+      m_material.ambient   = Color4(0.0f, 0.0f, 0.0f, 0.0f);
+      m_material.diffuse   = Color4(0.0f, 0.0f, 0.0f, 0.0f);
+      m_material.specular  = Color4(0.0f, 0.0f, 0.0f, 0.0f);
+      m_material.emission  = Color4(0.0f, 0.0f, 0.0f, 0.0f);
+      m_material.shininess = 0.0f;
+      m_material.texture   = NULL;
+      m_material.repeatS   = true;
+      m_material.repeatT   = true;
+      for (unsigned int i = 0; i < TRACE_MAX_LIGHTS; i++)
+         m_lightSlots[i] = -1;
+      m_lights.clear();
+      m_shadings.clear();
+      m_positions.clear();
+      m_normals.clear();
+      m_texCoords.clear();
+      m_faces.clear();
+      m_faceShading.clear();
+   }
+
+   /**
+    * Copy current matrix onto stack
+    */
+   void PushTransforms()
+   {
+      m_modelMatrixStack.push_back(m_modelMatrix);
+   }
+
+   /**
+    * Remove the current matrix from the stack and revert to prior
+    * (or identity if none are set)
+    */
+   void PopTransforms()
+   {
+      if (m_modelMatrixStack.size() > 0)
+      {
+         m_modelMatrix = m_modelMatrixStack.back();
+         m_modelMatrixStack.pop_back();
+      }
+      else
+         m_modelMatrix.SetIdentity();
+   }
+
+   /**
+    * Enable a light in a slot, replacing any light already there.
+    * @param  slot   Light slot (the light node index)
+    * @param  light  Light properties
+    */
+   void EnableLight(const unsigned int slot, const TraceLight& light)
+   {
+      m_lights.push_back(light);
+      m_lightSlots[slot] = (int)m_lights.size() - 1;
+   }
+
+   /**
+    * Set the light in a slot.
+    * @param  slot   Light slot
+    * @param  light  Index of the light (-1 to disable the slot)
+    */
+   void SetLightSlot(const unsigned int slot, const int light)
+   {
+      m_lightSlots[slot] = light;
+   }
+
+   /**
+    * Add a triangle mesh with the current modeling matrix, material and lights.
+    * @param  vertices   Vertex positions and normals in modeling coordinates
+    * @param  faces      Face list: 3 vertex indexes per triangle
+    * @param  texCoords  Texture coordinates per vertex (ignored unless there
+    *                    is one for each vertex)
+    */
+   template <class Index>
+   void AddMesh(const std::vector<VertexAndNormal>& vertices, const std::vector<Index>& faces,
+                const std::vector<Vector2>& texCoords = std::vector<Vector2>())
+   {
+      if (vertices.empty() || faces.empty())
+         return;
+
+      // Transform positions by the modeling matrix and normals by its normal
+      // matrix. Normals are normalized per vertex as in the vertex shader.
+      unsigned int base  = (unsigned int)m_positions.size();
+      unsigned int count = (unsigned int)vertices.size();
+      Matrix4x4 normalMatrix = m_modelMatrix.GetAffineInverse().Transpose();
+      m_positions.resize(base + count);
+      m_normals.resize(base + count);
+      for (unsigned int i = 0; i < count; i++)
+      {
+         m_positions[base + i] = vertices[i].m_vertex;
+         m_normals[base + i]   = vertices[i].m_normal;
+      }
+      if (texCoords.size() == count)
+         m_texCoords.insert(m_texCoords.end(), texCoords.begin(), texCoords.end());
+      else
+         m_texCoords.resize(base + count, Vector2(0.0f, 0.0f));
+      m_modelMatrix.Transform(&m_positions[base], &m_positions[base], count);
+      normalMatrix.Transform(&m_normals[base], &m_normals[base], count);
+      for (unsigned int i = base; i < base + count; i++)
+         m_normals[i].Normalize();
+
+      unsigned int shading = getShading();
+      typename std::vector<Index>::const_iterator index = faces.begin();
+      for ( ; index != faces.end(); index++)
+         m_faces.push_back(base + (unsigned int)*index);
+      m_faceShading.resize(m_faces.size() / 3, shading);
+   }
+
+   /**
+    * Build the hierarchy over all triangles added since Init.
+    */
+   void Build()
+   {
+      m_bvh.Build(m_positions, m_faces);
+   }
+
+   /**
+    * Get the number of triangles.
+    * @return  Returns the triangle count.
+    */
+   unsigned int GetTriangleCount() const
+   {
+      return (unsigned int)m_faceShading.size();
+   }
+
+protected:
+   /**
+    * Get the shading record for the current material and lights. Reuses the
+    * last record if nothing has changed since it was added.
+    * @return  Returns the index of the shading record.
+    */
+   unsigned int getShading()
+   {
+      TraceShading shading;
+      shading.material = m_material;
+      for (unsigned int i = 0; i < TRACE_MAX_LIGHTS; i++)
+      {
+         if (m_lightSlots[i] >= 0)
+            shading.lights.push_back((unsigned int)m_lightSlots[i]);
+      }
+
+      if (!m_shadings.empty() && sameShading(m_shadings.back(), shading))
+         return (unsigned int)m_shadings.size() - 1;
+      m_shadings.push_back(shading);
+      return (unsigned int)m_shadings.size() - 1;
+   }
+
+   // Compare shading records
+   static bool sameShading(const TraceShading& s1, const TraceShading& s2)
+   {
+      return sameColor(s1.material.ambient, s2.material.ambient) &&
+             sameColor(s1.material.diffuse, s2.material.diffuse) &&
+             sameColor(s1.material.specular, s2.material.specular) &&
+             sameColor(s1.material.emission, s2.material.emission) &&
+             s1.material.shininess == s2.material.shininess &&
+             s1.material.texture == s2.material.texture &&
+             s1.material.repeatS == s2.material.repeatS &&
+             s1.material.repeatT == s2.material.repeatT &&
+             s1.lights == s2.lights;
+   }
+
+   // Compare colors
+   static bool sameColor(const Color4& c1, const Color4& c2)
+   {
+      return c1.r == c2.r && c1.g == c2.g && c1.b == c2.b && c1.a == c2.a;
+   }
+};
+
+#endif
@@ -18,6 +18,11 @@
 /**
  * Transform node. Applies a transformation. This class allows OpenGL style 
  * transforms applied to the scene graph.
+ *
+ * The world (composite modeling) matrix and the matrices derived from it
+ * are cached. They are recomputed only when this node's matrix, an
+ * ancestor's matrix or the camera changes. Derived classes that set
+ * m_matrix directly must call MatrixChanged().
  */
 class TransformNode: public SceneNode
 {
@@ -28,6 +33,9 @@ public:
 	TransformNode()
    { 
       m_nodeType = SCENE_TRANSFORM; 
+      m_parentSerial = 0;
+      m_worldSerial  = 0;
+      m_viewSerial   = 0;
       LoadIdentity();
    }
 
@@ -42,6 +50,7 @@ public:
 	void LoadIdentity()
 	{
 		m_matrix.SetIdentity();
+		MatrixChanged();
 	}
 	
 	/**
@@ -53,6 +62,7 @@ public:
 	void Translate(const float x, const float y, const float z)
 	{
 		m_matrix.Translate(x, y, z);
+		MatrixChanged();
 	}
 	
 	/**
@@ -65,6 +75,7 @@ public:
 	void Rotate(const float deg, const float x, const float y, const float z)
 	{
 		m_matrix.Rotate(deg, x, y, z);
+		MatrixChanged();
 	}
 
 	/**
@@ -76,8 +87,22 @@ public:
 	void Scale(const float x, const float y, const float z)
 	{
 		m_matrix.Scale(x, y, z);
+		MatrixChanged();
 	}
 
+   /**
+    * Mark the stored matrix as changed so the cached matrices are recomputed
+    * on the next draw.
+    */
+   void MatrixChanged()
+   {
+      m_localDirty  = true;
+      m_normalValid = false;
+      m_mvValid     = false;
+      m_pvmValid    = false;
+      InvalidateBounds();
+   }
+
 	/**
 	 * Draw this transformation node and its children. Note how this uses push
     * and pop to retain state.
@@ -85,45 +110,122 @@ public:
 	virtual void Draw(SceneState& sceneState)
 	{
       // Copy current transforms onto stack
+      unsigned int parentSerial = sceneState.m_modelSerial;
       sceneState.PushTransforms();
 
+      UpdateWorldMatrix(sceneState);
+      LoadMatrices(sceneState);
+
+      // Draw all children
+		SceneNode::Draw(sceneState);
+
+      // Pop matrix stack to revert to prior matrices
+      sceneState.PopTransforms();
+      sceneState.m_modelSerial = parentSerial;
+	}
+
+   /**
+    * Apply this modeling transform to the current modeling matrix in the
+    * scene state (and its serial), reusing the cached world matrix if
+    * neither this matrix nor the parent's has changed. Does not set any
+    * uniforms.
+    * @param  sceneState  Current scene state (the parent's modeling matrix)
+    */
+   void UpdateWorldMatrix(SceneState& sceneState)
+   {
+      unsigned int parentSerial = sceneState.m_modelSerial;
+
       // Apply this modeling transform to the current modeling matrix. Note the postmultiply -
-      // this allows hierarchical transformations in the scene
-      sceneState.m_modelMatrix *= m_matrix;
+      // this allows hierarchical transformations in the scene. Reuse the cached world
+      // matrix if neither this matrix nor the parent's has changed.
+      if (m_localDirty || parentSerial != m_parentSerial)
+      {
+         sceneState.m_modelMatrix *= m_matrix;
+         m_worldMatrix  = sceneState.m_modelMatrix;
+         m_parentSerial = parentSerial;
+         m_worldSerial  = SceneState::NewSerial();
+         m_localDirty   = false;
+         m_normalValid  = false;
+         m_mvValid      = false;
+         m_pvmValid     = false;
+         sceneState.m_matricesComputed++;
+      }
+      else
+      {
+         sceneState.m_modelMatrix = m_worldMatrix;
+         sceneState.m_matricesSkipped++;
+      }
+      sceneState.m_modelSerial = m_worldSerial;
+   }
+
+   /**
+    * Set the matrix uniforms for the world matrix found by the last
+    * UpdateWorldMatrix, recomputing derived matrices only if they are out
+    * of date.
+    * @param  sceneState  Current scene state (uniform locations and camera)
+    */
+   void LoadMatrices(SceneState& sceneState)
+   {
+      // Matrices that include the view are invalid if the camera changed
+      if (m_viewSerial != sceneState.m_viewSerial)
+      {
+         m_viewSerial = sceneState.m_viewSerial;
+         m_mvValid    = false;
+         m_pvmValid   = false;
+      }
 
       if (sceneState.m_modelMatrixLoc != -1)
       {
          // Set the model matrix in the shader. This is NOT used in Animation3D. 
-         glUniformMatrix4fv(sceneState.m_modelMatrixLoc, 1, GL_FALSE, sceneState.m_modelMatrix.Get());
+         sceneState.m_glState.UniformMatrix4fv(sceneState.m_modelMatrixLoc, m_worldMatrix.Get());
 
          // Set the normal transformation matrix
-         Matrix4x4 normalMatrix = sceneState.m_modelMatrix.GetInverse().Transpose();
-         glUniformMatrix4fv(sceneState.m_normalMatrixLoc, 1, GL_FALSE, normalMatrix.Get());
+         if (!m_normalValid)
+         {
+            m_normalMatrix = m_worldMatrix.GetAffineInverse().Transpose();
+            m_normalValid  = true;
+            sceneState.m_matricesComputed++;
+         }
+         else
+            sceneState.m_matricesSkipped++;
+         sceneState.m_glState.UniformMatrix4fv(sceneState.m_normalMatrixLoc, m_normalMatrix.Get());
       }
 
       if (sceneState.m_modelViewMatrixLoc != -1)
       {
          // Set a model view composite matrix. Lighting is computed in view space
          // NOTE - this is used for Animation3D but not for LightingViewing
-         Matrix4x4 mv = sceneState.m_view * sceneState.m_modelMatrix;
-         glUniformMatrix4fv(sceneState.m_modelViewMatrixLoc, 1, GL_FALSE, mv.Get()); 
-
-         // Set the normal transform matrix (transpose of the inverse of the modelview matrix).
-         // This transforms normals into view coordinates
-         Matrix4x4 normalMatrix = mv.GetInverse().Transpose();
-         glUniformMatrix4fv(sceneState.m_normalMatrixLoc, 1, GL_FALSE, normalMatrix.Get());
+         // Also set the normal transform matrix (transpose of the inverse of the
+         // modelview matrix). This transforms normals into view coordinates
+         if (!m_mvValid)
+         {
+            m_mv           = sceneState.m_view * m_worldMatrix;
+            m_mvNormal     = m_mv.GetAffineInverse().Transpose();
+            m_mvValid      = true;
+            sceneState.m_matricesComputed++;
+         }
+         else
+            sceneState.m_matricesSkipped++;
+         sceneState.m_glState.UniformMatrix4fv(sceneState.m_modelViewMatrixLoc, m_mv.Get()); 
+         sceneState.m_glState.UniformMatrix4fv(sceneState.m_normalMatrixLoc, m_mvNormal.Get());
       }
 
-      // Set the composite projection, view, modeling matrix
-      Matrix4x4 pvm = sceneState.m_pvMatrix * sceneState.m_modelMatrix;
-      glUniformMatrix4fv(sceneState.m_pvmLoc, 1, GL_FALSE, pvm.Get());
-
-      // Draw all children
-		SceneNode::Draw(sceneState);
-
-      // Pop matrix stack to revert to prior matrices
-      sceneState.PopTransforms();
-	}
+      // Set the composite projection, view, modeling matrix (shaders that
+      // use the camera uniform block compose it themselves)
+      if (sceneState.m_pvmLoc != -1)
+      {
+         if (!m_pvmValid)
+         {
+            m_pvm      = sceneState.m_pvMatrix * m_worldMatrix;
+            m_pvmValid = true;
+            sceneState.m_matricesComputed++;
+         }
+         else
+            sceneState.m_matricesSkipped++;
+         sceneState.m_glState.UniformMatrix4fv(sceneState.m_pvmLoc, m_pvm.Get());
+      }
+      sceneState.m_stateChanges++;
+   }
 
    /**
 	 * Update the scene node and its children
@@ -133,9 +235,61 @@ public:
       SceneNode::Update(sceneState);
    }
 
+   /**
+    * Apply this modeling transform to the trace state and trace the children.
+    * @param  traceState  Current trace state
+    */
+   virtual void Trace(TraceState& traceState)
+   {
+      traceState.PushTransforms();
+      traceState.m_modelMatrix *= m_matrix;
+      SceneNode::Trace(traceState);
+      traceState.PopTransforms();
+   }
+
+   /**
+    * Add a transform entry to the render queue and compile the children.
+    * @param  queue  Render queue being compiled
+    */
+   virtual void Compile(RenderQueue& queue)
+   {
+      queue.PushTransform(this);
+      SceneNode::Compile(queue);
+      queue.PopTransform();
+   }
+
 protected:
    // Local modeling transformation
 	Matrix4x4 m_matrix;
+
+   // Cached matrices
+   Matrix4x4    m_worldMatrix;       // Parent world matrix * m_matrix
+   Matrix4x4    m_normalMatrix;      // Normal matrix for m_worldMatrix
+   Matrix4x4    m_mv;                // View * world
+   Matrix4x4    m_mvNormal;          // Normal matrix for m_mv
+   Matrix4x4    m_pvm;               // Projection * view * world
+   unsigned int m_parentSerial;      // Serial of the parent matrix m_worldMatrix was built from
+   unsigned int m_worldSerial;       // Serial of m_worldMatrix (passed to children)
+   unsigned int m_viewSerial;        // Serial of the view m_mv and m_pvm were built from
+   bool         m_localDirty;        // m_matrix changed since m_worldMatrix was built
+   bool         m_normalValid;       // m_normalMatrix is current
+   bool         m_mvValid;           // m_mv and m_mvNormal are current
+   bool         m_pvmValid;          // m_pvm is current
+
+   /**
+    * Compute the bounding box of the children transformed by this node's
+    * matrix.
+    * @param  box  Empty box to grow to bound the node
+    * @return  Returns false if a child has no bounds.
+    */
+   virtual bool computeBounds(AABB& box)
+   {
+      AABB children;
+      if (!SceneNode::computeBounds(children))
+         return false;
+      box = m_matrix.Transform(children);
+      return true;
+   }
 };
 
 #endif
\ No newline at end of file
@@ -28,9 +28,18 @@ public:
 	TriSurface() 
    {
       m_vao = 0;
+      m_faceListCount = 0;
+      m_indexType = GL_UNSIGNED_SHORT;
+      m_positionLoc = -1;
+      m_normalLoc = -1;
+      m_texCoordLoc = -1;
+      m_buffersPending = false;
+      m_jobs = NULL;
+      m_normalWeighting = NORMALS_EQUAL;
 		m_vertexBuffer  = 0;
 		m_faceBuffer    = 0;
 		m_texCoordBuffer = 0;
+      m_bvhBuilt = false;
    }
 	
 	/**
@@ -38,7 +47,10 @@ public:
 	 */
 	~TriSurface() 
    {
-      // Delete vertex buffer objects
+      // Delete vertex buffer objects (if they were created - surfaces that
+      // are never drawn can be used without an OpenGL context)
+      if (m_vao == 0)
+         return;
       glDeleteBuffers(1, &m_vertexBuffer);
       glDeleteBuffers(1, &m_faceBuffer);
 	  glDeleteBuffers(1, &m_texCoordBuffer);
@@ -46,27 +58,243 @@ public:
    }
 	
    /**
-    * Draw this geometry node.
+    * Draw this geometry node. The vertex buffers are created on the first
+    * draw.
     */
 	void Draw(SceneState& sceneState)
    {
-      glBindVertexArray(m_vao);
-		glDrawElements(GL_TRIANGLES, (GLsizei)m_faceListCount, GL_UNSIGNED_SHORT, (void*)0);
-      glBindVertexArray(0);
+      CreateVertexBuffers(&sceneState.m_glState);
+      sceneState.m_glState.BindVertexArray(m_vao);
+      DrawElements(sceneState);
+      sceneState.m_glState.ReleaseVertexArray();
 	}
+
+   /**
+    * Draw the triangles with this surface's vertex array already bound
+    * (see CreateVertexBuffers and GetVertexArray). Lets a render queue draw
+    * the same surface several times without binding it again.
+    * @param  sceneState  Current scene state
+    */
+   void DrawElements(SceneState& sceneState)
+   {
+      sceneState.FlushUniformBlocks();
+		glDrawElements(GL_TRIANGLES, (GLsizei)m_faceListCount, m_indexType, (void*)0);
+      sceneState.m_trianglesDrawn += m_faceListCount / 3;
+      sceneState.m_drawCalls++;
+   }
+
+   /**
+    * Get the vertex array object drawn by Draw.
+    * @return  Returns the vertex array (0 before the buffers are created).
+    */
+   GLuint GetVertexArray() const
+   {
+      return m_vao;
+   }
+
+   /**
+    * Add a record to the render queue that draws this surface directly.
+    * @param  queue  Render queue being compiled
+    */
+   void Compile(RenderQueue& queue)
+   {
+      queue.AddGeometry(this, true);
+   }
+
+   /**
+    * Add this surface's triangles to the trace state.
+    * @param  traceState  Current trace state
+    */
+   void Trace(TraceState& traceState)
+   {
+      traceState.AddMesh(m_vertexList, m_faceList, m_textureList);
+   }
+
+   /**
+    * Draw multiple instances of this surface with a single draw call. The
+    * vertex array object must reference this surface's buffers (see
+    * CreateVertexArray) plus any per-instance attributes.
+    * @param  sceneState  Current scene state
+    * @param  vao         Vertex array object to draw with
+    * @param  instances   Number of instances to draw
+    */
+   void DrawInstanced(SceneState& sceneState, const GLuint vao, const GLsizei instances)
+   {
+      sceneState.m_glState.BindVertexArray(vao);
+      glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)m_faceListCount, m_indexType, (void*)0, instances);
+      sceneState.m_glState.ReleaseVertexArray();
+   }
+
+   /**
+    * Create the vertex buffers and the vertex array drawn by Draw, if they
+    * have not been created yet. Surfaces keep their vertex lists until then,
+    * so they can be built and traced without an OpenGL context.
+    * @param  glState  State cache to bind vertex arrays through (may be
+    *                  NULL outside drawing)
+    * @return  Returns true if the buffers were created by this call (no
+    *          vertex array is left bound).
+    */
+   bool CreateVertexBuffers(GLStateCache* glState = NULL)
+   {
+      if (!m_buffersPending)
+         return false;
+      m_buffersPending = false;
+      createVertexBuffers(glState);
+      return true;
+   }
+
+   /**
+    * Create a vertex array object that uses this surface's vertex, texture
+    * coordinate and face buffers (creating them if needed). The caller owns
+    * the returned VAO and can add further attributes to it (e.g.
+    * per-instance data). No vertex array is left bound.
+    * @param  positionLoc  Vertex position attribute location
+    * @param  normalLoc    Vertex normal attribute location
+    * @param  texCoordLoc  Texture coordinate attribute location
+    * @param  glState      State cache to bind the vertex array through, so
+    *                      it stays correct when called while drawing (may
+    *                      be NULL outside drawing)
+    * @return  Returns the vertex array object.
+    */
+   GLuint CreateVertexArray(const int positionLoc, const int normalLoc, const int texCoordLoc,
+                            GLStateCache* glState = NULL)
+   {
+      CreateVertexBuffers(glState);
+      GLuint vao;
+		glGenVertexArrays(1, &vao);
+		bindVertexArray(vao, glState);
+
+      // Bind the vertex buffer, set the vertex position attribute and the vertex normal attribute
+      glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+      glVertexAttribPointer(positionLoc, 3, GL_FLOAT, GL_FALSE, sizeof(VertexAndNormal), (void*)0);
+      glVertexAttribPointer(normalLoc,   3, GL_FLOAT, GL_FALSE, sizeof(VertexAndNormal), (void*)(sizeof(Point3)));
+      glEnableVertexAttribArray(positionLoc);
+      glEnableVertexAttribArray(normalLoc);
+
+	  if (m_texCoordBuffer || m_textureList.size() > 0){
+		  glBindBuffer(GL_ARRAY_BUFFER, m_texCoordBuffer);
+		  if (m_texCoordBuffer)
+			  glVertexAttribPointer(texCoordLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2), (void*)0);
+		  else if (m_textureList.size()>0)
+			  glVertexAttribPointer(texCoordLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2), (void*)&m_textureList[0].x);
+		  glEnableVertexAttribArray(texCoordLoc);
+	  }
+
+      // Bind the face list buffer. Note the use of 0 offset in glDrawElements
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_faceBuffer);
+
+      // Make sure changes to this VAO are local
+      bindVertexArray(0, glState);
+      return vao;
+   }
 	
 	/**
 	 * Construct triangle surface by passing in vertex list and face list
     * @param  vertexList  List of vertices (position and normal)
-    * @param  faceList    Index list for triangles
+    * @param  faceList    Index list for triangles (16 or 32 bit indexes)
 	 */
-	void Construct(std::vector<VertexAndNormal>& vertexList, std::vector<unsigned short> faceList, std::vector<Vector2> textureList)
+   template <class Index>
+	void Construct(std::vector<VertexAndNormal>& vertexList, const std::vector<Index>& faceList, std::vector<Vector2> textureList)
 	{
 		m_vertexList = vertexList;
-		m_faceList   = faceList;
+		m_faceList.assign(faceList.begin(), faceList.end());
 		m_textureList = textureList;
+      m_bvhBuilt    = false;
+      m_vertexHash.Clear();
+      InvalidateBounds();
 	}
 
+   /**
+    * Get the number of vertices in the surface.
+    * @return  Returns the vertex count.
+    */
+   unsigned int GetVertexCount() const
+   {
+      return (unsigned int)m_vertexList.size();
+   }
+
+   /**
+    * Get the number of triangles in the surface.
+    * @return  Returns the triangle count.
+    */
+   unsigned int GetTriangleCount() const
+   {
+      return (unsigned int)m_faceList.size() / 3;
+   }
+
+   /**
+    * Count the triangles drawn by this surface.
+    * @return  Returns the triangle count.
+    */
+   virtual unsigned int CountTriangles()
+   {
+      return GetTriangleCount();
+   }
+
+   /**
+    * Get a sphere that bounds the surface: the center of its bounding box
+    * and the distance to the farthest vertex.
+    * @param  center  Returns the center of the sphere
+    * @param  radius  Returns the radius of the sphere (0 if there are no vertices)
+    */
+   void GetBoundingSphere(Point3& center, float& radius) const
+   {
+      center.Set(0.0f, 0.0f, 0.0f);
+      radius = 0.0f;
+      if (m_vertexList.empty())
+         return;
+
+      AABB box;
+      std::vector<VertexAndNormal>::const_iterator v = m_vertexList.begin();
+      for ( ; v != m_vertexList.end(); v++)
+         box.Add(v->m_vertex);
+      center = box.GetCenter();
+      float r2 = 0.0f;
+      for (v = m_vertexList.begin(); v != m_vertexList.end(); v++)
+         r2 = MAXV(r2, (v->m_vertex - center).NormSquared());
+      radius = sqrtf(r2);
+   }
+
+   /**
+    * Get the index type used for the face buffer: GL_UNSIGNED_SHORT if the
+    * vertex count allows it, otherwise GL_UNSIGNED_INT. Set by End.
+    * @return  Returns the OpenGL index type.
+    */
+   GLenum GetIndexType() const
+   {
+      return m_indexType;
+   }
+
+   /**
+    * Set the job system used to calculate vertex normals in End.
+    * @param  jobs  Job system (NULL to run on the calling thread)
+    */
+   void SetJobSystem(JobSystem* jobs)
+   {
+      m_jobs = jobs;
+   }
+
+   /**
+    * Set how face normals are weighted when End averages them into vertex
+    * normals. The default (NORMALS_EQUAL) weights all faces equally.
+    * @param  weighting  Weighting mode
+    */
+   void SetNormalWeighting(const NormalWeighting weighting)
+   {
+      m_normalWeighting = weighting;
+   }
+
+   /**
+    * Set the distance within which vertices passed to Add are merged with an
+    * existing vertex. Call before adding triangles. By default (0) only
+    * vertices with identical positions are merged.
+    * @param  tolerance  Weld distance
+    */
+   void SetWeldTolerance(const float tolerance)
+   {
+      m_vertexHash.SetTolerance(tolerance);
+   }
+
    /**
 	 * Adds the vertices of the triangle to the vertex list. Accounts for
 	 * shared vertices by checking if the vertex is already in the list.
@@ -83,53 +311,77 @@ public:
 		m_faceList.push_back(addVertex(v0));
 		m_faceList.push_back(addVertex(v1));
 		m_faceList.push_back(addVertex(v2));
+      m_bvhBuilt = false;
 	}
 
    /**
-	 * Marks the end of a triangle mesh. Calculates the vertex normals.
+	 * Marks the end of a triangle mesh. Calculates the vertex normals. The
+    * vertex buffers are created on the first draw.
+    * @param  positionLoc      Vertex position attribute location
+    * @param  normalLoc        Vertex normal attribute location
+    * @param  textureCoordLoc  Texture coordinate attribute location
 	 */
 	void End(const int positionLoc, const int normalLoc, const int textureCoordLoc)
 	{
-		// Iterate through the face list and calculate the normals for each 
-		// face and add the normal to each vertex in the face list. This 
-		// assumes the vertex normals are initilaized to 0 (in constructor
-		// of VertexAndNormal)
-		unsigned int v0, v1, v2;
-		Vector3 e1, e2, faceNormal;
-		std::vector<unsigned short>::iterator faceVertex = m_faceList.begin();
-		while (faceVertex != m_faceList.end())
-		{
-			// Get the vertices of the face (assumes ccw order)
-			v0 = *faceVertex++;
-			v1 = *faceVertex++;
-			v2 = *faceVertex++;
-			
-			// Calculate surface normal. Normalize it since cross products
-			// do not ensure unit length normals. We need to make sure normals
-			// are same length so averaging works properly
-			e1.Set(m_vertexList[v0].m_vertex, m_vertexList[v1].m_vertex);
-			e2.Set(m_vertexList[v0].m_vertex, m_vertexList[v2].m_vertex);
-			faceNormal = (e1.Cross(e2)).Normalize();
-			
-			// Add the face normal to the vertex normals of the triangle
-			m_vertexList[v0].m_normal += faceNormal;
-			m_vertexList[v1].m_normal += faceNormal;
-			m_vertexList[v2].m_normal += faceNormal;
-		}
-		
-		// Normalize the vertex normals - this essentially averages the adjoining face normals.
-		std::vector<VertexAndNormal>::iterator v = m_vertexList.begin();
-		for ( ; v != m_vertexList.end(); v++)
-			v->m_normal.Normalize();
+		// Calculate the normal of each face and add it to the vertex normals
+		// of the face, then normalize - this essentially averages the
+		// adjoining face normals. This assumes the vertex normals are
+		// initilaized to 0 (in constructor of VertexAndNormal)
+		VertexNormalBuilder normals;
+		normals.SetJobSystem(m_jobs);
+		normals.SetWeighting(m_normalWeighting);
+		normals.Build(m_vertexList, m_faceList);
+
+		// Free the vertex hash. It is rebuilt if more triangles are added.
+		m_vertexHash.Clear();
 		
-		// Create the vertex and face buffers
-	   CreateVertexBuffers(positionLoc, normalLoc, textureCoordLoc);
+		// Create the vertex and face buffers when first drawn
+	   SetVertexAttributes(positionLoc, normalLoc, textureCoordLoc);
 	}
+
+   /**
+    * Get the bounding volume hierarchy over this surface's triangles, for
+    * picking and collision queries in modeling coordinates. It is built on
+    * first use from the retained vertex and face lists.
+    * @return  Returns the hierarchy.
+    */
+   const BVH& GetBVH()
+   {
+      if (!m_bvhBuilt)
+      {
+         std::vector<Point3> positions;
+         getPositions(positions);
+         m_bvh.Build(positions, m_faceList);
+         m_bvhBuilt = true;
+      }
+      return m_bvh;
+   }
+
+   /**
+    * Update the hierarchy (and the bounds) after the vertex positions change
+    * (the face list must be unchanged). Cheaper than a rebuild for animated
+    * meshes.
+    */
+   void RefitBVH()
+   {
+      InvalidateBounds();
+      if (!m_bvhBuilt)
+         return;
+
+      std::vector<Point3> positions;
+      getPositions(positions);
+      m_bvh.Refit(positions);
+   }
 	
 protected:
    // Vertex buffer support
    unsigned int m_faceListCount;
+   GLenum m_indexType;
    GLuint m_vao;
+   GLint  m_positionLoc;      // Attribute locations of the vertex array
+   GLint  m_normalLoc;
+   GLint  m_texCoordLoc;
+   bool   m_buffersPending;   // Buffers are created on the next draw
 	GLuint m_vertexBuffer;
 	GLuint m_faceBuffer;
 	GLuint		m_texCoordBuffer;
@@ -139,8 +391,41 @@ protected:
    // Vertex and normal list
 	std::vector<VertexAndNormal> m_vertexList;
 	
-	// Use unsigned short for face list indexes (OpenGL ES compatible)
-	std::vector<unsigned short>  m_faceList;
+	// Face list indexes. Kept as 32 bit so large meshes do not wrap; the
+	// face buffer uses unsigned short when the mesh fits (OpenGL ES compatible)
+	std::vector<unsigned int>  m_faceList;
+
+   // Hierarchy over the triangles for ray and sphere queries (see GetBVH)
+   BVH  m_bvh;
+   bool m_bvhBuilt;
+
+   // Hash of the vertex positions used by addVertex to find shared vertices
+   PointHash m_vertexHash;
+
+   // Vertex normal calculation (see End)
+   JobSystem*      m_jobs;
+   NormalWeighting m_normalWeighting;
+
+   /**
+    * Compute the bounding box of the vertices.
+    * @param  box  Empty box to grow to bound the surface
+    * @return  Returns true (surfaces are always bounded).
+    */
+   virtual bool computeBounds(AABB& box)
+   {
+      std::vector<VertexAndNormal>::const_iterator v = m_vertexList.begin();
+      for ( ; v != m_vertexList.end(); v++)
+         box.Add(v->m_vertex);
+      return true;
+   }
+
+   // Copy the vertex positions
+   void getPositions(std::vector<Point3>& positions) const
+   {
+      positions.resize(m_vertexList.size());
+      for (unsigned int i = 0; i < m_vertexList.size(); i++)
+         positions[i] = m_vertexList[i].m_vertex;
+   }
 
    /**
     * Form triangle face indexes for a surface constructed using a double loop - one can be considered
@@ -152,48 +437,92 @@ protected:
     */
    void ConstructRowColFaceList(const unsigned int nrows, const unsigned int ncols)
    {
+      ConstructRowColFaceList(nrows, ncols, m_faceList);
+   }
+
+   /**
+    * Form row/column triangle face indexes into a face list of any index type.
+    * The index type must be able to hold nrows * ncols - 1.
+    * @param  nrows     Number of rows
+    * @param  ncols     Number of columns
+    * @param  faceList  Face list to append to
+    */
+   template <class Index>
+   static void ConstructRowColFaceList(const unsigned int nrows, const unsigned int ncols,
+                                       std::vector<Index>& faceList)
+   {
+      faceList.reserve(faceList.size() + (nrows-1) * (ncols-1) * 6);
 		for (unsigned int row = 0; row < nrows-1; row++)
 		{
 			for (unsigned int col = 0; col < ncols-1; col++)
 			{
 				// Divide each square into 2 triangles - make sure they are ccw.
 				// GL_TRIANGLES draws independent triangles for each set of 3 vertices
-				m_faceList.push_back((unsigned short)(col*nrows + row+1));
-				m_faceList.push_back((unsigned short)(col*nrows + row));
-				m_faceList.push_back((unsigned short)((col+1)*nrows + row));
+				faceList.push_back((Index)(col*nrows + row+1));
+				faceList.push_back((Index)(col*nrows + row));
+				faceList.push_back((Index)((col+1)*nrows + row));
 				
-				m_faceList.push_back((unsigned short)(col*nrows + row+1));
-				m_faceList.push_back((unsigned short)((col+1)*nrows + row));
-				m_faceList.push_back((unsigned short)((col+1)*nrows + row+1));
+				faceList.push_back((Index)(col*nrows + row+1));
+				faceList.push_back((Index)((col+1)*nrows + row));
+				faceList.push_back((Index)((col+1)*nrows + row+1));
 			}
 		}
    }
 
    // Adds a vertex to the surface vertex list.  Returns the index into the
-	// vertex list.  If the vertex is already in the list it does not
-	// replicate it.
+	// vertex list.  If the vertex is already in the list (or within the weld
+	// tolerance of one) it does not replicate it - the index of the first
+	// such vertex in the list is returned.
 	unsigned int addVertex(const Point3& vIn)
 	{
+		// Hash any vertices added to the list directly (derived classes may
+		// push vertices themselves). Start over if the list was replaced.
+		if (m_vertexHash.GetCount() > m_vertexList.size())
+			m_vertexHash.Clear();
+		for (unsigned int i = m_vertexHash.GetCount(); i < m_vertexList.size(); i++)
+			m_vertexHash.Add(m_vertexList[i].m_vertex);
+
 		// Check if vertex is in the list
-		unsigned int index = 0;
-		std::vector<VertexAndNormal>::iterator v = m_vertexList.begin();
-		for ( ; v != m_vertexList.end(); v++, index++)
-			if (vIn == v->m_vertex)
-				return index;
+		unsigned int index = m_vertexHash.Find(vIn);
+		if (index != PointHash::NOT_FOUND)
+			return index;
 		
 		// Not in the list, add it. Make sure the vertex normal is initialized 
 		// to (0,0,0)
 		VertexAndNormal vertex(vIn);
 		m_vertexList.push_back(vertex);
 		m_textureList.push_back(Vector2(vIn.x, vIn.y));
-		return (unsigned int)m_vertexList.size() - 1;
+		return m_vertexHash.Add(vIn);
 	}
 
+   /**
+    * Mark the vertex lists final and set the attribute locations the vertex
+    * array is created with. The buffers are created on the first draw (see
+    * CreateVertexBuffers).
+    * @param  positionLoc  Vertex position attribute location
+    * @param  normalLoc    Vertex normal attribute location
+    * @param  texCoordLoc  Texture coordinate attribute location
+    */
+   void SetVertexAttributes(const int positionLoc, const int normalLoc, const int texCoordLoc)
+   {
+      InvalidateBounds();
+      m_positionLoc    = positionLoc;
+      m_normalLoc      = normalLoc;
+      m_texCoordLoc    = texCoordLoc;
+      m_buffersPending = true;
+   }
+
    /**
     * Creates vertex buffers for this object.
+    * @param  glState  State cache to bind vertex arrays through (may be
+    *                  NULL outside drawing)
     */
-	void CreateVertexBuffers(const int positionLoc, const int normalLoc, const int texCoordLoc)
+	void createVertexBuffers(GLStateCache* glState)
 	{
+      // The face buffer binding below must not change a vertex array left
+      // bound by drawing (see GLStateCache::ReleaseVertexArray)
+      bindVertexArray(0, glState);
+
       // Generate vertex buffers for the vertex list, face list, and texture coordinate list
 		glGenBuffers(1, &m_vertexBuffer);
 		glGenBuffers(1, &m_faceBuffer);
@@ -211,10 +540,23 @@ protected:
 		glBufferData(GL_ARRAY_BUFFER, m_vertexList.size() * sizeof(VertexAndNormal), 
                      (void*)&m_vertexList[0], GL_STATIC_DRAW);
 
-      // Bind the face list to the vertex buffer object
+      // Bind the face list to the vertex buffer object. Use 16 bit indexes
+      // if all vertices can be addressed with them (half the memory and
+      // bandwidth), otherwise 32 bit indexes.
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_faceBuffer);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_faceList.size() * sizeof(unsigned short),
-                     (void*)&m_faceList[0], GL_STATIC_DRAW);
+      if (m_vertexList.size() <= 65536)
+      {
+         std::vector<unsigned short> shortFaceList(m_faceList.begin(), m_faceList.end());
+		   glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortFaceList.size() * sizeof(unsigned short),
+                        (void*)&shortFaceList[0], GL_STATIC_DRAW);
+         m_indexType = GL_UNSIGNED_SHORT;
+      }
+      else
+      {
+		   glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_faceList.size() * sizeof(unsigned int),
+                        (void*)&m_faceList[0], GL_STATIC_DRAW);
+         m_indexType = GL_UNSIGNED_INT;
+      }
 
       // Copy the face list count for use in Draw
       m_faceListCount = m_faceList.size();
@@ -223,33 +565,20 @@ protected:
       // cases where we want to keep it (e.g. collision detection, picking) so I am not
       // going to do that here.
 
-      // Allocate a VAO, enable it and set the vertex attribute arrays and pointers
-		glGenVertexArrays(1, &m_vao);
-		glBindVertexArray(m_vao);
-
-      // Bind the vertex buffer, set the vertex position attribute and the vertex normal attribute
-      glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
-      glVertexAttribPointer(positionLoc, 3, GL_FLOAT, GL_FALSE, sizeof(VertexAndNormal), (void*)0);
-      glVertexAttribPointer(normalLoc,   3, GL_FLOAT, GL_FALSE, sizeof(VertexAndNormal), (void*)(sizeof(Point3)));
-      glEnableVertexAttribArray(positionLoc);
-      glEnableVertexAttribArray(normalLoc);
-
-	  if (m_texCoordBuffer || m_textureList.size() > 0){
-		  glBindBuffer(GL_ARRAY_BUFFER, m_texCoordBuffer);
-		  if (m_texCoordBuffer)
-			  glVertexAttribPointer(texCoordLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2), (void*)0);
-		  else if (m_textureList.size()>0)
-			  glVertexAttribPointer(texCoordLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2), (void*)&m_textureList[0].x);
-		  glEnableVertexAttribArray(texCoordLoc);
-	  }
-
-      // Bind the face list buffer and draw. Note the use of 0 offset in glDrawElements
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_faceBuffer);
-	  
-      // Make sure changes to this VAO are local
-      glBindVertexArray(0);
+      // Allocate a VAO and set the vertex attribute arrays and pointers
+      m_vao = CreateVertexArray(m_positionLoc, m_normalLoc, m_texCoordLoc, glState);
 	}
+
+   // Bind a vertex array through the state cache if there is one, so the
+   // cache does not keep a stale binding
+   static void bindVertexArray(const GLuint vao, GLStateCache* glState)
+   {
+      if (glState != NULL)
+         glState->BindVertexArray(vao);
+      else
+         glBindVertexArray(vao);
+   }
 };
 
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
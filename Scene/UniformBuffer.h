@@ -0,0 +1,240 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    UniformBuffer.h
+//	Purpose: Uniform buffer objects holding std140 uniform blocks for the
+//          camera, lights and materials.
+//
+//============================================================================
+
+#ifndef __UNIFORMBUFFER_H
+#define __UNIFORMBUFFER_H
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+// Uniform block binding points. Shaders that declare the blocks bind them
+// to these points (see ShaderNode implementations).
+const GLuint CAMERA_BLOCK_BINDING   = 0;
+const GLuint LIGHTS_BLOCK_BINDING   = 1;
+const GLuint MATERIAL_BLOCK_BINDING = 2;
+
+// Number of lights in the lights block (MAX_LIGHTS in the shaders)
+const unsigned int BLOCK_MAX_LIGHTS = 8;
+
+// The structures below match the std140 layout of the uniform blocks in the
+// shaders: vec4 and struct members start on 16 byte boundaries, vec3 takes
+// 12 bytes and scalars 4. Padding members fill the gaps.
+
+// Camera block: composite projection and view matrix and the camera position
+struct CameraBlock
+{
+   float pvMatrix[16];
+   float cameraPosition[4];            // w unused
+};
+
+// One light in the lights block
+struct LightBlock
+{
+   int   enabled;
+   int   spotlight;
+   int   pad0[2];
+   float position[4];
+   float ambient[4];
+   float diffuse[4];
+   float specular[4];
+   float constantAttenuation;
+   float linearAttenuation;
+   float quadraticAttenuation;
+   float spotCosCutoff;
+   float spotExponent;
+   float pad1[3];
+   float spotDirection[3];
+   float pad2;
+};
+
+// Lights block: global ambient, number of lights and the lights
+struct LightsBlock
+{
+   float      globalLightAmbient[4];
+   int        numLights;
+   int        pad[3];
+   LightBlock lights[BLOCK_MAX_LIGHTS];
+};
+
+// Material block
+struct MaterialBlock
+{
+   float materialAmbient[4];
+   float materialDiffuse[4];
+   float materialSpecular[4];
+   float materialEmission[4];
+   float materialShininess;
+   float pad[3];
+};
+
+/**
+ * Uniform buffer. Holds one or more copies (elements) of a uniform block in
+ * a buffer object, each starting on the GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+ * boundary so it can be bound by offset with glBindBufferRange. Writes go to
+ * a copy of the buffer in memory; a write that does not change the data is
+ * ignored, and the changed bytes are sent with a single glBufferSubData when
+ * the buffer is flushed (before drawing). The buffer object is created on
+ * the first flush, so an OpenGL context must be current by then.
+ */
+class UniformBuffer
+{
+public:
+   /**
+    * Constructor.
+    * @param  binding    Uniform block binding point
+    * @param  blockSize  Size of the block (bytes)
+    */
+   UniformBuffer(const GLuint binding, const unsigned int blockSize)
+   {
+      m_binding    = binding;
+      m_blockSize  = blockSize;
+      m_stride     = 0;
+      m_buffer     = 0;
+      m_bufferSize = 0;
+      m_bound      = -1;
+      m_dirtyBegin = 0;
+      m_dirtyEnd   = 0;
+   }
+
+   /**
+    * Destructor.
+    */
+   ~UniformBuffer()
+   {
+      if (m_buffer != 0)
+         glDeleteBuffers(1, &m_buffer);
+   }
+
+   /**
+    * Add an element (a copy of the block, initially zero).
+    * @return  Returns the index of the element.
+    */
+   unsigned int Add()
+   {
+      // Elements are bound by offset, so each is aligned as OpenGL requires
+      if (m_stride == 0)
+      {
+         GLint alignment = 0;
+         glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+         if (alignment < 1)
+            alignment = 256;
+         m_stride = (m_blockSize + alignment - 1) / alignment * alignment;
+      }
+      unsigned int element = GetCount();
+      m_data.resize(m_data.size() + m_stride, 0);
+      markDirty(element * m_stride, m_blockSize);
+      return element;
+   }
+
+   /**
+    * Get the number of elements.
+    * @return  Returns the element count.
+    */
+   unsigned int GetCount() const
+   {
+      return (m_stride == 0) ? 0 : (unsigned int)(m_data.size() / m_stride);
+   }
+
+   /**
+    * Write part of an element. Nothing is marked for upload if the data is
+    * unchanged.
+    * @param  element  Element index
+    * @param  offset   Offset of the data within the block (bytes)
+    * @param  data     Data to write
+    * @param  size     Size of the data (bytes)
+    */
+   void Write(const unsigned int element, const unsigned int offset, const void* data,
+              const unsigned int size)
+   {
+      unsigned char* dest = &m_data[element * m_stride + offset];
+      if (memcmp(dest, data, size) == 0)
+         return;
+      memcpy(dest, data, size);
+      markDirty(element * m_stride + offset, size);
+   }
+
+   /**
+    * Send the changed part of the buffer to OpenGL with a single
+    * glBufferSubData (or create / grow the buffer object to hold every
+    * element).
+    */
+   void Flush()
+   {
+      if (m_dirtyEnd <= m_dirtyBegin)
+         return;
+
+      glBindBuffer(GL_UNIFORM_BUFFER, (m_buffer != 0) ? m_buffer : create());
+      if ((GLsizeiptr)m_data.size() > m_bufferSize)
+      {
+         glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)m_data.size(), &m_data[0], GL_DYNAMIC_DRAW);
+         m_bufferSize = (GLsizeiptr)m_data.size();
+      }
+      else
+         glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)m_dirtyBegin,
+                         (GLsizeiptr)(m_dirtyEnd - m_dirtyBegin), &m_data[m_dirtyBegin]);
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+      m_dirtyBegin = m_dirtyEnd = 0;
+   }
+
+   /**
+    * Bind an element to the block's binding point (only if another element
+    * is bound).
+    * @param  element  Element index
+    * @return  Returns true if the binding changed.
+    */
+   bool Bind(const unsigned int element)
+   {
+      if (m_bound == (int)element)
+         return false;
+      if (m_buffer == 0)
+         create();
+      glBindBufferRange(GL_UNIFORM_BUFFER, m_binding, m_buffer,
+                        (GLintptr)(element * m_stride), (GLsizeiptr)m_blockSize);
+      m_bound = (int)element;
+      return true;
+   }
+
+protected:
+   GLuint                     m_binding;       // Binding point
+   unsigned int               m_blockSize;     // Size of the block
+   unsigned int               m_stride;        // Block size rounded up to the offset alignment
+   GLuint                     m_buffer;        // Buffer object (0 until created)
+   GLsizeiptr                 m_bufferSize;    // Size of the buffer object's data store
+   int                        m_bound;         // Element bound to the binding point (-1 = none)
+   std::vector<unsigned char> m_data;          // Copy of the buffer
+   unsigned int               m_dirtyBegin;    // Byte range changed since the last flush
+   unsigned int               m_dirtyEnd;
+
+   // Create the buffer object. The data store is allocated by the next flush.
+   GLuint create()
+   {
+      glGenBuffers(1, &m_buffer);
+      return m_buffer;
+   }
+
+   // Extend the range of bytes to upload on the next flush
+   void markDirty(const unsigned int offset, const unsigned int size)
+   {
+      if (m_dirtyEnd <= m_dirtyBegin)
+      {
+         m_dirtyBegin = offset;
+         m_dirtyEnd   = offset + size;
+      }
+      else
+      {
+         m_dirtyBegin = (offset < m_dirtyBegin) ? offset : m_dirtyBegin;
+         m_dirtyEnd   = (offset + size > m_dirtyEnd) ? offset + size : m_dirtyEnd;
+      }
+   }
+};
+
+#endif
@@ -44,9 +44,9 @@ public:
 			}
 		}
 		
-      // Construct face list and create vertex buffer objects
+      // Construct face list (vertex buffer objects are created when first drawn)
       ConstructRowColFaceList(n+1, n+1);
-      CreateVertexBuffers(positionLoc, normalLoc, textureLoc);
+      SetVertexAttributes(positionLoc, normalLoc, textureLoc);
 	}
 	
 private:
@@ -0,0 +1,321 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    VertexNormals.h
+//	Purpose: Parallel calculation of vertex normals for triangle meshes.
+//
+//============================================================================
+
+#ifndef __VERTEXNORMALS_H
+#define __VERTEXNORMALS_H
+
+#include <vector>
+#include "ThreadSupport/JobSystem.h"
+
+// How face normals are weighted when they are averaged at a vertex
+enum NormalWeighting
+{
+   NORMALS_EQUAL,          // Unit face normals (every face counts the same)
+   NORMALS_AREA,           // Face normals scaled by the face area
+   NORMALS_ANGLE           // Unit face normals scaled by the angle at the vertex
+};
+
+/**
+ * Vertex normal builder. Sets each vertex normal to the normalized sum of
+ * the (weighted) normals of the faces that use it.
+ *
+ * Run serially (no job system, one thread, or fewer than PARALLEL_FACES
+ * faces) it makes one pass over the faces, adding each face normal to its
+ * vertices in face order starting from their current normals, so
+ * NORMALS_EQUAL gives exactly the same normals as the serial loop in
+ * TriSurface::End did. In parallel each thread takes a range of faces and
+ * stores the weighted normal at each of their corners. The corners of each
+ * vertex are then listed in face order, and a second pass gives each thread
+ * a range of vertices, adds their corner normals in that order and
+ * normalizes them. No two threads write the same memory, and every vertex
+ * gets the same sums in the same order as the serial pass, so the normals
+ * are identical. Normals are copied in blocks to x, y and z arrays so they
+ * can be normalized 4 at a time with SSE.
+ *
+ * NORMALS_EQUAL keeps Vector3::Normalize's behavior of leaving vectors
+ * shorter than EPSILON alone (so normals of very small faces are not unit
+ * length). The weighted modes normalize any nonzero vector.
+ */
+class VertexNormalBuilder
+{
+public:
+   /**
+    * Constructor.
+    */
+   VertexNormalBuilder()
+   {
+      m_jobs      = NULL;
+      m_weighting = NORMALS_EQUAL;
+   }
+
+   /**
+    * Set the job system used to split the vertices across threads.
+    * @param  jobs  Job system (NULL to run on the calling thread)
+    */
+   void SetJobSystem(JobSystem* jobs)
+   {
+      m_jobs = jobs;
+   }
+
+   /**
+    * Set how face normals are weighted.
+    * @param  weighting  Weighting mode
+    */
+   void SetWeighting(const NormalWeighting weighting)
+   {
+      m_weighting = weighting;
+   }
+
+   /**
+    * Calculate the vertex normals. Vertex normals should be initialized to 0
+    * (as the VertexAndNormal constructor does) - they are added to.
+    * @param  vertices  Vertex list
+    * @param  faces     Face list: 3 vertex indexes per triangle, ccw order
+    */
+   template <class Index>
+   void Build(std::vector<VertexAndNormal>& vertices, const std::vector<Index>& faces)
+   {
+      unsigned int vertexCount = (unsigned int)vertices.size();
+      unsigned int faceCount   = (unsigned int)faces.size() / 3;
+      if (vertexCount == 0)
+         return;
+
+      unsigned int threads = (m_jobs == NULL || faceCount < PARALLEL_FACES) ? 1 : m_jobs->GetThreadCount();
+      if (threads == 1)
+      {
+         if (faceCount > 0)
+            accumulate(&vertices[0], &faces[0], 0, faceCount);
+         normalize(vertices, 0, vertexCount);
+         return;
+      }
+
+      // Each thread finds the corner normals of a range of faces
+      m_cornerNormals.resize(3 * faceCount);
+      m_jobs->ParallelFor(faceCount, (faceCount + threads - 1) / threads,
+         [this, &vertices, &faces](unsigned int begin, unsigned int end)
+      {
+         for (unsigned int f = begin; f < end; f++)
+            cornerNormals(&vertices[0], &faces[3 * f], &m_cornerNormals[3 * f]);
+      });
+
+      // List the corners of each vertex in face order
+      listCorners(faces, vertexCount);
+
+      // Then each thread adds the corner normals of a range of vertices and
+      // normalizes them
+      m_jobs->ParallelFor(vertexCount, (vertexCount + threads - 1) / threads,
+         [this, &vertices](unsigned int begin, unsigned int end)
+      {
+         for (unsigned int i = begin; i < end; i++)
+         {
+            Vector3& normal = vertices[i].m_normal;
+            for (unsigned int c = m_cornerStart[i]; c < m_cornerStart[i + 1]; c++)
+               normal += m_cornerNormals[m_corners[c]];
+         }
+         normalize(vertices, begin, end);
+      });
+   }
+
+protected:
+   // Number of normals copied to x, y and z arrays at a time to normalize
+   static const unsigned int NORMALIZE_BLOCK = 64;
+
+   // Fewest faces worth splitting across threads
+   static const unsigned int PARALLEL_FACES = 16384;
+
+   JobSystem*      m_jobs;           // Job system (may be NULL)
+   NormalWeighting m_weighting;      // Face normal weighting
+
+   // Parallel pass: weighted normal at each face corner (3 per face), and
+   // the corners of each vertex in face order. The corners of vertex i are
+   // m_corners[m_cornerStart[i]] up to m_corners[m_cornerStart[i + 1]].
+   std::vector<Vector3>      m_cornerNormals;
+   std::vector<unsigned int> m_cornerStart;
+   std::vector<unsigned int> m_corners;
+
+   /**
+    * Add the weighted normals of faces [begin, end) to the normals of their
+    * vertices, in face order.
+    * @param  vertex  Vertex list
+    * @param  faces   Face list
+    * @param  begin   First face
+    * @param  end     One past the last face
+    */
+   template <class Index>
+   void accumulate(VertexAndNormal* vertex, const Index* faces, const unsigned int begin,
+                   const unsigned int end)
+   {
+      const Index* face = faces + 3 * begin;
+      Vector3 corner[3];
+      for (unsigned int f = begin; f < end; f++, face += 3)
+      {
+         if (m_weighting == NORMALS_ANGLE)
+         {
+            angleCorners(vertex, face, corner);
+            vertex[(unsigned int)face[0]].m_normal += corner[0];
+            vertex[(unsigned int)face[1]].m_normal += corner[1];
+            vertex[(unsigned int)face[2]].m_normal += corner[2];
+            continue;
+         }
+
+         Vector3 faceNormal = faceNormalOf(vertex, face);
+         vertex[(unsigned int)face[0]].m_normal += faceNormal;
+         vertex[(unsigned int)face[1]].m_normal += faceNormal;
+         vertex[(unsigned int)face[2]].m_normal += faceNormal;
+      }
+   }
+
+   /**
+    * Get the weighted face normal at each corner of a face (what accumulate
+    * adds to each of its vertices).
+    * @param  vertex  Vertex list
+    * @param  face    The face's 3 vertex indexes
+    * @param  corner  Returns the normal at each of the 3 corners
+    */
+   template <class Index>
+   void cornerNormals(const VertexAndNormal* vertex, const Index* face, Vector3* corner) const
+   {
+      if (m_weighting == NORMALS_ANGLE)
+         angleCorners(vertex, face, corner);
+      else
+         corner[0] = corner[1] = corner[2] = faceNormalOf(vertex, face);
+   }
+
+   // Face normal for NORMALS_EQUAL (unit length) or NORMALS_AREA (the cross
+   // product, whose length is twice the triangle area)
+   template <class Index>
+   Vector3 faceNormalOf(const VertexAndNormal* vertex, const Index* face) const
+   {
+      const Point3& p0 = vertex[(unsigned int)face[0]].m_vertex;
+      Vector3 e1(p0, vertex[(unsigned int)face[1]].m_vertex);
+      Vector3 e2(p0, vertex[(unsigned int)face[2]].m_vertex);
+      Vector3 faceNormal = e1.Cross(e2);
+      if (m_weighting == NORMALS_EQUAL)
+         faceNormal.Normalize();
+      return faceNormal;
+   }
+
+   // Unit face normal scaled by the angle at each corner (NORMALS_ANGLE)
+   template <class Index>
+   static void angleCorners(const VertexAndNormal* vertex, const Index* face, Vector3* corner)
+   {
+      const Point3& p0 = vertex[(unsigned int)face[0]].m_vertex;
+      const Point3& p1 = vertex[(unsigned int)face[1]].m_vertex;
+      const Point3& p2 = vertex[(unsigned int)face[2]].m_vertex;
+      Vector3 e1(p0, p1), e2(p0, p2);
+      Vector3 faceNormal = e1.Cross(e2);
+      float n = faceNormal.Norm();
+      if (n > 0.0f)
+         faceNormal *= 1.0f / n;
+      Vector3 e10(p1, p0), e12(p1, p2), e20(p2, p0), e21(p2, p1);
+      corner[0] = faceNormal * angle(e1, e2);
+      corner[1] = faceNormal * angle(e10, e12);
+      corner[2] = faceNormal * angle(e20, e21);
+   }
+
+   /**
+    * List the corners of each vertex in face order (m_cornerStart and
+    * m_corners). Corner c is vertex c % 3 of face c / 3.
+    * @param  faces        Face list
+    * @param  vertexCount  Number of vertices
+    */
+   template <class Index>
+   void listCorners(const std::vector<Index>& faces, const unsigned int vertexCount)
+   {
+      unsigned int cornerCount = (unsigned int)faces.size();
+      m_cornerStart.assign(vertexCount + 1, 0);
+      for (unsigned int c = 0; c < cornerCount; c++)
+         m_cornerStart[(unsigned int)faces[c] + 1]++;
+      for (unsigned int i = 0; i < vertexCount; i++)
+         m_cornerStart[i + 1] += m_cornerStart[i];
+
+      // Filling a list advances its start to its end (the next list's
+      // start), so shift the starts back afterwards
+      m_corners.resize(cornerCount);
+      for (unsigned int c = 0; c < cornerCount; c++)
+         m_corners[m_cornerStart[(unsigned int)faces[c]]++] = c;
+      for (unsigned int i = vertexCount; i > 0; i--)
+         m_cornerStart[i] = m_cornerStart[i - 1];
+      m_cornerStart[0] = 0;
+   }
+
+   // Angle between 2 edges (0 if either is degenerate)
+   static float angle(const Vector3& a, const Vector3& b)
+   {
+      float n = a.Norm() * b.Norm();
+      if (n <= 0.0f)
+         return 0.0f;
+      float c = a.Dot(b) / n;
+      return acosf((c < -1.0f) ? -1.0f : ((c > 1.0f) ? 1.0f : c));
+   }
+
+   /**
+    * Normalize the normals of vertices [begin, end) the same way as
+    * Vector3::Normalize (vectors of length 1, or no longer than EPSILON for
+    * NORMALS_EQUAL, are left alone). Normals are copied in blocks to x, y and
+    * z arrays that stay in cache.
+    */
+   void normalize(std::vector<VertexAndNormal>& vertices, const unsigned int begin,
+                  const unsigned int end)
+   {
+      float minLength = (m_weighting == NORMALS_EQUAL) ? EPSILON : 0.0f;
+      float x[NORMALIZE_BLOCK], y[NORMALIZE_BLOCK], z[NORMALIZE_BLOCK];
+      for (unsigned int block = begin; block < end; block += NORMALIZE_BLOCK)
+      {
+         unsigned int n = (end - block < NORMALIZE_BLOCK) ? end - block : NORMALIZE_BLOCK;
+         for (unsigned int i = 0; i < n; i++)
+         {
+            x[i] = vertices[block + i].m_normal.x;
+            y[i] = vertices[block + i].m_normal.y;
+            z[i] = vertices[block + i].m_normal.z;
+         }
+         normalize(x, y, z, n, minLength);
+         for (unsigned int i = 0; i < n; i++)
+            vertices[block + i].m_normal.Set(x[i], y[i], z[i]);
+      }
+   }
+
+   // Normalize n vectors stored as x, y and z arrays
+   static void normalize(float* x, float* y, float* z, const unsigned int n, const float minLength)
+   {
+      unsigned int i = 0;
+#if defined(GEOMETRY_USE_SSE)
+      const __m128 one = _mm_set1_ps(1.0f);
+      const __m128 min = _mm_set1_ps(minLength);
+      for ( ; i + 4 <= n; i += 4)
+      {
+         __m128 vx  = _mm_loadu_ps(&x[i]);
+         __m128 vy  = _mm_loadu_ps(&y[i]);
+         __m128 vz  = _mm_loadu_ps(&z[i]);
+         __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+                                             _mm_mul_ps(vz, vz)));
+         __m128 scale = _mm_and_ps(_mm_cmpgt_ps(len, min), _mm_cmpneq_ps(len, one));
+         __m128 inv   = _mm_div_ps(one, len);
+         inv = _mm_or_ps(_mm_and_ps(scale, inv), _mm_andnot_ps(scale, one));
+         _mm_storeu_ps(&x[i], _mm_mul_ps(vx, inv));
+         _mm_storeu_ps(&y[i], _mm_mul_ps(vy, inv));
+         _mm_storeu_ps(&z[i], _mm_mul_ps(vz, inv));
+      }
+#endif
+      for ( ; i < n; i++)
+      {
+         float len = sqrtf(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+         if (len > minLength && len != 1.0f)
+         {
+            float inv = 1.0f / len;
+            x[i] *= inv;
+            y[i] *= inv;
+            z[i] *= inv;
+         }
+      }
+   }
+};
+
+#endif
@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <fcntl.h>
+#include <string>
 
 #ifdef _WIN32
 #include <io.h>
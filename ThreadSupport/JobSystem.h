@@ -0,0 +1,253 @@
+//============================================================================
+//	Johns Hopkins University Engineering Programs for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    JobSystem.h
+//	Purpose: Small work stealing job system for data parallel loops.
+//
+//============================================================================
+
+#ifndef __JOBSYSTEM_H
+#define __JOBSYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/**
+ * Job system. A fixed pool of worker threads, each with its own queue of
+ * jobs. A thread takes jobs from the back of its own queue and, when that
+ * is empty, steals from the front of the other queues. The thread that
+ * calls ParallelFor works on the jobs too (it is thread 0).
+ *
+ * Loops are split into chunks whose boundaries depend only on the loop
+ * count and the chunk size - not on the number of threads. If each chunk
+ * writes only its own outputs (per item or per chunk) the results are the
+ * same no matter how many threads run or which thread runs each chunk.
+ *
+ * ParallelFor must only be called from one thread at a time and must not
+ * be called from inside a job.
+ */
+class JobSystem
+{
+public:
+   /**
+    * Function run on a range of items [begin, end).
+    */
+   typedef std::function<void (unsigned int begin, unsigned int end)> RangeFunction;
+
+   /**
+    * Constructor given the number of threads (including the calling thread).
+    * @param  numThreads  Number of threads. 0 uses one per hardware thread.
+    */
+   JobSystem(const unsigned int numThreads = 0)
+   {
+      unsigned int n = numThreads;
+      if (n == 0)
+         n = std::thread::hardware_concurrency();
+      if (n == 0)
+         n = 1;
+
+      m_pending = 0;
+      m_quit    = false;
+      for (unsigned int i = 0; i < n; i++)
+         m_queues.push_back(new WorkQueue);
+      for (unsigned int i = 1; i < n; i++)
+         m_threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+   }
+
+   /**
+    * Destructor. Stops the worker threads.
+    */
+   ~JobSystem()
+   {
+      {
+         std::lock_guard<std::mutex> lock(m_wakeMutex);
+         m_quit = true;
+      }
+      m_wake.notify_all();
+
+      std::vector<std::thread>::iterator thread = m_threads.begin();
+      for ( ; thread != m_threads.end(); thread++)
+         thread->join();
+
+      std::vector<WorkQueue*>::iterator queue = m_queues.begin();
+      for ( ; queue != m_queues.end(); queue++)
+         delete *queue;
+   }
+
+   /**
+    * Get the number of threads that run jobs (including the calling thread).
+    * @return  Returns the number of threads.
+    */
+   unsigned int GetThreadCount() const
+   {
+      return (unsigned int)m_queues.size();
+   }
+
+   /**
+    * Get the number of chunks a loop is split into.
+    * @param  count      Number of items
+    * @param  chunkSize  Number of items per chunk
+    * @return  Returns the number of chunks.
+    */
+   static unsigned int GetChunkCount(const unsigned int count, const unsigned int chunkSize)
+   {
+      unsigned int size = (chunkSize > 0) ? chunkSize : 1;
+      return (count + size - 1) / size;
+   }
+
+   /**
+    * Run a function over items [0, count) split into chunks of chunkSize
+    * items. Chunk c covers [c * chunkSize, min((c + 1) * chunkSize, count)).
+    * Returns when all chunks are done.
+    * @param  count      Number of items
+    * @param  chunkSize  Number of items per chunk
+    * @param  function   Function called once per chunk with the chunk range
+    */
+   void ParallelFor(const unsigned int count, const unsigned int chunkSize,
+                    const RangeFunction& function)
+   {
+      unsigned int size   = (chunkSize > 0) ? chunkSize : 1;
+      unsigned int chunks = GetChunkCount(count, size);
+      if (chunks == 0)
+         return;
+
+      // Run in order on this thread if there is only one chunk or thread
+      if (chunks == 1 || GetThreadCount() == 1)
+      {
+         for (unsigned int begin = 0; begin < count; begin += size)
+            function(begin, (count - begin > size) ? begin + size : count);
+         return;
+      }
+
+      // Deal the chunks out to the queues
+      std::atomic<unsigned int> remaining(chunks);
+      for (unsigned int c = 0; c < chunks; c++)
+      {
+         Job job;
+         job.function  = &function;
+         job.begin     = c * size;
+         job.end       = (count - job.begin > size) ? job.begin + size : count;
+         job.remaining = &remaining;
+
+         WorkQueue* queue = m_queues[c % GetThreadCount()];
+         std::lock_guard<std::mutex> lock(queue->mutex);
+         queue->jobs.push_back(job);
+      }
+      m_pending += (int)chunks;
+
+      // Wake the workers
+      {
+         std::lock_guard<std::mutex> lock(m_wakeMutex);
+      }
+      m_wake.notify_all();
+
+      // Help until all chunks are done
+      while (remaining > 0)
+      {
+         if (!runJob(0))
+            std::this_thread::yield();
+      }
+   }
+
+protected:
+   // A chunk of a loop
+   struct Job
+   {
+      const RangeFunction*       function;
+      unsigned int               begin;
+      unsigned int               end;
+      std::atomic<unsigned int>* remaining;
+   };
+
+   // Jobs owned by one thread
+   struct WorkQueue
+   {
+      std::mutex       mutex;
+      std::deque<Job>  jobs;
+   };
+
+   std::vector<WorkQueue*>  m_queues;        // One queue per thread (0 = calling thread)
+   std::vector<std::thread> m_threads;       // Worker threads (1 to n-1)
+   std::atomic<int>         m_pending;       // Number of queued jobs
+   std::mutex               m_wakeMutex;     // Protects sleeping and m_quit
+   std::condition_variable  m_wake;          // Signals new jobs or quit
+   bool                     m_quit;
+
+   /**
+    * Take a job from the back of this thread's queue or, if it is empty,
+    * from the front of another queue.
+    * @param  self  Index of this thread
+    * @param  job   (OUT) Job to run
+    * @return  Returns true if a job was taken.
+    */
+   bool takeJob(const unsigned int self, Job& job)
+   {
+      unsigned int n = GetThreadCount();
+      for (unsigned int i = 0; i < n; i++)
+      {
+         WorkQueue* queue = m_queues[(self + i) % n];
+         std::lock_guard<std::mutex> lock(queue->mutex);
+         if (queue->jobs.empty())
+            continue;
+
+         if (i == 0)
+         {
+            job = queue->jobs.back();
+            queue->jobs.pop_back();
+         }
+         else
+         {
+            job = queue->jobs.front();
+            queue->jobs.pop_front();
+         }
+         m_pending--;
+         return true;
+      }
+      return false;
+   }
+
+   /**
+    * Take and run one job.
+    * @param  self  Index of this thread
+    * @return  Returns true if a job was run.
+    */
+   bool runJob(const unsigned int self)
+   {
+      Job job;
+      if (!takeJob(self, job))
+         return false;
+
+      (*job.function)(job.begin, job.end);
+      (*job.remaining)--;
+      return true;
+   }
+
+   /**
+    * Worker thread. Runs jobs until told to quit, sleeping while there is
+    * no work.
+    * @param  self  Index of this thread
+    */
+   void workerLoop(const unsigned int self)
+   {
+      for (;;)
+      {
+         if (runJob(self))
+            continue;
+
+         std::unique_lock<std::mutex> lock(m_wakeMutex);
+         while (!m_quit && m_pending <= 0)
+            m_wake.wait(lock);
+         if (m_quit)
+            return;
+      }
+   }
+};
+
+#endif
@@ -15,19 +15,23 @@
 #define __AABB_H__
 
 #include <vector>
-
-// NOTE - this is not required until 605.767!
+#include <float.h>
 
 /**
- * Axis Aligned Bounding Box.
+ * Axis Aligned Bounding Box. A default constructed box is empty (its
+ * minimum is greater than its maximum) and grows as points are added.
  */
 struct AABB
 {
+   Point3 m_min;     // Minimum x,y,z
+   Point3 m_max;     // Maximum x,y,z
+
    /**
-    * Default constructor.
+    * Default constructor. Creates an empty box.
     */
    AABB()
    {
+      Clear();
    }
 
    /**
@@ -37,22 +41,91 @@ struct AABB
     */
    AABB(const Point3& minPt, const Point3& maxPt)
    {
+      m_min = minPt;
+      m_max = maxPt;
    }
 
    /**
     * Construct an AABB given a vertex list.
     * @param  vertexList  Vertex list.
     */
-   AABB(std::vector<Point3>& vertexList)
+   AABB(const std::vector<Point3>& vertexList)
    {
+      Create(vertexList);
    }
 
    /**
     * Creates an AABB given a vertex list.
     * @param  vertexList  Vertex list.
     */
-   void Create(std::vector<Point3>& vertexList)
+   void Create(const std::vector<Point3>& vertexList)
+   {
+      Clear();
+      std::vector<Point3>::const_iterator v = vertexList.begin();
+      for ( ; v != vertexList.end(); v++)
+         Add(*v);
+   }
+
+   /**
+    * Make the box empty.
+    */
+   void Clear()
    {
+      m_min.Set( FLT_MAX,  FLT_MAX,  FLT_MAX);
+      m_max.Set(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+   }
+
+   /**
+    * Check whether the box is empty (contains no points).
+    * @return  Returns true if the box is empty.
+    */
+   bool IsEmpty() const
+   {
+      return m_min.x > m_max.x || m_min.y > m_max.y || m_min.z > m_max.z;
+   }
+
+   /**
+    * Grow the box to contain a point.
+    * @param  p  Point
+    */
+   void Add(const Point3& p)
+   {
+      m_min.Set(MINV(m_min.x, p.x), MINV(m_min.y, p.y), MINV(m_min.z, p.z));
+      m_max.Set(MAXV(m_max.x, p.x), MAXV(m_max.y, p.y), MAXV(m_max.z, p.z));
+   }
+
+   /**
+    * Grow the box to contain another box.
+    * @param  box  Box
+    */
+   void Add(const AABB& box)
+   {
+      m_min.Set(MINV(m_min.x, box.m_min.x), MINV(m_min.y, box.m_min.y), MINV(m_min.z, box.m_min.z));
+      m_max.Set(MAXV(m_max.x, box.m_max.x), MAXV(m_max.y, box.m_max.y), MAXV(m_max.z, box.m_max.z));
+   }
+
+   /**
+    * Check whether a point is inside the box (or on its boundary).
+    * @param  p  Point
+    * @return  Returns true if the point is inside the box.
+    */
+   bool Contains(const Point3& p) const
+   {
+      return p.x >= m_min.x && p.x <= m_max.x &&
+             p.y >= m_min.y && p.y <= m_max.y &&
+             p.z >= m_min.z && p.z <= m_max.z;
+   }
+
+   /**
+    * Check whether this box overlaps another box.
+    * @param  box  Box
+    * @return  Returns true if the boxes overlap (or touch).
+    */
+   bool Overlaps(const AABB& box) const
+   {
+      return m_min.x <= box.m_max.x && m_max.x >= box.m_min.x &&
+             m_min.y <= box.m_max.y && m_max.y >= box.m_min.y &&
+             m_min.z <= box.m_max.z && m_max.z >= box.m_min.z;
    }
 
    /**
@@ -61,7 +134,7 @@ struct AABB
     */
    Point3 GetMinPt() const
    {
-      return Point3();
+      return m_min;
    }
 
    /**
@@ -70,7 +143,17 @@ struct AABB
     */
    Point3 GetMaxPt() const
    {
-      return Point3();
+      return m_max;
+   }
+
+   /**
+    * Get the center of the box.
+    * @return  Returns the center point.
+    */
+   Point3 GetCenter() const
+   {
+      return Point3((m_min.x + m_max.x) * 0.5f, (m_min.y + m_max.y) * 0.5f,
+                    (m_min.z + m_max.z) * 0.5f);
    }
 };
 
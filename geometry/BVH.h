@@ -0,0 +1,541 @@
+//============================================================================
+//	Johns Hopkins University Engineering for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    BVH.h
+//	Purpose: Bounding volume hierarchy over a triangle mesh for ray and
+//          sphere queries.
+//          Student should include "geometry.h" to get all class definitions
+//          included in proper order.
+//
+//============================================================================
+
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include <vector>
+#include <algorithm>
+#include <float.h>
+
+/**
+ * Bounding volume hierarchy over the triangles of a mesh. The tree is
+ * built with the surface area heuristic (SAH) over binned triangle
+ * centroids and stored as a flat array of nodes: the two children of an
+ * interior node are adjacent in the array, and children always come after
+ * their parent. Each leaf references a run of triangles, which are stored
+ * (with copies of their vertices) in leaf order so a leaf is contiguous in
+ * memory.
+ *
+ * For animated meshes whose connectivity does not change, Refit updates
+ * the vertices and node bounds without rebuilding the tree.
+ */
+class BVH
+{
+public:
+   /**
+    * Result of a ray query.
+    */
+   struct Hit
+   {
+      float        t;          // Parameter along the ray
+      float        u;          // Barycentric coordinate (weight of vertex 1)
+      float        v;          // Barycentric coordinate (weight of vertex 2)
+      unsigned int triangle;   // Index of the triangle in the face list
+   };
+
+   /**
+    * Constructor. Creates an empty hierarchy.
+    */
+   BVH() { }
+
+   /**
+    * Build the hierarchy.
+    * @param  vertices  Vertex positions
+    * @param  faces     Face list: 3 vertex indexes per triangle
+    */
+   template <class Index>
+   void Build(const std::vector<Point3>& vertices, const std::vector<Index>& faces)
+   {
+      unsigned int count = (unsigned int)(faces.size() / 3);
+      m_nodes.clear();
+      m_triangles.resize(count);
+      for (unsigned int i = 0; i < count; i++)
+      {
+         Triangle& tri = m_triangles[i];
+         tri.index = i;
+         tri.i0    = (unsigned int)faces[i * 3];
+         tri.i1    = (unsigned int)faces[i * 3 + 1];
+         tri.i2    = (unsigned int)faces[i * 3 + 2];
+         tri.v0    = vertices[tri.i0];
+         tri.v1    = vertices[tri.i1];
+         tri.v2    = vertices[tri.i2];
+      }
+      if (count == 0)
+         return;
+
+      // Triangle bounds and centroids used during the build
+      std::vector<AABB>   bounds(count);
+      std::vector<Point3> centroids(count);
+      for (unsigned int i = 0; i < count; i++)
+      {
+         bounds[i].Add(m_triangles[i].v0);
+         bounds[i].Add(m_triangles[i].v1);
+         bounds[i].Add(m_triangles[i].v2);
+         centroids[i] = bounds[i].GetCenter();
+      }
+
+      // Split nodes until each leaf is small or splitting no longer pays.
+      // Pending nodes are kept on a stack rather than by recursion.
+      m_nodes.reserve(2 * count);
+      m_nodes.push_back(Node());
+      m_nodes[0].first = 0;
+      m_nodes[0].count = count;
+      std::vector<unsigned int> pending(1, 0);
+      std::vector<unsigned int> depth(1, 0);
+      while (!pending.empty())
+      {
+         unsigned int n = pending.back();
+         unsigned int d = depth.back();
+         pending.pop_back();
+         depth.pop_back();
+         if (split(n, d < MAX_DEPTH, bounds, centroids))
+         {
+            pending.push_back(m_nodes[n].first);
+            pending.push_back(m_nodes[n].first + 1);
+            depth.push_back(d + 1);
+            depth.push_back(d + 1);
+         }
+      }
+   }
+
+   /**
+    * Update the triangle vertices and node bounds after the mesh vertices
+    * move. The face list must be the one the hierarchy was built with. The
+    * tree is not rebuilt, so queries get slower if the mesh deforms a lot.
+    * @param  vertices  New vertex positions
+    */
+   void Refit(const std::vector<Point3>& vertices)
+   {
+      std::vector<Triangle>::iterator tri = m_triangles.begin();
+      for ( ; tri != m_triangles.end(); tri++)
+      {
+         tri->v0 = vertices[tri->i0];
+         tri->v1 = vertices[tri->i1];
+         tri->v2 = vertices[tri->i2];
+      }
+
+      // Children come after their parents, so a backwards pass sees both
+      // children of a node before the node itself
+      for (unsigned int n = (unsigned int)m_nodes.size(); n-- > 0; )
+      {
+         Node& node = m_nodes[n];
+         node.box.Clear();
+         if (node.count > 0)
+         {
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+            {
+               node.box.Add(m_triangles[i].v0);
+               node.box.Add(m_triangles[i].v1);
+               node.box.Add(m_triangles[i].v2);
+            }
+         }
+         else
+         {
+            node.box.Add(m_nodes[node.first].box);
+            node.box.Add(m_nodes[node.first + 1].box);
+         }
+      }
+   }
+
+   /**
+    * Find the closest intersection of a ray with the mesh.
+    * @param  ray   Ray (need not be normalized)
+    * @param  hit   (OUT) Closest intersection
+    * @param  tMax  Ignore intersections at or beyond this parameter
+    * @return  Returns true if the ray hits the mesh.
+    */
+   bool Intersect(const Ray3& ray, Hit& hit, const float tMax = FLT_MAX) const
+   {
+      return traverse(ray, hit, tMax, false);
+   }
+
+   /**
+    * Check whether a ray hits the mesh anywhere in (0, tMax). Stops at the
+    * first intersection found (use for shadow and visibility rays).
+    * @param  ray   Ray (need not be normalized)
+    * @param  tMax  Ignore intersections at or beyond this parameter
+    * @return  Returns true if the ray hits the mesh.
+    */
+   bool IntersectAny(const Ray3& ray, const float tMax = FLT_MAX) const
+   {
+      Hit hit;
+      return traverse(ray, hit, tMax, true);
+   }
+
+   /**
+    * Find the triangles that overlap a sphere.
+    * @param  sphere     Sphere
+    * @param  triangles  (OUT) Indexes (in the face list) of the overlapping triangles
+    * @return  Returns the number of overlapping triangles.
+    */
+   unsigned int Overlap(const BoundingSphere& sphere, std::vector<unsigned int>& triangles) const
+   {
+      triangles.clear();
+      if (m_nodes.empty())
+         return 0;
+
+      float r2 = SQR(sphere.m_radius);
+      unsigned int stack[STACK_SIZE];
+      unsigned int top = 0;
+      stack[top++] = 0;
+      while (top > 0)
+      {
+         const Node& node = m_nodes[stack[--top]];
+         if (boxDistanceSquared(node.box, sphere.m_center) > r2)
+            continue;
+
+         if (node.count > 0)
+         {
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+            {
+               const Triangle& tri = m_triangles[i];
+               Point3 p = closestPoint(sphere.m_center, tri.v0, tri.v1, tri.v2);
+               if ((p - sphere.m_center).NormSquared() <= r2)
+                  triangles.push_back(tri.index);
+            }
+         }
+         else
+         {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+         }
+      }
+      return (unsigned int)triangles.size();
+   }
+
+   /**
+    * Get the bounding box of the mesh.
+    * @return  Returns the bounds of the root node (empty if there are no triangles).
+    */
+   AABB GetBounds() const
+   {
+      return m_nodes.empty() ? AABB() : m_nodes[0].box;
+   }
+
+   /**
+    * Get the number of nodes in the hierarchy.
+    * @return  Returns the node count.
+    */
+   unsigned int GetNodeCount() const
+   {
+      return (unsigned int)m_nodes.size();
+   }
+
+   /**
+    * Get the number of triangles in the hierarchy.
+    * @return  Returns the triangle count.
+    */
+   unsigned int GetTriangleCount() const
+   {
+      return (unsigned int)m_triangles.size();
+   }
+
+protected:
+   // Build and traversal parameters
+   enum
+   {
+      MAX_LEAF_SIZE = 4,     // Leaves are always split above this size (unless centroids coincide)
+      NUM_BINS      = 16,    // Number of SAH bins per split
+      MAX_DEPTH     = 60,    // Deepest node (nodes at this depth become leaves)
+      STACK_SIZE    = 64     // Traversal stack size (must exceed MAX_DEPTH + 1)
+   };
+
+   // Node. Interior nodes have count = 0 and their children at first and
+   // first + 1. Leaves hold triangles [first, first + count).
+   struct Node
+   {
+      AABB         box;
+      unsigned int first;
+      unsigned int count;
+   };
+
+   // Triangle in leaf order: vertex copies for the queries plus the vertex
+   // indexes (for Refit) and the index of the face in the face list
+   struct Triangle
+   {
+      Point3       v0, v1, v2;
+      unsigned int i0, i1, i2;
+      unsigned int index;
+   };
+
+   std::vector<Node>     m_nodes;        // Nodes (0 is the root)
+   std::vector<Triangle> m_triangles;    // Triangles in leaf order
+
+   // Surface area of a box (0 if empty)
+   static float area(const AABB& box)
+   {
+      if (box.IsEmpty())
+         return 0.0f;
+      float dx = box.m_max.x - box.m_min.x;
+      float dy = box.m_max.y - box.m_min.y;
+      float dz = box.m_max.z - box.m_min.z;
+      return 2.0f * (dx * dy + dy * dz + dz * dx);
+   }
+
+   /**
+    * Set the bounds of node n and split it if the SAH says splitting is
+    * cheaper than a leaf (or the leaf would be too large).
+    * @param  n          Node
+    * @param  canSplit   False if the node must be a leaf (depth limit)
+    * @param  bounds     Bounds of each triangle (reordered with the triangles)
+    * @param  centroids  Centroid of each triangle (reordered with the triangles)
+    * @return  Returns true if the node was split (its children need splitting).
+    */
+   bool split(const unsigned int n, const bool canSplit, std::vector<AABB>& bounds,
+              std::vector<Point3>& centroids)
+   {
+      unsigned int first = m_nodes[n].first;
+      unsigned int count = m_nodes[n].count;
+      AABB box, centroidBox;
+      for (unsigned int i = first; i < first + count; i++)
+      {
+         box.Add(bounds[i]);
+         centroidBox.Add(centroids[i]);
+      }
+      m_nodes[n].box = box;
+      if (count <= 1 || !canSplit)
+         return false;
+
+      // Find the best split plane over the bins of each axis
+      float bestCost = FLT_MAX;
+      int   bestAxis = -1;
+      int   bestBin  = 0;
+      const float* cmin = &centroidBox.m_min.x;
+      const float* cmax = &centroidBox.m_max.x;
+      for (int axis = 0; axis < 3; axis++)
+      {
+         float extent = cmax[axis] - cmin[axis];
+         if (extent <= 0.0f)
+            continue;
+
+         AABB         binBox[NUM_BINS];
+         unsigned int binCount[NUM_BINS] = { 0 };
+         float scale = (float)NUM_BINS / extent;
+         for (unsigned int i = first; i < first + count; i++)
+         {
+            int b = binIndex((&centroids[i].x)[axis], cmin[axis], scale);
+            binBox[b].Add(bounds[i]);
+            binCount[b]++;
+         }
+
+         // Sweep from the right to get the area and count right of each plane,
+         // then from the left evaluating the cost of each plane
+         float        rightArea[NUM_BINS];
+         unsigned int rightCount[NUM_BINS];
+         AABB         right;
+         unsigned int rc = 0;
+         for (int b = NUM_BINS - 1; b > 0; b--)
+         {
+            right.Add(binBox[b]);
+            rc += binCount[b];
+            rightArea[b]  = area(right);
+            rightCount[b] = rc;
+         }
+         AABB         left;
+         unsigned int lc = 0;
+         for (int b = 1; b < NUM_BINS; b++)
+         {
+            left.Add(binBox[b - 1]);
+            lc += binCount[b - 1];
+            if (lc == 0 || rightCount[b] == 0)
+               continue;
+            float cost = area(left) * lc + rightArea[b] * rightCount[b];
+            if (cost < bestCost)
+            {
+               bestCost = cost;
+               bestAxis = axis;
+               bestBin  = b;
+            }
+         }
+      }
+
+      // Keep the leaf if all centroids coincide, or if it is small and the
+      // split costs more than intersecting every triangle (costs relative to
+      // the node area, with a traversal step costing about one triangle test)
+      if (bestAxis < 0)
+         return false;
+      if (count <= MAX_LEAF_SIZE && 1.0f + bestCost / area(box) >= (float)count)
+         return false;
+
+      // Partition the triangles (and their build data) about the plane
+      float scale = (float)NUM_BINS / (cmax[bestAxis] - cmin[bestAxis]);
+      unsigned int i = first;
+      unsigned int j = first + count;
+      while (i < j)
+      {
+         if (binIndex((&centroids[i].x)[bestAxis], cmin[bestAxis], scale) < bestBin)
+            i++;
+         else
+         {
+            j--;
+            std::swap(m_triangles[i], m_triangles[j]);
+            std::swap(bounds[i], bounds[j]);
+            std::swap(centroids[i], centroids[j]);
+         }
+      }
+
+      // Children are adjacent and follow the parent
+      unsigned int child = (unsigned int)m_nodes.size();
+      m_nodes.push_back(Node());
+      m_nodes.push_back(Node());
+      m_nodes[child].first     = first;
+      m_nodes[child].count     = i - first;
+      m_nodes[child + 1].first = i;
+      m_nodes[child + 1].count = first + count - i;
+      m_nodes[n].first = child;
+      m_nodes[n].count = 0;
+      return true;
+   }
+
+   // Bin of a centroid coordinate
+   static int binIndex(const float c, const float minc, const float scale)
+   {
+      int b = (int)((c - minc) * scale);
+      return (b < NUM_BINS) ? b : NUM_BINS - 1;
+   }
+
+   // Distance along a ray to where it enters a box: 0 if the origin is
+   // inside, FLT_MAX if the ray misses or enters at or beyond tMax
+   static float boxEntry(const AABB& box, const Point3& o, const float* inv, const float tMax)
+   {
+      float t1 = (box.m_min.x - o.x) * inv[0];
+      float t2 = (box.m_max.x - o.x) * inv[0];
+      float tnear = MINV(t1, t2);
+      float tfar  = MAXV(t1, t2);
+      t1 = (box.m_min.y - o.y) * inv[1];
+      t2 = (box.m_max.y - o.y) * inv[1];
+      tnear = MAXV(tnear, MINV(t1, t2));
+      tfar  = MINV(tfar,  MAXV(t1, t2));
+      t1 = (box.m_min.z - o.z) * inv[2];
+      t2 = (box.m_max.z - o.z) * inv[2];
+      tnear = MAXV(tnear, MINV(t1, t2));
+      tfar  = MINV(tfar,  MAXV(t1, t2));
+      if (tfar < tnear || tfar < 0.0f || tnear >= tMax)
+         return FLT_MAX;
+      return MAXV(tnear, 0.0f);
+   }
+
+   // Closest (or any) hit traversal. Visits the nearer child first and
+   // skips nodes entered beyond the closest hit so far.
+   bool traverse(const Ray3& ray, Hit& hit, const float tMax, const bool any) const
+   {
+      if (m_nodes.empty())
+         return false;
+
+      float inv[3] = { rayInverse(ray.d.x), rayInverse(ray.d.y), rayInverse(ray.d.z) };
+      bool  found  = false;
+      hit.t = tMax;
+      if (boxEntry(m_nodes[0].box, ray.o, inv, hit.t) == FLT_MAX)
+         return false;
+
+      unsigned int stack[STACK_SIZE];
+      unsigned int top = 0;
+      stack[top++] = 0;
+      while (top > 0)
+      {
+         const Node& node = m_nodes[stack[--top]];
+         if (node.count > 0)
+         {
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+            {
+               const Triangle& tri = m_triangles[i];
+               float u, v;
+               float t = ray.Intersect(tri.v0, tri.v1, tri.v2, u, v);
+               if (t > 0.0f && t < hit.t)
+               {
+                  hit.t        = t;
+                  hit.u        = u;
+                  hit.v        = v;
+                  hit.triangle = tri.index;
+                  found        = true;
+                  if (any)
+                     return true;
+               }
+            }
+            continue;
+         }
+
+         // Push the farther child first so the nearer one is visited next
+         unsigned int c0 = node.first;
+         unsigned int c1 = node.first + 1;
+         float t0 = boxEntry(m_nodes[c0].box, ray.o, inv, hit.t);
+         float t1 = boxEntry(m_nodes[c1].box, ray.o, inv, hit.t);
+         if (t1 < t0)
+         {
+            std::swap(c0, c1);
+            std::swap(t0, t1);
+         }
+         if (t1 != FLT_MAX)
+            stack[top++] = c1;
+         if (t0 != FLT_MAX)
+            stack[top++] = c0;
+      }
+      return found;
+   }
+
+   // Squared distance from a point to a box (0 if inside)
+   static float boxDistanceSquared(const AABB& box, const Point3& p)
+   {
+      float d = 0.0f;
+      if (p.x < box.m_min.x) d += SQR(box.m_min.x - p.x);
+      else if (p.x > box.m_max.x) d += SQR(p.x - box.m_max.x);
+      if (p.y < box.m_min.y) d += SQR(box.m_min.y - p.y);
+      else if (p.y > box.m_max.y) d += SQR(p.y - box.m_max.y);
+      if (p.z < box.m_min.z) d += SQR(box.m_min.z - p.z);
+      else if (p.z > box.m_max.z) d += SQR(p.z - box.m_max.z);
+      return d;
+   }
+
+   // Closest point on triangle abc to point p (Ericson, Real-Time Collision
+   // Detection 5.1.5): find the Voronoi region of the triangle containing p
+   static Point3 closestPoint(const Point3& p, const Point3& a, const Point3& b, const Point3& c)
+   {
+      Vector3 ab = b - a;
+      Vector3 ac = c - a;
+      Vector3 ap = p - a;
+      float d1 = ab.Dot(ap);
+      float d2 = ac.Dot(ap);
+      if (d1 <= 0.0f && d2 <= 0.0f)
+         return a;
+
+      Vector3 bp = p - b;
+      float d3 = ab.Dot(bp);
+      float d4 = ac.Dot(bp);
+      if (d3 >= 0.0f && d4 <= d3)
+         return b;
+
+      float vc = d1 * d4 - d3 * d2;
+      if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+         return a + ab * (d1 / (d1 - d3));
+
+      Vector3 cp = p - c;
+      float d5 = ab.Dot(cp);
+      float d6 = ac.Dot(cp);
+      if (d6 >= 0.0f && d5 <= d6)
+         return c;
+
+      float vb = d5 * d2 - d1 * d6;
+      if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+         return a + ac * (d2 / (d2 - d6));
+
+      float va = d3 * d6 - d5 * d4;
+      if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+         return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+      float denom = 1.0f / (va + vb + vc);
+      return a + ab * (vb * denom) + ac * (vc * denom);
+   }
+};
+
+#endif
@@ -0,0 +1,439 @@
+//============================================================================
+//	Johns Hopkins University Engineering for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    CollisionWorld.h
+//	Purpose: Uniform grid broad phase for moving spheres. Produces candidate
+//          pairs for a narrow phase intersection test.
+//          Student should include "geometry.h" to get all class definitions
+//          included in proper order.
+//
+//============================================================================
+
+#ifndef __COLLISIONWORLD_H__
+#define __COLLISIONWORLD_H__
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Pair of object indexes whose swept bounds overlap. The first index is
+ * always less than the second.
+ */
+struct CollisionPair
+{
+   unsigned int first;
+   unsigned int second;
+
+   /**
+    * Constructor given the two object indexes (in any order).
+    * @param  i  Index of an object
+    * @param  j  Index of the other object
+    */
+   CollisionPair(const unsigned int i, const unsigned int j)
+   {
+      first  = (i < j) ? i : j;
+      second = (i < j) ? j : i;
+   }
+
+   /**
+    * Less than operator. Orders pairs by first then second index.
+    * @param  p  Pair to compare to.
+    * @return  Returns true if this pair sorts before p.
+    */
+   bool operator < (const CollisionPair& p) const
+   {
+      return (first < p.first) || (first == p.first && second < p.second);
+   }
+};
+
+/**
+ * Broad phase collision world for spheres moving along a straight line
+ * (or anywhere within a given reach) during a frame. Each sphere is bounded by the axis aligned box of its
+ * swept volume and binned into a uniform grid whose cell size is the
+ * largest swept box. Two boxes can then only overlap if they are in the
+ * same or adjacent cells, so each object only needs to look at half of its
+ * 26 neighbors. Binning is a counting sort, so building and querying the
+ * grid is linear in the number of objects.
+ */
+class CollisionWorld
+{
+public:
+   /**
+    * Constructor. No bounds are set - the grid covers the objects.
+    */
+   CollisionWorld()
+   {
+      m_hasBounds = false;
+      m_maxCells  = 0;
+   }
+
+   /**
+    * Set the extents of the world. Objects outside the extents are still
+    * handled, they are binned into the border cells.
+    * @param  minPt  Minimum point (x,y,z)
+    * @param  maxPt  Maximum point (x,y,z)
+    */
+   void SetBounds(const Point3& minPt, const Point3& maxPt)
+   {
+      m_minPt = minPt;
+      m_maxPt = maxPt;
+      m_hasBounds = true;
+   }
+
+   /**
+    * Set the extents of the world from a set of inward facing, axis aligned
+    * bounding planes (e.g. the walls, floor and ceiling of a room). Planes
+    * that are not axis aligned are ignored.
+    * @param  planes  Bounding planes.
+    */
+   void SetBounds(const std::vector<Plane>& planes)
+   {
+      float minv[3] = {  1.0e30f,  1.0e30f,  1.0e30f };
+      float maxv[3] = { -1.0e30f, -1.0e30f, -1.0e30f };
+      std::vector<Plane>::const_iterator plane = planes.begin();
+      for ( ; plane != planes.end(); plane++)
+      {
+         // Plane is n.p = d. Find the axis of the normal and which side
+         // of the plane is inside the room.
+         float n[3] = { plane->a, plane->b, plane->c };
+         for (int axis = 0; axis < 3; axis++)
+         {
+            if (fabs(n[(axis+1)%3]) > EPSILON || fabs(n[(axis+2)%3]) > EPSILON ||
+                fabs(n[axis]) <= EPSILON)
+               continue;
+
+            float v = plane->d / n[axis];
+            if (n[axis] > 0.0f)
+               minv[axis] = v;
+            else
+               maxv[axis] = v;
+         }
+      }
+
+      // Only use the bounds if all 3 axes are bounded
+      if (minv[0] < maxv[0] && minv[1] < maxv[1] && minv[2] < maxv[2])
+         SetBounds(Point3(minv[0], minv[1], minv[2]), Point3(maxv[0], maxv[1], maxv[2]));
+   }
+
+   /**
+    * Limit the number of grid cells. By default the grid is allowed 2
+    * cells per object (with a minimum of 4096).
+    * @param  maxCells  Maximum number of cells (0 to use the default).
+    */
+   void SetMaxCells(const unsigned int maxCells)
+   {
+      m_maxCells = maxCells;
+   }
+
+   /**
+    * Remove all objects. Call once per frame before inserting objects.
+    */
+   void Clear()
+   {
+      m_cx.clear();
+      m_cy.clear();
+      m_cz.clear();
+      m_hx.clear();
+      m_hy.clear();
+      m_hz.clear();
+   }
+
+   /**
+    * Reserve storage for the specified number of objects.
+    * @param  n  Number of objects
+    */
+   void Reserve(const unsigned int n)
+   {
+      m_cx.reserve(n);
+      m_cy.reserve(n);
+      m_cz.reserve(n);
+      m_hx.reserve(n);
+      m_hy.reserve(n);
+      m_hz.reserve(n);
+   }
+
+   /**
+    * Add a moving sphere. Objects are indexed in the order they are
+    * inserted (starting at 0).
+    * @param  position      Center of the sphere at the start of the frame
+    * @param  displacement  Movement of the center during the frame
+    * @param  radius        Radius of the sphere
+    * @return  Returns the index of the object.
+    */
+   unsigned int Insert(const Point3& position, const Vector3& displacement, const float radius)
+   {
+      // Swept box: center is the midpoint of the movement, half extents are
+      // half the movement plus the radius
+      m_cx.push_back(position.x + displacement.x * 0.5f);
+      m_cy.push_back(position.y + displacement.y * 0.5f);
+      m_cz.push_back(position.z + displacement.z * 0.5f);
+      m_hx.push_back(fabs(displacement.x) * 0.5f + radius);
+      m_hy.push_back(fabs(displacement.y) * 0.5f + radius);
+      m_hz.push_back(fabs(displacement.z) * 0.5f + radius);
+      return (unsigned int)m_cx.size() - 1;
+   }
+
+   /**
+    * Add a sphere that may move up to a given distance in any direction
+    * during the frame (e.g. one that may bounce part way through). Objects
+    * are indexed in the order they are inserted (starting at 0).
+    * @param  position  Center of the sphere at the start of the frame
+    * @param  reach     Largest distance the center moves during the frame
+    * @param  radius    Radius of the sphere
+    * @return  Returns the index of the object.
+    */
+   unsigned int Insert(const Point3& position, const float reach, const float radius)
+   {
+      // Box centered on the start position, half extents are the reach
+      // plus the radius
+      m_cx.push_back(position.x);
+      m_cy.push_back(position.y);
+      m_cz.push_back(position.z);
+      m_hx.push_back(reach + radius);
+      m_hy.push_back(reach + radius);
+      m_hz.push_back(reach + radius);
+      return (unsigned int)m_cx.size() - 1;
+   }
+
+   /**
+    * Get the number of objects in the world.
+    * @return  Returns the number of objects inserted since the last Clear.
+    */
+   unsigned int GetCount() const
+   {
+      return (unsigned int)m_cx.size();
+   }
+
+   /**
+    * Find all pairs of objects whose swept bounds overlap. The pairs are
+    * sorted by first index and then second index, so a narrow phase that
+    * walks them visits pairs in the same order as a brute force double
+    * loop over all objects.
+    * @param  pairs  (OUT) Candidate pairs
+    */
+   void FindPairs(std::vector<CollisionPair>& pairs)
+   {
+      pairs.clear();
+      if (GetCount() < 2)
+         return;
+
+      Build();
+      FindPairs(0, GetCount(), pairs);
+      std::sort(pairs.begin(), pairs.end());
+   }
+
+   /**
+    * Size the grid and bin the objects into cells with a counting sort.
+    * Call after inserting all objects and before FindPairs(begin,end,pairs).
+    */
+   void Build()
+   {
+      if (GetCount() > 0)
+         BuildGrid();
+   }
+
+   /**
+    * Find the overlapping pairs for objects [begin, end) in grid order
+    * (not insertion order). Pairs are appended to the list unsorted. The
+    * grid must be built. Disjoint ranges only read the grid so they can be
+    * searched concurrently (each into its own list) and the results merged
+    * and sorted.
+    * @param  begin  First entry in the sorted object list
+    * @param  end    One past the last entry in the sorted object list
+    * @param  pairs  (OUT) Pairs are appended to this list
+    */
+   void FindPairs(const unsigned int begin, const unsigned int end,
+                  std::vector<CollisionPair>& pairs) const
+   {
+      // Forward half of the 26 neighbor cells. Each pair of adjacent cells
+      // is visited from exactly one side.
+      static const int offsets[13][3] = {
+         { 1, 0, 0}, {-1, 1, 0}, { 0, 1, 0}, { 1, 1, 0},
+         {-1,-1, 1}, { 0,-1, 1}, { 1,-1, 1}, {-1, 0, 1}, { 0, 0, 1},
+         { 1, 0, 1}, {-1, 1, 1}, { 0, 1, 1}, { 1, 1, 1} };
+
+      for (unsigned int s = begin; s < end; s++)
+      {
+         const SweptBox& a = m_sortedBox[s];
+         unsigned int c = m_sortedCell[s];
+
+         // Remaining objects in the same cell
+         for (unsigned int t = s + 1; t < m_cellStart[c + 1]; t++)
+         {
+            if (overlap(a, m_sortedBox[t]))
+               pairs.push_back(CollisionPair(m_sorted[s], m_sorted[t]));
+         }
+
+         // Objects in the forward neighbor cells
+         int i = (int)(c % (unsigned int)m_dims[0]);
+         int j = (int)((c / (unsigned int)m_dims[0]) % (unsigned int)m_dims[1]);
+         int k = (int)(c / (unsigned int)(m_dims[0] * m_dims[1]));
+         for (int o = 0; o < 13; o++)
+         {
+            int ni = i + offsets[o][0];
+            int nj = j + offsets[o][1];
+            int nk = k + offsets[o][2];
+            if (ni < 0 || nj < 0 || nk < 0 || ni >= m_dims[0] || nj >= m_dims[1] || nk >= m_dims[2])
+               continue;
+
+            unsigned int nc = cellIndex(ni, nj, nk);
+            for (unsigned int t = m_cellStart[nc]; t < m_cellStart[nc + 1]; t++)
+            {
+               if (overlap(a, m_sortedBox[t]))
+                  pairs.push_back(CollisionPair(m_sorted[s], m_sorted[t]));
+            }
+         }
+      }
+   }
+
+protected:
+   // World extents (from the bounding planes)
+   bool   m_hasBounds;
+   Point3 m_minPt;
+   Point3 m_maxPt;
+   unsigned int m_maxCells;
+
+   // Swept box of each object: center and half extents
+   std::vector<float> m_cx, m_cy, m_cz;
+   std::vector<float> m_hx, m_hy, m_hz;
+
+   // Grid definition
+   float m_origin[3];
+   float m_invCellSize;
+   int   m_dims[3];
+
+   // Swept box copied into cell order so neighbor tests read contiguous memory
+   struct SweptBox
+   {
+      float cx, cy, cz;
+      float hx, hy, hz;
+   };
+
+   // Objects sorted by cell. Objects in cell c are m_sorted[m_cellStart[c]]
+   // up to m_sorted[m_cellStart[c+1]]
+   std::vector<unsigned int> m_cellStart;
+   std::vector<unsigned int> m_sorted;
+   std::vector<unsigned int> m_sortedCell;
+   std::vector<SweptBox>     m_sortedBox;
+   std::vector<unsigned int> m_objectCell;
+   std::vector<unsigned int> m_next;
+
+   // Get the grid coordinate along an axis (clamped to the grid)
+   int cellCoord(const float v, const int axis) const
+   {
+      int c = (int)floorf((v - m_origin[axis]) * m_invCellSize);
+      return (c < 0) ? 0 : ((c >= m_dims[axis]) ? m_dims[axis] - 1 : c);
+   }
+
+   // Get the cell index given grid coordinates
+   unsigned int cellIndex(const int i, const int j, const int k) const
+   {
+      return (unsigned int)((k * m_dims[1] + j) * m_dims[0] + i);
+   }
+
+   // Test if 2 swept boxes overlap
+   bool overlap(const SweptBox& a, const SweptBox& b) const
+   {
+      return fabsf(a.cx - b.cx) <= a.hx + b.hx &&
+             fabsf(a.cy - b.cy) <= a.hy + b.hy &&
+             fabsf(a.cz - b.cz) <= a.hz + b.hz;
+   }
+
+   /**
+    * Size the grid and bin the objects into cells with a counting sort.
+    */
+   void BuildGrid()
+   {
+      // Find the extents of the objects and the largest swept box
+      unsigned int n = GetCount();
+      float minv[3] = { m_cx[0], m_cy[0], m_cz[0] };
+      float maxv[3] = { m_cx[0], m_cy[0], m_cz[0] };
+      float maxExtent = 0.0f;
+      for (unsigned int i = 0; i < n; i++)
+      {
+         minv[0] = MINV(minv[0], m_cx[i]);
+         minv[1] = MINV(minv[1], m_cy[i]);
+         minv[2] = MINV(minv[2], m_cz[i]);
+         maxv[0] = MAXV(maxv[0], m_cx[i]);
+         maxv[1] = MAXV(maxv[1], m_cy[i]);
+         maxv[2] = MAXV(maxv[2], m_cz[i]);
+         maxExtent = MAXV(maxExtent, MAXV(m_hx[i], MAXV(m_hy[i], m_hz[i])));
+      }
+
+      // Do not let the grid extend past the room - anything outside is
+      // binned into the border cells
+      if (m_hasBounds)
+      {
+         minv[0] = MAXV(minv[0], m_minPt.x);
+         minv[1] = MAXV(minv[1], m_minPt.y);
+         minv[2] = MAXV(minv[2], m_minPt.z);
+         maxv[0] = MINV(maxv[0], m_maxPt.x);
+         maxv[1] = MINV(maxv[1], m_maxPt.y);
+         maxv[2] = MINV(maxv[2], m_maxPt.z);
+      }
+
+      // Cell size must be at least the largest swept box so overlapping boxes
+      // are never more than 1 cell apart. Grow cells if there would be too many.
+      float cellSize = MAXV(2.0f * maxExtent, EPSILON);
+      unsigned int maxCells = (m_maxCells > 0) ? m_maxCells : MAXV(2 * n, 4096u);
+      float size[3];
+      double numCells;
+      for (;;)
+      {
+         numCells = 1.0;
+         for (int axis = 0; axis < 3; axis++)
+         {
+            size[axis] = MAXV(maxv[axis] - minv[axis], 0.0f);
+            m_dims[axis] = (int)(size[axis] / cellSize) + 1;
+            numCells *= (double)m_dims[axis];
+         }
+         if (numCells <= (double)maxCells)
+            break;
+         cellSize *= (float)pow(numCells / (double)maxCells, 1.0 / 3.0) * 1.01f;
+      }
+      m_invCellSize = 1.0f / cellSize;
+      for (int axis = 0; axis < 3; axis++)
+      {
+         // Center the grid on the objects
+         m_origin[axis] = minv[axis] - 0.5f * ((float)m_dims[axis] * cellSize - size[axis]);
+      }
+
+      // Count objects per cell
+      unsigned int cells = (unsigned int)numCells;
+      m_cellStart.assign(cells + 1, 0);
+      m_objectCell.resize(n);
+      for (unsigned int i = 0; i < n; i++)
+      {
+         unsigned int c = cellIndex(cellCoord(m_cx[i], 0), cellCoord(m_cy[i], 1), cellCoord(m_cz[i], 2));
+         m_objectCell[i] = c;
+         m_cellStart[c + 1]++;
+      }
+
+      // Prefix sum to get the start of each cell, then scatter. Objects stay
+      // in increasing index order within a cell.
+      for (unsigned int c = 0; c < cells; c++)
+         m_cellStart[c + 1] += m_cellStart[c];
+      m_next.assign(m_cellStart.begin(), m_cellStart.end() - 1);
+      m_sorted.resize(n);
+      m_sortedCell.resize(n);
+      m_sortedBox.resize(n);
+      for (unsigned int i = 0; i < n; i++)
+      {
+         unsigned int s = m_next[m_objectCell[i]]++;
+         m_sorted[s] = i;
+         m_sortedCell[s] = m_objectCell[i];
+         SweptBox& box = m_sortedBox[s];
+         box.cx = m_cx[i];
+         box.cy = m_cy[i];
+         box.cz = m_cz[i];
+         box.hx = m_hx[i];
+         box.hy = m_hy[i];
+         box.hz = m_hz[i];
+      }
+   }
+};
+
+#endif
@@ -0,0 +1,130 @@
+//============================================================================
+//	Johns Hopkins University Engineering for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    Frustum.h
+//	Purpose: View frustum (6 bounding planes) for culling boxes and
+//          spheres that cannot be seen.
+//          Student should include "geometry.h" to get all class definitions
+//          included in proper order.
+//
+//============================================================================
+
+#ifndef __FRUSTUM_H__
+#define __FRUSTUM_H__
+
+#include <math.h>
+
+/**
+ * View frustum of a symmetric perspective projection. The planes are stored
+ * with unit normals pointing into the frustum (left, right, bottom, top,
+ * near, far), so Plane::Solve gives the signed distance from each plane,
+ * positive inside. The tests are conservative: a box or sphere is only
+ * reported outside if it is entirely behind one plane, so a few objects
+ * near the corners of the frustum are kept although they cannot be seen.
+ */
+class Frustum
+{
+public:
+   // Number of bounding planes
+   static const unsigned int PLANE_COUNT = 6;
+
+   /**
+    * Constructor. The planes are undefined until Set is called.
+    */
+   Frustum() { }
+
+   /**
+    * Set the frustum from the camera position, view axes and perspective
+    * projection parameters.
+    * @param  eye     View point (eye)
+    * @param  u       View right axis (unit length)
+    * @param  v       View up axis (unit length)
+    * @param  n       View plane normal (unit length, points away from the scene)
+    * @param  fov     Field of view angle y (degrees)
+    * @param  aspect  Aspect ratio (width / height)
+    * @param  nearDistance  Near plane distance
+    * @param  farDistance   Far plane distance
+    */
+   void Set(const Point3& eye, const Vector3& u, const Vector3& v, const Vector3& n,
+            const float fov, const float aspect, const float nearDistance, const float farDistance)
+   {
+      // The side planes pass through the eye. Each normal is perpendicular to
+      // the side's edge direction (forward +/- the half extent along u or v).
+      Vector3 forward = n * -1.0f;
+      float tanY = tanf(degreesToRadians(fov * 0.5f));
+      float tanX = aspect * tanY;
+      setPlane(0, eye, u + forward * tanX);
+      setPlane(1, eye, u * -1.0f + forward * tanX);
+      setPlane(2, eye, v + forward * tanY);
+      setPlane(3, eye, v * -1.0f + forward * tanY);
+      setPlane(4, eye + forward * nearDistance, forward);
+      setPlane(5, eye + forward * farDistance, n);
+   }
+
+   /**
+    * Get one of the bounding planes.
+    * @param  i  Plane index (left, right, bottom, top, near, far)
+    * @return  Returns the plane (normal points into the frustum).
+    */
+   const Plane& GetPlane(const unsigned int i) const
+   {
+      return m_planes[i];
+   }
+
+   /**
+    * Check whether a box is outside the frustum.
+    * @param  box  Axis aligned box
+    * @return  Returns true if the box is empty or entirely outside one of
+    *          the planes.
+    */
+   bool Outside(const AABB& box) const
+   {
+      if (box.IsEmpty())
+         return true;
+
+      // Compare the distance of the center to each plane with the box's
+      // extent along the plane normal
+      Point3 c((box.m_min.x + box.m_max.x) * 0.5f, (box.m_min.y + box.m_max.y) * 0.5f,
+               (box.m_min.z + box.m_max.z) * 0.5f);
+      Vector3 e((box.m_max.x - box.m_min.x) * 0.5f, (box.m_max.y - box.m_min.y) * 0.5f,
+                (box.m_max.z - box.m_min.z) * 0.5f);
+      for (unsigned int i = 0; i < PLANE_COUNT; i++)
+      {
+         const Plane& p = m_planes[i];
+         float r = e.x * fabsf(p.a) + e.y * fabsf(p.b) + e.z * fabsf(p.c);
+         if (p.Solve(c) < -r)
+            return true;
+      }
+      return false;
+   }
+
+   /**
+    * Check whether a sphere is outside the frustum.
+    * @param  center  Center of the sphere
+    * @param  radius  Radius of the sphere
+    * @return  Returns true if the sphere is entirely outside one of the planes.
+    */
+   bool Outside(const Point3& center, const float radius) const
+   {
+      for (unsigned int i = 0; i < PLANE_COUNT; i++)
+      {
+         if (m_planes[i].Solve(center) < -radius)
+            return true;
+      }
+      return false;
+   }
+
+protected:
+   Plane m_planes[PLANE_COUNT];     // Bounding planes (normals point inward)
+
+   // Set a plane given a point and an (unnormalized) inward normal
+   void setPlane(const unsigned int i, const Point3& p, const Vector3& normal)
+   {
+      m_planes[i].Set(p, normal);
+      m_planes[i].Normalize();
+   }
+};
+
+#endif
@@ -173,40 +173,8 @@ public:
     */
    Matrix4x4 operator * (const Matrix4x4& n) const
    {
-      // Unroll the loop, do 1 row at a time.
       Matrix4x4 t;
-      float a0 = m00();
-      float a1 = m01();
-      float a2 = m02();
-      float a3 = m03();
-      t.m00() = a0 * n.m00() + a1 * n.m10() + a2 * n.m20() + a3 * n.m30();
-      t.m01() = a0 * n.m01() + a1 * n.m11() + a2 * n.m21() + a3 * n.m31();
-      t.m02() = a0 * n.m02() + a1 * n.m12() + a2 * n.m22() + a3 * n.m32();
-      t.m03() = a0 * n.m03() + a1 * n.m13() + a2 * n.m23() + a3 * n.m33();
-      a0 = m10();
-      a1 = m11();
-      a2 = m12();
-      a3 = m13();
-      t.m10() = a0 * n.m00() + a1 * n.m10() + a2 * n.m20() + a3 * n.m30();
-      t.m11() = a0 * n.m01() + a1 * n.m11() + a2 * n.m21() + a3 * n.m31();
-      t.m12() = a0 * n.m02() + a1 * n.m12() + a2 * n.m22() + a3 * n.m32();
-      t.m13() = a0 * n.m03() + a1 * n.m13() + a2 * n.m23() + a3 * n.m33();
-      a0 = m20();
-      a1 = m21();
-      a2 = m22();
-      a3 = m23();
-      t.m20() = a0 * n.m00() + a1 * n.m10() + a2 * n.m20() + a3 * n.m30();
-      t.m21() = a0 * n.m01() + a1 * n.m11() + a2 * n.m21() + a3 * n.m31();
-      t.m22() = a0 * n.m02() + a1 * n.m12() + a2 * n.m22() + a3 * n.m32();
-      t.m23() = a0 * n.m03() + a1 * n.m13() + a2 * n.m23() + a3 * n.m33();
-      a0 = m30();
-      a1 = m31();
-      a2 = m32();
-      a3 = m33();
-      t.m30() = a0 * n.m00() + a1 * n.m10() + a2 * n.m20() + a3 * n.m30();
-      t.m31() = a0 * n.m01() + a1 * n.m11() + a2 * n.m21() + a3 * n.m31();
-      t.m32() = a0 * n.m02() + a1 * n.m12() + a2 * n.m22() + a3 * n.m32();
-      t.m33() = a0 * n.m03() + a1 * n.m13() + a2 * n.m23() + a3 * n.m33();
+      MatrixMultiply(a, n.a, t.a);
 	   return t;
    }
 
@@ -243,10 +211,9 @@ public:
     */
    HPoint3 operator *(const HPoint3& v) const
    {
-      return HPoint3((a[0] * v.x + a[4] * v.y + a[8]  * v.z + a[12] * v.w),
-                     (a[1] * v.x + a[5] * v.y + a[9]  * v.z + a[13] * v.w),
-		               (a[2] * v.x + a[6] * v.y + a[10] * v.z + a[14] * v.w),
-		               (a[3] * v.x + a[7] * v.y + a[11] * v.z + a[15] * v.w));
+      HPoint3 t;
+      MatrixTransform4(a, &v.x, &t.x, 1);
+      return t;
    }
 
    /**
@@ -257,10 +224,10 @@ public:
     */
    HPoint3 operator *(const Point3& v) const
    {
-      return HPoint3((a[0] * v.x + a[4] * v.y + a[8]  * v.z + a[12]),
-                     (a[1] * v.x + a[5] * v.y + a[9]  * v.z + a[13]),
-                     (a[2] * v.x + a[6] * v.y + a[10] * v.z + a[14]),
-                     1.0f);
+      HPoint3 t;
+      MatrixTransform3(a, &v.x, &t.x, 1, 1.0f);
+      t.w = 1.0f;
+      return t;
    }
 
    /**
@@ -271,9 +238,9 @@ public:
     */
    Vector3 operator *(const Vector3& v) const
    {
-      return Vector3((a[0] * v.x + a[4] * v.y + a[8]  * v.z),
-                     (a[1] * v.x + a[5] * v.y + a[9]  * v.z),
-                     (a[2] * v.x + a[6] * v.y + a[10] * v.z));
+      Vector3 t;
+      MatrixTransform3(a, &v.x, &t.x, 1, 0.0f);
+      return t;
    }
 
    /**
@@ -287,6 +254,73 @@ public:
       return Ray3(*this * ray.o, *this * ray.d, true);
    }
 
+   /**
+    * Transforms an array of points by the matrix. Assumes the matrix is
+    * affine (the w coordinate of the result is 1).
+    * @param   in     Points to transform
+    * @param   out    (OUT) Transformed points. May be the same array as in.
+    * @param   count  Number of points
+    */
+   void Transform(const Point3* in, Point3* out, const unsigned int count) const
+   {
+      MatrixTransform3(a, &in->x, &out->x, count, 1.0f);
+   }
+
+   /**
+    * Transforms an array of vectors (normals or directions) by the matrix.
+    * Only the upper 3x3 portion of the matrix is used (no translation).
+    * @param   in     Vectors to transform
+    * @param   out    (OUT) Transformed vectors. May be the same array as in.
+    * @param   count  Number of vectors
+    */
+   void Transform(const Vector3* in, Vector3* out, const unsigned int count) const
+   {
+      MatrixTransform3(a, &in->x, &out->x, count, 0.0f);
+   }
+
+   /**
+    * Transforms a box by the matrix. Assumes the matrix is affine. The
+    * result is the axis aligned box that bounds the transformed box: its
+    * center is the transformed center and its half widths are the half
+    * widths multiplied by the absolute values of the upper 3x3 elements.
+    * @param   box  Box to transform
+    * @return  Returns the bounding box of the transformed box (empty if box is empty).
+    */
+   AABB Transform(const AABB& box) const
+   {
+      if (box.IsEmpty())
+         return box;
+
+      float c[3] = { (box.m_min.x + box.m_max.x) * 0.5f, (box.m_min.y + box.m_max.y) * 0.5f,
+                     (box.m_min.z + box.m_max.z) * 0.5f };
+      float e[3] = { (box.m_max.x - box.m_min.x) * 0.5f, (box.m_max.y - box.m_min.y) * 0.5f,
+                     (box.m_max.z - box.m_min.z) * 0.5f };
+      float tc[3], te[3];
+      for (unsigned int row = 0; row < 3; row++)
+      {
+         tc[row] = a[12 + row];
+         te[row] = 0.0f;
+         for (unsigned int col = 0; col < 3; col++)
+         {
+            tc[row] += a[col * 4 + row] * c[col];
+            te[row] += fabsf(a[col * 4 + row]) * e[col];
+         }
+      }
+      return AABB(Point3(tc[0] - te[0], tc[1] - te[1], tc[2] - te[2]),
+                  Point3(tc[0] + te[0], tc[1] + te[1], tc[2] + te[2]));
+   }
+
+   /**
+    * Transforms an array of homogeneous coordinates by the matrix.
+    * @param   in     Homogeneous coordinates to transform
+    * @param   out    (OUT) Transformed coordinates. May be the same array as in.
+    * @param   count  Number of coordinates
+    */
+   void Transform(const HPoint3* in, HPoint3* out, const unsigned int count) const
+   {
+      MatrixTransform4(a, &in->x, &out->x, count);
+   }
+
    /**
     * Transposes the current matrix.
     * @return   Returns the address of the current matrix.
@@ -305,22 +339,7 @@ public:
    Matrix4x4 GetTranspose() const
    {
 	   Matrix4x4 t;
-      t.m00() = m00();
-      t.m01() = m10();
-      t.m02() = m20();
-      t.m03() = m30();
-      t.m10() = m01();
-      t.m11() = m11();
-      t.m12() = m21();
-      t.m13() = m31();
-      t.m20() = m02();
-      t.m21() = m12();
-      t.m22() = m22();
-      t.m23() = m32();
-      t.m30() = m03();
-      t.m31() = m13();
-      t.m32() = m23();
-      t.m33() = m33();
+      MatrixTranspose(a, t.a);
       return t;
    }
 
@@ -488,6 +507,36 @@ public:
       *this = GetInverse();
    }
 
+   /**
+    * Tests if the matrix is affine (the last row is 0,0,0,1). Modeling and
+    * viewing transforms are affine, projections are not.
+    * @return  Returns true if the matrix is affine.
+    */
+   bool IsAffine() const
+   {
+      return (m30() == 0.0f && m31() == 0.0f && m32() == 0.0f && m33() == 1.0f);
+   }
+
+   /**
+    * Calculates the inverse of the current matrix, which is much cheaper
+    * when the matrix is affine. Falls back to GetInverse if it is not.
+    * @return  Returns the inverse of the current matrix.
+    */
+   Matrix4x4 GetAffineInverse() const
+   {
+      if (!IsAffine())
+         return GetInverse();
+
+      Matrix4x4 b;
+      if (!MatrixAffineInverse(a, b.a))
+      {
+         extern void logmsg(const char *message, ...);
+         logmsg("InvertMatrix: Singular matrix");
+         b.SetIdentity();
+      }
+      return b;
+   }
+
    /**
     * Calculates the inverse of the current 4x4 matrix and returns it.
     * @return  Returns the inverse of the current matrix.
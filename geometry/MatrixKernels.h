@@ -0,0 +1,326 @@
+//============================================================================
+//	Johns Hopkins University Engineering for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    MatrixKernels.h
+//	Purpose: 4x4 matrix kernels (multiply, transpose, affine inverse and
+//          transforms) with SSE and AVX versions selected at compile time.
+//          Student should include "geometry.h" to get all class definitions
+//          included in proper order.
+//
+//============================================================================
+
+#ifndef __MATRIXKERNELS_H__
+#define __MATRIXKERNELS_H__
+
+// Select the instruction set. SSE2 is used when the compiler targets it
+// (always on x64), AVX when compiling with /arch:AVX (or -mavx). Define
+// GEOMETRY_NO_SIMD to force the scalar kernels.
+#if !defined(GEOMETRY_NO_SIMD)
+#if defined(__AVX__)
+#define GEOMETRY_USE_AVX
+#endif
+#if defined(GEOMETRY_USE_AVX) || defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GEOMETRY_USE_SSE
+#endif
+#endif
+
+#if defined(GEOMETRY_USE_AVX)
+#include <immintrin.h>
+#elif defined(GEOMETRY_USE_SSE)
+#include <emmintrin.h>
+#endif
+
+// All kernels operate on column ordered 4x4 matrices (the same layout as
+// Matrix4x4 and OpenGL): element (row, col) is m[col * 4 + row]. Outputs
+// may alias inputs. The SSE and AVX kernels perform the same operations in
+// the same order as the scalar kernels, so results agree to within floating
+// point rounding.
+
+/**
+ * Get the name of the instruction set the kernels were compiled for.
+ * @return  Returns "AVX", "SSE" or "scalar".
+ */
+inline const char* MatrixKernelName()
+{
+#if defined(GEOMETRY_USE_AVX)
+   return "AVX";
+#elif defined(GEOMETRY_USE_SSE)
+   return "SSE";
+#else
+   return "scalar";
+#endif
+}
+
+#if defined(GEOMETRY_USE_SSE)
+// Cross product of the x,y,z components (w of the result is 0)
+inline __m128 sseCross(const __m128 a, const __m128 b)
+{
+   __m128 ayzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+   __m128 byzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+   __m128 c    = _mm_sub_ps(_mm_mul_ps(a, byzx), _mm_mul_ps(ayzx, b));
+   return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// Dot product of all 4 components, returned in every component
+inline __m128 sseDot4(const __m128 a, const __m128 b)
+{
+   __m128 p = _mm_mul_ps(a, b);
+   __m128 s = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 0, 1)));
+   return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// Linear combination of the 4 columns c0..c3 with weights x,y,z,w
+inline __m128 sseCombine(const __m128 c0, const __m128 c1, const __m128 c2, const __m128 c3,
+                         const float x, const float y, const float z, const float w)
+{
+   __m128 r = _mm_mul_ps(c0, _mm_set1_ps(x));
+   r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(y)));
+   r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(z)));
+   return _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(w)));
+}
+#endif
+
+/**
+ * Matrix product out = a * b.
+ * @param  a    Left matrix
+ * @param  b    Right matrix
+ * @param  out  (OUT) Product
+ */
+inline void MatrixMultiply(const float* a, const float* b, float* out)
+{
+#if defined(GEOMETRY_USE_AVX)
+   // Two columns of the product at a time. Each 128 bit lane holds one column.
+   __m256 c0 = _mm256_broadcast_ps((const __m128*)(a));
+   __m256 c1 = _mm256_broadcast_ps((const __m128*)(a + 4));
+   __m256 c2 = _mm256_broadcast_ps((const __m128*)(a + 8));
+   __m256 c3 = _mm256_broadcast_ps((const __m128*)(a + 12));
+   __m256 b01 = _mm256_loadu_ps(b);
+   __m256 b23 = _mm256_loadu_ps(b + 8);
+   __m256 r01 = _mm256_mul_ps(c0, _mm256_shuffle_ps(b01, b01, 0x00));
+   r01 = _mm256_add_ps(r01, _mm256_mul_ps(c1, _mm256_shuffle_ps(b01, b01, 0x55)));
+   r01 = _mm256_add_ps(r01, _mm256_mul_ps(c2, _mm256_shuffle_ps(b01, b01, 0xAA)));
+   r01 = _mm256_add_ps(r01, _mm256_mul_ps(c3, _mm256_shuffle_ps(b01, b01, 0xFF)));
+   __m256 r23 = _mm256_mul_ps(c0, _mm256_shuffle_ps(b23, b23, 0x00));
+   r23 = _mm256_add_ps(r23, _mm256_mul_ps(c1, _mm256_shuffle_ps(b23, b23, 0x55)));
+   r23 = _mm256_add_ps(r23, _mm256_mul_ps(c2, _mm256_shuffle_ps(b23, b23, 0xAA)));
+   r23 = _mm256_add_ps(r23, _mm256_mul_ps(c3, _mm256_shuffle_ps(b23, b23, 0xFF)));
+   _mm256_storeu_ps(out, r01);
+   _mm256_storeu_ps(out + 8, r23);
+#elif defined(GEOMETRY_USE_SSE)
+   // Column j of the product is a combination of the columns of a weighted
+   // by column j of b
+   __m128 c0 = _mm_loadu_ps(a);
+   __m128 c1 = _mm_loadu_ps(a + 4);
+   __m128 c2 = _mm_loadu_ps(a + 8);
+   __m128 c3 = _mm_loadu_ps(a + 12);
+   __m128 r0 = sseCombine(c0, c1, c2, c3, b[0],  b[1],  b[2],  b[3]);
+   __m128 r1 = sseCombine(c0, c1, c2, c3, b[4],  b[5],  b[6],  b[7]);
+   __m128 r2 = sseCombine(c0, c1, c2, c3, b[8],  b[9],  b[10], b[11]);
+   __m128 r3 = sseCombine(c0, c1, c2, c3, b[12], b[13], b[14], b[15]);
+   _mm_storeu_ps(out,      r0);
+   _mm_storeu_ps(out + 4,  r1);
+   _mm_storeu_ps(out + 8,  r2);
+   _mm_storeu_ps(out + 12, r3);
+#else
+   float t[16];
+   for (int col = 0; col < 4; col++)
+   {
+      const float* bc = b + col * 4;
+      for (int row = 0; row < 4; row++)
+         t[col * 4 + row] = a[row] * bc[0] + a[4 + row] * bc[1] + a[8 + row] * bc[2] + a[12 + row] * bc[3];
+   }
+   for (int i = 0; i < 16; i++)
+      out[i] = t[i];
+#endif
+}
+
+/**
+ * Matrix transpose.
+ * @param  m    Matrix
+ * @param  out  (OUT) Transpose of m
+ */
+inline void MatrixTranspose(const float* m, float* out)
+{
+#if defined(GEOMETRY_USE_SSE)
+   __m128 c0 = _mm_loadu_ps(m);
+   __m128 c1 = _mm_loadu_ps(m + 4);
+   __m128 c2 = _mm_loadu_ps(m + 8);
+   __m128 c3 = _mm_loadu_ps(m + 12);
+   _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+   _mm_storeu_ps(out,      c0);
+   _mm_storeu_ps(out + 4,  c1);
+   _mm_storeu_ps(out + 8,  c2);
+   _mm_storeu_ps(out + 12, c3);
+#else
+   float t[16];
+   for (int row = 0; row < 4; row++)
+   {
+      for (int col = 0; col < 4; col++)
+         t[row * 4 + col] = m[col * 4 + row];
+   }
+   for (int i = 0; i < 16; i++)
+      out[i] = t[i];
+#endif
+}
+
+/**
+ * Inverse of an affine matrix (last row is 0,0,0,1). The upper 3x3 is
+ * inverted using cross products of its columns (adjugate / determinant)
+ * and the translation is -inverse(3x3) * translation. Much cheaper than a
+ * general 4x4 inverse.
+ * @param  m    Affine matrix
+ * @param  out  (OUT) Inverse of m. Unchanged if m is singular.
+ * @return  Returns false if the upper 3x3 is singular.
+ */
+inline bool MatrixAffineInverse(const float* m, float* out)
+{
+#if defined(GEOMETRY_USE_SSE)
+   __m128 c0 = _mm_loadu_ps(m);
+   __m128 c1 = _mm_loadu_ps(m + 4);
+   __m128 c2 = _mm_loadu_ps(m + 8);
+   __m128 t  = _mm_loadu_ps(m + 12);
+
+   // Rows of the adjugate
+   __m128 r0 = sseCross(c1, c2);
+   __m128 r1 = sseCross(c2, c0);
+   __m128 r2 = sseCross(c0, c1);
+   float det = _mm_cvtss_f32(sseDot4(c0, r0));
+   if (det == 0.0f)
+      return false;
+
+   __m128 s = _mm_set1_ps(1.0f / det);
+   r0 = _mm_mul_ps(r0, s);
+   r1 = _mm_mul_ps(r1, s);
+   r2 = _mm_mul_ps(r2, s);
+
+   // Transpose the rows into columns, then form the translation column
+   __m128 r3 = _mm_setzero_ps();
+   _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+   float tv[4];
+   _mm_storeu_ps(tv, t);
+   __m128 it = sseCombine(r0, r1, r2, _mm_setzero_ps(), tv[0], tv[1], tv[2], 0.0f);
+   it = _mm_sub_ps(_mm_setzero_ps(), it);
+   it = _mm_add_ps(it, _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f));
+   _mm_storeu_ps(out,      r0);
+   _mm_storeu_ps(out + 4,  r1);
+   _mm_storeu_ps(out + 8,  r2);
+   _mm_storeu_ps(out + 12, it);
+   return true;
+#else
+   // Rows of the adjugate
+   float r0[3] = { m[5] * m[10] - m[6] * m[9],  m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8] };
+   float r1[3] = { m[9] * m[2]  - m[10] * m[1], m[10] * m[0] - m[8] * m[2], m[8] * m[1] - m[9] * m[0] };
+   float r2[3] = { m[1] * m[6]  - m[2] * m[5],  m[2] * m[4] - m[0] * m[6],  m[0] * m[5] - m[1] * m[4] };
+   float det = m[0] * r0[0] + m[1] * r0[1] + m[2] * r0[2];
+   if (det == 0.0f)
+      return false;
+
+   float s = 1.0f / det;
+   float tx = m[12], ty = m[13], tz = m[14];
+   for (int i = 0; i < 3; i++)
+   {
+      r0[i] *= s;
+      r1[i] *= s;
+      r2[i] *= s;
+   }
+   out[0]  = r0[0];  out[1]  = r1[0];  out[2]  = r2[0];  out[3]  = 0.0f;
+   out[4]  = r0[1];  out[5]  = r1[1];  out[6]  = r2[1];  out[7]  = 0.0f;
+   out[8]  = r0[2];  out[9]  = r1[2];  out[10] = r2[2];  out[11] = 0.0f;
+   out[12] = -(r0[0] * tx + r0[1] * ty + r0[2] * tz);
+   out[13] = -(r1[0] * tx + r1[1] * ty + r1[2] * tz);
+   out[14] = -(r2[0] * tx + r2[1] * ty + r2[2] * tz);
+   out[15] = 1.0f;
+   return true;
+#endif
+}
+
+/**
+ * Transform an array of vectors with 4 components (x,y,z,w) by a matrix.
+ * @param  m       Matrix
+ * @param  in      Input vectors (4 floats each)
+ * @param  out     (OUT) Transformed vectors (4 floats each). May equal in.
+ * @param  count   Number of vectors
+ */
+inline void MatrixTransform4(const float* m, const float* in, float* out, const unsigned int count)
+{
+#if defined(GEOMETRY_USE_SSE)
+   __m128 c0 = _mm_loadu_ps(m);
+   __m128 c1 = _mm_loadu_ps(m + 4);
+   __m128 c2 = _mm_loadu_ps(m + 8);
+   __m128 c3 = _mm_loadu_ps(m + 12);
+   for (unsigned int i = 0; i < count; i++, in += 4, out += 4)
+      _mm_storeu_ps(out, sseCombine(c0, c1, c2, c3, in[0], in[1], in[2], in[3]));
+#else
+   for (unsigned int i = 0; i < count; i++, in += 4, out += 4)
+   {
+      float x = in[0], y = in[1], z = in[2], w = in[3];
+      out[0] = m[0] * x + m[4] * y + m[8]  * z + m[12] * w;
+      out[1] = m[1] * x + m[5] * y + m[9]  * z + m[13] * w;
+      out[2] = m[2] * x + m[6] * y + m[10] * z + m[14] * w;
+      out[3] = m[3] * x + m[7] * y + m[11] * z + m[15] * w;
+   }
+#endif
+}
+
+/**
+ * Transform an array of 3 component points or vectors by a matrix. The w
+ * component of the input is taken as w (1 for points, 0 for vectors) and
+ * the w component of the result is dropped (the matrix is assumed to be
+ * affine).
+ * @param  m       Matrix
+ * @param  in      Input points or vectors (3 floats each)
+ * @param  out     (OUT) Transformed points or vectors (3 floats each). May equal in.
+ * @param  count   Number of points or vectors
+ * @param  w       1 to transform points, 0 to transform vectors
+ */
+inline void MatrixTransform3(const float* m, const float* in, float* out, const unsigned int count,
+                             const float w)
+{
+   unsigned int i = 0;
+#if defined(GEOMETRY_USE_SSE)
+   // 4 at a time: split 4 packed x,y,z triples into x, y and z vectors,
+   // transform, then pack the results back into triples
+   __m128 m0 = _mm_set1_ps(m[0]), m4 = _mm_set1_ps(m[4]), m8  = _mm_set1_ps(m[8]),  m12 = _mm_set1_ps(m[12] * w);
+   __m128 m1 = _mm_set1_ps(m[1]), m5 = _mm_set1_ps(m[5]), m9  = _mm_set1_ps(m[9]),  m13 = _mm_set1_ps(m[13] * w);
+   __m128 m2 = _mm_set1_ps(m[2]), m6 = _mm_set1_ps(m[6]), m10 = _mm_set1_ps(m[10]), m14 = _mm_set1_ps(m[14] * w);
+   for ( ; i + 4 <= count; i += 4, in += 12, out += 12)
+   {
+      __m128 v0 = _mm_loadu_ps(in);
+      __m128 v1 = _mm_loadu_ps(in + 4);
+      __m128 v2 = _mm_loadu_ps(in + 8);
+      __m128 t  = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 1, 2, 2));
+      __m128 x  = _mm_shuffle_ps(v0, t,  _MM_SHUFFLE(2, 0, 3, 0));
+      __m128 ta = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 1, 1));
+      __m128 tb = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 2, 3, 3));
+      __m128 y  = _mm_shuffle_ps(ta, tb, _MM_SHUFFLE(2, 0, 2, 0));
+      t         = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 2, 2));
+      __m128 z  = _mm_shuffle_ps(t,  v2, _MM_SHUFFLE(3, 0, 2, 0));
+
+      __m128 ox = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m4, y)), _mm_mul_ps(m8,  z)), m12);
+      __m128 oy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, x), _mm_mul_ps(m5, y)), _mm_mul_ps(m9,  z)), m13);
+      __m128 oz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m2, x), _mm_mul_ps(m6, y)), _mm_mul_ps(m10, z)), m14);
+
+      ta = _mm_shuffle_ps(ox, oy, _MM_SHUFFLE(0, 0, 0, 0));
+      tb = _mm_shuffle_ps(oz, ox, _MM_SHUFFLE(1, 1, 0, 0));
+      _mm_storeu_ps(out, _mm_shuffle_ps(ta, tb, _MM_SHUFFLE(2, 0, 2, 0)));
+      ta = _mm_shuffle_ps(oy, oz, _MM_SHUFFLE(1, 1, 1, 1));
+      tb = _mm_shuffle_ps(ox, oy, _MM_SHUFFLE(2, 2, 2, 2));
+      _mm_storeu_ps(out + 4, _mm_shuffle_ps(ta, tb, _MM_SHUFFLE(2, 0, 2, 0)));
+      ta = _mm_shuffle_ps(oz, ox, _MM_SHUFFLE(3, 3, 2, 2));
+      tb = _mm_shuffle_ps(oy, oz, _MM_SHUFFLE(3, 3, 3, 3));
+      _mm_storeu_ps(out + 8, _mm_shuffle_ps(ta, tb, _MM_SHUFFLE(2, 0, 2, 0)));
+   }
+#endif
+   for ( ; i < count; i++, in += 3, out += 3)
+   {
+      float x = in[0], y = in[1], z = in[2];
+      out[0] = m[0] * x + m[4] * y + m[8]  * z + m[12] * w;
+      out[1] = m[1] * x + m[5] * y + m[9]  * z + m[13] * w;
+      out[2] = m[2] * x + m[6] * y + m[10] * z + m[14] * w;
+   }
+}
+
+#endif
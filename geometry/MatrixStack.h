@@ -0,0 +1,162 @@
+//============================================================================
+//	Johns Hopkins University Engineering for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    MatrixStack.h
+//	Purpose: Stack of 4x4 matrices in preallocated, cache line aligned
+//          storage.
+//          Student should include "geometry.h" to get all class definitions
+//          included in proper order.
+//
+//============================================================================
+
+#ifndef __MATRIXSTACK_H__
+#define __MATRIXSTACK_H__
+
+#include <new>
+
+/**
+ * Matrix stack. Matrices are stored in one contiguous array that starts on
+ * a cache line boundary, so each matrix (64 bytes) fills exactly one cache
+ * line. Push and pop copy a matrix and never allocate: the array doubles
+ * only when a push finds it full, and popping or clearing keeps the
+ * capacity, so once a scene has been drawn at its deepest nesting no
+ * further memory is allocated.
+ */
+class MatrixStack
+{
+public:
+   // Alignment of the matrix array (bytes)
+   enum { CACHE_LINE = 64 };
+
+   /**
+    * Constructor.
+    * @param  capacity  Number of matrices to allocate room for
+    */
+   MatrixStack(const unsigned int capacity = 32)
+   {
+      m_buffer      = NULL;
+      m_matrices    = NULL;
+      m_capacity    = 0;
+      m_size        = 0;
+      m_allocations = 0;
+      Reserve(capacity);
+   }
+
+   /**
+    * Destructor.
+    */
+   ~MatrixStack()
+   {
+      delete [] m_buffer;
+   }
+
+   /**
+    * Make room for a number of matrices. Never shrinks the stack.
+    * @param  capacity  Number of matrices
+    */
+   void Reserve(const unsigned int capacity)
+   {
+      if (capacity <= m_capacity)
+         return;
+
+      // Over-allocate by a cache line so the array can start on a boundary
+      unsigned char* buffer = new unsigned char[capacity * sizeof(Matrix4x4) + CACHE_LINE];
+      size_t offset = (CACHE_LINE - ((size_t)buffer & (CACHE_LINE - 1))) & (CACHE_LINE - 1);
+      Matrix4x4* matrices = (Matrix4x4*)(buffer + offset);
+      for (unsigned int i = 0; i < capacity; i++)
+         new (&matrices[i]) Matrix4x4;
+      for (unsigned int i = 0; i < m_size; i++)
+         matrices[i] = m_matrices[i];
+
+      delete [] m_buffer;
+      m_buffer   = buffer;
+      m_matrices = matrices;
+      m_capacity = capacity;
+      m_allocations++;
+   }
+
+   /**
+    * Push a copy of a matrix.
+    * @param  m  Matrix to push
+    */
+   void Push(const Matrix4x4& m)
+   {
+      if (m_size == m_capacity)
+         Reserve((m_capacity > 0) ? m_capacity * 2 : 1);
+      m_matrices[m_size++] = m;
+   }
+
+   /**
+    * Pop the top matrix.
+    * @param  m  Returns the matrix (unchanged if the stack is empty)
+    * @return  Returns false if the stack is empty.
+    */
+   bool Pop(Matrix4x4& m)
+   {
+      if (m_size == 0)
+         return false;
+      m = m_matrices[--m_size];
+      return true;
+   }
+
+   /**
+    * Get the top matrix. The stack must not be empty.
+    * @return  Returns the matrix on top of the stack.
+    */
+   const Matrix4x4& Top() const
+   {
+      return m_matrices[m_size - 1];
+   }
+
+   /**
+    * Remove all matrices (keeps the capacity).
+    */
+   void Clear()
+   {
+      m_size = 0;
+   }
+
+   /**
+    * Get the number of matrices on the stack.
+    * @return  Returns the stack depth.
+    */
+   unsigned int Size() const
+   {
+      return m_size;
+   }
+
+   /**
+    * Get the number of matrices the stack holds without allocating.
+    * @return  Returns the capacity.
+    */
+   unsigned int Capacity() const
+   {
+      return m_capacity;
+   }
+
+   /**
+    * Get the number of times storage has been allocated (including the
+    * constructor's allocation).
+    * @return  Returns the allocation count.
+    */
+   unsigned int GetAllocationCount() const
+   {
+      return m_allocations;
+   }
+
+protected:
+   unsigned char* m_buffer;        // Allocated storage
+   Matrix4x4*     m_matrices;      // Matrix array (cache line aligned, within m_buffer)
+   unsigned int   m_capacity;      // Number of matrices allocated
+   unsigned int   m_size;          // Number of matrices on the stack
+   unsigned int   m_allocations;   // Number of allocations
+
+private:
+   // Stacks own their storage and are not copied
+   MatrixStack(const MatrixStack&);
+   MatrixStack& operator=(const MatrixStack&);
+};
+
+#endif
@@ -0,0 +1,223 @@
+//============================================================================
+//	Johns Hopkins University Engineering for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    PointHash.h
+//	Purpose: Spatial hash of points for finding duplicate (or nearby)
+//          vertices in constant time.
+//          Student should include "geometry.h" to get all class definitions
+//          included in proper order.
+//
+//============================================================================
+
+#ifndef __POINTHASH_H__
+#define __POINTHASH_H__
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * Spatial hash of a list of points, indexed in the order they are added.
+ * Find returns the lowest index of a matching point, which is the same
+ * point a linear search from the start of the list would find.
+ *
+ * With a tolerance of 0 points match only if they are equal (as
+ * Point3::operator ==) and are hashed by their exact coordinates. With a
+ * tolerance t > 0 points match if they are within distance t; points are
+ * hashed by the grid cell of size t that contains them, and a query checks
+ * the 27 cells around it.
+ *
+ * Buckets are chains threaded through an array (one entry per point), and
+ * the bucket table doubles when there are more points than buckets.
+ */
+class PointHash
+{
+public:
+   // Returned by Find when no point matches
+   enum { NOT_FOUND = 0xFFFFFFFF };
+
+   /**
+    * Constructor. Creates an empty hash that matches equal points.
+    */
+   PointHash()
+   {
+      m_tolerance = 0.0f;
+      m_invCell   = 0.0f;
+   }
+
+   /**
+    * Set the distance within which points match. Points already in the hash
+    * are rehashed.
+    * @param  tolerance  Match distance (0 to match only equal points)
+    */
+   void SetTolerance(const float tolerance)
+   {
+      m_tolerance = (tolerance > 0.0f) ? tolerance : 0.0f;
+      m_invCell   = (m_tolerance > 0.0f) ? 1.0f / m_tolerance : 0.0f;
+      rehash((unsigned int)m_heads.size());
+   }
+
+   /**
+    * Get the match distance.
+    * @return  Returns the tolerance (0 if only equal points match).
+    */
+   float GetTolerance() const
+   {
+      return m_tolerance;
+   }
+
+   /**
+    * Remove all points.
+    */
+   void Clear()
+   {
+      m_points.clear();
+      m_next.clear();
+      m_heads.clear();
+   }
+
+   /**
+    * Get the number of points in the hash.
+    * @return  Returns the point count.
+    */
+   unsigned int GetCount() const
+   {
+      return (unsigned int)m_points.size();
+   }
+
+   /**
+    * Add a point. It is not checked against the points already added.
+    * @param  p  Point to add
+    * @return  Returns the index of the point.
+    */
+   unsigned int Add(const Point3& p)
+   {
+      unsigned int index = (unsigned int)m_points.size();
+      m_points.push_back(p);
+      m_next.push_back((unsigned int)NOT_FOUND);
+      if (m_points.size() > m_heads.size())
+         rehash(m_heads.empty() ? MIN_BUCKETS : (unsigned int)m_heads.size() * 2);
+      else
+         link(index);
+      return index;
+   }
+
+   /**
+    * Find the lowest index of a point matching p.
+    * @param  p  Point to look for
+    * @return  Returns the index of the matching point, or NOT_FOUND.
+    */
+   unsigned int Find(const Point3& p) const
+   {
+      if (m_heads.empty())
+         return NOT_FOUND;
+
+      // Chains are in decreasing index order, so keep the last match
+      unsigned int found = (unsigned int)NOT_FOUND;
+      if (m_tolerance == 0.0f)
+      {
+         int key[3];
+         exactKey(p, key);
+         unsigned int i = m_heads[bucket(key)];
+         for ( ; i != NOT_FOUND; i = m_next[i])
+         {
+            if (m_points[i] == p)
+               found = i;
+         }
+         return found;
+      }
+
+      // Check the cells around p (adjacent cells may share a bucket, so
+      // a chain can be searched more than once)
+      int key[3];
+      cellKey(p, key);
+      float t2 = m_tolerance * m_tolerance;
+      for (int dx = -1; dx <= 1; dx++)
+      {
+         for (int dy = -1; dy <= 1; dy++)
+         {
+            for (int dz = -1; dz <= 1; dz++)
+            {
+               int cell[3] = { key[0] + dx, key[1] + dy, key[2] + dz };
+               unsigned int i = m_heads[bucket(cell)];
+               for ( ; i != NOT_FOUND; i = m_next[i])
+               {
+                  if (i < found && (m_points[i] - p).NormSquared() <= t2)
+                     found = i;
+               }
+            }
+         }
+      }
+      return found;
+   }
+
+protected:
+   // Initial number of buckets (a power of 2)
+   static const unsigned int MIN_BUCKETS = 256;
+
+   float                     m_tolerance;   // Match distance (0 = exact)
+   float                     m_invCell;     // 1 / cell size
+   std::vector<Point3>       m_points;      // Points in the order added
+   std::vector<unsigned int> m_next;        // Next point in the same bucket
+   std::vector<unsigned int> m_heads;       // First point in each bucket
+
+   // Key of a point for exact matching: its coordinate bits (with -0 as 0
+   // since they compare equal)
+   static void exactKey(const Point3& p, int key[3])
+   {
+      float c[3] = { p.x + 0.0f, p.y + 0.0f, p.z + 0.0f };
+      memcpy(key, c, sizeof(c));
+   }
+
+   // Key of a point for tolerance matching: its grid cell. Very distant
+   // points are clamped to the outer cells.
+   void cellKey(const Point3& p, int key[3]) const
+   {
+      const float* c = &p.x;
+      for (int i = 0; i < 3; i++)
+      {
+         float f = floorf(c[i] * m_invCell);
+         if (f < -1.0e9f)
+            f = -1.0e9f;
+         else if (f > 1.0e9f)
+            f = 1.0e9f;
+         key[i] = (int)f;
+      }
+   }
+
+   // Bucket of a key
+   unsigned int bucket(const int key[3]) const
+   {
+      unsigned int h = ((unsigned int)key[0] * 73856093u) ^ ((unsigned int)key[1] * 19349663u) ^
+                       ((unsigned int)key[2] * 83492791u);
+      h ^= h >> 16;
+      return h & ((unsigned int)m_heads.size() - 1);
+   }
+
+   // Add point i to the front of its bucket's chain
+   void link(const unsigned int i)
+   {
+      int key[3];
+      if (m_tolerance == 0.0f)
+         exactKey(m_points[i], key);
+      else
+         cellKey(m_points[i], key);
+      unsigned int b = bucket(key);
+      m_next[i]  = m_heads[b];
+      m_heads[b] = i;
+   }
+
+   // Rebuild the chains with a new number of buckets (a power of 2)
+   void rehash(const unsigned int buckets)
+   {
+      m_heads.assign(buckets, (unsigned int)NOT_FOUND);
+      if (buckets == 0)
+         return;
+      for (unsigned int i = 0; i < m_points.size(); i++)
+         link(i);
+   }
+};
+
+#endif
@@ -16,6 +16,20 @@
 #include <math.h>
 #include <vector>
 
+/**
+ * Inverse of a ray direction component for slab tests. Components near 0
+ * are clamped to +/-1e-20 so the slab distances stay finite (no 0 * inf).
+ * @param   d   Direction component
+ * @return  Returns 1 / d.
+ */
+inline float rayInverse(const float d)
+{
+   float a = fabsf(d);
+   if (a < 1e-20f)
+      a = 1e-20f;
+   return 1.0f / ((d < 0.0f) ? -a : a);
+}
+
 /**
  * 3D ray
  */
@@ -120,8 +134,13 @@ struct Ray3
     */
    float Intersect(const Plane& p) const
    {
-     // Required in 605.767
-      return 0.0f; 
+      // Solve n.(o + td) = d for t
+      float denom = p.a * d.x + p.b * d.y + p.c * d.z;
+      if (denom == 0.0f)
+         return 0.0f;
+
+      float t = -p.Solve(o) / denom;
+      return (t > 0.0f) ? t : 0.0f;
    }
       
    /**
@@ -171,8 +190,31 @@ struct Ray3
     */
    float Intersect(const AABB& box) const
    {
-      // Required in 605.767
-      return 0.0f; 
+      // Slab test: intersect the ray with the pair of planes bounding each
+      // axis and keep the overlap of the 3 parameter ranges [tnear, tfar]
+      float inv = rayInverse(d.x);
+      float t1  = (box.m_min.x - o.x) * inv;
+      float t2  = (box.m_max.x - o.x) * inv;
+      float tnear = MINV(t1, t2);
+      float tfar  = MAXV(t1, t2);
+
+      inv = rayInverse(d.y);
+      t1  = (box.m_min.y - o.y) * inv;
+      t2  = (box.m_max.y - o.y) * inv;
+      tnear = MAXV(tnear, MINV(t1, t2));
+      tfar  = MINV(tfar,  MAXV(t1, t2));
+
+      inv = rayInverse(d.z);
+      t1  = (box.m_min.z - o.z) * inv;
+      t2  = (box.m_max.z - o.z) * inv;
+      tnear = MAXV(tnear, MINV(t1, t2));
+      tfar  = MINV(tfar,  MAXV(t1, t2));
+
+      // Miss if the ranges do not overlap or the box is behind the ray.
+      // If the origin is inside the box return the exit point.
+      if (tfar < tnear || tfar <= 0.0f)
+         return 0.0f;
+      return (tnear > 0.0f) ? tnear : tfar;
    }
 
    /**
@@ -182,14 +224,51 @@ struct Ray3
     * @return  Returns the parameter t along the ray where intersection occurs. Return
     *          0.0f if no intersection occurs.
     */
-   float Intersect(std::vector<Point3>& polygon, Vector3& normal) const
+   float Intersect(const std::vector<Point3>& polygon, const Vector3& normal) const
    {
-      // Required in 605.767
-      return 0.0f;
+      unsigned int n = (unsigned int)polygon.size();
+      if (n < 3)
+         return 0.0f;
+
+      // Intersect the plane of the polygon
+      float denom = normal.Dot(d);
+      if (denom == 0.0f)
+         return 0.0f;
+      float t = normal.Dot(polygon[0] - o) / denom;
+      if (t <= 0.0f)
+         return 0.0f;
+
+      // Project onto the coordinate plane most parallel to the polygon (drop
+      // the largest normal component) and count edge crossings of a ray from
+      // the intersect point along +u
+      Point3 p  = Intersect(t);
+      float  nx = fabsf(normal.x);
+      float  ny = fabsf(normal.y);
+      float  nz = fabsf(normal.z);
+      int    ui = 1, vi = 2;
+      if (ny >= nx && ny >= nz)
+         ui = 0;
+      else if (nz >= nx && nz >= ny)
+      {
+         ui = 0;
+         vi = 1;
+      }
+      const float* pp = &p.x;
+      bool inside = false;
+      for (unsigned int i = 0, j = n - 1; i < n; j = i++)
+      {
+         const float* a = &polygon[i].x;
+         const float* b = &polygon[j].x;
+         if ((a[vi] > pp[vi]) != (b[vi] > pp[vi]) &&
+              pp[ui] < (b[ui] - a[ui]) * (pp[vi] - a[vi]) / (b[vi] - a[vi]) + a[ui])
+            inside = !inside;
+      }
+      return inside ? t : 0.0f;
    }
 
    /**
-    * Intersection of a ray with a triangle.
+    * Intersection of a ray with a triangle (Moller-Trumbore). The ray need
+    * not be normalized.
     * @param   v0  Vertex of the triangle
     * @param   v1  Vertex of the triangle
     * @param   v2  Vertex of the triangle
@@ -201,8 +280,26 @@ struct Ray3
    float Intersect(const Point3& v0, const Point3& v1, const Point3& v2,
                    float& u, float& v) const
    {
-      // Required in 605.767
-      return 0.0f;
+      Vector3 e1 = v1 - v0;
+      Vector3 e2 = v2 - v0;
+      Vector3 p  = d.Cross(e2);
+      float det  = e1.Dot(p);
+      if (det == 0.0f)              // Ray is parallel to the triangle
+         return 0.0f;
+
+      float   inv = 1.0f / det;
+      Vector3 s   = o - v0;
+      u = s.Dot(p) * inv;
+      if (u < 0.0f || u > 1.0f)
+         return 0.0f;
+
+      Vector3 q = s.Cross(e1);
+      v = d.Dot(q) * inv;
+      if (v < 0.0f || u + v > 1.0f)
+         return 0.0f;
+
+      float t = e2.Dot(q) * inv;
+      return (t > EPSILON) ? t : 0.0f;
    }
 };
 
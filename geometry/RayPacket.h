@@ -0,0 +1,287 @@
+//============================================================================
+//	Johns Hopkins University Engineering for Professionals
+//	605.467 Computer Graphics and 605.767 Applied Computer Graphics
+//
+//	Author:  Michael Hogue
+//	File:    RayPacket.h
+//	Purpose: Packets of 4 or 8 rays tested against one box or triangle at a
+//          time using SSE or AVX (see MatrixKernels.h for the selection).
+//          Student should include "geometry.h" to get all class definitions
+//          included in proper order.
+//
+//============================================================================
+
+#ifndef __RAYPACKET_H__
+#define __RAYPACKET_H__
+
+#if defined(GEOMETRY_USE_SSE)
+// Lane operations used by the packet kernels. One set per register width so
+// the kernels are written once.
+struct SSELanes
+{
+   typedef __m128 V;
+   enum { Width = 4 };
+   static V    Load(const float* p)       { return _mm_loadu_ps(p); }
+   static void Store(float* p, const V a) { _mm_storeu_ps(p, a); }
+   static V    Set(const float a)         { return _mm_set1_ps(a); }
+   static V    Add(const V a, const V b)  { return _mm_add_ps(a, b); }
+   static V    Sub(const V a, const V b)  { return _mm_sub_ps(a, b); }
+   static V    Mul(const V a, const V b)  { return _mm_mul_ps(a, b); }
+   static V    Div(const V a, const V b)  { return _mm_div_ps(a, b); }
+   static V    Min(const V a, const V b)  { return _mm_min_ps(a, b); }
+   static V    Max(const V a, const V b)  { return _mm_max_ps(a, b); }
+   static V    And(const V a, const V b)  { return _mm_and_ps(a, b); }
+   static V    Ge(const V a, const V b)   { return _mm_cmpge_ps(a, b); }
+   static V    Gt(const V a, const V b)   { return _mm_cmpgt_ps(a, b); }
+   static V    Le(const V a, const V b)   { return _mm_cmple_ps(a, b); }
+   static V    Ne(const V a, const V b)   { return _mm_cmpneq_ps(a, b); }
+   static V    Select(const V m, const V a, const V b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+   static int  Mask(const V m)            { return _mm_movemask_ps(m); }
+};
+#endif
+
+#if defined(GEOMETRY_USE_AVX)
+struct AVXLanes
+{
+   typedef __m256 V;
+   enum { Width = 8 };
+   static V    Load(const float* p)       { return _mm256_loadu_ps(p); }
+   static void Store(float* p, const V a) { _mm256_storeu_ps(p, a); }
+   static V    Set(const float a)         { return _mm256_set1_ps(a); }
+   static V    Add(const V a, const V b)  { return _mm256_add_ps(a, b); }
+   static V    Sub(const V a, const V b)  { return _mm256_sub_ps(a, b); }
+   static V    Mul(const V a, const V b)  { return _mm256_mul_ps(a, b); }
+   static V    Div(const V a, const V b)  { return _mm256_div_ps(a, b); }
+   static V    Min(const V a, const V b)  { return _mm256_min_ps(a, b); }
+   static V    Max(const V a, const V b)  { return _mm256_max_ps(a, b); }
+   static V    And(const V a, const V b)  { return _mm256_and_ps(a, b); }
+   static V    Ge(const V a, const V b)   { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+   static V    Gt(const V a, const V b)   { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+   static V    Le(const V a, const V b)   { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+   static V    Ne(const V a, const V b)   { return _mm256_cmp_ps(a, b, _CMP_NEQ_OQ); }
+   static V    Select(const V m, const V a, const V b) { return _mm256_blendv_ps(b, a, m); }
+   static int  Mask(const V m)            { return _mm256_movemask_ps(m); }
+};
+#endif
+
+/**
+ * Packet of N rays (N = 4 or 8) stored by component so that one box or
+ * triangle can be tested against all of them at once. Each lane gives the
+ * same result as Ray3::Intersect for that ray: the parameter t of the
+ * intersection, or 0 if there is none. With AVX 8 lanes are tested per
+ * instruction, with SSE 4, and without SIMD each ray is tested in turn.
+ */
+template <unsigned int N>
+struct RayPacket
+{
+   float ox[N], oy[N], oz[N];    // Ray origins
+   float dx[N], dy[N], dz[N];    // Ray directions
+   float ix[N], iy[N], iz[N];    // Inverse directions (see rayInverse)
+   unsigned int count;           // Number of rays in use (remaining lanes repeat ray 0)
+
+   /**
+    * Default constructor. Creates an empty packet.
+    */
+   RayPacket()
+   {
+      count = 0;
+   }
+
+   /**
+    * Constructor given a list of rays.
+    * @param  rays  Rays
+    * @param  n     Number of rays (at most N)
+    */
+   RayPacket(const Ray3* rays, const unsigned int n)
+   {
+      Set(rays, n);
+   }
+
+   /**
+    * Load rays into the packet. Unused lanes repeat the first ray and never
+    * report a hit.
+    * @param  rays  Rays
+    * @param  n     Number of rays (at most N)
+    */
+   void Set(const Ray3* rays, const unsigned int n)
+   {
+      count = (n < N) ? n : N;
+      for (unsigned int i = 0; i < N; i++)
+      {
+         const Ray3& ray = rays[(i < count) ? i : 0];
+         ox[i] = ray.o.x;
+         oy[i] = ray.o.y;
+         oz[i] = ray.o.z;
+         dx[i] = ray.d.x;
+         dy[i] = ray.d.y;
+         dz[i] = ray.d.z;
+         ix[i] = rayInverse(ray.d.x);
+         iy[i] = rayInverse(ray.d.y);
+         iz[i] = rayInverse(ray.d.z);
+      }
+   }
+
+   /**
+    * Get one ray of the packet.
+    * @param  i  Lane
+    * @return  Returns the ray in lane i.
+    */
+   Ray3 GetRay(const unsigned int i) const
+   {
+      return Ray3(Point3(ox[i], oy[i], oz[i]), Vector3(dx[i], dy[i], dz[i]));
+   }
+
+   /**
+    * Intersect all rays with an axis aligned bounding box.
+    * @param  box  Box
+    * @param  t    (OUT) N parameters along each ray (0 if no intersection
+    *              or no ray in the lane)
+    * @return  Returns a bit mask of the rays that hit the box.
+    */
+   int Intersect(const AABB& box, float* t) const
+   {
+      int mask = 0;
+      unsigned int i = 0;
+#if defined(GEOMETRY_USE_AVX)
+      for ( ; i + 8 <= N; i += 8)
+         mask |= intersectBox<AVXLanes>(box, i, t) << i;
+#endif
+#if defined(GEOMETRY_USE_SSE)
+      for ( ; i + 4 <= N; i += 4)
+         mask |= intersectBox<SSELanes>(box, i, t) << i;
+#endif
+      for ( ; i < N; i++)
+      {
+         t[i] = GetRay(i).Intersect(box);
+         if (t[i] != 0.0f)
+            mask |= 1 << i;
+      }
+      for (i = count; i < N; i++)
+         t[i] = 0.0f;
+      return mask & activeMask();
+   }
+
+   /**
+    * Intersect all rays with a triangle.
+    * @param  v0  Vertex of the triangle
+    * @param  v1  Vertex of the triangle
+    * @param  v2  Vertex of the triangle
+    * @param  t   (OUT) N parameters along each ray (0 if no intersection
+    *             or no ray in the lane)
+    * @param  u   (OUT) N barycentric coordinates of the intersections
+    * @param  v   (OUT) N barycentric coordinates of the intersections
+    * @return  Returns a bit mask of the rays that hit the triangle.
+    */
+   int Intersect(const Point3& v0, const Point3& v1, const Point3& v2,
+                 float* t, float* u, float* v) const
+   {
+      int mask = 0;
+      unsigned int i = 0;
+#if defined(GEOMETRY_USE_AVX)
+      for ( ; i + 8 <= N; i += 8)
+         mask |= intersectTriangle<AVXLanes>(v0, v1, v2, i, t, u, v) << i;
+#endif
+#if defined(GEOMETRY_USE_SSE)
+      for ( ; i + 4 <= N; i += 4)
+         mask |= intersectTriangle<SSELanes>(v0, v1, v2, i, t, u, v) << i;
+#endif
+      for ( ; i < N; i++)
+      {
+         t[i] = GetRay(i).Intersect(v0, v1, v2, u[i], v[i]);
+         if (t[i] != 0.0f)
+            mask |= 1 << i;
+         else
+            u[i] = v[i] = 0.0f;
+      }
+      for (i = count; i < N; i++)
+         t[i] = u[i] = v[i] = 0.0f;
+      return mask & activeMask();
+   }
+
+protected:
+   // Mask of the lanes holding rays
+   int activeMask() const
+   {
+      return (count >= 32) ? -1 : (1 << count) - 1;
+   }
+
+#if defined(GEOMETRY_USE_SSE)
+   // Slab test for lanes [first, first + L::Width). Same operations in the
+   // same order as Ray3::Intersect(const AABB&).
+   template <class L>
+   int intersectBox(const AABB& box, const unsigned int first, float* t) const
+   {
+      typedef typename L::V V;
+      V t1 = L::Mul(L::Sub(L::Set(box.m_min.x), L::Load(ox + first)), L::Load(ix + first));
+      V t2 = L::Mul(L::Sub(L::Set(box.m_max.x), L::Load(ox + first)), L::Load(ix + first));
+      V tnear = L::Min(t1, t2);
+      V tfar  = L::Max(t1, t2);
+
+      t1 = L::Mul(L::Sub(L::Set(box.m_min.y), L::Load(oy + first)), L::Load(iy + first));
+      t2 = L::Mul(L::Sub(L::Set(box.m_max.y), L::Load(oy + first)), L::Load(iy + first));
+      tnear = L::Max(tnear, L::Min(t1, t2));
+      tfar  = L::Min(tfar,  L::Max(t1, t2));
+
+      t1 = L::Mul(L::Sub(L::Set(box.m_min.z), L::Load(oz + first)), L::Load(iz + first));
+      t2 = L::Mul(L::Sub(L::Set(box.m_max.z), L::Load(oz + first)), L::Load(iz + first));
+      tnear = L::Max(tnear, L::Min(t1, t2));
+      tfar  = L::Min(tfar,  L::Max(t1, t2));
+
+      V zero = L::Set(0.0f);
+      V hit  = L::And(L::Ge(tfar, tnear), L::Gt(tfar, zero));
+      V r    = L::Select(L::Gt(tnear, zero), tnear, tfar);
+      L::Store(t + first, L::And(hit, r));
+      return L::Mask(hit);
+   }
+
+   // Moller-Trumbore for lanes [first, first + L::Width). Same operations
+   // in the same order as Ray3::Intersect(v0, v1, v2, u, v).
+   template <class L>
+   int intersectTriangle(const Point3& v0, const Point3& v1, const Point3& v2,
+                         const unsigned int first, float* t, float* u, float* v) const
+   {
+      typedef typename L::V V;
+      Vector3 e1 = v1 - v0;
+      Vector3 e2 = v2 - v0;
+      V e1x = L::Set(e1.x), e1y = L::Set(e1.y), e1z = L::Set(e1.z);
+      V e2x = L::Set(e2.x), e2y = L::Set(e2.y), e2z = L::Set(e2.z);
+      V rdx = L::Load(dx + first), rdy = L::Load(dy + first), rdz = L::Load(dz + first);
+
+      // p = d x e2, det = e1 . p
+      V px  = L::Sub(L::Mul(rdy, e2z), L::Mul(rdz, e2y));
+      V py  = L::Sub(L::Mul(rdz, e2x), L::Mul(rdx, e2z));
+      V pz  = L::Sub(L::Mul(rdx, e2y), L::Mul(rdy, e2x));
+      V det = L::Add(L::Add(L::Mul(e1x, px), L::Mul(e1y, py)), L::Mul(e1z, pz));
+      V inv = L::Div(L::Set(1.0f), det);
+
+      // s = o - v0, u = (s . p) / det
+      V sx = L::Sub(L::Load(ox + first), L::Set(v0.x));
+      V sy = L::Sub(L::Load(oy + first), L::Set(v0.y));
+      V sz = L::Sub(L::Load(oz + first), L::Set(v0.z));
+      V uu = L::Mul(L::Add(L::Add(L::Mul(sx, px), L::Mul(sy, py)), L::Mul(sz, pz)), inv);
+
+      // q = s x e1, v = (d . q) / det, t = (e2 . q) / det
+      V qx = L::Sub(L::Mul(sy, e1z), L::Mul(sz, e1y));
+      V qy = L::Sub(L::Mul(sz, e1x), L::Mul(sx, e1z));
+      V qz = L::Sub(L::Mul(sx, e1y), L::Mul(sy, e1x));
+      V vv = L::Mul(L::Add(L::Add(L::Mul(rdx, qx), L::Mul(rdy, qy)), L::Mul(rdz, qz)), inv);
+      V tt = L::Mul(L::Add(L::Add(L::Mul(e2x, qx), L::Mul(e2y, qy)), L::Mul(e2z, qz)), inv);
+
+      V zero = L::Set(0.0f);
+      V one  = L::Set(1.0f);
+      V hit  = L::Ne(det, zero);
+      hit = L::And(hit, L::And(L::Ge(uu, zero), L::Le(uu, one)));
+      hit = L::And(hit, L::And(L::Ge(vv, zero), L::Le(L::Add(uu, vv), one)));
+      hit = L::And(hit, L::Gt(tt, L::Set(EPSILON)));
+      L::Store(t + first, L::And(hit, tt));
+      L::Store(u + first, L::And(hit, uu));
+      L::Store(v + first, L::And(hit, vv));
+      return L::Mask(hit);
+   }
+#endif
+};
+
+typedef RayPacket<4> RayPacket4;
+typedef RayPacket<8> RayPacket8;
+
+#endif
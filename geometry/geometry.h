@@ -87,8 +87,15 @@ inline float FastInvSqrt(float x)
 #include "geometry/AABB.h"
 #include "geometry/BoundingSphere.h"
 #include "geometry/Ray3.h"
+#include "geometry/CollisionWorld.h"
 #include "geometry/Noise.h"
+#include "geometry/MatrixKernels.h"
 #include "geometry/Matrix.h"
+#include "geometry/MatrixStack.h"
+#include "geometry/Frustum.h"
+#include "geometry/RayPacket.h"
+#include "geometry/BVH.h"
+#include "geometry/PointHash.h"
 
 /**
  * Structure to hold a vertex position and normal